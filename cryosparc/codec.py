@@ -0,0 +1,265 @@
+"""
+Codecs for compressing dataset fields when saving in ``CSDAT_FORMAT`` or
+``ROWGROUP_FORMAT``.
+
+Each field is encoded with a codec named by its compression backend,
+optionally prefixed with ``shuffle+`` to byte-shuffle its elements before
+compressing. Byte-shuffling groups the similar sign and exponent bytes of
+numeric data together, which usually compresses floating-point fields much
+better. Available backends:
+
+- ``"snap"``: snappy (built in, the default)
+- ``"zstd"``: Zstandard, requires the ``zstandard`` package
+- ``"lz4"``: LZ4, requires the ``lz4`` package
+- ``""``: not compressed
+
+e.g., ``"shuffle+zstd"``. Specify ``"auto"`` to pick a codec for each field
+based on a sample of its data.
+"""
+from typing import TYPE_CHECKING, List, Mapping, Optional, Union
+
+import numpy as n
+
+from .core import compress, decompress, decompressed_size, shuffle
+from .dtype import NEVER_COMPRESS_FIELDS, DatasetHeader, Field
+
+if TYPE_CHECKING:
+    from numpy.typing import NDArray  # type: ignore
+
+SHUFFLE = "shuffle+"
+"""
+Prefix for codecs that byte-shuffle data before compressing it.
+"""
+
+BACKENDS = {"snap": None, "zstd": "zstandard", "lz4": "lz4"}
+"""
+Compression backends and the packages they require.
+"""
+
+AUTO_SAMPLE_BYTES = 1 << 18
+"""
+Size of the sample of each field used to pick a codec in ``"auto"`` mode.
+"""
+
+
+def backend_module(backend: str):
+    """
+    Get the module to encode with the given optional compression backend.
+
+    Args:
+        backend (str): ``"zstd"`` or ``"lz4"``
+
+    Raises:
+        ImportError: If the required package is not installed.
+    """
+    try:
+        if backend == "zstd":
+            import zstandard
+
+            return zstandard
+        else:
+            import lz4.frame
+
+            return lz4.frame
+    except ImportError as e:
+        raise ImportError(f'Dataset codec "{backend}" requires the "{BACKENDS[backend]}" package') from e
+
+
+def available(backend: str) -> bool:
+    """
+    Args:
+        backend (str): Compression backend name.
+
+    Returns:
+        bool: Whether the given compression backend may be used.
+    """
+    try:
+        return backend == "snap" or (backend in BACKENDS and bool(backend_module(backend)))
+    except ImportError:
+        return False
+
+
+def auto_codec(arr: "NDArray") -> str:
+    """
+    Pick a codec for the given field data. Uses Zstandard when available and
+    snappy otherwise. Numeric data is byte-shuffled if that makes a sample of
+    it compress better. Data that does not compress is not compressed.
+
+    Args:
+        arr (NDArray): Field data
+
+    Returns:
+        str: Codec name
+    """
+    elsize = arr.dtype.base.itemsize
+    data = n.ascontiguousarray(arr).reshape(-1).view(n.uint8)
+    sample = data[: AUTO_SAMPLE_BYTES // elsize * elsize]
+    backend = "zstd" if available("zstd") else "snap"
+    if len(sample) == 0:
+        return backend
+
+    # snappy is fast enough to try both ways and is a good proxy for others
+    trials = [("", sample)]
+    if elsize > 1 and arr.dtype.base.kind in "fciu":
+        shuffled = n.empty_like(sample)
+        shuffle(sample, shuffled, elsize)
+        trials.append((SHUFFLE, shuffled))
+    sizes = [len(c) for c in compress([t for _, t in trials])]
+    best = min(range(len(trials)), key=lambda i: sizes[i])
+    if sizes[best] > 0.97 * len(sample) and backend == "snap":
+        return ""
+    return trials[best][0] + backend
+
+
+def check_codec(codec: str) -> str:
+    """
+    Raises:
+        TypeError: If the codec name is invalid.
+        ImportError: If the codec's backend is not installed.
+
+    Returns:
+        str: The given codec.
+    """
+    backend = codec[len(SHUFFLE) :] if codec.startswith(SHUFFLE) else codec
+    if backend not in BACKENDS and backend != "":
+        raise TypeError(f'Invalid dataset codec "{codec}"')
+    if backend and BACKENDS[backend]:
+        backend_module(backend)
+    return codec
+
+
+def resolve_codecs(
+    names: List[str], arrays: List["NDArray"], compression: Union[str, Mapping[str, str]] = "snap"
+) -> List[str]:
+    """
+    Get the codec to save each of the given fields with.
+
+    Args:
+        names (list[str]): Field names.
+        arrays (list[NDArray]): Data for each field.
+        compression (str | Mapping[str, str], optional): Codec for all fields,
+            except those such as ``uid`` that are never compressed, or
+            ``"auto"``. May also be a mapping from field names to codecs;
+            other fields use the default. Defaults to ``"snap"``.
+
+    Returns:
+        list[str]: Codec for each field.
+    """
+    codecs = []
+    for name, arr in zip(names, arrays):
+        default = "" if name in NEVER_COMPRESS_FIELDS else "snap"
+        if isinstance(compression, str):
+            codec = default if default == "" else compression
+        else:
+            codec = compression.get(name, default)
+        codecs.append(auto_codec(arr) if codec == "auto" else check_codec(codec))
+    return codecs
+
+
+def make_header(descr: List[Field], codecs: List[str], offsets: Optional[List[int]] = None) -> DatasetHeader:
+    """
+    Header for a dataset with the given fields saved with the given codecs.
+    Only uses per-field codecs if required, so that the data remains readable
+    by older versions when only snappy is used.
+    """
+    compressed_fields = [f[0] for f, c in zip(descr, codecs) if c]
+    offsets = offsets or []
+    if all(c in ("", "snap") for c in codecs):
+        return DatasetHeader(
+            dtype=descr, compression="snap", compressed_fields=compressed_fields, codecs={}, offsets=offsets
+        )
+    return DatasetHeader(
+        dtype=descr,
+        compression="field",
+        compressed_fields=compressed_fields,
+        codecs={f[0]: c for f, c in zip(descr, codecs) if c},
+        offsets=offsets,
+    )
+
+
+def field_codec(header: DatasetHeader, name: str) -> str:
+    """
+    Returns:
+        str: The codec that the field with the given name was saved with.
+    """
+    if header["compression"] == "snap":
+        return "snap" if name in header["compressed_fields"] else ""
+    return header["codecs"].get(name, "")
+
+
+def encode(arrays: List["NDArray"], codecs: List[str]) -> List[bytes]:
+    """
+    Encode each field's data with the codec at the same index. Snappy fields
+    are compressed together in parallel.
+    """
+    encoded: List[bytes] = [b""] * len(arrays)
+    snap = []
+    for i, (arr, codec) in enumerate(zip(arrays, codecs)):
+        data = n.ascontiguousarray(arr).reshape(-1).view(n.uint8)
+        if codec.startswith(SHUFFLE):
+            shuffled = n.empty_like(data)
+            shuffle(data, shuffled, arr.dtype.base.itemsize)
+            data, codec = shuffled, codec[len(SHUFFLE) :]
+        if codec == "snap":
+            snap.append((i, data))
+        elif codec == "zstd":
+            encoded[i] = backend_module(codec).ZstdCompressor(threads=-1).compress(data)
+        elif codec == "lz4":
+            encoded[i] = backend_module(codec).compress(data)
+        else:
+            encoded[i] = data.tobytes()
+    for (i, _), data in zip(snap, compress([data for _, data in snap])):
+        encoded[i] = data
+    return encoded
+
+
+def decoded_size(data: bytes, codec: str) -> int:
+    """
+    Returns:
+        int: Size of the given encoded data once decoded.
+    """
+    codec = codec[len(SHUFFLE) :] if codec.startswith(SHUFFLE) else codec
+    if codec == "snap":
+        return decompressed_size(data)
+    elif codec == "zstd":
+        size = backend_module(codec).frame_content_size(data)
+        if size < 0:
+            raise ValueError("Zstandard data does not record its size")
+        return size
+    elif codec == "lz4":
+        return backend_module(codec).get_frame_info(data)["content_size"]
+    else:
+        return len(data)
+
+
+def decode(buffers: List[bytes], codecs: List[str], outputs: List["NDArray"]):
+    """
+    Decode each buffer with the codec at the same index into the contiguous
+    output array at the same index, which must have the exact decoded size.
+    Snappy buffers are decompressed together in parallel.
+
+    Raises:
+        ValueError: If data is invalid or has the wrong size.
+    """
+    snap = []
+    unshuffle = []
+    for data, codec, out in zip(buffers, codecs, outputs):
+        target = out.reshape(-1).view(n.uint8)
+        stage = target
+        if codec.startswith(SHUFFLE):
+            stage = n.empty_like(target)
+            unshuffle.append((stage, target, out.dtype.base.itemsize))
+            codec = codec[len(SHUFFLE) :]
+        if codec == "snap":
+            snap.append((data, stage))
+            continue
+        if codec == "zstd":
+            data = backend_module(codec).ZstdDecompressor().decompress(data)
+        elif codec == "lz4":
+            data = backend_module(codec).decompress(data)
+        if len(data) != len(stage):
+            raise ValueError(f"Expected {len(stage)} bytes of decoded data, got {len(data)}")
+        stage[:] = n.frombuffer(data, dtype=n.uint8)
+    decompress([data for data, _ in snap], [stage for _, stage in snap])
+    for stage, target, elsize in unshuffle:
+        shuffle(stage, target, elsize, reverse=True)
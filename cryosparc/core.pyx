@@ -1,6 +1,10 @@
 from . cimport dataset
 from cython.view cimport array
-from cpython.ref cimport PyObject
+from cpython.ref cimport PyObject, Py_INCREF, Py_DECREF, Py_XINCREF, Py_XDECREF
+from cpython.mem cimport PyMem_Malloc, PyMem_Free
+from cpython.bytes cimport PyBytes_FromStringAndSize
+from cpython.pycapsule cimport PyCapsule_New, PyCapsule_GetPointer
+from libc.stdint cimport uint32_t, uint64_t
 
 
 # Mirror of equivalent C-datatype enumeration
@@ -21,9 +25,157 @@ cpdef enum DsetType:
     T_OBJ = 14
 
 
+# Size of each numeric type in bytes
+TYPE_SIZES = {
+    T_F32: 4, T_F64: 8, T_I8: 1, T_I16: 2, T_I32: 4, T_I64: 8, T_U8: 1, T_U16: 2, T_U32: 4, T_U64: 8
+}
+
+
+def setnthreads(int nthreads):
+    # Maximum number of threads for parallel dataset operations (0 = one per CPU)
+    dataset.dset_setnthreads(nthreads)
+
+
+def setgrowth(uint32_t percent, uint64_t max_bytes):
+    # Growth of datasets that run out of space: percent of the current
+    # capacity, but at most max_bytes more than required
+    dataset.dset_setgrowth(percent, max_bytes)
+
+
+def compress(list buffers):
+    # Compress each contiguous buffer in parallel into a snappy-format bytes
+    cdef uint32_t n = len(buffers)
+    cdef list views = [memoryview(b).cast("B") for b in buffers]
+    cdef list result = []
+    cdef const unsigned char[::1] view
+    cdef const void **src = <const void **> PyMem_Malloc(n * sizeof(void *))
+    cdef uint64_t *srcsz = <uint64_t *> PyMem_Malloc(n * sizeof(uint64_t))
+    cdef void **dst = <void **> PyMem_Malloc(n * sizeof(void *))
+    cdef uint64_t *dstsz = <uint64_t *> PyMem_Malloc(n * sizeof(uint64_t))
+    cdef bint success
+    cdef uint32_t i
+    try:
+        if not (src and srcsz and dst and dstsz):
+            raise MemoryError()
+        for i in range(n):
+            dst[i] = NULL
+        for i in range(n):
+            view = views[i]
+            srcsz[i] = view.shape[0]
+            src[i] = &view[0] if srcsz[i] > 0 else NULL
+            dst[i] = PyMem_Malloc(dataset.dset_compress_bound(srcsz[i]))
+            if not dst[i]:
+                raise MemoryError()
+
+        with nogil:
+            success = dataset.dset_compress(n, src, srcsz, dst, dstsz)
+        if not success:
+            raise ValueError("Could not compress data")
+
+        for i in range(n):
+            result.append(PyBytes_FromStringAndSize(<char *> dst[i], dstsz[i]))
+        return result
+    finally:
+        if src and srcsz and dst and dstsz:
+            for i in range(n):
+                PyMem_Free(dst[i])
+        PyMem_Free(src)
+        PyMem_Free(srcsz)
+        PyMem_Free(dst)
+        PyMem_Free(dstsz)
+
+
+def decompressed_size(const unsigned char[::1] data):
+    # Size of snappy-format data once decompressed
+    cdef uint64_t size = dataset.dset_decompressed_size(&data[0] if data.shape[0] > 0 else NULL, data.shape[0])
+    if size == <uint64_t> -1:
+        raise ValueError("Invalid compressed data")
+    return size
+
+
+def decompress(list buffers, list outputs):
+    # Decompress each snappy-format buffer in parallel into the writable
+    # output buffer with the same index, which must have the exact size
+    cdef uint32_t n = len(buffers)
+    cdef list views = [memoryview(b).cast("B") for b in buffers]
+    cdef list outviews = [memoryview(b).cast("B") for b in outputs]
+    cdef const unsigned char[::1] view
+    cdef unsigned char[::1] outview
+    cdef const void **src = <const void **> PyMem_Malloc(n * sizeof(void *))
+    cdef uint64_t *srcsz = <uint64_t *> PyMem_Malloc(n * sizeof(uint64_t))
+    cdef void **dst = <void **> PyMem_Malloc(n * sizeof(void *))
+    cdef uint64_t *dstsz = <uint64_t *> PyMem_Malloc(n * sizeof(uint64_t))
+    cdef bint success
+    cdef uint32_t i
+    try:
+        if not (src and srcsz and dst and dstsz):
+            raise MemoryError()
+        if len(outputs) != n:
+            raise ValueError(f"Expected {n} outputs, got {len(outputs)}")
+        for i in range(n):
+            view = views[i]
+            outview = outviews[i]
+            srcsz[i] = view.shape[0]
+            src[i] = &view[0] if srcsz[i] > 0 else NULL
+            dstsz[i] = outview.shape[0]
+            dst[i] = &outview[0] if dstsz[i] > 0 else NULL
+
+        with nogil:
+            success = dataset.dset_decompress(n, src, srcsz, dst, dstsz)
+        if not success:
+            raise ValueError("Could not decompress data")
+    finally:
+        PyMem_Free(src)
+        PyMem_Free(srcsz)
+        PyMem_Free(dst)
+        PyMem_Free(dstsz)
+
+
+def shuffle(const unsigned char[::1] data, unsigned char[::1] out, uint32_t elsize, bint reverse = False):
+    # Byte-shuffle (or reverse the byte-shuffle of) data with elements of the
+    # given size into the output buffer of the same size
+    cdef bint success
+    if data.shape[0] != out.shape[0]:
+        raise ValueError(f"Expected output of size {data.shape[0]}, got {out.shape[0]}")
+    if data.shape[0] == 0:
+        return
+    with nogil:
+        if reverse:
+            success = dataset.dset_unshuffle(&data[0], &out[0], data.shape[0], elsize)
+        else:
+            success = dataset.dset_shuffle(&data[0], &out[0], data.shape[0], elsize)
+    if not success:
+        raise ValueError(f"Could not shuffle data with element size {elsize}")
+
+def unshare(str name):
+    # Remove the name of shared data so that no other process can attach
+    cdef bytes name_b = name.encode()
+    if not dataset.dset_unshare(name_b):
+        raise OSError(f"Could not remove shared dataset {name}")
+
+
+cdef void _arrow_done(void *data) noexcept with gil:
+    # Called when an exported Arrow array is released
+    Py_DECREF(<object> data)
+
+
+cdef void _release_arrow_schema(object capsule) noexcept:
+    cdef dataset.ArrowSchema *schema = <dataset.ArrowSchema *> PyCapsule_GetPointer(capsule, "arrow_schema")
+    if schema.release != NULL:
+        schema.release(schema)
+    PyMem_Free(schema)
+
+
+cdef void _release_arrow_array(object capsule) noexcept:
+    cdef dataset.ArrowArray *array = <dataset.ArrowArray *> PyCapsule_GetPointer(capsule, "arrow_array")
+    if array.release != NULL:
+        array.release(array)
+    PyMem_Free(array)
+
 cdef class Data:
     cdef dataset.Dset _handle
     cdef dict _strcache
+    cdef Data _parent  # data that a view reads from, kept alive with the view
 
     def __cinit__(self, other = None):
         cdef Data othr
@@ -47,8 +199,475 @@ cdef class Data:
         if self._handle:
             dataset.dset_del(self._handle)
 
+    @classmethod
+    def sized(cls, uint32_t ncol, uint64_t nrow, uint64_t strheap = 0):
+        # Allocate empty data with room for about ncol fields of nrow rows and
+        # strheap bytes of C strings, so that filling it in does not move it
+        cdef dataset.Dset handle = dataset.dset_new_sized(ncol, nrow, strheap)
+        if handle == <dataset.Dset> -1:
+            raise MemoryError()
+        return cls(handle)
+
+    @classmethod
+    def mmap(cls, str path, bint readonly = False):
+        # Map an image saved with save_image without reading it into memory.
+        # Changes are never written back to the file.
+        cdef bytes path_b = path.encode()
+        cdef const char *path_c = path_b
+        cdef dataset.Dset handle
+        with nogil:
+            handle = dataset.dset_mmap(path_c, readonly)
+        if handle == <dataset.Dset> -1:
+            raise OSError(f"Could not map dataset image {path}")
+        return cls(handle)
+
+    @classmethod
+    def read_star(cls, const unsigned char[::1] text, list labels, list types, Py_ssize_t start = 0):
+        # Parse the rows of a STAR file table starting at the given offset into
+        # columns with the given labels. Each type is T_F64, T_I64, T_STR or 0
+        # to infer. Returns the data and the offset where the table ended
+        cdef uint32_t ncol = len(labels)
+        cdef list labels_b = [label.encode() for label in labels]
+        cdef const char **labels_c = <const char **> PyMem_Malloc(max(ncol, 1) * sizeof(const char *))
+        cdef int *types_c = <int *> PyMem_Malloc(max(ncol, 1) * sizeof(int))
+        cdef const char *text_c = <const char *> &text[start] if start < text.shape[0] else NULL
+        cdef uint64_t size = text.shape[0] - start if start < text.shape[0] else 0
+        cdef uint64_t end = 0
+        cdef dataset.Dset handle
+        cdef uint32_t i
+        try:
+            if not (labels_c and types_c):
+                raise MemoryError()
+            if len(types) != ncol:
+                raise ValueError(f"Expected {ncol} types, got {len(types)}")
+            for i in range(ncol):
+                labels_c[i] = labels_b[i]
+                types_c[i] = types[i]
+            with nogil:
+                handle = dataset.dset_read_star(text_c, size, ncol, labels_c, types_c, &end)
+        finally:
+            PyMem_Free(labels_c)
+            PyMem_Free(types_c)
+        if handle == <dataset.Dset> -1:
+            raise ValueError(f"Could not parse STAR file data at offset {start}")
+        return cls(handle), start + end
+
+    @classmethod
+    def attach(cls, str name, bint readonly = True):
+        # Attach to data shared by another process with share
+        cdef bytes name_b = name.encode()
+        cdef const char *name_c = name_b
+        cdef dataset.Dset handle
+        with nogil:
+            handle = dataset.dset_attach(name_c, readonly)
+        if handle == <dataset.Dset> -1:
+            raise OSError(f"Could not attach to shared dataset {name}")
+        return cls(handle)
+
+    def share(self, str name):
+        # Move into a new named shared memory object. Buffers previously
+        # returned by getbuf are no longer valid
+        cdef bytes name_b = name.encode()
+        cdef const char *name_c = name_b
+        cdef bint success
+        with nogil:
+            success = dataset.dset_share(self._handle, name_c)
+        if not success:
+            raise OSError(f"Could not share dataset as {name}")
+
+    def save_image(self, str path):
+        cdef bytes path_b = path.encode()
+        cdef const char *path_c = path_b
+        cdef bint success
+        with nogil:
+            success = dataset.dset_save_image(self._handle, path_c)
+        return success
+
     def innerjoin(self, str key, Data other):
-        return type(self)(dataset.dset_innerjoin(key.encode(), self._handle, other._handle))
+        cdef bytes key_b = key.encode()
+        cdef const char *key_c = key_b
+        cdef dataset.Dset result
+        with nogil:
+            result = dataset.dset_innerjoin(key_c, self._handle, other._handle)
+        return type(self)(result)
+
+    def innerjoin_many(self, str key, *others):
+        # Join this and all others in a single pass
+        cdef bytes key_b = key.encode()
+        cdef const char *key_c = key_b
+        cdef uint32_t n = 1 + len(others)
+        cdef dataset.Dset result
+        cdef dataset.Dset *handles = <dataset.Dset *> PyMem_Malloc(n * sizeof(dataset.Dset))
+        cdef Data other
+        cdef uint32_t i
+        if not handles:
+            raise MemoryError()
+
+        handles[0] = self._handle
+        for i in range(1, n):
+            other = <Data?> others[i - 1]
+            handles[i] = other._handle
+
+        with nogil:
+            result = dataset.dset_innerjoin_many(key_c, n, handles)
+        PyMem_Free(handles)
+
+        if result == <dataset.Dset> -1:
+            return None  # e.g., missing key field or too many result rows
+
+        return type(self)(result)
+
+    def append_many(self, *others, str key = None):
+        # Concatenate rows of this and others, fails if key is given and repeats
+        return self._combine(0, key, others)
+
+    def union_many(self, *others, str key = "uid"):
+        # Concatenate rows of this and others, keeping the first row of each key
+        return self._combine(1, key, others)
+
+    def interlace(self, *others, str key = None):
+        # Alternate rows of this and others, fails if key is given and repeats
+        return self._combine(2, key, others)
+
+    def view(self, uint64_t start, uint64_t stop, list fields = None):
+        # Data with rows start to stop of this data and only the given fields
+        # (or all fields), which reads this data without copying it. Views
+        # cannot be modified, copy them first
+        cdef list fields_b = [f.encode() for f in fields] if fields is not None else []
+        cdef uint32_t ncol = len(fields_b)
+        cdef const char **keys = NULL
+        cdef dataset.Dset result
+        cdef Data data
+        cdef uint32_t i
+        if fields is not None:
+            keys = <const char **> PyMem_Malloc(max(ncol, 1) * sizeof(const char *))
+            if keys == NULL:
+                raise MemoryError()
+            for i in range(ncol):
+                keys[i] = fields_b[i]
+        try:
+            with nogil:
+                result = dataset.dset_view(self._handle, start, stop - start if stop > start else 0, ncol, keys)
+        finally:
+            PyMem_Free(keys)
+        if result == <dataset.Dset> -1:
+            raise IndexError(f"Could not view rows {start} to {stop} of dataset")
+        data = type(self)(result)
+        data._parent = self
+        return data
+
+    def take(self, const uint64_t[::1] indices):
+        # New data with only the rows at the given indices
+        cdef uint64_t n = indices.shape[0]
+        cdef const uint64_t *indices_c = &indices[0] if n > 0 else NULL
+        cdef dataset.Dset result
+        with nogil:
+            result = dataset.dset_take(self._handle, indices_c, n)
+        return self._subset(result)
+
+    def mask(self, const unsigned char[::1] mask):
+        # New data with only the rows where mask is non-zero
+        cdef const unsigned char *mask_c = &mask[0] if mask.shape[0] > 0 else NULL
+        cdef dataset.Dset result
+        if <uint64_t> mask.shape[0] != dataset.dset_nrow(self._handle):
+            raise ValueError(f"Mask with size {mask.shape[0]} does not match dataset size {self.nrow()}")
+        with nogil:
+            result = dataset.dset_mask(self._handle, mask_c)
+        return self._subset(result)
+
+    def query_mask(self, list fields, list values, unsigned char[::1] mask):
+        # Set mask to 1 at each row where every field has one of the values at
+        # the same index, 0 elsewhere. Values of numeric fields are contiguous
+        # arrays of the field's type, values of C string fields are lists of
+        # bytes and values of Python string fields are sets of str
+        cdef uint32_t nfields = len(fields)
+        cdef uint64_t nrow = dataset.dset_nrow(self._handle)
+        cdef uint64_t nstrs = sum(len(v) for v in values if isinstance(v, list))
+        cdef const char **keys = <const char **> PyMem_Malloc(max(nfields, 1) * sizeof(const char *))
+        cdef uint64_t *nvalues = <uint64_t *> PyMem_Malloc(max(nfields, 1) * sizeof(uint64_t))
+        cdef const void **values_c = <const void **> PyMem_Malloc(max(nfields, 1) * sizeof(void *))
+        cdef const char **strs = <const char **> PyMem_Malloc(max(nstrs, 1) * sizeof(const char *))
+        cdef unsigned char *mask_c = &mask[0] if mask.shape[0] > 0 else NULL
+        cdef list encoded = []  # keeps encoded keys alive until queried
+        cdef list objfields = []
+        cdef const unsigned char[::1] view
+        cdef PyObject **objs
+        cdef set valueset
+        cdef bytes key_b, str_b
+        cdef uint32_t i, n = 0
+        cdef uint64_t j, s = 0
+        cdef bint success
+        if <uint64_t> mask.shape[0] != nrow:
+            raise ValueError(f"Mask with size {mask.shape[0]} does not match dataset size {self.nrow()}")
+        try:
+            if not (keys and nvalues and values_c and strs):
+                raise MemoryError()
+            for i in range(nfields):
+                key_b = fields[i].encode()
+                encoded.append(key_b)
+                if dataset.dset_type(self._handle, key_b) == T_OBJ:
+                    objfields.append((key_b, values[i]))
+                    continue
+                keys[n] = key_b
+                nvalues[n] = len(values[i])
+                if isinstance(values[i], list):
+                    values_c[n] = &strs[s]
+                    for j in range(nvalues[n]):
+                        str_b = values[i][j]
+                        strs[s] = str_b
+                        s += 1
+                else:
+                    view = memoryview(values[i]).cast("B")
+                    values_c[n] = &view[0] if view.shape[0] > 0 else NULL
+                n += 1
+
+            with nogil:
+                success = dataset.dset_query_mask(self._handle, n, keys, nvalues, values_c, mask_c)
+
+            # Python strings are checked here, after the other fields
+            for key_b, valueset in objfields:
+                objs = <PyObject **> dataset.dset_get(self._handle, key_b)
+                for j in range(nrow):
+                    if mask_c[j] and <object> objs[j] not in valueset:
+                        mask_c[j] = 0
+        finally:
+            PyMem_Free(keys)
+            PyMem_Free(nvalues)
+            PyMem_Free(values_c)
+            PyMem_Free(strs)
+        return success
+
+    def argsort(self, list fields, uint64_t[::1] order):
+        # Write the indexes of the rows in order of the values of the given
+        # fields into order
+        cdef uint32_t nkeys = len(fields)
+        cdef const char **keys = <const char **> PyMem_Malloc(max(nkeys, 1) * sizeof(const char *))
+        cdef list encoded = [f.encode() for f in fields]
+        cdef uint64_t *order_c = &order[0] if order.shape[0] > 0 else NULL
+        cdef bytes field_b
+        cdef bint success
+        cdef uint32_t i
+        if <uint64_t> order.shape[0] != dataset.dset_nrow(self._handle):
+            raise ValueError(f"Order with size {order.shape[0]} does not match dataset size {self.nrow()}")
+        try:
+            if not keys:
+                raise MemoryError()
+            for i in range(nkeys):
+                field_b = encoded[i]
+                keys[i] = field_b
+            with nogil:
+                success = dataset.dset_argsort(self._handle, nkeys, keys, order_c)
+        finally:
+            PyMem_Free(keys)
+        return success
+
+    def groupby(self, str field, uint64_t[::1] order, uint64_t[::1] offsets, bint reorder = False):
+        # Write the indexes of the rows grouped by the value of the given field
+        # into order and the start of each group into offsets, which must have
+        # space for one more item than there are rows. Returns the number of
+        # groups, or -1 on error
+        cdef bytes field_b = field.encode()
+        cdef const char *field_c = field_b
+        cdef uint64_t *order_c = &order[0] if order.shape[0] > 0 else NULL
+        cdef uint64_t ngroup
+        if <uint64_t> order.shape[0] != dataset.dset_nrow(self._handle) or offsets.shape[0] != order.shape[0] + 1:
+            raise ValueError(f"Order or offsets do not match dataset size {self.nrow()}")
+        with nogil:
+            ngroup = dataset.dset_groupby(self._handle, field_c, order_c, &offsets[0], reorder)
+        return -1 if ngroup == <uint64_t> -1 else ngroup
+
+    def convert(self, str field, int dtype, unsigned char[::1] out):
+        # Write the values of the given numeric field converted to the given
+        # numeric type into out, which must have the exact size
+        cdef bytes field_b = field.encode()
+        cdef const char *field_c = field_b
+        cdef int srctype = dataset.dset_type(self._handle, field_c)
+        cdef uint64_t size = dataset.dset_getsz(self._handle, field_c)
+        cdef bint success
+        if srctype not in TYPE_SIZES or dtype not in TYPE_SIZES:
+            raise TypeError(f"Cannot convert field {field} with type {srctype} to type {dtype}")
+        if <uint64_t> out.shape[0] != size // TYPE_SIZES[srctype] * TYPE_SIZES[dtype]:
+            raise ValueError(f"Output with size {out.shape[0]} does not match converted size of field {field}")
+        if size == 0:
+            return True
+        with nogil:
+            success = dataset.dset_convert(self._handle, field_c, dtype, &out[0])
+        return success
+
+    def fma(self, str field, const double[::1] scale, const double[::1] offset):
+        # Replace each value of the given field with value * scale + offset,
+        # with one scale and offset per element of a row
+        cdef bytes field_b = field.encode()
+        cdef const char *field_c = field_b
+        cdef Py_ssize_t size = 1
+        cdef bint success
+        for dim in self.getshp(field):
+            size *= dim
+        if scale.shape[0] != size or offset.shape[0] != size:
+            raise ValueError(f"Expected {size} scale and offset values for field {field}")
+        with nogil:
+            success = dataset.dset_fma(self._handle, field_c, &scale[0], &offset[0])
+        return success
+
+    def reduce(
+        self,
+        str field,
+        const uint64_t[::1] order,
+        const uint64_t[::1] offsets,
+        double[::1] mins,
+        double[::1] maxs,
+        double[::1] sums,
+    ):
+        # Minimum, maximum and sum of each element of the given field in each
+        # group given by order and offsets from groupby. Order may be None if
+        # groups are contiguous rows and offsets None for one group
+        cdef bytes field_b = field.encode()
+        cdef const char *field_c = field_b
+        cdef uint64_t ngroup = offsets.shape[0] - 1 if offsets is not None else 1
+        cdef const uint64_t *order_c = &order[0] if order is not None and order.shape[0] > 0 else NULL
+        cdef const uint64_t *offsets_c = NULL
+        cdef Py_ssize_t size = 1
+        cdef bint success
+        if offsets is not None:
+            if offsets.shape[0] == 0:
+                raise ValueError("Expected at least one group offset")
+            offsets_c = &offsets[0]
+        for dim in self.getshp(field):
+            size *= dim
+        size *= ngroup
+        if mins.shape[0] != size or maxs.shape[0] != size or sums.shape[0] != size:
+            raise ValueError(f"Expected outputs with {size} values for field {field}")
+        if order is not None and <uint64_t> order.shape[0] != dataset.dset_nrow(self._handle):
+            raise ValueError(f"Order does not match dataset size {self.nrow()}")
+        if size == 0:
+            return True
+        with nogil:
+            success = dataset.dset_reduce(
+                self._handle, field_c, ngroup, order_c, offsets_c, &mins[0], &maxs[0], &sums[0]
+            )
+        return success
+
+    def histogram(self, str field, double lo, double hi, uint64_t[::1] counts):
+        # Count the elements of the given field in each of len(counts) equal
+        # bins from lo to hi
+        cdef bytes field_b = field.encode()
+        cdef const char *field_c = field_b
+        cdef uint32_t nbins = counts.shape[0]
+        cdef bint success
+        if nbins == 0:
+            raise ValueError("Expected at least one bin")
+        with nogil:
+            success = dataset.dset_histogram(self._handle, field_c, lo, hi, nbins, &counts[0])
+        return success
+
+    def format_star(self, list fields, Py_ssize_t start, unsigned char[::1] buf):
+        # Format whole rows of the given fields starting at the given row into
+        # buf as STAR file lines. Returns the number of rows and bytes written
+        cdef uint32_t ncol = len(fields)
+        cdef uint64_t *cols = <uint64_t *> PyMem_Malloc(max(ncol, 1) * sizeof(uint64_t))
+        cdef uint64_t nrow, used = 0
+        cdef bytes field_b
+        cdef uint32_t i
+        try:
+            if not cols:
+                raise MemoryError()
+            for i in range(ncol):
+                field_b = fields[i].encode()
+                cols[i] = dataset.dset_colindex(self._handle, field_b)
+            with nogil:
+                nrow = dataset.dset_format_star(self._handle, ncol, cols, start, <char *> &buf[0], buf.shape[0], &used)
+        finally:
+            PyMem_Free(cols)
+        if nrow == <uint64_t> -1:
+            raise ValueError(f"Could not format fields {fields} for a STAR file")
+        return nrow, used
+
+    def arrow_capsules(self, bint schema_only = False):
+        # Export as Arrow C data interface schema and array PyCapsules. The
+        # array refers to this data, which is kept alive until it's released
+        cdef dataset.ArrowSchema *schema = <dataset.ArrowSchema *> PyMem_Malloc(sizeof(dataset.ArrowSchema))
+        cdef dataset.ArrowArray *array = NULL
+        cdef void *ctx = <void *> self
+        cdef bint success
+        if schema == NULL:
+            raise MemoryError()
+        schema.release = NULL
+        schema_capsule = PyCapsule_New(schema, "arrow_schema", _release_arrow_schema)
+        if schema_only:
+            with nogil:
+                success = dataset.dset_export_arrow(self._handle, schema, NULL, NULL, NULL)
+            if not success:
+                raise TypeError("Could not export data schema to Arrow")
+            return schema_capsule, None
+
+        array = <dataset.ArrowArray *> PyMem_Malloc(sizeof(dataset.ArrowArray))
+        if array == NULL:
+            raise MemoryError()
+        array.release = NULL
+        array_capsule = PyCapsule_New(array, "arrow_array", _release_arrow_array)
+        Py_INCREF(self)
+        with nogil:
+            success = dataset.dset_export_arrow(self._handle, schema, array, _arrow_done, ctx)
+        if not success:
+            Py_DECREF(self)
+            raise TypeError("Could not export data to Arrow")
+        return schema_capsule, array_capsule
+
+    cdef _subset(self, dataset.Dset result):
+        cdef Data data
+        if result == <dataset.Dset> -1:
+            raise IndexError("Could not take subset of dataset")
+        data = type(self)(result)
+        data._increfobjs()
+        return data
+
+    cdef _combine(self, int mode, str key, tuple others):
+        cdef bytes key_b = key.encode() if key is not None else None
+        cdef const char *key_c = NULL
+        cdef uint32_t n = 1 + len(others)
+        cdef dataset.Dset result
+        cdef dataset.Dset *handles = <dataset.Dset *> PyMem_Malloc(n * sizeof(dataset.Dset))
+        cdef Data other
+        cdef Data data
+        cdef uint32_t i
+        if not handles:
+            raise MemoryError()
+
+        if key_b is not None:
+            key_c = key_b
+        handles[0] = self._handle
+        for i in range(1, n):
+            other = <Data?> others[i - 1]
+            handles[i] = other._handle
+
+        with nogil:
+            if mode == 0:
+                result = dataset.dset_append_many(key_c, n, handles)
+            elif mode == 1:
+                result = dataset.dset_union_many(key_c, n, handles)
+            else:
+                result = dataset.dset_interlace(key_c, n, handles)
+        PyMem_Free(handles)
+
+        if result == <dataset.Dset> -1:
+            return None  # e.g., repeated keys
+
+        data = type(self)(result)
+        data._increfobjs()
+        return data
+
+    cdef void _increfobjs(self):
+        # Native kernels copy object columns as plain pointers. Take a
+        # reference for each copy so that the result owns its objects the same
+        # way as a column populated from Python.
+        cdef uint64_t nrow = dataset.dset_nrow(self._handle)
+        cdef uint64_t c, i
+        cdef PyObject **pycol
+        for c in range(dataset.dset_ncol(self._handle)):
+            if dataset.dset_type_at(self._handle, c) == T_OBJ:
+                pycol = <PyObject **> dataset.dset_get_at(self._handle, c)
+                for i in range(nrow):
+                    Py_XINCREF(pycol[i])
 
     def totalsz(self):
         return dataset.dset_totalsz(self._handle)
@@ -59,6 +678,14 @@ cdef class Data:
     def nrow(self):
         return dataset.dset_nrow(self._handle)
 
+    def stats(self):
+        # Layout of the data and counts of expensive operations on it, plus
+        # totals for all data. Times are in nanoseconds.
+        cdef dataset.ds_stats out
+        if not dataset.dset_stats(self._handle, &out):
+            raise ValueError("Could not get dataset stats")
+        return out
+
     def key(self, int index):
         return dataset.dset_key(self._handle, index).decode()
 
@@ -71,12 +698,36 @@ cdef class Data:
     def addrows(self, int num):
         return dataset.dset_addrows(self._handle, num)
 
+    def reserve(self, int nrow, int strheap_bytes = 0):
+        return dataset.dset_reserve(self._handle, nrow, strheap_bytes)
+
     def addcol_scalar(self, str field, int dtype):
         return dataset.dset_addcol_scalar(self._handle, field.encode(), dtype)
 
     def addcol_array(self, str field, int dtype, int shape0, int shape1, int shape2):
         return dataset.dset_addcol_array(self._handle, field.encode(), dtype, shape0, shape1, shape2)
 
+    def castcol(self, str field, int dtype):
+        # Convert the values of the given numeric field to the given numeric
+        # type in place
+        cdef bytes field_b = field.encode()
+        cdef const char *field_c = field_b
+        cdef bint success
+        with nogil:
+            success = dataset.dset_castcol(self._handle, field_c, dtype)
+        return success
+
+    def dropcol(self, str field):
+        self._strcache.pop(field, None)
+        return dataset.dset_dropcol(self._handle, field.encode())
+
+    def renamecol(self, str field, str newfield):
+        if not dataset.dset_renamecol(self._handle, field.encode(), newfield.encode()):
+            return False
+        if field in self._strcache:
+            self._strcache[newfield] = self._strcache.pop(field)
+        return True
+
     def getshp(self, str colkey):
         cdef int val = dataset.dset_getshp(self._handle, colkey.encode())
         cdef tuple shape = (val & 0xFF, (val >> 8) & 0xFF, (val >> 16) & 0xFF)
@@ -87,9 +738,11 @@ cdef class Data:
         cdef Py_ssize_t size
         cdef bytes colkey_b = colkey.encode()
         cdef const char *colkey_c = colkey_b
+        cdef uint64_t colindex
         with nogil:
-            mem = dataset.dset_get(self._handle, colkey_c)
-            size = dataset.dset_getsz(self._handle, colkey_c)
+            colindex = dataset.dset_colindex(self._handle, colkey_c)
+            mem = dataset.dset_get_at(self._handle, colindex)
+            size = dataset.dset_getsz_at(self._handle, colindex)
         if size == 0:
             return 0
         else:
@@ -105,15 +758,52 @@ cdef class Data:
         cdef int prevtype = dataset.dset_type(self._handle, colkey_c)
         cdef Py_ssize_t nrow = dataset.dset_nrow(self._handle)
         cdef PyObject **pycol = <PyObject **> dataset.dset_get(self._handle, colkey_c)
-        cdef str pybytes
+        cdef PyObject **pyobjs
+        cdef const char **cstrs
+        cdef dict encoded = dict()  # keeps encoded bytes alive until copied
+        cdef bytes pybytes
+        cdef str pystr
+        cdef bint success
+        cdef Py_ssize_t i
 
-        if prevtype != T_OBJ or not dataset.dset_changecol(self._handle, colkey_c, T_STR):
+        if prevtype != T_OBJ:
             return False
 
-        for i in range(nrow):
-            pybytes = <str> (pycol[i])
-            pycol[i] = NULL  # so string is not deallocated
-            dataset.dset_setstr(self._handle, colkey_c, i, pybytes.encode())
+        cstrs = <const char **> PyMem_Malloc(max(nrow, 1) * sizeof(const char *))
+        pyobjs = <PyObject **> PyMem_Malloc(max(nrow, 1) * sizeof(PyObject *))
+        if cstrs == NULL or pyobjs == NULL:
+            PyMem_Free(cstrs)
+            PyMem_Free(pyobjs)
+            raise MemoryError()
+
+        try:
+            # Encode each distinct string only once. The column keeps its
+            # objects until the C strings replace them.
+            for i in range(nrow):
+                pystr = <str> (pycol[i])
+                pybytes = encoded.get(pystr)
+                if pybytes is None:
+                    pybytes = pystr.encode()
+                    encoded[pystr] = pybytes
+                cstrs[i] = pybytes
+                pyobjs[i] = pycol[i]
+
+            if not dataset.dset_changecol(self._handle, colkey_c, T_STR):
+                return False
+
+            with nogil:
+                success = dataset.dset_setstrs(self._handle, colkey_c, 0, nrow, cstrs)
+
+            if not success:
+                dataset.dset_changecol(self._handle, colkey_c, T_OBJ)  # still holds the objects
+                return False
+
+            # The column now holds string handles, so release its objects
+            for i in range(nrow):
+                Py_XDECREF(pyobjs[i])
+        finally:
+            PyMem_Free(cstrs)
+            PyMem_Free(pyobjs)
 
         return True
 
@@ -125,27 +815,39 @@ cdef class Data:
         cdef Py_ssize_t nrow = dataset.dset_nrow(self._handle)
         cdef Py_ssize_t *pycol = <Py_ssize_t *> dataset.dset_get(self._handle, colkey_c)
         cdef void **pystrcol = <void **> pycol
+        cdef const char **cstrs
         cdef dict strcache = dict()
-        cdef char *cstr
-        cdef bytes cbytes
         cdef str pystr
+        cdef bint success
+        cdef Py_ssize_t i
 
         if prevtype != T_STR:
             return False
 
-        # Save computed strcache to prevent string handles from getting garbage
-        # collected (since no other Python reference to them is kept)
-        self._strcache[colkey] = strcache
+        cstrs = <const char **> PyMem_Malloc(max(nrow, 1) * sizeof(const char *))
+        if cstrs == NULL:
+            raise MemoryError()
 
-        for i in range(nrow):
-            if pycol[i] in strcache:
-                pystr = strcache[pycol[i]]
-            else:
-                cbytes = dataset.dset_getstr(self._handle, colkey_c, i)
-                pystr = cbytes.decode()
-                strcache[pycol[i]] = pystr
+        try:
+            with nogil:
+                success = dataset.dset_getstrs(self._handle, colkey_c, 0, nrow, cstrs)
+            if not success:
+                return False
+
+            # Save computed strcache to prevent string handles from getting garbage
+            # collected (since no other Python reference to them is kept)
+            self._strcache[colkey] = strcache
 
-            pystrcol[i] = <void *> pystr
+            for i in range(nrow):
+                if pycol[i] in strcache:
+                    pystr = strcache[pycol[i]]
+                else:
+                    pystr = cstrs[i].decode()
+                    strcache[pycol[i]] = pystr
+
+                pystrcol[i] = <void *> pystr
+        finally:
+            PyMem_Free(cstrs)
 
         if not dataset.dset_changecol(self._handle, colkey_c, T_OBJ):
             return False
@@ -155,8 +857,88 @@ cdef class Data:
     def defrag(self, bint realloc_smaller):
         return dataset.dset_defrag(self._handle, realloc_smaller)
 
+    def setconcurrent(self, bint enable):
+        # Allow threads to pin this data while another thread adds rows
+        return dataset.dset_setconcurrent(self._handle, enable)
+
+    def pin(self):
+        # Keep field memory in place until unpin, waiting for any move in
+        # progress in another thread
+        cdef bint success
+        with nogil:
+            success = dataset.dset_pin(self._handle)
+        return success
+
+    def unpin(self):
+        return dataset.dset_unpin(self._handle)
+
     def dumptxt(self):
         dataset.dset_dumptxt(self._handle)
 
     def handle(self):
         return self._handle
+
+
+cdef class StreamDecoder:
+    # Decode CSDAT field data incrementally as it is fed in, e.g., from a
+    # network response. Each field is a tuple (key, type, shape, itemsize,
+    # shuffle, codec, wanted), see ds_stream_field in dataset.h
+    cdef dataset.ds_stream *_stream
+
+    def __cinit__(self, list fields):
+        cdef uint32_t nfield = len(fields)
+        cdef list keys = [field[0].encode() for field in fields]
+        cdef dataset.ds_stream_field *cfields = <dataset.ds_stream_field *> PyMem_Malloc(
+            (nfield or 1) * sizeof(dataset.ds_stream_field)
+        )
+        cdef bytes key
+        cdef uint32_t i, j
+        self._stream = NULL
+        if not cfields:
+            raise MemoryError()
+        try:
+            for i in range(nfield):
+                _, ftype, shape, itemsize, elsize, codec, wanted = fields[i]
+                key = keys[i]
+                cfields[i].key = key
+                cfields[i].type = ftype
+                for j in range(3):
+                    cfields[i].shape[j] = shape[j] if j < len(shape) else 0
+                cfields[i].itemsize = itemsize
+                cfields[i].shuffle = elsize
+                cfields[i].codec = codec
+                cfields[i].wanted = wanted
+            self._stream = dataset.dset_stream_new(nfield, cfields)
+        finally:
+            PyMem_Free(cfields)
+        if not self._stream:
+            raise ValueError("Could not decode dataset fields")
+
+    def __dealloc__(self):
+        if self._stream:
+            dataset.dset_stream_del(self._stream)
+
+    def feed(self, const unsigned char[::1] data):
+        cdef bint success
+        if not self._stream:
+            raise ValueError("Dataset stream is already finished")
+        if data.shape[0] == 0:
+            return
+        with nogil:
+            success = dataset.dset_stream_feed(self._stream, &data[0], data.shape[0])
+        if not success:
+            raise ValueError("Invalid or corrupt dataset stream")
+
+    def need(self):
+        # Bytes needed to complete the current field, 0 when all are done
+        return dataset.dset_stream_need(self._stream) if self._stream else 0
+
+    def finish(self):
+        cdef dataset.Dset handle
+        if not self._stream:
+            raise ValueError("Dataset stream is already finished")
+        handle = dataset.dset_stream_finish(self._stream)
+        self._stream = NULL
+        if handle == <dataset.Dset> -1:
+            raise ValueError("Dataset stream ended before all fields were read")
+        return Data(handle)
@@ -3,9 +3,68 @@ ctypedef uint64_t Dset
 
 cdef extern from "cryosparc-tools/dataset.h":
 
+    struct ArrowSchema:
+        void (*release)(ArrowSchema *) noexcept nogil
+
+    struct ArrowArray:
+        void (*release)(ArrowArray *) noexcept nogil
+
+    ctypedef struct ds_stats:
+        uint64_t total_sz
+        uint64_t nrow
+        uint64_t crow
+        uint32_t ncol
+        uint32_t ccol
+        uint64_t arrheap_sz
+        uint64_t arrheap_capacity
+        uint64_t strheap_sz
+        uint64_t strheap_capacity
+        uint64_t strheap_freed
+        uint32_t nrealloc
+        uint32_t nreassign_arroffsets
+        uint32_t nshift_strhandles
+        uint32_t nmore_arrheap
+        uint32_t nmore_strheap
+        uint32_t nmore_colspace
+        uint64_t bytes_moved
+        uint64_t resize_ns
+        uint64_t string_ns
+        uint64_t nintern
+        uint64_t nintern_hits
+        uint64_t module_bytes_moved
+        uint64_t module_resize_ns
+        uint64_t module_string_ns
+        uint64_t module_nintern
+        uint64_t module_nintern_hits
+        uint64_t module_join_ns
+        uint64_t module_njoin
+        uint64_t module_nslots
+        uint64_t module_nslots_used
+        uint64_t module_narenas
+
     Dset dset_new() nogil
+    Dset dset_new_sized(uint32_t ncol_hint, uint64_t nrow_hint, uint64_t strheap_hint) nogil
     Dset dset_copy(Dset dset) nogil
+    Dset dset_view(Dset dset, uint64_t start, uint64_t nrow, uint32_t ncol, const char **keys) nogil
+    Dset dset_mmap(const char *path, bint readonly) nogil
+    bint dset_save_image(Dset dset, const char *path) nogil
+    bint dset_share(Dset dset, const char *name) nogil
+    Dset dset_attach(const char *name, bint readonly) nogil
+    bint dset_unshare(const char *name) nogil
     Dset dset_innerjoin(const char *key, Dset dset_r, Dset dset_s) nogil
+    Dset dset_innerjoin_many(const char *key, uint32_t n, const Dset *dsets) nogil
+    Dset dset_append_many(const char *key, uint32_t n, const Dset *dsets) nogil
+    Dset dset_union_many(const char *key, uint32_t n, const Dset *dsets) nogil
+    Dset dset_interlace(const char *key, uint32_t n, const Dset *dsets) nogil
+    Dset dset_take(Dset dset, const uint64_t *indices, uint64_t n) nogil
+    Dset dset_mask(Dset dset, const unsigned char *mask) nogil
+    bint dset_query_mask(Dset dset, uint32_t nfields, const char **keys, const uint64_t *nvalues, const void **values, unsigned char *mask) nogil
+    bint dset_argsort(Dset dset, uint32_t nkeys, const char **keys, uint64_t *order) nogil
+    uint64_t dset_groupby(Dset dset, const char *key, uint64_t *order, uint64_t *offsets, int reorder) nogil
+    bint dset_convert(Dset dset, const char *key, int type, void *out) nogil
+    bint dset_fma(Dset dset, const char *key, const double *scale, const double *offset) nogil
+    bint dset_reduce(Dset dset, const char *key, uint64_t ngroup, const uint64_t *order, const uint64_t *offsets, double *min, double *max, double *sum) nogil
+    bint dset_histogram(Dset dset, const char *key, double lo, double hi, uint32_t nbins, uint64_t *counts) nogil
     void dset_del(Dset dset) nogil
 
     uint64_t dset_totalsz(Dset dset) nogil
@@ -17,12 +76,56 @@ cdef extern from "cryosparc-tools/dataset.h":
     uint64_t dset_getsz(Dset dset, const char *colkey) nogil
     bint dset_setstr(Dset dset, const char *colkey, uint64_t index, const char *value) nogil
     const char *dset_getstr(Dset dset, const char *colkey, uint64_t index) nogil
+    bint dset_setstrs(Dset dset, const char *colkey, uint64_t start, uint64_t n, const char **values) nogil
+    bint dset_getstrs(Dset dset, const char *colkey, uint64_t start, uint64_t n, const char **out) nogil
     uint32_t dset_getshp(Dset dset, const char *colkey) nogil
+    uint64_t dset_colindex(Dset dset, const char *colkey) nogil
+    int dset_type_at(Dset dset, uint64_t colindex) nogil
+    void *dset_get_at(Dset dset, uint64_t colindex) nogil
+    uint64_t dset_getsz_at(Dset dset, uint64_t colindex) nogil
+    uint32_t dset_getshp_at(Dset dset, uint64_t colindex) nogil
 
     bint dset_addrows(Dset dset, uint32_t num) nogil
+    bint dset_reserve(Dset dset, uint64_t nrow, uint64_t strheap_bytes) nogil
     bint dset_addcol_scalar(Dset dset, const char *key, int type) nogil
     bint dset_addcol_array(Dset dset, const char *key, int type, int shape0, int shape1, int shape2) nogil
     bint dset_changecol(Dset dset, const char *key, int type) nogil
+    bint dset_castcol(Dset dset, const char *key, int type) nogil
+    bint dset_dropcol(Dset dset, const char *key) nogil
+    bint dset_renamecol(Dset dset, const char *key, const char *newkey) nogil
     bint dset_defrag(Dset dset, bint realloc_smaller) nogil
+    void dset_setnthreads(uint32_t nthreads) nogil
+    void dset_setgrowth(uint32_t percent, uint64_t max_bytes) nogil
+    bint dset_setconcurrent(Dset dset, bint enable) nogil
+    bint dset_pin(Dset dset) nogil
+    bint dset_unpin(Dset dset) nogil
+
+    uint64_t dset_compress_bound(uint64_t n) nogil
+    bint dset_compress(uint32_t n, const void **src, const uint64_t *srcsz, void **dst, uint64_t *dstsz) nogil
+    uint64_t dset_decompressed_size(const void *src, uint64_t srcsz) nogil
+    bint dset_decompress(uint32_t n, const void **src, const uint64_t *srcsz, void **dst, const uint64_t *dstsz) nogil
+    bint dset_shuffle(const void *src, void *dst, uint64_t size, uint32_t elsize) nogil
+    bint dset_unshuffle(const void *src, void *dst, uint64_t size, uint32_t elsize) nogil
+
+    ctypedef struct ds_stream_field:
+        const char *key
+        int type
+        int shape[3]
+        uint32_t itemsize
+        uint32_t shuffle
+        int codec
+        bint wanted
+    ctypedef struct ds_stream:
+        pass
+    ds_stream *dset_stream_new(uint32_t nfield, const ds_stream_field *fields) nogil
+    bint dset_stream_feed(ds_stream *s, const void *data, uint64_t size) nogil
+    uint64_t dset_stream_need(const ds_stream *s) nogil
+    Dset dset_stream_finish(ds_stream *s) nogil
+    void dset_stream_del(ds_stream *s) nogil
+
+    Dset dset_read_star(const char *text, uint64_t size, uint32_t ncol, const char **labels, const int *types, uint64_t *end) nogil
+    uint64_t dset_format_star(Dset dset, uint32_t ncol, const uint64_t *cols, uint64_t start, char *buf, uint64_t bufsz, uint64_t *used) nogil
+    bint dset_export_arrow(Dset dset, ArrowSchema *schema, ArrowArray *array, void (*done)(void *) noexcept, void *ctx) nogil
 
+    bint dset_stats(Dset dset, ds_stats *out) nogil
     void dset_dumptxt(Dset dset) nogil
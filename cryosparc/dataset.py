@@ -23,7 +23,9 @@ Dataset supports:
 - joining fields from another dataset on UID
 
 """
-from functools import reduce
+import os
+import secrets
+from contextlib import contextmanager
 from pathlib import PurePath
 from typing import (
     IO,
@@ -33,6 +35,8 @@ from typing import (
     Collection,
     Dict,
     Generic,
+    Iterable,
+    Iterator,
     List,
     Mapping,
     MutableMapping,
@@ -50,24 +54,40 @@ import numpy.core.records
 if TYPE_CHECKING:
     from numpy.typing import NDArray, ArrayLike, DTypeLike
 
-from .core import Data, DsetType
+from . import codec
+from .core import Data, DsetType, StreamDecoder, unshare
 from .dtype import (
-    NEVER_COMPRESS_FIELDS,
     TYPE_TO_DSET_MAP,
     DatasetHeader,
     Field,
+    RowgroupField,
+    RowgroupIndex,
     decode_dataset_header,
+    decode_rowgroup_field,
+    decode_rowgroup_index,
     get_data_field,
     get_data_field_dtype,
     makefield,
     encode_dataset_header,
+    encode_rowgroup_field,
+    encode_rowgroup_index,
     fielddtype,
     arraydtype,
     safe_makefield,
 )
 from .column import Column
 from .row import Row, Spool, R
-from .util import bopen, default_rng, hashcache, random_integers, u32bytesle, u32intle
+from .util import (
+    AsyncBinaryIteratorIO,
+    bopen,
+    default_rng,
+    hashcache,
+    random_integers,
+    u32bytesle,
+    u32intle,
+    u64bytesle,
+    u64intle,
+)
 
 # Save format options
 NUMPY_FORMAT = 1
@@ -80,6 +100,46 @@ CSDAT_FORMAT = 2
 Compressed stream .cs file format. Same as ``NEWEST_FORMAT``.
 """
 
+IMAGE_FORMAT = 3
+"""
+Uncompressed .cs file format that is loaded by mapping the file into memory
+instead of reading it. Has the same magic prefix as ``CSDAT_FORMAT``. Only
+supported for file paths, not file handles.
+"""
+
+ROWGROUP_FORMAT = 4
+"""
+Version 2 of the compressed stream .cs file format. Rows are stored in
+compressed groups of up to ``ROWGROUP_SIZE`` rows followed by an index of the
+groups, so it may be written while rows are still being produced and ranges of
+rows may be read without reading the whole file. Rows and fields may be added
+to existing files with ``Dataset.append_to`` and ``Dataset.add_fields_to``
+without rewriting them. Not readable by versions of cryosparc-tools from before
+it was added.
+"""
+
+ROWGROUP_SIZE = 65536
+"""
+Default maximum number of rows in each group of a ``ROWGROUP_FORMAT`` file.
+"""
+
+STREAM_CHUNK_SIZE = 2**20
+"""
+Size of the chunks read from a non-seekable ``CSDAT_FORMAT`` stream, e.g., a
+network response, and decoded while the rest of the stream arrives.
+"""
+
+# Codecs that CSDAT_FORMAT streams may be decoded with as they arrive, mapped
+# to their constants in dataset.h
+STREAM_CODECS = {"": 0, "snap": 1}
+
+# Tags of records in ROWGROUP_FORMAT files other than row groups, which are
+# tagged with their number of rows. Skip records jump over a footer that was
+# replaced when appending, and column records add a field to earlier groups.
+ROWGROUP_SKIP_TAG = 1 << 63
+ROWGROUP_COLUMN_TAG = 1 << 62
+ROWGROUP_TAG_MASK = ROWGROUP_COLUMN_TAG - 1
+
 DEFAULT_FORMAT = NUMPY_FORMAT
 """
 Default save .cs file format. Same as ``NUMPY_FORMAT``.
@@ -93,6 +153,7 @@ Newest save .cs file format. Same as ``CSDAT_FORMAT``.
 FORMAT_MAGIC_PREFIXES = {
     NUMPY_FORMAT: b"\x93NUMPY",  # .npy file format
     CSDAT_FORMAT: b"\x94CSDAT",  # .csl binary format
+    ROWGROUP_FORMAT: b"\x95CSDAT",  # .csl binary format with row groups
 }
 MAGIC_PREFIX_FORMATS = {v: k for k, v in FORMAT_MAGIC_PREFIXES.items()}  # inverse dict
 
@@ -137,11 +198,17 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
 
     """
 
-    __slots__ = ("_row_class", "_rows", "_data")
+    __slots__ = ("_row_class", "_rows", "_data", "_lazy")
 
     _row_class: Type[R]
     _rows: Optional[Spool[R]]
     _data: Data
+    _lazy: Optional[Dict[str, Tuple[str, Field, int, str]]]
+    """
+    Fields not yet read from a lazily-loaded file, see ``load``. Each maps to
+    the file path, field, position of the field data and the name of the codec
+    it's compressed with.
+    """
 
     @classmethod
     def allocate(cls, size: int = 0, fields: List[Field] = []):
@@ -156,8 +223,10 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
         Returns:
             Dataset: Empty dataset
         """
-        dset = cls(size)
-        dset.add_fields(fields)
+        dset = cls(Data.sized(len(fields) + 1, size))
+        dset._data.addrows(size)  # first, so that object fields are filled with ""
+        dset.add_fields([("uid", "<u8"), *fields])
+        dset["uid"] = generate_uids(size)
         return dset
 
     def append(self, *others: "Dataset", assert_same_fields=False, repeat_allowed=False):
@@ -220,24 +289,20 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
         if not datasets:
             return cls()
 
-        if not repeat_allowed:
-            all_uids = n.concatenate([dset["uid"] for dset in datasets])
-            assert len(all_uids) == len(n.unique(all_uids)), "Cannot append datasets that contain the same UIDs."
-
         if len(datasets) == 1:
+            if not repeat_allowed:
+                uids = datasets[0]["uid"]
+                assert len(uids) == len(n.unique(uids)), "Cannot append datasets that contain the same UIDs."
             return cls(datasets[0])
 
-        size = sum(len(d) for d in datasets)
-        keep_fields = cls.common_fields(*datasets, assert_same_fields=assert_same_fields)
-        result = cls.allocate(size, keep_fields)
-        startidx = 0
-        for dset in datasets:
-            num = len(dset)
-            for key, *_ in keep_fields:
-                result[key][startidx : startidx + num] = dset[key]
-            startidx += num
-
-        return result
+        cls.common_fields(*datasets, assert_same_fields=assert_same_fields)
+        for d in datasets:
+            d._load_lazy()
+        data = datasets[0]._data.append_many(
+            *(d._data for d in datasets[1:]), key=None if repeat_allowed else "uid"
+        )
+        assert data is not None, "Cannot append datasets with repeated UIDs or mixed C/Python string fields."
+        return cls(data)
 
     def union(self, *others: "Dataset", assert_same_fields=False, assume_unique=False):
         """
@@ -296,31 +361,16 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
         """
         datasets = tuple(d for d in datasets if len(d) > 0)  # skip empty datasets
         keep_fields = cls.common_fields(*datasets, assert_same_fields=assert_same_fields)
-        keep_masks = []
-        keep_uids = n.array([], dtype=n.uint64)
-        for dset in datasets:
-            uid = dset["uid"]
-            mask = n.isin(uid, keep_uids, assume_unique=assume_unique, invert=True)
-            if assume_unique:
-                unique_uids = uid[mask]
-            else:
-                unique_uids, first_idxs = n.unique(uid, return_index=True)
-                unique_mask = n.zeros(len(dset), dtype=bool)
-                unique_mask[first_idxs] = True
-                mask &= unique_mask
-
-            keep_masks.append(mask)
-            keep_uids = n.concatenate((keep_uids, unique_uids))
-
-        size = sum(mask.sum() for mask in keep_masks)
-        result = cls.allocate(size, keep_fields)
-        startidx = 0
-        for mask, dset in zip(keep_masks, datasets):
-            num = mask.sum()
-            for key, *_ in keep_fields:
-                result[key][startidx : startidx + num] = dset[key][mask]
-            startidx += num
-        return result
+        if not datasets:
+            return cls.allocate(0, keep_fields)
+
+        # Native union keeps the first row with each uid, so assume_unique only
+        # documents the caller's intent
+        for d in datasets:
+            d._load_lazy()
+        data = datasets[0]._data.union_many(*(d._data for d in datasets[1:]), key="uid")
+        assert data is not None, "Cannot union datasets with mixed C/Python string fields."
+        return cls(data)
 
     def interlace(self, *datasets: "Dataset", assert_same_fields=False):
         """
@@ -340,20 +390,12 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
 
         assert all(len(dset) == len(self) for dset in datasets), "All datasets must be the same length to interlace."
         datasets = (self,) + datasets
-        keep_fields = self.common_fields(*datasets, assert_same_fields=assert_same_fields)
-        all_uids = n.concatenate([dset["uid"] for dset in datasets])
-        assert len(all_uids) == len(n.unique(all_uids)), "Cannot interlace datasets that contain the same UIDs."
-
-        step = len(datasets)
-        stride = len(self)
-        startidx = 0
-        result = type(self).allocate(len(all_uids), keep_fields)
-        for dset in datasets:
-            for key, *_ in keep_fields:
-                result[key][startidx : startidx + (stride * step) : step] = dset[key]
-            startidx += 1
-
-        return result
+        self.common_fields(*datasets, assert_same_fields=assert_same_fields)
+        for d in datasets:
+            d._load_lazy()
+        data = self._data.interlace(*(d._data for d in datasets[1:]), key="uid")
+        assert data is not None, "Cannot interlace datasets with repeated UIDs or mixed C/Python string fields."
+        return type(self)(data)
 
     def innerjoin(self, *others: "Dataset", assert_no_drop=False):
         """
@@ -435,7 +477,9 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
         # and safer because we don't have to worry about not updating Python
         # string reference counts in the resulting dataset.
         indexed_dsets = [Dataset({"uid": d["uid"], f"idx{i}": n.arange(len(d))}) for i, d in enumerate(datasets)]
-        indexed_dset = reduce(lambda dr, ds: cls(dr._data.innerjoin("uid", ds._data)), indexed_dsets)
+        data = indexed_dsets[0]._data.innerjoin_many("uid", *(d._data for d in indexed_dsets[1:]))
+        assert data is not None, "Cannot innerjoin datasets: out of memory or too many result rows."
+        indexed_dset = cls(data)
         result = cls({"uid": indexed_dset["uid"]})
         result.add_fields(all_fields)
         for i, d, fields in zip(range(len(datasets)), datasets, fields_by_dataset):
@@ -470,7 +514,13 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
         return [f for f in datasets[0].descr() if f in fields]
 
     @classmethod
-    def load(cls, file: Union[str, PurePath, IO[bytes]]):
+    def load(
+        cls,
+        file: Union[str, PurePath, IO[bytes]],
+        fields: Optional[Collection[str]] = None,
+        lazy: bool = False,
+        rows: Optional[slice] = None,
+    ):
         """
         Read a dataset from path or file handle.
 
@@ -478,16 +528,37 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
         (i.e., created by ``numpy.save()``), then the handle must be seekable.
         This restriction does not apply when loading the newer ``CSDAT_FORMAT``.
 
+        Datasets saved with ``IMAGE_FORMAT`` are mapped into memory without
+        copying, so only the parts that are accessed are read from disk. These
+        may only be loaded from a file path.
+
         Args:
             file (str | Path | IO): Readable file path or handle. Must be
                 seekable if loading a dataset saved in the default
                 ``NUMPY_FORMAT``
+            fields (list[str], optional): Only load these fields (and ``uid``).
+                Other fields in ``CSDAT_FORMAT`` files are skipped without
+                being read or decompressed. Defaults to None (all fields).
+            lazy (bool, optional): If True and loading ``CSDAT_FORMAT`` from a
+                file path, only read and decompress each field the first time
+                it is accessed. The file must not change while the dataset is
+                in use. Defaults to False.
+            rows (slice, optional): Only load this range of rows. Only the row
+                groups that contain these rows are read from seekable
+                ``ROWGROUP_FORMAT`` files. Defaults to None (all rows).
 
         Raises:
             TypeError: If cannot determine type of dataset file.
 
         Returns:
             Dataset: loaded dataset.
+
+        Examples:
+
+            >>> dset = Dataset.load('/path/to/particles.cs', fields=['alignments3D/pose'])
+            >>> dset.fields()
+            ['uid', 'alignments3D/pose']
+            >>> Dataset.load('/path/to/particles.cs', rows=slice(1000, 2000))
         """
         prefix = None
         with bopen(file, "rb") as f:
@@ -495,24 +566,418 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
             if prefix == FORMAT_MAGIC_PREFIXES[NUMPY_FORMAT]:
                 f.seek(0)
                 indata = n.load(f, allow_pickle=False)
-                return cls(indata)
+                dset = cls(indata) if fields is None else cls(indata).filter_fields(fields)
+                return dset if rows is None else dset.take(dset._row_indices(rows))
             elif prefix == FORMAT_MAGIC_PREFIXES[CSDAT_FORMAT]:
-                import snappy
-
                 headersize = u32intle(f.read(4))
+                if headersize == 0:  # IMAGE_FORMAT
+                    if not isinstance(file, (str, PurePath)):
+                        raise TypeError(f"Dataset image {file} can only be loaded from a file path")
+                    dset = cls(Data.mmap(str(file)))
+                    dset = dset if fields is None else dset.filter_fields(fields)
+                    dset = dset if rows is None else dset.take(dset._row_indices(rows))
+                    return dset.to_pystrs()
                 header = decode_dataset_header(f.read(headersize))
-                cols = {}
-                for field in header["dtype"]:
-                    colsize = u32intle(f.read(4))
-                    buffer = f.read(colsize)
-                    if field[0] in header["compressed_fields"]:
-                        buffer = snappy.uncompress(buffer)
-                    cols[field[0]] = n.frombuffer(buffer, dtype=fielddtype(field))
-                return cls(cols)
+                path = str(file) if lazy and isinstance(file, (str, PurePath)) else None
+                dset = cls._load_fields(f, header, fields, path)
+                return dset if rows is None else dset.take(dset._row_indices(rows))
+            elif prefix == FORMAT_MAGIC_PREFIXES[ROWGROUP_FORMAT]:
+                header = decode_dataset_header(f.read(u32intle(f.read(4))))
+                return cls._load_rowgroups(f, header, fields, rows)
 
         raise TypeError(f"Could not determine dataset format for file {file} (prefix is {prefix})")
 
-    def save(self, file: Union[str, PurePath, IO[bytes]], format: int = DEFAULT_FORMAT):
+    @classmethod
+    def _load_fields(
+        cls,
+        f: IO[bytes],
+        header: DatasetHeader,
+        fields: Optional[Collection[str]] = None,
+        lazy_path: Optional[str] = None,
+    ):
+        # Read the CSDAT field data following the header. Unselected fields
+        # are skipped, seeking past them when possible. If a path is given for
+        # lazy loading, only record where each selected field's data is.
+        seekable = f.seekable() if hasattr(f, "seekable") else False
+        decoder = None if seekable else cls._stream_decoder(header, fields)
+        if decoder:
+            while decoder.need():
+                data = f.read(min(STREAM_CHUNK_SIZE, decoder.need()))
+                if not data:
+                    break
+                decoder.feed(data)
+            return cls._finish_stream(decoder)
+
+        offsets = header["offsets"] if seekable else []
+        start = f.tell() if seekable else 0
+        names = [field[0] for field in header["dtype"]]
+        lazy_path = lazy_path if seekable and "uid" in names else None
+
+        selected: List[Field] = []
+        buffers: List[Tuple[Field, bytes, str]] = []
+        lazy = {}
+        for i, field in enumerate(header["dtype"]):
+            name = field[0]
+            wanted = fields is None or name == "uid" or name in fields
+            if offsets:
+                if not wanted:
+                    continue
+                f.seek(start + offsets[i])
+            pos = f.tell() if seekable else 0
+            colsize = u32intle(f.read(4))
+            fieldcodec = codec.field_codec(header, name)
+            if wanted:
+                selected.append(field)
+            if wanted and lazy_path and name != "uid":
+                lazy[name] = (lazy_path, field, pos, fieldcodec)
+                wanted = False
+            if not wanted:
+                if seekable:
+                    f.seek(colsize, 1)
+                else:
+                    f.read(colsize)
+                continue
+            buffers.append((field, f.read(colsize), fieldcodec))
+
+        if not buffers:
+            return cls()
+
+        # allocate the dataset up front so that data may be decompressed
+        # directly into it
+        field, data, fieldcodec = buffers[0]
+        size = codec.decoded_size(data, fieldcodec)
+        dset = cls._allocate_fields(size // n.dtype(fielddtype(field)).itemsize, selected)
+        dset._decode_fields(buffers)
+        dset._lazy = lazy or None
+        return dset
+
+    def _decode_fields(self, buffers: List[Tuple[Field, bytes, str]]):
+        # Decode the given field data in CSDAT format with the given codecs
+        # into this dataset's existing fields. String fields are decoded into
+        # temporary arrays and then converted.
+        outs = []
+        strs: List[Tuple[str, "NDArray"]] = []
+        for field, _, _ in buffers:
+            dt = n.dtype(fielddtype(field))
+            if dt.char in {"O", "S", "U"}:
+                out = n.empty(len(self), dtype=dt)
+                strs.append((field[0], out))
+            else:
+                out = n.asarray(self[field[0]])
+            outs.append(out)
+        codec.decode([data for _, data, _ in buffers], [c for _, _, c in buffers], outs)
+        for name, out in strs:
+            self[name] = out
+
+    @classmethod
+    def _stream_decoder(cls, header: DatasetHeader, fields: Optional[Collection[str]] = None):
+        # Decoder for the CSDAT field data following the given header that
+        # decodes each selected field into the result as its data arrives.
+        # None if a selected field has a codec or type that only
+        # _decode_fields supports, e.g., zstd or unicode strings.
+        specs = []
+        for field in header["dtype"]:
+            name = field[0]
+            if not (fields is None or name == "uid" or name in fields):
+                specs.append((name, 0, (), 0, 0, 0, False))
+                continue
+            fieldcodec = codec.field_codec(header, name)
+            shuffled = fieldcodec.startswith(codec.SHUFFLE)
+            backend = fieldcodec[len(codec.SHUFFLE) :] if shuffled else fieldcodec
+            dt = n.dtype(fielddtype(field))
+            dsettype = DsetType.T_STR if dt.char == "S" else TYPE_TO_DSET_MAP.get(dt.base.type)
+            if (
+                backend not in STREAM_CODECS
+                or dsettype in (None, DsetType.T_OBJ)
+                or not dt.base.isnative
+                or len(dt.shape) > 3
+                or (dsettype == DsetType.T_STR and dt.shape)
+            ):
+                return None
+            shuffle = dt.base.itemsize if shuffled else 0
+            specs.append((name, dsettype, dt.shape, dt.itemsize, shuffle, STREAM_CODECS[backend], True))
+        return StreamDecoder(specs)
+
+    @classmethod
+    def _finish_stream(cls, decoder: StreamDecoder):
+        # Dataset decoded by a decoder from _stream_decoder. Like
+        # _allocate_fields, generates uids only if there is no uid field
+        dset = cls(decoder.finish()).to_pystrs()
+        if not dset._data.has("uid"):
+            dset.add_fields([("uid", "<u8")])
+            dset["uid"] = generate_uids(len(dset))
+        return dset
+
+    @classmethod
+    def _allocate_fields(cls, nrow: int, selected: List[Field]):
+        # Allocate a dataset with the given fields to decode file data into.
+        # Unlike allocate(), does not generate uids unless there is no uid field
+        dset = cls(Data.sized(len(selected) + 1, nrow))
+        dset._data.addrows(nrow)
+        dset.add_fields(selected)
+        if all(field[0] != "uid" for field in selected):
+            dset["uid"] = generate_uids(nrow)
+        return dset
+
+    @classmethod
+    def _load_rowgroups(
+        cls,
+        f: IO[bytes],
+        header: DatasetHeader,
+        fields: Optional[Collection[str]] = None,
+        rows: Optional[slice] = None,
+    ):
+        # Read the ROWGROUP_FORMAT groups following the header. If the file is
+        # seekable and complete, use the index in the footer to only read the
+        # groups that the given rows are in.
+        seekable = f.seekable() if hasattr(f, "seekable") else False
+        index = cls._load_rowgroup_index(f) if seekable else None
+        if index is None:
+            parts, index = cls._read_rowgroups(f, header, fields)
+            selected = [field for field, _ in cls._rowgroup_fields(header, index, len(index["groups"]))]
+            selected = [field for field in selected if fields is None or field[0] in fields or field[0] == "uid"]
+            dset = cls._concat_rowgroups(parts, selected)
+            return dset if rows is None else dset.take(dset._row_indices(rows))
+
+        groups = index["groups"]
+        allfields = cls._rowgroup_fields(header, index, len(groups))
+        selected = [field for field, _ in allfields if fields is None or field[0] in fields or field[0] == "uid"]
+        parts: List[Dataset] = []
+        first = 0  # index of the first row in the loaded groups
+        start = f.tell()
+        total = sum(nrow for _, nrow in groups)
+        wanted = range(*(slice(None) if rows is None else rows).indices(total))
+        lo, hi = (min(wanted[0], wanted[-1]), max(wanted[0], wanted[-1]) + 1) if len(wanted) > 0 else (0, 0)
+        end = 0  # index of the row after the current group
+        for g, (offset, nrow) in enumerate(groups):
+            end += nrow
+            if end <= lo or end - nrow >= hi:
+                continue
+            if not parts:
+                first = end - nrow
+            f.seek(start + offset)
+            assert u64intle(f.read(8)) == nrow, f"Incorrect row group index in {f}"
+            buffers: List[Tuple[Field, bytes, str]] = []
+            for field, fieldcodec in cls._rowgroup_fields(header, index, g):
+                data, _ = cls._read_rowgroup_blob(f, field in selected, seekable)
+                if data is not None:
+                    buffers.append((field, data, fieldcodec))
+
+            # fields added after this group was written are stored separately
+            for added in index["fields"]:
+                if added["group"] > g and added["field"] in selected:
+                    f.seek(start + added["blobs"][g])
+                    buffers.append((added["field"], f.read(u64intle(f.read(8))), added["codec"]))
+            part = cls._allocate_fields(nrow, selected)
+            part._decode_fields(buffers)
+            parts.append(part)
+
+        dset = cls._concat_rowgroups(parts, selected)
+        if rows is None:
+            return dset
+        indexes = n.arange(wanted.start, wanted.stop, wanted.step, dtype=n.int64) - first
+        return dset.take(indexes.astype(n.uint64))
+
+    @classmethod
+    def _load_rowgroup_index(cls, f: IO[bytes]) -> Optional[RowgroupIndex]:
+        # Read the footer of a complete ROWGROUP_FORMAT file. Returns None if
+        # the file does not have a footer (e.g., because it is still being
+        # written). Restores the position.
+        pos = f.tell()
+        f.seek(0, 2)
+        size = f.tell() - pos
+        index = None
+        if size >= 14:
+            f.seek(-14, 2)
+            trailer = f.read(14)
+            indexsize = u64intle(trailer[:8])
+            if trailer[8:] == FORMAT_MAGIC_PREFIXES[ROWGROUP_FORMAT] and indexsize <= size - 22:
+                f.seek(-14 - indexsize, 2)
+                index = decode_rowgroup_index(f.read(indexsize))
+        f.seek(pos)
+        return index
+
+    @classmethod
+    def _read_rowgroups(
+        cls, f: IO[bytes], header: DatasetHeader, fields: Optional[Collection[str]] = None, decode: bool = True
+    ):
+        # Read the records following the header of a ROWGROUP_FORMAT file in
+        # order until the tag that ends the groups, following skip records
+        # and adding the fields in column records to the groups before them.
+        # Decodes the given fields of each group unless decode is False, in
+        # which case only finds where the data is. Returns the decoded groups
+        # and the index of the data found.
+        seekable = f.seekable() if hasattr(f, "seekable") else False
+        index = RowgroupIndex(groups=[], fields=[])
+        parts: List[Dataset] = []
+        pos = 0  # relative to the end of the header
+
+        def wanted(field: Field):
+            return decode and (fields is None or field[0] in fields or field[0] == "uid")
+
+        while True:
+            tag = u64intle(f.read(8))
+            pos += 8
+            if tag == 0:
+                break
+            elif tag & ROWGROUP_SKIP_TAG:
+                size = tag & ROWGROUP_TAG_MASK
+                f.seek(size, 1) if seekable else f.read(size)
+                pos += size
+            elif tag & ROWGROUP_COLUMN_TAG:
+                size = tag & ROWGROUP_TAG_MASK
+                added = decode_rowgroup_field(f.read(size))
+                added["group"] = len(index["groups"])
+                pos += size
+                for g in range(added["group"]):
+                    added["blobs"].append(pos)
+                    data, size = cls._read_rowgroup_blob(f, wanted(added["field"]), seekable)
+                    pos += 8 + size
+                    if data is not None:
+                        parts[g].add_fields([added["field"]])
+                        parts[g]._decode_fields([(added["field"], data, added["codec"])])
+                index["fields"].append(added)
+            else:
+                index["groups"].append((pos - 8, tag))
+                buffers: List[Tuple[Field, bytes, str]] = []
+                for field, fieldcodec in cls._rowgroup_fields(header, index, len(index["groups"]) - 1):
+                    data, size = cls._read_rowgroup_blob(f, wanted(field), seekable)
+                    pos += 8 + size
+                    if data is not None:
+                        buffers.append((field, data, fieldcodec))
+                if decode:
+                    part = cls._allocate_fields(tag, [field for field, _, _ in buffers])
+                    part._decode_fields(buffers)
+                    parts.append(part)
+        return parts, index
+
+    @classmethod
+    def _read_rowgroup_blob(cls, f: IO[bytes], wanted: bool, seekable: bool) -> Tuple[Optional[bytes], int]:
+        # Read the data of one field in a ROWGROUP_FORMAT group if wanted, or
+        # skip it. Returns the data and its size.
+        size = u64intle(f.read(8))
+        if wanted:
+            return f.read(size), size
+        f.seek(size, 1) if seekable else f.read(size)
+        return None, size
+
+    @classmethod
+    def _rowgroup_fields(cls, header: DatasetHeader, index: RowgroupIndex, group: int) -> List[Tuple[Field, str]]:
+        # Fields whose data is stored in the ROWGROUP_FORMAT group with the
+        # given index, in order, with their codecs. Later groups include all
+        # fields added to the file.
+        fields = [(field, codec.field_codec(header, field[0])) for field in header["dtype"]]
+        return fields + [(added["field"], added["codec"]) for added in index["fields"] if added["group"] <= group]
+
+    @classmethod
+    def _concat_rowgroups(cls, parts: List["Dataset"], selected: List[Field]):
+        if not parts:
+            return cls._allocate_fields(0, selected)
+        return parts[0] if len(parts) == 1 else cls.append_many(*parts, repeat_allowed=True)
+
+    @classmethod
+    async def from_async_stream(cls, stream: AsyncBinaryIteratorIO, fields: Optional[Collection[str]] = None):
+        """
+        Asynchronously read a dataset in ``CSDAT_FORMAT`` or
+        ``ROWGROUP_FORMAT`` from a stream, e.g., of a network response.
+        ``CSDAT_FORMAT`` fields are decompressed into the result in chunks as
+        they arrive and each ``ROWGROUP_FORMAT`` group is decoded as soon as it
+        arrives, while the rest is still downloading.
+
+        Args:
+            stream (AsyncBinaryIteratorIO): Stream of dataset file chunks
+            fields (list[str], optional): Only decode these fields (and
+                ``uid``). Defaults to None (all fields).
+
+        Raises:
+            TypeError: If cannot determine type of dataset stream.
+
+        Returns:
+            Dataset: loaded dataset.
+        """
+        prefix = await stream.read(6)
+        if prefix not in (FORMAT_MAGIC_PREFIXES[CSDAT_FORMAT], FORMAT_MAGIC_PREFIXES[ROWGROUP_FORMAT]):
+            raise TypeError(f"Could not determine dataset format for stream (prefix is {prefix})")
+        header = decode_dataset_header(await stream.read(u32intle(await stream.read(4))))
+        selected = [field for field in header["dtype"] if fields is None or field[0] in fields or field[0] == "uid"]
+
+        if prefix == FORMAT_MAGIC_PREFIXES[CSDAT_FORMAT]:
+            decoder = cls._stream_decoder(header, fields)
+            if decoder:
+                while decoder.need():
+                    data = await stream.read(min(STREAM_CHUNK_SIZE, decoder.need()))
+                    if not data:
+                        break
+                    decoder.feed(data)
+                return cls._finish_stream(decoder)
+
+            buffers = []
+            for field in header["dtype"]:
+                data = await stream.read(u32intle(await stream.read(4)))
+                if field in selected:
+                    buffers.append((field, data, codec.field_codec(header, field[0])))
+            if not buffers:
+                return cls()
+            field, data, fieldcodec = buffers[0]
+            size = codec.decoded_size(data, fieldcodec)
+            dset = cls._allocate_fields(size // n.dtype(fielddtype(field)).itemsize, selected)
+            dset._decode_fields(buffers)
+            return dset
+
+        # same as _read_rowgroups, see for the record types
+        index = RowgroupIndex(groups=[], fields=[])
+        parts: List[Dataset] = []
+        while True:
+            tag = u64intle(await stream.read(8))
+            if tag == 0:
+                break
+            elif tag & ROWGROUP_SKIP_TAG:
+                await stream.read(tag & ROWGROUP_TAG_MASK)
+            elif tag & ROWGROUP_COLUMN_TAG:
+                added = decode_rowgroup_field(await stream.read(tag & ROWGROUP_TAG_MASK))
+                added["group"] = len(parts)
+                for part in parts:
+                    data = await stream.read(u64intle(await stream.read(8)))
+                    if fields is None or added["field"][0] in fields:
+                        part.add_fields([added["field"]])
+                        part._decode_fields([(added["field"], data, added["codec"])])
+                index["fields"].append(added)
+                if fields is None or added["field"][0] in fields:
+                    selected.append(added["field"])
+            else:
+                buffers = []
+                for field, fieldcodec in cls._rowgroup_fields(header, index, len(parts)):
+                    data = await stream.read(u64intle(await stream.read(8)))
+                    if field in selected:
+                        buffers.append((field, data, fieldcodec))
+                part = cls._allocate_fields(tag, selected)
+                part._decode_fields(buffers)
+                parts.append(part)
+
+        return cls._concat_rowgroups(parts, selected)
+
+    def _load_lazy(self, *fields: str):
+        # Read and decompress the given fields (or all fields if none are
+        # given) that have not yet been loaded from a lazily-loaded file
+        if not self._lazy:
+            return
+
+        buffers: List[Tuple[Field, bytes, str]] = []
+        for name in fields or list(self._lazy):
+            if name not in self._lazy:
+                continue
+            path, field, pos, fieldcodec = self._lazy.pop(name)
+            with open(path, "rb") as f:
+                f.seek(pos)
+                buffers.append((field, f.read(u32intle(f.read(4))), fieldcodec))
+        self._decode_fields(buffers)
+
+    def save(
+        self,
+        file: Union[str, PurePath, IO[bytes]],
+        format: int = DEFAULT_FORMAT,
+        compression: Union[str, Mapping[str, str]] = "snap",
+    ):
         """
         Save a dataset to the given path or I/O buffer.
 
@@ -523,11 +988,19 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
         Args:
             file (str | Path | IO): Writeable file path or handle
             format (int, optional): Must be of the constants ``DEFAULT_FORMAT``,
-                ``NUMPY_FORMAT`` (same as ``DEFAULT_FORMAT``), or
-                ``CSDAT_FORMAT``. Defaults to ``DEFAULT_FORMAT``.
+                ``NUMPY_FORMAT`` (same as ``DEFAULT_FORMAT``), ``CSDAT_FORMAT``,
+                ``IMAGE_FORMAT`` or ``ROWGROUP_FORMAT``. Defaults to
+                ``DEFAULT_FORMAT``.
+            compression (str | Mapping[str, str], optional): Codec to compress
+                fields with in ``CSDAT_FORMAT`` and ``ROWGROUP_FORMAT``, e.g.,
+                ``"shuffle+zstd"``, or ``"auto"`` to pick one for each field.
+                May also map field names to codecs. Codecs other than
+                ``"snap"`` are not readable by older versions. See
+                ``cryosparc.codec``. Defaults to ``"snap"``.
 
         Raises:
-            TypeError: If invalid format specified
+            TypeError: If invalid format specified, or if ``IMAGE_FORMAT`` is
+                specified with a file handle rather than a path
         """
         if format == NUMPY_FORMAT:
             outdata = self.to_records(fixed=True)
@@ -535,12 +1008,253 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
                 n.save(f, outdata, allow_pickle=False)
         elif format == CSDAT_FORMAT:
             with bopen(file, "wb") as f:
-                for chunk in self.stream():
+                for chunk in self.stream(compression):
+                    f.write(chunk)
+        elif format == ROWGROUP_FORMAT:
+            with bopen(file, "wb") as f:
+                for chunk in Dataset.stream_rowgroups([self], compression=compression):
                     f.write(chunk)
+        elif format == IMAGE_FORMAT:
+            if not isinstance(file, (str, PurePath)):
+                raise TypeError(f"Dataset image {file} can only be saved to a file path")
+            self._load_lazy()
+            try:
+                self.to_cstrs()
+                assert self._data.save_image(str(file)), f"Could not save dataset image {file}"
+            finally:
+                self.to_pystrs()
         else:
             raise TypeError(f"Invalid dataset save format for {file}: {format}")
 
-    def stream(self):
+    def append_to(self, file: Union[str, PurePath, IO[bytes]], rowgroup: int = ROWGROUP_SIZE):
+        """
+        Add this dataset's rows to the end of a dataset file saved with
+        ``ROWGROUP_FORMAT``, without rewriting the rows already in it. The
+        rows are encoded with the codecs of the file's fields and become
+        visible to readers all at once, when the append completes.
+
+        Args:
+            file (str | Path | IO): Path or seekable read/write handle of the
+                file to append to
+            rowgroup (int, optional): Maximum number of rows in each group.
+                Defaults to ``ROWGROUP_SIZE``.
+
+        Raises:
+            TypeError: If the file is not in ``ROWGROUP_FORMAT``.
+
+        Examples:
+
+            >>> particles.save('/path/to/particles.cs', format=ROWGROUP_FORMAT)
+            >>> more_particles.append_to('/path/to/particles.cs')
+        """
+        assert rowgroup > 0, f"Invalid row group size {rowgroup}"
+        with bopen(file, "r+b") as f:
+            header, index, start, end = Dataset._open_rowgroups(f)
+            fields = Dataset._rowgroup_fields(header, index, len(index["groups"]))
+            arrays = self._rowgroup_arrays([field for field, _ in fields])
+            codecs = [fieldcodec for _, fieldcodec in fields]
+
+            slices = [slice(s, s + rowgroup) for s in range(0, len(self), rowgroup)]
+            encoded = iter(codec.encode([a[s] for s in slices for a in arrays], codecs * len(slices)))
+            pos = f.seek(0, 2)
+            for s in slices:
+                nrow = len(arrays[0][s])
+                index["groups"].append((f.tell() - start, nrow))
+                f.write(u64bytesle(nrow))
+                for _ in arrays:
+                    data = next(encoded)
+                    f.write(u64bytesle(len(data)))
+                    f.write(data)
+            Dataset._commit_rowgroups(f, index, end, pos)
+
+    def add_fields_to(
+        self,
+        file: Union[str, PurePath, IO[bytes]],
+        fields: Optional[Collection[str]] = None,
+        compression: Union[str, Mapping[str, str]] = "snap",
+    ):
+        """
+        Add fields of this dataset to a dataset file saved with
+        ``ROWGROUP_FORMAT``, without rewriting the fields already in it. This
+        dataset must have the same rows as the file, in the same order. The
+        fields become visible to readers all at once, when the write
+        completes. Rows appended to the file later must include them.
+
+        Args:
+            file (str | Path | IO): Path or seekable read/write handle of the
+                file to add fields to
+            fields (list[str], optional): Fields to add. Defaults to None (all
+                fields that are not yet in the file).
+            compression (str | Mapping[str, str], optional): Field codecs, see
+                ``Dataset.save``. Defaults to ``"snap"``.
+
+        Raises:
+            TypeError: If the file is not in ``ROWGROUP_FORMAT``.
+
+        Examples:
+
+            >>> particles = Dataset.load('/path/to/particles.cs', fields=['ctf/df1_A', 'ctf/df2_A'])
+            >>> particles.add_fields(['ctf/defocus_A'], ['f4'])
+            >>> particles['ctf/defocus_A'] = (particles['ctf/df1_A'] + particles['ctf/df2_A']) / 2
+            >>> particles.add_fields_to('/path/to/particles.cs', ['ctf/defocus_A'])
+        """
+        with bopen(file, "r+b") as f:
+            header, index, start, end = Dataset._open_rowgroups(f)
+            existing = {field[0] for field, _ in Dataset._rowgroup_fields(header, index, len(index["groups"]))}
+            names = [name for name in self.fields() if name not in existing] if fields is None else list(fields)
+            assert all(name not in existing for name in names), f"Some of {names} are already in {file}"
+            f.seek(start)
+            uids = Dataset._load_rowgroups(f, header, ["uid"])["uid"]
+            assert n.array_equal(uids, self["uid"]), f"Cannot add fields from dataset with different rows than {file}"
+
+            cols = self.cols()
+            arrays = [n.ascontiguousarray(cols[name].to_fixed()) for name in names]
+            codecs = codec.resolve_codecs(names, arrays, compression)
+            slices, first = [], 0
+            for _, nrow in index["groups"]:
+                slices.append(slice(first, first + nrow))
+                first += nrow
+            encoded = iter(codec.encode([a[s] for a in arrays for s in slices], [c for c in codecs for _ in slices]))
+            pos = f.seek(0, 2)
+            for name, arr, fieldcodec in zip(names, arrays, codecs):
+                field = makefield(name, arraydtype(arr))
+                added = RowgroupField(field=field, codec=fieldcodec, group=len(slices), blobs=[])
+                record = encode_rowgroup_field(added)
+                f.write(u64bytesle(ROWGROUP_COLUMN_TAG | len(record)))
+                f.write(record)
+                for _ in slices:
+                    data = next(encoded)
+                    added["blobs"].append(f.tell() - start)
+                    f.write(u64bytesle(len(data)))
+                    f.write(data)
+                index["fields"].append(added)
+            Dataset._commit_rowgroups(f, index, end, pos)
+
+    def _rowgroup_arrays(self, fields: List[Field]) -> List["NDArray"]:
+        # Data of this dataset's fields to append to a ROWGROUP_FORMAT file
+        # with the given fields. Strings are padded to the size in the file.
+        assert set(self.fields()) == {field[0] for field in fields}, (
+            f"Cannot append dataset with fields {self.descr()} to row groups with fields {fields}"
+        )
+        cols = self.cols()
+        arrays = []
+        for field in fields:
+            arr = n.ascontiguousarray(cols[field[0]].to_fixed())
+            dt = n.dtype(fielddtype(field))
+            if arr.dtype.char == "S" and dt.char == "S" and arr.dtype.itemsize <= dt.itemsize:
+                arr = arr.astype(dt)
+            assert makefield(field[0], arraydtype(arr)) == field, (
+                f"Cannot append field {makefield(field[0], arraydtype(arr))} to row groups with field {field}"
+            )
+            arrays.append(arr)
+        return arrays
+
+    @classmethod
+    def _open_rowgroups(cls, f: IO[bytes]) -> Tuple[DatasetHeader, RowgroupIndex, int, int]:
+        # Read the header and index of a ROWGROUP_FORMAT file to append to.
+        # Also returns the positions of the end of the header and of the tag
+        # that ends the groups. Finds the groups by reading them in order if
+        # the footer is missing, e.g., because a previous append stopped.
+        prefix = f.read(6)
+        if prefix != FORMAT_MAGIC_PREFIXES[ROWGROUP_FORMAT]:
+            raise TypeError(f"Can only append to dataset files saved in ROWGROUP_FORMAT (prefix is {prefix})")
+        header = decode_dataset_header(f.read(u32intle(f.read(4))))
+        start = f.tell()
+        index = cls._load_rowgroup_index(f)
+        if index is None:
+            _, index = cls._read_rowgroups(f, header, decode=False)
+            end = f.tell() - 8
+        else:
+            f.seek(-14, 2)
+            indexsize = u64intle(f.read(8))
+            end = f.tell() - 8 - indexsize - 8
+            f.seek(end)
+            assert u64intle(f.read(8)) == 0, f"Incorrect row group footer in {f}"
+        return header, index, start, end
+
+    @staticmethod
+    def _commit_rowgroups(f: IO[bytes], index: RowgroupIndex, end: int, pos: int):
+        # Finish appending the records written to a ROWGROUP_FORMAT file from
+        # the given position, which was the end of the file. Writes a new
+        # footer, then replaces the tag that ended the previous groups with a
+        # skip record to the new ones. Each step is synced to disk so that if
+        # the append stops early, readers still see the previous contents.
+        def sync():
+            f.flush()
+            try:
+                os.fsync(f.fileno())
+            except (AttributeError, OSError):
+                pass  # not a file on disk
+
+        data = encode_rowgroup_index(index["groups"], index["fields"])
+        f.write(u64bytesle(0))
+        f.write(data)
+        f.write(u64bytesle(len(data)))
+        sync()
+        f.seek(end)
+        f.write(u64bytesle(ROWGROUP_SKIP_TAG | (pos - end - 8)))
+        sync()
+        f.seek(0, 2)
+        f.write(FORMAT_MAGIC_PREFIXES[ROWGROUP_FORMAT])
+        sync()
+
+    @contextmanager
+    def shared(self, name: Optional[str] = None) -> Iterator[str]:
+        """
+        Context manager that shares a snapshot of this dataset in shared
+        memory for the duration of the ``with`` block. Other processes, such
+        as ``multiprocessing`` pool workers, may attach to it by name with
+        ``Dataset.attach`` without copying or serializing it.
+
+        Args:
+            name (str, optional): Name of the shared memory object. Defaults
+                to a unique name.
+
+        Yields:
+            str: Shared dataset name to pass to ``Dataset.attach``.
+
+        Examples:
+
+            >>> with particles.shared() as name:
+            ...     pool.starmap(process_micrograph, [(name, mic) for mic in mics])
+
+            In each worker:
+
+            >>> particles = Dataset.attach(name)
+        """
+        name = name or f"cryosparc-{os.getpid()}-{secrets.token_hex(8)}"
+        self._load_lazy()
+        snapshot = Dataset(Data(self._data)).to_cstrs()
+        snapshot._data.share(name)
+        try:
+            yield name
+        finally:
+            unshare(name)
+
+    @classmethod
+    def attach(cls, name: str, readonly: bool = False):
+        """
+        Attach to a dataset shared by another process with ``Dataset.shared``.
+        Only the parts of the dataset that are accessed are read, and only
+        rows or fields that are added are copied.
+
+        Args:
+            name (str): Shared dataset name.
+            readonly (bool, optional): If True, the dataset cannot be modified
+                and string fields remain C strings (with dtype ``np.uint64``,
+                see ``to_pystrs``). Otherwise changes are private to this
+                process (copy-on-write). Defaults to False.
+
+        Raises:
+            OSError: If the shared dataset does not exist.
+
+        Returns:
+            Dataset: shared dataset.
+        """
+        dset = cls(Data.attach(name, readonly))
+        return dset if readonly else dset.to_pystrs()
+
+    def stream(self, compression: Union[str, Mapping[str, str]] = "snap"):
         """
         Generate a binary representation for this dataset. Results may be
         written to a file or buffer to be sent over the network.
@@ -549,31 +1263,110 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
         ``format=CSDAT_FORMAT``. Call ``Dataset.load`` on the resulting
         file/buffer to retrieve the original data.
 
+        Args:
+            compression (str | Mapping[str, str], optional): Field codecs, see
+                ``Dataset.save``. Defaults to ``"snap"``.
+
         Yields:
             bytes: Dataset file chunks
         """
-        import snappy
-
         cols = self.cols()
-        arrays = [cols[c].to_fixed() for c in cols]
+        arrays = [n.ascontiguousarray(cols[c].to_fixed()) for c in cols]
         descr = [makefield(f, arraydtype(a)) for f, a in zip(cols, arrays)]
+        codecs = codec.resolve_codecs(list(cols), arrays, compression)
 
         yield FORMAT_MAGIC_PREFIXES[CSDAT_FORMAT]
 
-        compressed_fields = [col for col in cols if col not in NEVER_COMPRESS_FIELDS]
-        header = encode_dataset_header(
-            DatasetHeader(dtype=descr, compression="snap", compressed_fields=compressed_fields)
-        )
+        header = encode_dataset_header(codec.make_header(descr, codecs))
         yield u32bytesle(len(header))
         yield header
 
-        for f, arr in zip(cols, arrays):
-            if f in NEVER_COMPRESS_FIELDS:
-                fielddata = arr.data.tobytes()
+        # encode each field only when it's next, so that only one field's
+        # encoded data is held at once. Readers skip fields by their size
+        # prefix, see load(fields=...)
+        for arr, fieldcodec in zip(arrays, codecs):
+            data = codec.encode([arr], [fieldcodec])[0]
+            yield u32bytesle(len(data))
+            yield data
+
+    @staticmethod
+    def stream_rowgroups(
+        datasets: Iterable["Dataset"],
+        rowgroup: int = ROWGROUP_SIZE,
+        compression: Union[str, Mapping[str, str]] = "snap",
+    ):
+        """
+        Generate a binary representation of the rows of the given datasets in
+        ``ROWGROUP_FORMAT``. Each dataset is encoded as soon as the iterable
+        produces it, so this may be used to write rows while they are still
+        being computed. All datasets must have the same fields.
+
+        Call ``Dataset.load`` on the resulting file/buffer to retrieve all the
+        rows as a single dataset.
+
+        Args:
+            datasets (Iterable[Dataset]): Datasets with rows to write
+            rowgroup (int, optional): Maximum number of rows in each group.
+                Datasets with fewer rows are written as a single group.
+                Defaults to ``ROWGROUP_SIZE``.
+            compression (str | Mapping[str, str], optional): Field codecs, see
+                ``Dataset.save``. ``"auto"`` picks codecs based on the first
+                dataset. Defaults to ``"snap"``.
+
+        Yields:
+            bytes: Dataset file chunks
+
+        Examples:
+
+            >>> def particles():
+            ...     for mic in micrographs:
+            ...         yield pick(mic)
+            >>> with open('/path/to/particles.cs', 'wb') as f:
+            ...     for chunk in Dataset.stream_rowgroups(particles()):
+            ...         f.write(chunk)
+        """
+        assert rowgroup > 0, f"Invalid row group size {rowgroup}"
+        descr: Optional[List[Field]] = None
+        groups: List[Tuple[int, int]] = []
+        offset = 0  # relative to the end of the header
+        for dset in datasets:
+            cols = dset.cols()
+            arrays = [n.ascontiguousarray(cols[c].to_fixed()) for c in cols]
+            if descr is None:
+                descr = [makefield(f, arraydtype(a)) for f, a in zip(cols, arrays)]
+                codecs = codec.resolve_codecs(list(cols), arrays, compression)
+                header = encode_dataset_header(codec.make_header(descr, codecs))
+                yield FORMAT_MAGIC_PREFIXES[ROWGROUP_FORMAT]
+                yield u32bytesle(len(header))
+                yield header
             else:
-                fielddata: bytes = snappy.compress(arr.data)
-            yield u32bytesle(len(fielddata))
-            yield fielddata
+                assert [makefield(f, arraydtype(a)) for f, a in zip(cols, arrays)] == descr, (
+                    f"Cannot stream dataset with fields {dset.descr()} in row groups with fields {descr}"
+                )
+
+            # compress all groups in this dataset at once, in parallel
+            slices = [slice(start, start + rowgroup) for start in range(0, len(dset), rowgroup)]
+            encoded = iter(codec.encode([a[s] for s in slices for a in arrays], codecs * len(slices)))
+            for s in slices:
+                nrow = len(arrays[0][s])
+                groups.append((offset, nrow))
+                yield u64bytesle(nrow)
+                offset += 8
+                for _ in arrays:
+                    data = next(encoded)
+                    yield u64bytesle(len(data))
+                    yield data
+                    offset += 8 + len(data)
+
+        if descr is None:  # no datasets, write an empty one
+            yield from Dataset.stream_rowgroups([Dataset()], rowgroup, compression)
+            return
+
+        index = encode_rowgroup_index(groups)
+        yield u64bytesle(0)  # marks the end of the groups
+        yield index
+        yield u64bytesle(len(index))
+        yield FORMAT_MAGIC_PREFIXES[ROWGROUP_FORMAT]
 
     def __init__(
         self,
@@ -592,9 +1385,11 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
         super().__init__()
         self._row_class = row_class
         self._rows = None
+        self._lazy = None
 
         if isinstance(allocate, Dataset):
             # Copy constructor, create copy of underlying data
+            allocate._load_lazy()
             self._data = Data(allocate._data)
             return
 
@@ -603,7 +1398,6 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
             self._data = allocate
             return
 
-        self._data = Data()
         populate: List[Tuple[Field, n.ndarray]] = []
         if allocate is None:  # Same as zero
             populate = [(("uid", "<u8"), n.ndarray(0, dtype=n.uint64))]
@@ -635,6 +1429,7 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
         if not any(entry[0][0] == "uid" for entry in populate):
             populate.insert(0, (("uid", "<u8"), generate_uids(nrows)))
 
+        self._data = Data.sized(len(populate), nrows)
         self.add_fields([entry[0] for entry in populate])
         self._data.addrows(nrows)
         for field, data in populate:
@@ -680,6 +1475,8 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
                 array subclass representing a column.
         """
         if isinstance(key, str):
+            if self._lazy:
+                self._load_lazy(key)
             return Column(get_data_field(self._data, key), self._data)
         else:
             return self.rows()[key]
@@ -954,10 +1751,22 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
         if len(new_fields) == len(self.descr()):
             return self
 
-        result = self.allocate(len(self), new_fields)
-        for key, *_ in new_fields:
-            result[key] = self[key]
-        return result if copy else self._reset(result._data)
+        if copy:
+            result = self.allocate(len(self), new_fields)
+            for key, *_ in new_fields:
+                result[key] = self[key]
+            return result
+
+        # Remove fields in place, last first so that less data moves, then
+        # give the freed memory back
+        keep = {f[0] for f in new_fields}
+        for name in reversed(self.fields()):
+            if name not in keep:
+                if self._lazy:
+                    self._lazy.pop(name, None)
+                assert self._data.dropcol(name), f"Could not remove field {name}"
+        self._data.defrag(True)
+        return self._reset()
 
     def filter_prefixes(self, prefixes: Collection[str], copy: bool = False):
         """
@@ -1041,8 +1850,18 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
         else:
             fm = field_map
 
-        result = type(self)([(f if f == "uid" else fm(f), self[f]) for f in self])
-        return result if copy else self._reset(result._data)
+        result = type(self)(self) if copy else self
+        renames = [(f, fm(f)) for f in result if f != "uid" and fm(f) != f]
+        if any(result._data.has(new) for _, new in renames):
+            # some fields take the names of others, so move them out of the way first
+            temps = [f"__rename_{i}" for i in range(len(renames))]
+            renames = [(f, t) for (f, _), t in zip(renames, temps)] + [(t, new) for (_, new), t in zip(renames, temps)]
+        for old, new in renames:
+            assert result._data.renamecol(old, new), f"Could not rename field {old} to {new}"
+            if result._lazy and old in result._lazy:
+                path, field, pos, fieldcodec = result._lazy.pop(old)
+                result._lazy[new] = (path, (new, *field[1:]), pos, fieldcodec)  # type: ignore
+        return result._reset()
 
     def rename_field(self, current_name: str, new_name: str, copy: bool = False):
         """
@@ -1081,6 +1900,34 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
 
         return self.rename_fields(field_map, copy=copy)
 
+    def cast_fields(self, dtypes: Mapping[str, "DTypeLike"], copy: bool = False):
+        """
+        Convert the values of the given numeric fields to other numeric types,
+        e.g., to store ``float64`` fields as ``float32`` before saving. Floats
+        converted to integers are truncated and saturate at the limits of the
+        integer type. Array fields keep their shape.
+
+        Args:
+            dtypes (Mapping[str, DTypeLike]): New numeric type of each field
+                to convert
+            copy (bool, optional): If True, return a copy of the dataset rather
+                than mutate. Defaults to False.
+
+        Returns:
+            Dataset: current dataset or copy with converted fields
+
+        Examples:
+
+            >>> dset.cast_fields({"blob/idx": n.uint16, "ctf/df1_A": n.float32})
+        """
+        result = type(self)(self) if copy else self
+        for name, dtype in dtypes.items():
+            dt = n.dtype(dtype)
+            assert dt.type in TYPE_TO_DSET_MAP, f"Unsupported column data type {dt}"
+            result._load_lazy(name)
+            assert result._data.castcol(name, TYPE_TO_DSET_MAP[dt.type]), f"Could not convert {name} to {dt}"
+        return result._reset()
+
     def copy_fields(self, old_fields: List[str], new_fields: List[str]):
         """
         Copy the values at the given old fields into the new fields, allocating
@@ -1157,6 +2004,44 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
         dtype = [(f, arraydtype(a)) for f, a in zip(cols, arrays)]
         return numpy.core.records.fromarrays(arrays, dtype=dtype)
 
+    def to_arrow(self):
+        """
+        Convert to an Arrow record batch without copying numeric fields.
+        Requires the ``pyarrow`` package.
+
+        Array fields become fixed-size lists of their (flattened) elements and
+        complex numbers become fixed-size lists of their real and imaginary
+        parts. String fields become Arrow ``large_string`` columns built from
+        the dataset's C strings.
+
+        Note:
+            The result refers to this dataset's memory. Adding fields or rows
+            invalidates it, similar to a ``Column`` instance.
+
+        Also available through the Arrow PyCapsule interface, so other Arrow
+        libraries can read datasets directly (e.g., ``polars.from_arrow``).
+
+        Returns:
+            pyarrow.RecordBatch: Record batch with a column for each field.
+        """
+        import pyarrow
+
+        return pyarrow.record_batch(self)
+
+    def __arrow_c_schema__(self):
+        return self._arrow_data().arrow_capsules(schema_only=True)[0]
+
+    def __arrow_c_array__(self, requested_schema=None):
+        return self._arrow_data().arrow_capsules()
+
+    def _arrow_data(self) -> Data:
+        # Python string columns cannot be exported, so export a copy of the
+        # dataset with C strings instead
+        self._load_lazy()
+        if any(self._data.type(f) == DsetType.T_OBJ for f in self):
+            return self.to_cstrs(copy=True)._data
+        return self._data
+
     def query(self, query: Union[Dict[str, "ArrayLike"], Callable[[R], bool]]):
         """
         Get a subset of data based on whether the fields match the values in the
@@ -1218,9 +2103,32 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
         Returns:
             NDArray[bool]: Query mask, may be used with the ``mask()`` method.
         """
-        query_fields = set(self.fields()).intersection(query.keys())
-        mask = n.ones(len(self), dtype=bool)
+        query_fields = [f for f in self.fields() if f in query]
+
+        # fields with scalar numbers or strings are matched natively in one
+        # pass, anything else with numpy
+        fields, values, others = [], [], []
         for field in query_fields:
+            dtype, kind = self[field].dtype, self._data.type(field)
+            queried = n.asarray(query[field]).reshape(-1)
+            if kind == DsetType.T_OBJ:
+                fields.append(field)
+                values.append(set(queried.tolist()))
+            elif kind == DsetType.T_STR:
+                fields.append(field)
+                values.append([v.encode() if isinstance(v, str) else bytes(v) for v in queried.tolist()])
+            elif len(self[field].shape) == 1 and dtype.kind in "iuf" and queried.dtype.kind in "biuf":
+                # only values that the field's type can represent exactly can match
+                cast = queried.astype(dtype)
+                fields.append(field)
+                values.append(n.ascontiguousarray(cast[cast == queried]))
+            else:
+                others.append(field)
+
+        mask = n.empty(len(self), dtype=n.uint8)
+        assert self._data.query_mask(fields, values, mask), f"Could not query dataset fields {fields}"
+        mask = mask.view(n.bool_)
+        for field in others:
             mask &= n.isin(self[field], query[field])
 
         return n.invert(mask, out=mask) if invert else mask
@@ -1248,7 +2156,32 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
         Returns:
             Dataset: subset with matching row indices
         """
-        return type(self)([(f, self[f][indices]) for f in self])
+        rows = self._row_indices(indices)
+        self._load_lazy()
+        return type(self)(self._data.take(rows))
+
+    def _row_indices(self, indices: Union[slice, List[int], "NDArray"]) -> "NDArray":
+        # Same as n.arange(len(self))[indices] as contiguous uint64 row numbers,
+        # but in time and space proportional to the number of selected rows
+        size = len(self)
+        if isinstance(indices, slice):
+            return n.arange(*indices.indices(size), dtype=n.uint64)
+        idx = n.asarray(indices).reshape(-1)
+        if idx.dtype == n.bool_:
+            if len(idx) != size:
+                raise IndexError(f"Boolean index with size {len(idx)} does not match dataset size {size}")
+            return n.flatnonzero(idx).astype(n.uint64)
+        if len(idx) == 0:
+            return n.zeros(0, dtype=n.uint64)
+        if idx.dtype.kind not in "iu":
+            raise IndexError(f"Dataset rows must be selected with integers, not {idx.dtype}")
+        lo, hi = idx.min(), idx.max()
+        if hi >= size or (idx.dtype.kind == "i" and lo < -size):
+            raise IndexError(f"Row index {hi if hi >= size else lo} is out of bounds for dataset with size {size}")
+        if idx.dtype.kind == "i" and lo < 0:
+            idx = idx.astype(n.int64)
+            idx[idx < 0] += size
+        return n.ascontiguousarray(idx, dtype=n.uint64)
 
     def mask(self, mask: Union[List[bool], "NDArray"]):
         """
@@ -1262,7 +2195,9 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
             Dataset: subset with only matching rows
         """
         assert len(mask) == len(self), f"Mask with size {len(mask)} does not match expected dataset size {len(self)}"
-        return type(self)([(f, self[f][mask]) for f in self])
+        mask = n.ascontiguousarray(mask, dtype=bool)
+        self._load_lazy()
+        return type(self)(self._data.mask(mask.view(n.uint8)))
 
     def slice(self, start: int = 0, stop: Optional[int] = None, step: int = 1):
         """
@@ -1279,7 +2214,37 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
         Returns:
             Dataset: subset with slice of matching rows
         """
-        return type(self)([(f, self[f][slice(start, stop, step)]) for f in self])
+        return self.take(self._row_indices(slice(start, stop, step)))
+
+    def view(self, start: int = 0, stop: Optional[int] = None, fields: Optional[Collection[str]] = None):
+        """
+        Get a view of the dataset with rows in the given range, without
+        copying them. Fields of the view share memory with this dataset, so
+        changes to the values of either are seen in both. Fields cannot be
+        added to or removed from a view and other operations such as
+        ``take()`` are not available; copy the view with ``Dataset(view)``
+        first.
+
+        Args:
+            start (int, optional): Start index of the view (inclusive).
+                Defaults to 0.
+            stop (int, optional): End index of the view (exclusive). Defaults
+                to length of dataset.
+            fields (list[str], optional): Only include these fields (and
+                ``uid``) in the view. Defaults to all fields.
+
+        Returns:
+            Dataset: view of the matching rows
+
+        Examples:
+
+            >>> for start in range(0, len(particles), 10000):
+            ...     process(particles.view(start, start + 10000))
+        """
+        start, stop, _ = slice(start, stop).indices(len(self))
+        names = None if fields is None else [f for f in self if f == "uid" or f in fields]
+        self._load_lazy(*(names or []))
+        return type(self)(self._data.view(start, stop, names))
 
     def split_by(self, field: str):
         """
@@ -1299,15 +2264,178 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
             }
 
         """
-        cols = self.cols()
-        col = cols[field]
-        idxs: Dict[Any, List[int]] = {}
-        for idx, val in enumerate(col):
-            curr = idxs.get(val, [])
-            curr.append(idx)
-            idxs[val] = curr
+        order, offsets = self.groupby(field)
+        col = self[field]
+        firsts = order[offsets[:-1]]  # keep groups in order of first appearance
+        return {col[firsts[g]]: self.take(order[offsets[g] : offsets[g + 1]]) for g in n.argsort(firsts)}
+
+    def argsort(self, *fields: str) -> "NDArray[n.uint64]":
+        """
+        Get the indexes of the rows of this dataset in order of the values of
+        the given fields. Rows are compared by the first field, then by the
+        next field where the first is equal, etc. Rows with equal values keep
+        their order. Strings are compared by text and NaN sorts after all
+        other numbers. Fields must have one number or string per row.
 
-        return {val: self.take(idx) for val, idx in idxs.items()}
+        Args:
+            *fields (str): Fields to sort by
+
+        Returns:
+            NDArray[uint64]: Row indexes, e.g., to use with ``take()``
+
+        Examples:
+
+            >>> dset.take(dset.argsort('location/micrograph_path', 'location/center_x_frac'))
+        """
+        assert fields, "Specify at least one field to sort by"
+        order = n.empty(len(self), dtype=n.uint64)
+        assert self._sort_data(fields).argsort(list(fields), order), f"Could not sort dataset by fields {fields}"
+        return order
+
+    def groupby(self, field: str, reorder: bool = False) -> Tuple["NDArray[n.uint64]", "NDArray[n.uint64]"]:
+        """
+        Group the rows of this dataset by the value of the given field, with
+        the same ordering as ``argsort()``. Rows in each group keep their
+        order.
+
+        Args:
+            field (str): Field to group by
+            reorder (bool, optional): If True, also move the rows of this
+                dataset so that each group is a contiguous range of rows.
+                Defaults to False.
+
+        Returns:
+            tuple[NDArray[uint64], NDArray[uint64]]: Row indexes ``order`` and
+                group ``offsets``. Group ``i`` is the rows at indexes
+                ``order[offsets[i]:offsets[i + 1]]``. If reordered, group
+                ``i`` is rows ``offsets[i]`` to ``offsets[i + 1] - 1`` and
+                ``order`` has the previous index of each row.
+
+        Examples:
+
+            >>> order, offsets = particles.groupby('location/micrograph_uid', reorder=True)
+            >>> for start, stop in zip(offsets[:-1], offsets[1:]):
+            ...     process(particles.view(start, stop))
+        """
+        order = n.empty(len(self), dtype=n.uint64)
+        offsets = n.empty(len(self) + 1, dtype=n.uint64)
+        data = self._sort_data([field])
+        if reorder:
+            self._load_lazy()
+        inplace = reorder and data is self._data
+        ngroup = data.groupby(field, order, offsets, inplace)
+        assert ngroup >= 0, f"Could not group dataset by field {field}"
+        if inplace:
+            self._reset()
+        elif reorder:
+            self._reset(self._data.take(order))
+        return order, offsets[: ngroup + 1]
+
+    def transform(self, field: str, scale: "ArrayLike" = 1.0, offset: "ArrayLike" = 0.0):
+        """
+        Replace each value of the given floating-point field with
+        ``value * scale + offset`` in one pass, without temporary arrays.
+        For a field with multiple values per row, scale and offset may be
+        given per value.
+
+        Args:
+            field (str): Field to transform
+            scale (ArrayLike, optional): Scale factor or factors. Defaults
+                to 1.0.
+            offset (ArrayLike, optional): Value or values to add after
+                scaling. Defaults to 0.0.
+
+        Returns:
+            Dataset: current dataset, modified in place
+
+        Examples:
+
+            >>> particles.transform('alignments2D/shift', scale=old_psize / new_psize)
+        """
+        self._load_lazy(field)
+        shape = self._data.getshp(field)
+        size = int(n.prod(shape)) if shape else 1
+        scales = n.ascontiguousarray(n.broadcast_to(n.asarray(scale, dtype=n.float64), shape).reshape(size))
+        offsets = n.ascontiguousarray(n.broadcast_to(n.asarray(offset, dtype=n.float64), shape).reshape(size))
+        assert self._data.fma(field, scales, offsets), f"Could not transform field {field}"
+        return self
+
+    def reduce(self, field: str, by: Optional[str] = None) -> Dict[str, "NDArray"]:
+        """
+        Compute the minimum, maximum, sum and mean of the given numeric field
+        in one pass, optionally for each group of rows with the same value of
+        another field. NaN values make the result NaN, as with numpy.
+
+        Args:
+            field (str): Numeric field to reduce
+            by (str, optional): Field to group rows by. Defaults to None.
+
+        Returns:
+            dict[str, NDArray]: Arrays ``min``, ``max``, ``sum``, ``mean`` and
+                ``count``. If grouped, also ``groups``, the value of ``by`` in
+                each group. Each has one entry per group (sorted as with
+                ``groupby()``) and the shape of a row of the field.
+
+        Examples:
+
+            >>> stats = particles.reduce('ctf/df1_A', by='location/micrograph_uid')
+            >>> stats['groups'], stats['mean']
+        """
+        self._load_lazy(field)
+        shape = self._data.getshp(field)
+        order, offsets = self.groupby(by) if by else (None, n.array([0, len(self)], dtype=n.uint64))
+        ngroup = len(offsets) - 1
+        mins, maxs, sums = (n.empty((ngroup, *shape), dtype=n.float64) for _ in range(3))
+        assert self._data.reduce(
+            field, order, offsets, mins.reshape(-1), maxs.reshape(-1), sums.reshape(-1)
+        ), f"Could not reduce field {field}"
+        counts = n.diff(offsets).astype(n.int64)
+        with n.errstate(invalid="ignore", divide="ignore"):
+            means = sums / counts.reshape((ngroup,) + (1,) * len(shape))
+        result = {"min": mins, "max": maxs, "sum": sums, "mean": means, "count": counts}
+        if not by:
+            return {k: v[0] for k, v in result.items()}
+        result["groups"] = self[by][order[offsets[:-1]]]
+        return result
+
+    def histogram(self, field: str, bins: int = 10, range: Optional[Tuple[float, float]] = None):
+        """
+        Count values of the given numeric field in equal-width bins in one
+        pass, the same as ``numpy.histogram``.
+
+        Args:
+            field (str): Numeric field
+            bins (int, optional): Number of bins. Defaults to 10.
+            range (tuple[float, float], optional): Lower and upper edges of
+                the bins. Defaults to the minimum and maximum of the field.
+
+        Returns:
+            tuple[NDArray[int], NDArray[float]]: Count in each bin and the
+                ``bins + 1`` bin edges.
+
+        Examples:
+
+            >>> counts, edges = particles.histogram('ctf/df1_A', bins=50)
+        """
+        self._load_lazy(field)
+        if range is None:
+            stats = self.reduce(field)
+            lo, hi = (float(stats["min"].min()), float(stats["max"].max())) if len(self) else (0.0, 1.0)
+        else:
+            lo, hi = range
+        if lo == hi:
+            lo, hi = lo - 0.5, hi + 0.5
+        counts = n.zeros(bins, dtype=n.uint64)
+        assert self._data.histogram(field, lo, hi, counts), f"Could not compute histogram of field {field}"
+        return counts.astype(n.int64), n.linspace(lo, hi, bins + 1)
+
+    def _sort_data(self, fields: Collection[str]) -> Data:
+        # Data to sort by the given fields. Python strings cannot be compared
+        # natively, so sorts a copy of the fields with C strings instead
+        self._load_lazy(*fields)
+        if all(self._data.type(f) != DsetType.T_OBJ for f in fields):
+            return self._data
+        return self.filter_fields(fields, copy=True).to_cstrs()._data
 
     def replace(self, query: Dict[str, "ArrayLike"], *others: "Dataset", assume_disjoint=False, assume_unique=False):
         """
@@ -1369,6 +2497,7 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
             Dataset: same dataset or copy if specified.
         """
         dset = self.copy() if copy else self
+        dset._load_lazy()
         for k in dset:
             if dset._data.type(k) == DsetType.T_OBJ:
                 assert dset._data.tocstrs(k), f"Could not convert column {k} to C strings"
@@ -1388,6 +2517,7 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
             Dataset: same dataset or copy if specified.
         """
         dset = self.copy() if copy else self
+        dset._load_lazy()
         for k in dset:
             if dset._data.type(k) == DsetType.T_STR:
                 assert dset._data.topystrs(k), f"Could not convert column {k} to Python strings"
@@ -1402,6 +2532,7 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
             int: Dataset handle that may be used with C API defined in
                 `<cryosparc-tools/dataset.h>`
         """
+        self._load_lazy()
         return self._data.handle()
 
     def __repr__(self) -> str:
@@ -1423,6 +2554,8 @@ class Dataset(MutableMapping[str, Column], Generic[R]):
         return s
 
     def _reset(self, data: Optional[Data] = None):
+        if data:
+            self._lazy = None  # new data already has every field loaded
         self._data = data or self._data
 
         # Check if rows can be preserved
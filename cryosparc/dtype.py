@@ -44,8 +44,58 @@ class DatasetHeader(TypedDict):
     """
 
     dtype: List[Field]
-    compression: Literal["snap"]
+    compression: Literal["snap", "field"]
+    """
+    ``"snap"`` if all compressed fields use snappy or ``"field"`` if each
+    field's codec is given in ``codecs``.
+    """
     compressed_fields: List[str]
+    codecs: Dict[str, str]
+    """
+    Codec of each compressed field when ``compression`` is ``"field"``. See
+    ``cryosparc.codec``.
+    """
+    offsets: List[int]
+    """
+    Byte offset of each field's data, relative to the end of the header.
+    Empty unless recorded by the writer; ``Dataset.stream`` does not record
+    them so that it can write each field as soon as it is encoded.
+    """
+
+
+class RowgroupField(TypedDict):
+    """
+    Description of a field added to an existing ``ROWGROUP_FORMAT`` file.
+    """
+
+    field: Field
+    codec: str
+    group: int
+    """
+    Index of the first row group that includes this field's data. Earlier
+    groups were written before the field was added.
+    """
+    blobs: List[int]
+    """
+    Byte offset of this field's data for each earlier group, relative to the
+    end of the header.
+    """
+
+
+class RowgroupIndex(TypedDict):
+    """
+    Footer of a ``ROWGROUP_FORMAT`` file.
+    """
+
+    groups: List[Tuple[int, int]]
+    """
+    Byte offset relative to the end of the header and number of rows of
+    each group.
+    """
+    fields: List[RowgroupField]
+    """
+    Fields added after the file was first written, in the order added.
+    """
 
 
 DSET_TO_TYPE_MAP: Dict[DsetType, Type] = {
@@ -134,16 +184,67 @@ def decode_dataset_header(data: Union[bytes, dict]) -> DatasetHeader:
             header["dtype"], list
         ), 'Dataset header "dtype" key missing or has incorrect type'
         assert (
-            "compression" in header and header["compression"] == "snap"
+            "compression" in header and header["compression"] in ("snap", "field")
         ), 'Dataset header "compression" key missing or has incorrect type'
         assert (
             "compressed_fields" and header or isinstance(header["compressed_fields"], list)
         ), 'Dataset header "compressed_fields" key missing or has incorrect type'
 
         dtype: List[Field] = [(f, d, tuple(rest[0])) if rest else (f, d) for f, d, *rest in header["dtype"]]
-        compression: Literal["snap"] = header["compression"]
+        compression: Literal["snap", "field"] = header["compression"]
         compressed_fields: List[str] = header["compressed_fields"]
-
-        return DatasetHeader(dtype=dtype, compression=compression, compressed_fields=compressed_fields)
+        codecs: Dict[str, str] = header.get("codecs", {})
+        assert isinstance(codecs, dict), 'Dataset header "codecs" key has incorrect type'
+        offsets: List[int] = header.get("offsets", [])
+        assert isinstance(offsets, list) and (
+            not offsets or len(offsets) == len(dtype)
+        ), 'Dataset header "offsets" key has incorrect type or length'
+
+        return DatasetHeader(
+            dtype=dtype,
+            compression=compression,
+            compressed_fields=compressed_fields,
+            codecs=codecs,
+            offsets=offsets,
+        )
     except Exception as e:
         raise ValueError(f"Incorrect dataset field format: {data.decode() if isinstance(data, bytes) else data}") from e
+
+
+def encode_rowgroup_index(groups: List[Tuple[int, int]], fields: List[RowgroupField] = []) -> bytes:
+    index: dict = {"groups": groups}
+    if fields:  # omitted so that files without added fields stay the same
+        index["fields"] = fields
+    return json.dumps(index).encode()
+
+
+def decode_rowgroup_index(data: bytes) -> RowgroupIndex:
+    try:
+        index = json.loads(data)
+        assert isinstance(index, dict) and isinstance(index.get("groups"), list), "Row group index missing groups"
+        assert isinstance(index.get("fields", []), list), 'Row group index "fields" key has incorrect type'
+        return RowgroupIndex(
+            groups=[(int(offset), int(nrow)) for offset, nrow in index["groups"]],
+            fields=[decode_rowgroup_field(f) for f in index.get("fields", [])],
+        )
+    except Exception as e:
+        raise ValueError(f"Incorrect dataset row group index: {data.decode()}") from e
+
+
+def encode_rowgroup_field(field: RowgroupField) -> bytes:
+    return json.dumps({"field": field["field"], "codec": field["codec"]}).encode()
+
+
+def decode_rowgroup_field(data: Union[bytes, dict]) -> RowgroupField:
+    try:
+        f = json.loads(data) if isinstance(data, bytes) else data
+        name, dt, *rest = f["field"]
+        return RowgroupField(
+            field=(name, dt, tuple(rest[0])) if rest else (name, dt),
+            codec=str(f["codec"]),
+            group=int(f.get("group", 0)),
+            blobs=[int(offset) for offset in f.get("blobs", [])],
+        )
+    except Exception as e:
+        data = data.decode() if isinstance(data, bytes) else data
+        raise ValueError(f"Incorrect dataset row group field: {data}") from e
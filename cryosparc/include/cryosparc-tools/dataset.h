@@ -49,10 +49,75 @@ enum dset_type {
 	T_OBJ = 14,
 };
 
+/*
+	Arrow C data interface, for exporting datasets to Arrow-based libraries
+	without copying. See https://arrow.apache.org/docs/format/CDataInterface.html
+*/
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+	const char *format;
+	const char *name;
+	const char *metadata;
+	int64_t flags;
+	int64_t n_children;
+	struct ArrowSchema **children;
+	struct ArrowSchema *dictionary;
+	void (*release)(struct ArrowSchema *);
+	void *private_data;
+};
+
+struct ArrowArray {
+	int64_t length;
+	int64_t null_count;
+	int64_t offset;
+	int64_t n_buffers;
+	int64_t n_children;
+	const void **buffers;
+	struct ArrowArray **children;
+	struct ArrowArray *dictionary;
+	void (*release)(struct ArrowArray *);
+	void *private_data;
+};
+
+#endif
+
 uint64_t  dset_new (void);
+uint64_t  dset_new_sized (uint32_t ncol_hint, uint64_t nrow_hint, uint64_t strheap_hint);
 void      dset_del (uint64_t dset);
 uint64_t  dset_copy (uint64_t dset);
+uint64_t  dset_view (uint64_t dset, uint64_t start, uint64_t nrow, uint32_t ncol, const char **keys);
+uint64_t  dset_mmap (const char *path, int readonly);
+int       dset_share (uint64_t dset, const char *name);
+uint64_t  dset_attach (const char *name, int readonly);
+int       dset_unshare (const char *name);
+int       dset_save_image (uint64_t dset, const char *path);
 uint64_t  dset_innerjoin (const char *key, uint64_t dset_r, uint64_t dset_s);
+uint64_t  dset_innerjoin_many (const char *key, uint32_t n, const uint64_t *dsets);
+uint64_t  dset_append_many (const char *key, uint32_t n, const uint64_t *dsets);
+uint64_t  dset_union_many (const char *key, uint32_t n, const uint64_t *dsets);
+uint64_t  dset_interlace (const char *key, uint32_t n, const uint64_t *dsets);
+uint64_t  dset_take (uint64_t dset, const uint64_t *indices, uint64_t n);
+uint64_t  dset_mask (uint64_t dset, const uint8_t *mask);
+int       dset_query_mask (uint64_t dset, uint32_t nfields, const char **keys, const uint64_t *nvalues, const void **values, uint8_t *mask);
+int       dset_argsort (uint64_t dset, uint32_t nkeys, const char **keys, uint64_t *order);
+uint64_t  dset_groupby (uint64_t dset, const char *key, uint64_t *order, uint64_t *offsets, int reorder);
+
+int       dset_convert (uint64_t dset, const char *key, int type, void *out);
+int       dset_fma (uint64_t dset, const char *key, const double *scale, const double *offset);
+int       dset_reduce (uint64_t dset, const char *key, uint64_t ngroup, const uint64_t *order, const uint64_t *offsets, double *min, double *max, double *sum);
+int       dset_histogram (uint64_t dset, const char *key, double lo, double hi, uint32_t nbins, uint64_t *counts);
+
+// Allocate the memory of new datasets from large slabs that are released
+// together. See the arena section below.
+uint64_t  dset_arena_new (uint64_t slabsz);
+int       dset_arena_use (uint64_t arena);
+void      dset_arena_del (uint64_t arena);
 
 uint64_t    dset_totalsz(uint64_t dset);
 uint32_t    dset_ncol   (uint64_t dset);
@@ -63,14 +128,118 @@ void *      dset_get    (uint64_t dset, const char * colkey);
 uint64_t    dset_getsz  (uint64_t dset, const char * colkey);
 int         dset_setstr (uint64_t dset, const char * colkey, uint64_t index, const char * value);
 const char* dset_getstr (uint64_t dset, const char * colkey, uint64_t index);
+int         dset_setstrs (uint64_t dset, const char * colkey, uint64_t start, uint64_t n, const char ** values);
+int         dset_getstrs (uint64_t dset, const char * colkey, uint64_t start, uint64_t n, const char ** out);
 uint32_t    dset_getshp (uint64_t dset, const char * colkey);
 
+// Look up a column once and access it by integer index afterwards. Indexes
+// are stable while no columns are removed.
+uint64_t    dset_colindex  (uint64_t dset, const char * colkey);
+int         dset_type_at   (uint64_t dset, uint64_t colindex);
+void *      dset_get_at    (uint64_t dset, uint64_t colindex);
+uint64_t    dset_getsz_at  (uint64_t dset, uint64_t colindex);
+uint32_t    dset_getshp_at (uint64_t dset, uint64_t colindex);
+
 int        dset_addrows       (uint64_t dset, uint32_t num);
+int        dset_reserve       (uint64_t dset, uint64_t nrow, uint64_t strheap_bytes);
 int        dset_addcol_scalar (uint64_t dset, const char * key, int type);
 int        dset_addcol_array  (uint64_t dset, const char * key, int type, int shape0, int shape1, int shape2);
 int        dset_changecol     (uint64_t dset, const char * key, int type);
+int        dset_castcol       (uint64_t dset, const char * key, int type);
+int        dset_dropcol       (uint64_t dset, const char * key);
+int        dset_renamecol     (uint64_t dset, const char * key, const char * newkey);
 
 int        dset_defrag (uint64_t dset, int realloc_smaller);
+void       dset_setnthreads (uint32_t nthreads);
+void       dset_setgrowth (uint32_t percent, uint64_t max_bytes);
+
+// Concurrent readers, see dset_setconcurrent below
+int        dset_setconcurrent (uint64_t dset, int enable);
+int        dset_pin           (uint64_t dset);
+int        dset_unpin         (uint64_t dset);
+
+uint64_t   dset_compress_bound (uint64_t n);
+int        dset_compress (uint32_t n, const void **src, const uint64_t *srcsz, void **dst, uint64_t *dstsz);
+uint64_t   dset_decompressed_size (const void *src, uint64_t srcsz);
+int        dset_decompress (uint32_t n, const void **src, const uint64_t *srcsz, void **dst, const uint64_t *dstsz);
+int        dset_shuffle (const void *src, void *dst, uint64_t size, uint32_t elsize);
+int        dset_unshuffle (const void *src, void *dst, uint64_t size, uint32_t elsize);
+
+// Incremental decoder for CSDAT field data, see dset_stream_new below
+enum dset_codec {
+	DSCODEC_NONE = 0,
+	DSCODEC_SNAP = 1,
+};
+
+typedef struct ds_stream_field {
+	const char *key;
+	int         type;     // T_STR for fixed-width strings
+	int         shape[3];
+	uint32_t    itemsize; // bytes per row in the stream, e.g., the width of strings
+	uint32_t    shuffle;  // element size that the data was byte-shuffled with, 0 if not shuffled
+	int         codec;    // see enum dset_codec
+	int         wanted;   // decode this field, otherwise skip it
+} ds_stream_field;
+
+typedef struct ds_stream ds_stream;
+
+ds_stream *dset_stream_new (uint32_t nfield, const ds_stream_field *fields);
+int        dset_stream_feed (ds_stream *s, const void *data, uint64_t size);
+uint64_t   dset_stream_need (const ds_stream *s);
+uint64_t   dset_stream_dataset (const ds_stream *s, uint32_t *ndone);
+uint64_t   dset_stream_finish (ds_stream *s);
+void       dset_stream_del (ds_stream *s);
+
+uint64_t   dset_read_star (const char *text, uint64_t size, uint32_t ncol, const char **labels, const int *types, uint64_t *end);
+uint64_t   dset_format_star (uint64_t dset, uint32_t ncol, const uint64_t *cols, uint64_t start, char *buf, uint64_t bufsz, uint64_t *used);
+int        dset_export_arrow (uint64_t dset, struct ArrowSchema *schema, struct ArrowArray *array, void (*done)(void *), void *ctx);
+
+/*
+	Runtime statistics from dset_stats. Counts, bytes and times (in
+	nanoseconds) are totals since the dataset was created. Module totals also
+	include datasets that have since been deleted.
+*/
+typedef struct ds_stats {
+	// layout of the dataset
+	uint64_t total_sz;
+	uint64_t nrow;
+	uint64_t crow;
+	uint32_t ncol;
+	uint32_t ccol;
+	uint64_t arrheap_sz; // bytes reserved by columns
+	uint64_t arrheap_capacity;
+	uint64_t strheap_sz;
+	uint64_t strheap_capacity;
+	uint64_t strheap_freed;
+
+	// expensive operations on the dataset, as printed by dset_dumptxt
+	uint32_t nrealloc;
+	uint32_t nreassign_arroffsets;
+	uint32_t nshift_strhandles;
+	uint32_t nmore_arrheap;
+	uint32_t nmore_strheap;
+	uint32_t nmore_colspace;
+
+	uint64_t bytes_moved;  // copied by reallocation, heap re-layout and compaction
+	uint64_t resize_ns;    // spent resizing and re-laying out the heaps
+	uint64_t string_ns;    // spent in bulk string assignment and string heap compaction
+	uint64_t nintern;      // strings looked up in the intern index when assigned
+	uint64_t nintern_hits; // lookups that reused a string instead of adding it to the heap
+
+	// all datasets
+	uint64_t module_bytes_moved;
+	uint64_t module_resize_ns;
+	uint64_t module_string_ns;
+	uint64_t module_nintern;
+	uint64_t module_nintern_hits;
+	uint64_t module_join_ns; // spent in inner joins, appends, unions and interlaces
+	uint64_t module_njoin;
+	uint64_t module_nslots;  // dataset slots allocated
+	uint64_t module_nslots_used;
+	uint64_t module_narenas;
+} ds_stats;
+
+int        dset_stats (uint64_t dset, ds_stats *out);
 void       dset_dumptxt (uint64_t dset);
 void *     dset_dump (uint64_t dset);
 
@@ -93,6 +262,7 @@ void *     dset_dump (uint64_t dset);
 #include <errno.h>
 #include <assert.h>
 #include <stdarg.h>    // functions with variable number of arguments (e.g. error message callback)
+#include <math.h>      // INFINITY
 
 #ifdef _WIN32
 
@@ -110,6 +280,24 @@ typedef HANDLE ds_mutex_t;
 typedef INIT_ONCE ds_once_t;
 typedef	DWORD ds_mutex_lock_t;
 
+// aligned 64-bit volatile accesses are atomic with acquire/release semantics
+#define DSATOMIC_LOAD(x) (*(volatile uint64_t *) &(x))
+#define DSATOMIC_STORE(x, val) (*(volatile uint64_t *) &(x) = (val))
+#define DSATOMIC_FETCH_ADD(x, val) ((uint64_t) InterlockedExchangeAdd64((volatile LONG64 *) &(x), (LONG64) (val)))
+
+typedef HANDLE ds_thread_t;
+#define DSTHREAD_RETURN DWORD WINAPI
+#define DSTHREAD_CREATE(thread, fn, arg) (((thread) = CreateThread(NULL, 0, fn, arg, 0, NULL)) != NULL)
+#define DSTHREAD_JOIN(thread) (WaitForSingleObject(thread, INFINITE), CloseHandle(thread))
+
+typedef SRWLOCK ds_rwlock_t;
+#define DSRWLOCK_INIT(l) (InitializeSRWLock(l), 1)
+#define DSRWLOCK_DESTROY(l) ((void) (l))
+#define DSRWLOCK_RDLOCK(l) AcquireSRWLockShared(l)
+#define DSRWLOCK_RDUNLOCK(l) ReleaseSRWLockShared(l)
+#define DSRWLOCK_WRLOCK(l) AcquireSRWLockExclusive(l)
+#define DSRWLOCK_WRUNLOCK(l) ReleaseSRWLockExclusive(l)
+
 #else
 #include <stdalign.h>
 #include <stdnoreturn.h>
@@ -125,6 +313,28 @@ typedef	DWORD ds_mutex_lock_t;
 typedef pthread_mutex_t ds_mutex_t;
 typedef pthread_once_t ds_once_t;
 typedef	int ds_mutex_lock_t;
+
+#define DSATOMIC_LOAD(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define DSATOMIC_STORE(x, val) __atomic_store_n(&(x), (val), __ATOMIC_RELEASE)
+#define DSATOMIC_FETCH_ADD(x, val) __atomic_fetch_add(&(x), (val), __ATOMIC_ACQ_REL)
+
+#include <unistd.h>    // sysconf, close
+#include <fcntl.h>     // open
+#include <sys/mman.h>  // mmap, munmap
+#include <sys/stat.h>  // fstat
+#include <time.h>      // clock_gettime
+typedef pthread_t ds_thread_t;
+#define DSTHREAD_RETURN void *
+#define DSTHREAD_CREATE(thread, fn, arg) (pthread_create(&(thread), NULL, fn, arg) == 0)
+#define DSTHREAD_JOIN(thread) pthread_join(thread, NULL)
+
+typedef pthread_rwlock_t ds_rwlock_t;
+#define DSRWLOCK_INIT(l) (pthread_rwlock_init(l, NULL) == 0)
+#define DSRWLOCK_DESTROY(l) pthread_rwlock_destroy(l)
+#define DSRWLOCK_RDLOCK(l) xassert(pthread_rwlock_rdlock(l) == 0)
+#define DSRWLOCK_RDUNLOCK(l) xassert(pthread_rwlock_unlock(l) == 0)
+#define DSRWLOCK_WRLOCK(l) xassert(pthread_rwlock_wrlock(l) == 0)
+#define DSRWLOCK_WRUNLOCK(l) xassert(pthread_rwlock_unlock(l) == 0)
 #endif
 
 /*
@@ -140,6 +350,22 @@ typedef	int ds_mutex_lock_t;
   #define DSFREE    free
 #endif
 
+/*
+	Growth policy for when a dataset runs out of reserved rows or memory.
+	Row capacity and total allocation size grow by DSGROWTH_PERCENT of their
+	current value (or however much is required, if more), but never reserve
+	more than DSGROWTH_MAX_BYTES beyond what is required. Define before
+	including this file to change the defaults, or call dset_setgrowth at run
+	time. Use dset_reserve to pre-size instead.
+*/
+#ifndef DSGROWTH_PERCENT
+#define DSGROWTH_PERCENT 50
+#endif
+
+#ifndef DSGROWTH_MAX_BYTES
+#define DSGROWTH_MAX_BYTES (UINT64_C(1) << 30)
+#endif
+
 
 
 
@@ -163,8 +389,8 @@ __attribute__ ((format (printf, 1, 2)))
 nonfatal(char *fmt, ...)
 {
 	char buf[1024];
-	char buf2[128];
-	char buf3[1024];
+	char buf2[128] = "";
+	char buf3[sizeof(buf) + sizeof(buf2) + 1]; // room for both and the newline
 
 	int e = errno;
 	if (e != 0) snprintf(buf2,sizeof(buf2)," (errno %d: %s)", e, strerror(e));
@@ -185,8 +411,8 @@ __attribute__ ((format (printf, 1, 2)))
 fatal(char *fmt, ...)
 {
 	char buf[1024];
-	char buf2[128];
-	char buf3[1024];
+	char buf2[128] = "";
+	char buf3[sizeof(buf) + sizeof(buf2) + 1]; // room for both and the newline
 
 	int e = errno;
 	if (e != 0) snprintf(buf2,sizeof(buf2)," (errno %d: %s)", e, strerror(e));
@@ -237,21 +463,267 @@ typedef struct {
 	uint64_t   arrheap_start; // offset where column data begins
 	uint64_t   strheap_start; // offset where string (and other data structure) heap begins
 	uint64_t   strheap_sz; // 
+	uint64_t   strheap_freed; // bytes in string heap that may no longer be referenced, reclaimed by strheap_compact
 	struct {
 		// lets track the number of times the more expensive operations occurr
 		// in the future we can improve the implementation based on what actually happens a lot
 		uint32_t nrealloc;   
 		uint32_t nreassign_arroffsets;
-		uint32_t nshift_strhandles;
+		uint32_t nshift_strhandles; // number of string heap compactions
 		uint32_t nmore_arrheap;
 		uint32_t nmore_strheap;
 		uint32_t nmore_colspace;
 	} stats;
+
+	// Open-addressing hash index from column key to column index, so that
+	// column lookup doesn't need to strcmp every key. Each non-zero entry
+	// packs the upper bits of the key hash with (column index + 1). Only
+	// the first ncolindexed columns are indexed; any beyond that are found
+	// with a linear scan.
+	#define DSCOLINDEX_EXP 9
+	#define DSCOLINDEX_SZ (1 << DSCOLINDEX_EXP)
+	#define DSCOLINDEX_MAX (DSCOLINDEX_SZ * 3 / 4)
+	uint32_t   ncolindexed;
+	uint32_t   colindex[DSCOLINDEX_SZ];
+
 	ds_column  columns[];
 
 } ds;
 
 
+/**
+ * Definitions for hash table where every key and value is 64 bits
+ * Based on https://nullprogram.com/blog/2022/08/08/
+ * Future work: Adapt for generic key/value types for the string buffer.
+ */
+
+// Invalid or unset hashtable entry (64 bit all ones)
+#define DSHT64_INVALID 0xffffffffffffffffU
+
+typedef uint64_t ds_ht64_row[2];
+
+/**
+ * Numeric hashtable where each key and value is a 64 bit integer
+ */
+typedef struct ds_ht64 {
+	ds_ht64_row *ht; // array of key/value pairs
+	int32_t len;
+	int32_t exp; // exponent that denotes total hashtable capacity
+} ds_ht64;
+
+// https://nullprogram.com/blog/2018/07/31/
+static inline uint64_t hash64(uint64_t x) {
+    x ^= x >> 32;
+    x *= 0xd6e8feb86659fd93U;
+    x ^= x >> 32;
+    x *= 0xd6e8feb86659fd93U;
+    x ^= x >> 32;
+    return x;
+}
+
+// Allocate a hashtable with the given size
+static void ht64_new(ds_ht64 *t, uint32_t sz) {
+	// Allocate the given size for the hash table t
+	uint32_t exp = 0;
+	do { exp++; } while ((1 << exp) < sz);
+	exp += 1; // at least double the required size for fast lookups
+
+	size_t totalsz = sizeof(ds_ht64_row) * ((size_t)1 << exp);
+	void *mem = DSREALLOC(0, totalsz);
+	t->ht = mem;
+	t->len =  0;
+	t->exp = exp;
+	if (!mem) {
+		nonfatal("ht64_new: out of memory");
+		t->exp = 0;
+		return;
+	}
+	// Initialize memory to -1 (all ones)
+	memset(mem, -1, totalsz);
+	xassert(t->ht[0][0] == DSHT64_INVALID) // verify that memset worked
+}
+
+// Free an allocated hash table
+static void ht64_del(ds_ht64 *t) {
+	if (t->ht) {
+	DSFREE(t->ht);
+	}
+	t->ht = 0;
+	t->len = 0;
+	t->exp = 0;
+}
+
+// Compute the next candidate index. Initialize idx to the hash.
+static inline int32_t ht64_lookup(uint64_t hash, int exp, int32_t idx) {
+	uint32_t mask = ((uint32_t)1 << exp) - 1;
+	uint32_t step = (hash >> (64 - exp)) | 1;
+	return (idx + step) & mask;
+}
+
+static inline int ht64_has(ds_ht64 *t, const uint64_t key) {
+	uint64_t h = hash64(key);
+	for (int32_t i = h;;) {
+		i = ht64_lookup(h, t->exp, i);
+		if (t->ht[i][0] == DSHT64_INVALID) return 0; // empty, does not exist
+		else if (t->ht[i][0] == key) return 1; // found
+		// otherwise keep looking
+	}
+	return 0;
+}
+
+// Find the value of key in the hash table. Put the result in val. Returns 1
+// (true) if located, 0 otherwise.
+static int ht64_find(ds_ht64 *t, const uint64_t key, uint64_t *val) {
+	uint64_t h = hash64(key);
+	for (int32_t i = h;;) {
+		i = ht64_lookup(h, t->exp, i);
+		if (t->ht[i][0] == DSHT64_INVALID) {
+			// empty
+			return 0;
+		} else if (t->ht[i][0] == key) {
+			// Found, populate result
+			*val = t->ht[i][1];
+			return 1;
+		}
+		// Otherwise keep looking
+	}
+	return 0;
+}
+
+// Insert a value into the hash table
+// Will overwrite val if the key already exists
+static int ht64_insert(ds_ht64 *t, const uint64_t key, const uint64_t val) {
+	if ((uint32_t) t->len == (uint32_t) (1 << t->exp)) {
+		// hash table is full
+		return 0;
+	}
+
+	uint64_t h = hash64(key);
+	for (int32_t i = h;;) {
+		i = ht64_lookup(h, t->exp, i);
+		if (t->ht[i][0] == DSHT64_INVALID || t->ht[i][0] == key) {
+			// empty or existing key, insert here
+			t->len++;
+			t->ht[i][0] = key;
+			t->ht[i][1] = val;
+			return 1;
+		}
+		// Otherwise keep looking for a spot to insert
+	}
+	return 0;
+}
+
+// Insert a value into the hash table without checking for an existing key.
+// Allows multiple entries with the same key. Table must have space available.
+static inline void ht64_insert_dup(ds_ht64 *t, const uint64_t key, const uint64_t val) {
+	uint64_t h = hash64(key);
+	for (int32_t i = h;;) {
+		i = ht64_lookup(h, t->exp, i);
+		if (t->ht[i][0] == DSHT64_INVALID) {
+			t->len++;
+			t->ht[i][0] = key;
+			t->ht[i][1] = val;
+			return;
+		}
+	}
+}
+
+// Make sure the hash table has capacity for at least sz entries at a load
+// factor of 1/2, rehashing existing entries into a larger table if required.
+// Allocates the table if it has not been allocated yet. Returns 1 on success,
+// 0 if out of memory (original table remains valid).
+static int ht64_reserve(ds_ht64 *t, uint32_t sz) {
+	if (t->ht && (uint64_t) sz * 2 <= ((uint64_t) 1 << t->exp)) return 1;
+
+	ds_ht64 grown;
+	uint32_t want = sz;
+	if (t->ht && want < (uint32_t) 1 << t->exp) want = (uint32_t) 1 << t->exp; // at least double
+	ht64_new(&grown, want);
+	if (!grown.ht) return 0;
+
+	if (t->ht) {
+		const uint64_t cap = (uint64_t) 1 << t->exp;
+		for (uint64_t i = 0; i < cap; i++) {
+			if (t->ht[i][0] != DSHT64_INVALID) ht64_insert_dup(&grown, t->ht[i][0], t->ht[i][1]);
+		}
+		DSFREE(t->ht);
+	}
+	*t = grown;
+	return 1;
+}
+
+// Create a deep copy of hash table src in dst. Returns 1 on success, 0 if out of
+// memory (in which case dst is left empty)
+static int ht64_copy(ds_ht64 *dst, const ds_ht64 *src) {
+	*dst = (ds_ht64) {0};
+	if (!src->ht) return 1;
+	const size_t totalsz = sizeof(ds_ht64_row) * ((size_t) 1 << src->exp);
+	void *mem = DSREALLOC(0, totalsz);
+	if (!mem) return 0;
+	memcpy(mem, src->ht, totalsz);
+	dst->ht = mem;
+	dst->len = src->len;
+	dst->exp = src->exp;
+	return 1;
+}
+
+/**
+ * String intern index. Maps the hash of each string in a dataset's string heap
+ * to that string's handle (offset relative to the start of the string heap) so
+ * that duplicate strings may be detected without scanning the heap. Distinct
+ * strings with the same hash get separate entries under the same key, so
+ * lookups must compare the actual strings.
+ */
+
+// FNV-1a. Also computes the string length since we need it anyway. Never
+// returns DSHT64_INVALID so that the result may be used as a hashtable key.
+static inline uint64_t strhash(const char *str, size_t *len) {
+	uint64_t h = 0xcbf29ce484222325U;
+	const char *p = str;
+	for (; *p; p++) { h ^= (uint8_t) *p; h *= 0x100000001b3U; }
+	*len = (size_t) (p - str);
+	return h == DSHT64_INVALID ? h - 1 : h;
+}
+
+// Find the handle of the given string with the given hash within strheap.
+// Returns DSHT64_INVALID if the string is not in the index.
+static inline uint64_t strindex_find(const ds_ht64 *t, const char *strheap, uint64_t h, const char *str) {
+	uint64_t hh = hash64(h);
+	for (int32_t i = hh;;) {
+		i = ht64_lookup(hh, t->exp, i);
+		if (t->ht[i][0] == DSHT64_INVALID) return DSHT64_INVALID;
+		if (t->ht[i][0] == h && !strcmp(strheap + t->ht[i][1], str)) return t->ht[i][1];
+	}
+	return DSHT64_INVALID;
+}
+
+// Record a newly-allocated string in the index. Returns 0 if out of memory.
+static inline int strindex_add(ds_ht64 *t, uint64_t h, uint64_t handle) {
+	if (!ht64_reserve(t, (uint32_t) t->len + 1)) return 0;
+	ht64_insert_dup(t, h, handle);
+	return 1;
+}
+
+// Populate the index from every string currently in the heap. Where the heap
+// contains duplicate strings, the first one is used.
+static int strindex_build(ds_ht64 *t, const char *strheap, uint64_t strheap_sz) {
+	uint64_t count = 0;
+	for (const char *p = strheap; p < strheap + strheap_sz; p += strlen(p) + 1) count++;
+
+	ht64_del(t);
+	if (!ht64_reserve(t, count > 16 ? (uint32_t) count : 16)) return 0;
+
+	size_t len;
+	for (const char *p = strheap; p < strheap + strheap_sz; p += len + 1) {
+		uint64_t h = strhash(p, &len);
+		if (strindex_find(t, strheap, h, p) == DSHT64_INVALID) {
+			ht64_insert_dup(t, h, (uint64_t) (p - strheap));
+		}
+	}
+	return 1;
+}
+
+
 /*
 	We'll be managing datasets via integer handles instead of via pointers.
 	The handle is a composite value containing an index and a "generation" counter.
@@ -261,15 +733,88 @@ typedef struct {
 	The generation counter is a way to make sure that if an index gets re-used, 
 	we can tell if an old handle that points to this index does indeed refer to this dset.
 	This detects the case the user accidentally kept a handle around after deleting a dset.
+
+	Slots are allocated in fixed-size pages that never move once allocated, so
+	handles may be looked up without holding the module lock while other
+	threads create or delete datasets. Unused slots form a FIFO free list so
+	that finding one is O(1), and so that a freed index is re-used as late as
+	possible.
+
+	A slot may also hold a view of a range of rows of another dataset (see
+	dset_view). Its memory is then a ds block with only the column layout and
+	no heaps; column data is found in the parent at access time. Only the
+	functions that look up handles with handle_lookup_any accept views.
 */
 
+// Runtime counters that are not part of the dataset's memory (which is saved
+// as-is in images), see dset_stats
+typedef struct {
+	uint64_t bytes_moved;
+	uint64_t resize_ns;
+	uint64_t string_ns;
+	uint64_t nintern;
+	uint64_t nintern_hits;
+} ds_counters;
+
 typedef struct {
 
 	ds         *memory;
 	uint16_t   generation;
+	ds_ht64    strindex; // string heap intern index. Built lazily, not present if ht is null
+	ds_ht64    strrefs;  // number of uses of each string handle, see strref_move. Built lazily like strindex
+	uint64_t   nextfree; // next slot index in the free list, if this slot is unused
+	void       *mapbase; // start of the file mapping if memory is in a mapped image, see dset_mmap
+	uint64_t   mapsz;
+	int        readonly; // mapping may not be modified
+	uint64_t   parent;   // handle of the viewed dataset if this is a view, otherwise 0
+	uint64_t   rowstart; // row of the parent where the view starts
+	uint32_t   arena;    // index + 1 of the arena that memory is allocated from, 0 if allocated with DSREALLOC
+	ds_counters counters;
+	ds_rwlock_t *pins;   // held shared by readers that pinned the dataset, see dset_setconcurrent. 0 if not enabled
+	uint32_t   nmoving;  // depth of nested moves holding pins exclusively, only used by the writing thread
 
 } ds_slot;
 
+#define DSSLOT_PAGE_EXP 12
+#define DSSLOT_PAGESZ   (1 << DSSLOT_PAGE_EXP)
+#define DSSLOT_MAXPAGES 4096
+#define DSSLOT_NONE     UINT64_MAX
+
+/*
+	Arenas. Creating thousands of small datasets (e.g., one per micrograph or
+	class) with one DSREALLOC each churns the allocator and fragments memory.
+	While an arena is in use (dset_arena_use), the memory of new datasets is
+	instead carved from large slabs that the arena allocates with DSREALLOC.
+	Each block records its capacity in a header so that it can be resized;
+	the most recent block in a slab grows and shrinks in place and other
+	blocks move to the end. Space of freed or moved blocks is only reused once
+	every dataset in the arena is deleted, or released all at once by
+	dset_arena_del. Arena bookkeeping is done with the module lock held.
+*/
+#ifndef DSARENA_MAX
+#define DSARENA_MAX 64
+#endif
+#define DSARENA_DEFAULT_SLABSZ (UINT64_C(1) << 24)
+
+typedef struct ds_slab {
+	struct ds_slab *next;
+	uint64_t        size; // bytes available for blocks after this header
+	uint64_t        used;
+	uint64_t        reserved_; // keeps blocks 16-byte aligned
+} ds_slab;
+
+typedef struct {
+	uint64_t capacity; // bytes available in the block after this header
+	uint64_t reserved_;
+} ds_block;
+
+typedef struct {
+	ds_slab   *slabs;  // blocks are carved from the first slab, others are full or hold one large block
+	uint64_t   slabsz;
+	uint64_t   nblocks; // blocks in use
+	uint16_t   generation;
+	int        inuse;
+} ds_arena;
 
 /*
 	This is the dataset "module". A single global that stores all the state
@@ -279,13 +824,32 @@ static struct {
 	ds_once_t    init_guard;
 	ds_mutex_t   mtx;
 
-	uint64_t          nslots;
-	ds_slot *         slots;
+	uint64_t          nslots; // only written with the lock held, see DSATOMIC_STORE
+	ds_slot *         pages[DSSLOT_MAXPAGES];
+	uint64_t          freehead;
+	uint64_t          freetail;
+	uint64_t          nthreads; // max worker threads for parallel operations, 0 means one per CPU
+	uint64_t          growth_percent;   // atomic, see DSGROWTH_PERCENT
+	uint64_t          growth_max_bytes; // atomic, see DSGROWTH_MAX_BYTES
+	ds_arena          arenas[DSARENA_MAX];
+	uint32_t          arena; // index + 1 of the arena that new datasets are allocated from, 0 for none
+	ds_counters       retired; // counters of deleted datasets, only accessed with the lock held
+	uint64_t          join_ns; // atomic
+	uint64_t          njoin;   // atomic
 
 } ds_module = {
 	.init_guard = DSONCE_INIT,
+	.freehead = DSSLOT_NONE,
+	.freetail = DSSLOT_NONE,
+	.growth_percent = DSGROWTH_PERCENT,
+	.growth_max_bytes = DSGROWTH_MAX_BYTES,
 };
 
+static inline ds_slot *
+slot_at (uint64_t idx) {
+	return &ds_module.pages[idx >> DSSLOT_PAGE_EXP][idx & (DSSLOT_PAGESZ - 1)];
+}
+
 #ifdef _WIN32
 BOOL CALLBACK
 _module_init(PINIT_ONCE InitOnce, PVOID Parameter, PVOID *lpContext)
@@ -336,30 +900,139 @@ static inline void
 lock (void) {
 /*
 	This lock only needs to be held when creating or destroying datasets.
-	We don't guarantee that datasets can be safely accessed concurrently, that's up to the user.
+	We don't guarantee that datasets can be safely accessed concurrently, that's up to the user
+	(but see dset_setconcurrent).
 */
 	ds_mutex_lock_t rc = DSMUTEX_LOCK(ds_module.mtx);
-	errno = (int) rc == DSMUTEX_LOCK_SUCCESS;
 	xassert(rc == DSMUTEX_LOCK_SUCCESS);
 }
 
 static inline void
 unlock (void) {
 	int rc = DSMUTEX_UNLOCK(ds_module.mtx);
-	errno = (int) rc == DSMUTEX_UNLOCK_SUCCESS;
 	xassert(rc == DSMUTEX_UNLOCK_SUCCESS);
 }
 
 
+// Monotonic time in nanoseconds, for dset_stats
+static inline uint64_t
+now_ns (void) {
+#ifdef _WIN32
+	LARGE_INTEGER count, freq;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return (uint64_t) ((double) count.QuadPart * 1e9 / (double) freq.QuadPart);
+#else
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000 + (uint64_t) t.tv_nsec;
+#endif
+}
+
+/*
+	Parallel operations. Large joins split their work across up to
+	dset_setnthreads() threads, each processing a contiguous share.
+	Inputs smaller than DSPARALLEL_MIN_ROWS per thread are processed on fewer
+	threads since thread start up would dominate.
+*/
+#ifndef DSPARALLEL_MIN_ROWS
+#define DSPARALLEL_MIN_ROWS (1 << 16)
+#endif
+#define DSPARALLEL_MAX_THREADS 64
+
+typedef void (*ds_task)(void *ctx, uint32_t tid, uint32_t nthreads);
+
+typedef struct {
+	ds_task fn;
+	void *ctx;
+	uint32_t tid;
+	uint32_t nthreads;
+} ds_taskarg;
+
+static DSTHREAD_RETURN
+task_main (void *arg) {
+	ds_taskarg *a = arg;
+	a->fn(a->ctx, a->tid, a->nthreads);
+	return 0;
+}
+
+// Number of threads to use for the given number of independent tasks
+static uint32_t
+nthreads_for_tasks (uint64_t ntasks) {
+	uint64_t n = DSATOMIC_LOAD(ds_module.nthreads);
+	if (n == 0) {
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		n = info.dwNumberOfProcessors;
+#else
+		const long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		n = ncpu > 0 ? (uint64_t) ncpu : 1;
+#endif
+	}
+	if (n > ntasks) n = ntasks;
+	if (n > DSPARALLEL_MAX_THREADS) n = DSPARALLEL_MAX_THREADS;
+	return n ? (uint32_t) n : 1;
+}
+
+// Number of threads to use to process the given number of rows
+static uint32_t
+nthreads_for (uint64_t nrow) {
+	return nthreads_for_tasks(nrow / DSPARALLEL_MIN_ROWS);
+}
+
+// Call fn once for every tid in [0, nthreads) and wait for all to finish.
+// The caller's thread runs tid 0, and runs any share a thread could not be
+// started for.
+static void
+parallel_run (uint32_t nthreads, ds_task fn, void *ctx) {
+	ds_thread_t threads[DSPARALLEL_MAX_THREADS];
+	ds_taskarg args[DSPARALLEL_MAX_THREADS];
+	int started[DSPARALLEL_MAX_THREADS];
+
+	if (nthreads > DSPARALLEL_MAX_THREADS) nthreads = DSPARALLEL_MAX_THREADS;
+	for (uint32_t t = 1; t < nthreads; t++) {
+		args[t] = (ds_taskarg) { fn, ctx, t, nthreads };
+		started[t] = DSTHREAD_CREATE(threads[t], task_main, &args[t]);
+	}
+	fn(ctx, 0, nthreads);
+	for (uint32_t t = 1; t < nthreads; t++) {
+		if (started[t]) DSTHREAD_JOIN(threads[t]);
+		else fn(ctx, t, nthreads);
+	}
+}
+
+// Start of the share of n items processed by the given thread
+static inline uint64_t
+share_start (uint64_t n, uint32_t tid, uint32_t nthreads) {
+	return n / nthreads * tid + (n % nthreads) * tid / nthreads;
+}
+
+
+// Append the slot at the given index to the free list. Lock must be held.
+static void
+freeslot (uint64_t idx) {
+	slot_at(idx)->nextfree = DSSLOT_NONE;
+	if (ds_module.freetail == DSSLOT_NONE) ds_module.freehead = idx;
+	else slot_at(ds_module.freetail)->nextfree = idx;
+	ds_module.freetail = idx;
+}
+
+// Allocate another page of slots. Lock must be held.
 static void 
 moreslots (void) {
-	static const size_t chunk = 4096;
-	void * mem = DSREALLOC(ds_module.slots, sizeof(ds_module.slots[0]) * (ds_module.nslots+chunk));
-	if (mem) {
-		ds_module.slots   = mem;
-		memset(&ds_module.slots[ds_module.nslots], 0, sizeof(ds_module.slots[0])*chunk);
-		ds_module.nslots += chunk;
-	}
+	const uint64_t nslots = ds_module.nslots;
+	const uint64_t page = nslots >> DSSLOT_PAGE_EXP;
+	if (page >= DSSLOT_MAXPAGES) return;
+
+	ds_slot *mem = DSREALLOC(0, sizeof(ds_slot) * DSSLOT_PAGESZ);
+	if (!mem) return;
+	memset(mem, 0, sizeof(ds_slot) * DSSLOT_PAGESZ);
+	ds_module.pages[page] = mem;
+
+	// publish the page before handles in it can be considered valid
+	DSATOMIC_STORE(ds_module.nslots, nslots + DSSLOT_PAGESZ);
+	for (uint64_t i = nslots; i < nslots + DSSLOT_PAGESZ; i++) freeslot(i);
 }
 
 #define SHIFT_GEN (64-16)
@@ -372,58 +1045,186 @@ roundup(uint64_t value, uint64_t to)
 	return value+to-(value%to);
 }
 
-static uint64_t 
-dset_new_(size_t newsize, ds **allocation) 
-{
-	module_init();
-	lock();
+static inline uint64_t
+align16(uint64_t value) {
+	return (value + 15) & ~(uint64_t) 15;
+}
 
-	ds_slot *s;
-	uint64_t gen;
-	void *mem;
+static inline ds_block *
+block_header(void *ptr) {
+	return (ds_block *) ptr - 1;
+}
 
-	// see if we can find an existing empty slot
-	uint64_t i = 0;
-	for (i = 0; i < ds_module.nslots; i++) {
+// Whether the block is the most recent one in the arena's current slab
+static inline int
+block_is_last(const ds_arena *a, void *ptr) {
+	const ds_slab *slab = a->slabs;
+	return slab && (char *) ptr + block_header(ptr)->capacity == (char *) (slab + 1) + slab->used;
+}
 
-		if (! ds_module.slots[i].memory) break;
+// Allocate a block of at least sz bytes. Lock must be held.
+static void *
+arena_alloc(ds_arena *a, uint64_t sz) {
+	const uint64_t need = sizeof(ds_block) + align16(sz);
+	ds_slab *slab = a->slabs;
+
+	if (!slab || slab->size - slab->used < need) {
+		// blocks that would fill much of a slab get a slab of their own, so
+		// that the current slab keeps its free space for smaller ones
+		const int own = need > a->slabsz / 4;
+		const uint64_t size = own ? need : a->slabsz;
+		ds_slab *fresh = DSREALLOC(0, sizeof(ds_slab) + size);
+		if (!fresh) return 0;
+		*fresh = (ds_slab) { .size = size };
+		if (own && slab) {
+			fresh->next = slab->next;
+			slab->next = fresh;
+		} else {
+			fresh->next = slab;
+			a->slabs = fresh;
+		}
+		slab = fresh;
 	}
 
-	if (i == ds_module.nslots)
-		moreslots();
+	ds_block *b = (ds_block *) ((char *) (slab + 1) + slab->used);
+	b->capacity = need - sizeof(ds_block);
+	slab->used += need;
+	a->nblocks++;
+	return b + 1;
+}
 
-	if (i == ds_module.nslots) 
-		goto out_of_memory;
+// Free a block. Once no blocks are used, all but the current slab are given
+// back and it is reused from the start. Lock must be held.
+static void
+arena_free(ds_arena *a, void *ptr) {
+	if (block_is_last(a, ptr)) a->slabs->used -= sizeof(ds_block) + block_header(ptr)->capacity;
+	if (--a->nblocks > 0) return;
+
+	ds_slab *keep = a->slabs;
+	for (ds_slab *slab = keep->next, *next; slab; slab = next) {
+		next = slab->next;
+		DSFREE(slab);
+	}
+	keep->next = 0;
+	keep->used = 0;
+}
 
+// Resize a block to sz bytes. Lock must be held.
+static void *
+arena_realloc(ds_arena *a, void *ptr, uint64_t sz) {
+	if (!ptr) return arena_alloc(a, sz);
+
+	ds_block *b = block_header(ptr);
+	const uint64_t capacity = align16(sz);
+	if (block_is_last(a, ptr) && a->slabs->size - a->slabs->used + b->capacity >= capacity) {
+		a->slabs->used = a->slabs->used - b->capacity + capacity;
+		b->capacity = capacity;
+		return ptr;
+	}
+	if (sz <= b->capacity) return ptr;
 
-	s = &ds_module.slots[i];
+	void *moved = arena_alloc(a, sz);
+	if (!moved) return 0;
+	memcpy(moved, ptr, b->capacity);
+	arena_free(a, ptr);
+	return moved;
+}
 
-	mem = DSREALLOC(0, newsize);
-	if (!mem) goto out_of_memory;
+// Arena at the given index + 1, as stored in slots
+static inline ds_arena *
+arena_at(uint32_t arena) {
+	return &ds_module.arenas[arena - 1];
+}
 
-	*allocation = (ds *) mem;
-	s->memory   = (ds *) mem;
+// Allocate or resize dataset memory from the given arena, or with DSREALLOC
+// if arena is 0
+static void *
+block_realloc(uint32_t arena, void *ptr, uint64_t sz) {
+	if (!arena) return DSREALLOC(ptr, sz);
+	lock();
+	void *mem = arena_realloc(arena_at(arena), ptr, sz);
 	unlock();
+	return mem;
+}
+
+// Take the least-recently freed slot and give it the given memory (or file
+// mapping, if mapbase is non-null). Returns the new handle or UINT64_MAX
+static uint64_t
+newslot(ds *mem, void *mapbase, uint64_t mapsz, int readonly)
+{
+	module_init();
+	lock();
+
+	ds_slot *s;
+	uint64_t gen;
+
+	if (ds_module.freehead == DSSLOT_NONE)
+		moreslots();
+
+	if (ds_module.freehead == DSSLOT_NONE) {
+		unlock();
+		return UINT64_MAX;
+	}
+
+	const uint64_t i = ds_module.freehead;
+	s = slot_at(i);
+	ds_module.freehead = s->nextfree;
+	if (ds_module.freehead == DSSLOT_NONE) ds_module.freetail = DSSLOT_NONE;
 
-	memset(s->memory, 0, newsize);
 	if (s->generation >= MAX_GEN) {
 		// Generation limit reached, trigger overflow so that handle != 0
 		s->generation = 0;
 	}
 	gen = ++s->generation;
+	s->mapbase  = mapbase;
+	s->mapsz    = mapsz;
+	s->readonly = readonly;
+	s->memory   = mem;
+	s->parent   = 0;
+	s->rowstart = 0;
+	s->arena    = 0;
+	s->counters = (ds_counters) {0};
+	s->pins     = 0;
+	s->nmoving  = 0;
+	unlock();
 
 	return i | (gen << SHIFT_GEN);
+}
+
+static uint64_t 
+dset_new_(size_t newsize, ds **allocation) 
+{
+	module_init();
+	lock();
+	const uint32_t arena = ds_module.arena;
+	void *mem = arena ? arena_alloc(arena_at(arena), newsize) : DSREALLOC(0, newsize);
+	unlock();
+	if (!mem) goto out_of_memory;
+	memset(mem, 0, newsize);
+
+	const uint64_t h = newslot((ds *) mem, 0, 0, 0);
+	if (h == UINT64_MAX) {
+		lock();
+		if (arena) arena_free(arena_at(arena), mem);
+		else DSFREE(mem);
+		unlock();
+		goto out_of_memory;
+	}
+
+	slot_at(h & MASK_IDX)->arena = arena;
+	*allocation = (ds *) mem;
+	return h;
 	 
 	out_of_memory:
-	unlock();
 	nonfatal("out of memory");
 	return UINT64_MAX;
 }
 
 
 
+// Look up the memory of a dataset or view handle
 static ds* 
-handle_lookup (uint64_t h, const char * msg_fragment, uint16_t * gen, uint64_t * idx) 
+handle_lookup_any (uint64_t h, const char * msg_fragment, uint16_t * gen, uint64_t * idx) 
 {
 	uint16_t gen_ = 0;
 	uint64_t idx_ = 0;
@@ -435,25 +1236,59 @@ handle_lookup (uint64_t h, const char * msg_fragment, uint16_t * gen, uint64_t *
 	*idx = MASK_IDX & h;
 	*gen = h >> SHIFT_GEN;
 
-	if (ds_module.nslots <= *idx) {
+	// pages below nslots are never moved or freed, so no lock is needed here
+	if (DSATOMIC_LOAD(ds_module.nslots) <= *idx) {
 		nonfatal("%s: invalid handle %" PRIu64 ", no such slot", msg_fragment, h);
 		return 0;
 	}
 
-	if (!ds_module.slots[*idx].memory) { 
+	const ds_slot *s = slot_at(*idx);
+	if (!s->memory) { 
 		nonfatal("%s: invalid handle %" PRIu64 ", no heap at index %" PRIu64, msg_fragment, h, *idx);
 		return 0;
 	}
 
-	if (ds_module.slots[*idx].generation != *gen) {
+	if (s->generation != *gen) {
 		nonfatal("%s: invalid handle %" PRIu64 ", wrong generation counter"
 				" (given %" PRIu16 ", expected %" PRIu16")", 
-				msg_fragment, h, *gen, ds_module.slots[*idx].generation);
+				msg_fragment, h, *gen, s->generation);
+		return 0;
+	}
+
+
+	return s->memory;
+}
+
+// Same as handle_lookup_any for operations that need the dataset's heaps,
+// which views do not have
+static ds*
+handle_lookup (uint64_t h, const char * msg_fragment, uint16_t * gen, uint64_t * idx)
+{
+	uint64_t idx_ = 0;
+	idx = idx ? idx : &idx_;
+
+	ds *d = handle_lookup_any(h, msg_fragment, gen, idx);
+	if (d && slot_at(*idx)->parent) {
+		nonfatal("%s: dataset %" PRIu64 " is a view, copy it first", msg_fragment, h);
 		return 0;
 	}
+	return d;
+}
 
+// Same as handle_lookup for operations that modify the dataset, which are not
+// permitted on read-only mapped datasets
+static ds*
+handle_lookup_mut (uint64_t h, const char * msg_fragment, uint64_t * idx)
+{
+	uint64_t idx_ = 0;
+	idx = idx ? idx : &idx_;
 
-	return ds_module.slots[*idx].memory;
+	ds *d = handle_lookup(h, msg_fragment, 0, idx);
+	if (d && slot_at(*idx)->readonly) {
+		nonfatal("%s: dataset %" PRIu64 " is read-only", msg_fragment, h);
+		return 0;
+	}
+	return d;
 }
 
 
@@ -519,21 +1354,71 @@ getkey(const ds *d, const ds_column *c)
 	return key;
 }
 
+#define COLINDEX_TAG(h) ((uint32_t) ((h) >> 48) << 16)
+
+// Add the most recently added column to the column key index.
+static void
+colindex_add(ds *d)
+{
+	const uint32_t icol = d->ncol - 1;
+	if (d->ncolindexed != icol || icol >= DSCOLINDEX_MAX) return;
+
+	size_t len;
+	const uint64_t h = hash64(strhash(getkey(d, d->columns + icol), &len));
+	for (int32_t i = (int32_t) h;;) {
+		i = ht64_lookup(h, DSCOLINDEX_EXP, i);
+		if (d->colindex[i] == 0) {
+			d->colindex[i] = COLINDEX_TAG(h) | (icol + 1);
+			d->ncolindexed++;
+			return;
+		}
+	}
+}
+
+// Returns the index of the column with the given key or UINT64_MAX
+static uint64_t
+colindex_find(const ds *d, const char *colkey)
+{
+	size_t len;
+	const uint64_t h = hash64(strhash(colkey, &len));
+	const uint32_t tag = COLINDEX_TAG(h);
+
+	for (int32_t i = (int32_t) h;;) {
+		i = ht64_lookup(h, DSCOLINDEX_EXP, i);
+		const uint32_t e = d->colindex[i];
+		if (e == 0) break;
+		if ((e & 0xffff0000U) == tag && !strcmp(getkey(d, d->columns + (e & 0xffff) - 1), colkey))
+			return (e & 0xffff) - 1;
+	}
+
+	for (uint32_t i = d->ncolindexed; i < d->ncol; i++)
+		if (!strcmp(getkey(d, d->columns + i), colkey)) return i;
+
+	return UINT64_MAX;
+}
+
+// Re-index every column from scratch after columns are removed or renamed
+static void
+colindex_rebuild(ds *d)
+{
+	const uint32_t ncol = d->ncol;
+	memset(d->colindex, 0, sizeof(d->colindex));
+	d->ncolindexed = 0;
+	for (d->ncol = 1; d->ncol <= ncol; d->ncol++) colindex_add(d);
+	d->ncol = ncol;
+}
+
 static ds_column * 
 column_lookup(ds * d, const char * colkey)
 {
 	if(!d) return 0;
 
-	char * ptr = (char *)d;
-	ds_column *c = d->columns;
-	long i = 0;
-	for (;  i < d->ncol;  i++,c++) {
-		const char * key = getkey(d, c);
-		if (!strcmp(key, colkey)) return c;
+	const uint64_t i = colindex_find(d, colkey);
+	if (i == UINT64_MAX) {
+		// nonfatal("key error: %s", colkey);
+		return 0;
 	}
-
-	// nonfatal("key error: %s", colkey);
-	return 0;
+	return d->columns + i;
 }
 
 
@@ -548,27 +1433,267 @@ strheap_capacity (const ds *d) {
 }
 
 static inline uint64_t
-compute_col_reserved_space (uint32_t crow, const ds_column *c) {
+compute_col_reserved_space (uint64_t crow, const ds_column *c) {
 
 	const uint64_t col_stride = type_size[abs_i8(c->type)] * stride(c);
 	return roundup(crow*col_stride, 16);
 }
 
+// Compute new capacity for a geometrically-growing quantity (e.g., number of
+// rows or bytes) that must hold at least reqd units. unitsz is the size of
+// each unit in bytes, used to apply the maximum growth in bytes.
+static inline uint64_t
+grow_capacity (uint64_t current, uint64_t reqd, uint64_t unitsz) {
+	const uint64_t percent = DSATOMIC_LOAD(ds_module.growth_percent);
+	uint64_t grown = current + current / 100 * percent + current % 100 * percent / 100;
+	const uint64_t maxextra = DSATOMIC_LOAD(ds_module.growth_max_bytes) / (unitsz ? unitsz : 1);
+	if (grown > reqd && grown - reqd > maxextra) grown = reqd + maxextra;
+	return grown > reqd ? grown : reqd;
+}
+
+/*
+	Dataset images (see dset_save_image) are mapped into memory as-is, so the
+	ds block starts DSIMAGE_OFFSET bytes into the file. A stream-format .cs
+	file always has a non-empty header, so a zero header size after the magic
+	identifies an image. The rest of the file header records the image version
+	and the layout of the build that saved it, since the block is only usable
+	by builds with the same struct layout and byte order.
+*/
+#define DSIMAGE_OFFSET  4096
+#define DSIMAGE_VERSION 1
+#define DSIMAGE_HEADER_AT 16 // after the magic and zero header size, aligned
+#define DSIMAGE_BYTEORDER 0x01020304U
+
+typedef struct {
+	char     tag[8];    // "DSIMAGE"
+	uint32_t version;   // DSIMAGE_VERSION
+	uint32_t byteorder; // DSIMAGE_BYTEORDER in the byte order of the saving machine
+	uint32_t dssz;      // sizeof(ds)
+	uint32_t columnsz;  // sizeof(ds_column)
+	uint64_t blocksz;   // size of the ds block at DSIMAGE_OFFSET
+} ds_image_header;
+
+static ds_image_header
+image_header (uint64_t blocksz) {
+	ds_image_header h = { "DSIMAGE", DSIMAGE_VERSION, DSIMAGE_BYTEORDER, sizeof(ds), sizeof(ds_column), blocksz };
+	return h;
+}
+
+// Map the whole file at the given path into memory. Writable mappings are
+// private copy-on-write, so changes never reach the file. Returns 0 on error
+static void *
+map_file (const char *path, int readonly, uint64_t *size)
+{
+#ifdef _WIN32
+	LARGE_INTEGER sz;
+	void *base = 0;
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return 0;
+	if (GetFileSizeEx(file, &sz) && sz.QuadPart > 0) {
+		// the view keeps the mapping open after its handles are closed
+		HANDLE mapping = CreateFileMappingA(file, NULL, readonly ? PAGE_READONLY : PAGE_WRITECOPY, 0, 0, NULL);
+		if (mapping) {
+			base = MapViewOfFile(mapping, readonly ? FILE_MAP_READ : FILE_MAP_COPY, 0, 0, 0);
+			CloseHandle(mapping);
+		}
+		*size = (uint64_t) sz.QuadPart;
+	}
+	CloseHandle(file);
+	return base;
+#else
+	struct stat st;
+	void *base = 0;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return 0;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		base = mmap(NULL, (size_t) st.st_size, readonly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (base == MAP_FAILED) base = 0;
+		*size = (uint64_t) st.st_size;
+	}
+	close(fd);
+	return base;
+#endif
+}
+
+// Create (if createsz is non-zero) or open the named shared memory object and
+// map it. Created objects are mapped writable and shared. Opened objects are
+// mapped read-only, or as a private copy-on-write view if not readonly.
+// Returns 0 on error
+static void *
+map_shared (const char *name, uint64_t createsz, int readonly, uint64_t *size)
+{
+	char path[256];
+	void *base = 0;
+	if (name[0] == '/') name++;
+#ifdef _WIN32
+	snprintf(path, sizeof(path), "Local\\%s", name);
+	if (createsz) {
+		HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+			(DWORD) (createsz >> 32), (DWORD) createsz, path);
+		if (!mapping) return 0;
+		// the object lives as long as some process has a view of it
+		if (GetLastError() != ERROR_ALREADY_EXISTS) base = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0);
+		CloseHandle(mapping);
+		*size = createsz;
+	} else {
+		MEMORY_BASIC_INFORMATION info;
+		HANDLE mapping = OpenFileMappingA(readonly ? FILE_MAP_READ : FILE_MAP_COPY, FALSE, path);
+		if (!mapping) return 0;
+		base = MapViewOfFile(mapping, readonly ? FILE_MAP_READ : FILE_MAP_COPY, 0, 0, 0);
+		CloseHandle(mapping);
+		if (base && VirtualQuery(base, &info, sizeof(info))) *size = (uint64_t) info.RegionSize;
+	}
+	return base;
+#else
+	struct stat st;
+	snprintf(path, sizeof(path), "/%s", name);
+	int fd = shm_open(path, createsz ? O_RDWR | O_CREAT | O_EXCL : O_RDONLY, 0600);
+	if (fd < 0) return 0;
+	if (createsz) {
+		if (ftruncate(fd, (off_t) createsz) == 0) {
+			base = mmap(NULL, (size_t) createsz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			*size = createsz;
+		}
+		if (!base || base == MAP_FAILED) shm_unlink(path);
+	} else if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		base = mmap(NULL, (size_t) st.st_size, readonly ? PROT_READ : PROT_READ | PROT_WRITE,
+			readonly ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+		*size = (uint64_t) st.st_size;
+	}
+	close(fd);
+	return base == MAP_FAILED ? 0 : base;
+#endif
+}
+
+static void
+unmap_file (void *base, uint64_t size)
+{
+#ifdef _WIN32
+	(void) size;
+	UnmapViewOfFile(base);
+#else
+	munmap(base, (size_t) size);
+#endif
+}
+
+// Free the memory of the dataset or view in the given slot. Lock must be held.
+static void
+release_memory(ds_slot *s) {
+	if (s->mapbase) unmap_file(s->mapbase, s->mapsz);
+	else if (s->arena) arena_free(arena_at(s->arena), s->memory);
+	else DSFREE(s->memory);
+	s->memory = 0;
+	s->mapbase = 0;
+	s->mapsz = 0;
+	s->arena = 0;
+}
+
+// Free the dataset in the given slot and make the slot available again. Lock
+// must be held.
+static void
+delslot(uint64_t idx) {
+	ds_slot *s = slot_at(idx);
+	release_memory(s);
+	ds_module.retired.bytes_moved  += s->counters.bytes_moved;
+	ds_module.retired.resize_ns    += s->counters.resize_ns;
+	ds_module.retired.string_ns    += s->counters.string_ns;
+	ds_module.retired.nintern      += s->counters.nintern;
+	ds_module.retired.nintern_hits += s->counters.nintern_hits;
+	s->counters = (ds_counters) {0};
+	if (s->pins) {
+		DSRWLOCK_DESTROY(s->pins);
+		DSFREE(s->pins);
+		s->pins = 0;
+	}
+	s->readonly = 0;
+	s->parent = 0;
+	s->rowstart = 0;
+	ht64_del(&s->strindex);
+	ht64_del(&s->strrefs);
+	freeslot(idx);
+}
+
+// Start and finish changes to the dataset in slot idx that move its memory
+// or its contents, which invalidates pointers from dset_get. Waits for
+// readers that have the dataset pinned. May be nested.
+static inline void
+move_begin (uint64_t idx) {
+	ds_slot *s = slot_at(idx);
+	if (s->pins && s->nmoving++ == 0) DSRWLOCK_WRLOCK(s->pins);
+}
+
+static inline void
+move_end (uint64_t idx) {
+	ds_slot *s = slot_at(idx);
+	if (s->pins && --s->nmoving == 0) DSRWLOCK_WRUNLOCK(s->pins);
+}
+
+// As move_begin and move_end, also recording the time taken and the number
+// of bytes moved. resize_begin returns the start time to give resize_end.
+static inline uint64_t
+resize_begin (uint64_t idx) {
+	move_begin(idx);
+	return now_ns();
+}
+
+static inline void
+resize_end (uint64_t idx, uint64_t bytes, uint64_t t0) {
+	ds_counters *c = &slot_at(idx)->counters;
+	c->bytes_moved += bytes;
+	c->resize_ns += now_ns() - t0;
+	move_end(idx);
+}
+
+// Resize the memory of the dataset at the given slot index to newsz bytes.
+// A mapped dataset is moved to the heap first, since its mapping cannot grow.
+// Returns the new dataset pointer or 0 if out of memory
+static ds*
+resize_memory (uint64_t idx, uint64_t newsz) {
+
+	ds_slot *s = slot_at(idx);
+	ds *d = s->memory;
+	ds *newptr;
+	const uint64_t t0 = resize_begin(idx);
+	const uint64_t oldsz = d->total_sz < newsz ? d->total_sz : newsz;
+	const uintptr_t oldptr = (uintptr_t) d;
+
+	if (s->mapbase) {
+		newptr = DSREALLOC(0, newsz);
+		if (newptr) {
+			memcpy(newptr, d, oldsz);
+			unmap_file(s->mapbase, s->mapsz);
+			s->mapbase = 0;
+			s->mapsz = 0;
+		}
+	} else {
+		newptr = block_realloc(s->arena, d, newsz);
+	}
+	if (!newptr) {
+		resize_end(idx, 0, t0);
+		return 0;
+	}
+
+	s->memory = newptr;
+	newptr->stats.nrealloc++;
+	resize_end(idx, (uintptr_t) newptr != oldptr ? oldsz : 0, t0);
+	return newptr;
+}
+
 static ds*
 more_memory (uint64_t idx, uint64_t nbytes_more) {
 
-	const uint64_t more = roundup(nbytes_more, 1<<15); // 32 kB at a time (too little? too much?)
+	ds *d = slot_at(idx)->memory;
 
-	ds *d = ds_module.slots[idx].memory;
-	d->stats.nrealloc++;
+	// 32 kB at a time at minimum
+	const uint64_t more = roundup(grow_capacity(d->total_sz, d->total_sz + nbytes_more, 1) - d->total_sz, 1<<15);
 
-	ds * newptr = DSREALLOC(d, d->total_sz + more);
+	ds * newptr = resize_memory(idx, d->total_sz + more);
 	if (!newptr) {
 		nonfatal("dataset.more_memory: out of memory");
 		return 0;
 	}
 
-	ds_module.slots[idx].memory = d = newptr;
+	d = newptr;
 
 	char * ptr = (char *) newptr;
 	memset(ptr + d->total_sz, 0, more);
@@ -581,7 +1706,7 @@ more_memory (uint64_t idx, uint64_t nbytes_more) {
 static ds* 
 more_strheap (uint64_t idx, uint64_t nbytes_more) {
 
-	ds *d = ds_module.slots[idx].memory;
+	ds *d = slot_at(idx)->memory;
 	d->stats.nmore_strheap++;
 
 	uint64_t arrheap_reqdsize = 0;
@@ -595,14 +1720,16 @@ more_strheap (uint64_t idx, uint64_t nbytes_more) {
 	// if we can find the space just by shrinking the array heap, do that.
 	if (arrheap_actualsize - arrheap_reqdsize >= nbytes_more) {
 
+		const uint64_t t0 = resize_begin(idx);
 		char * ptr = (char *) d;
 		char * move_src = ptr + d->strheap_start;
-		char * move_dst = move_dst - nbytes_more;
+		char * move_dst = move_src - nbytes_more;
 
 		memmove (move_dst, move_src, d->strheap_sz);
-		memset  (move_dst + d->strheap_sz, 0, d->strheap_sz);
+		memset  (move_dst + d->strheap_sz, 0, nbytes_more);
 
 		d->strheap_start -= nbytes_more;
+		resize_end(idx, d->strheap_sz, t0);
 		return d;
 	}
 
@@ -613,21 +1740,23 @@ more_strheap (uint64_t idx, uint64_t nbytes_more) {
 static ds*
 more_arrheap (uint64_t idx, uint64_t nbytes_more) {
 
-	ds *d = ds_module.slots[idx].memory;
+	ds *d = slot_at(idx)->memory;
 	d->stats.nmore_arrheap++;
 
 	do {
 		// if we can find the space just by shrinking the string heap, do that.
 		if (d->total_sz - d->strheap_start - d->strheap_sz   >   nbytes_more) {
 
+			const uint64_t t0 = resize_begin(idx);
 			char * ptr = (char *) d;
 			char * move_src = ptr + d->strheap_start;
 			char * move_dst = move_src + nbytes_more;
 
 			memmove (move_dst, move_src, d->strheap_sz);
-			memset  (move_src, 0,        d->strheap_sz);
+			memset  (move_src, 0,        nbytes_more);
 
 			d->strheap_start += nbytes_more;
+			resize_end(idx, d->strheap_sz, t0);
 			return d;
 		}
 
@@ -642,7 +1771,7 @@ more_columndescr_space (uint64_t idx, uint64_t ncolumns_more) {
 
 	uint64_t nbytes_more = ncolumns_more * sizeof(ds_column);
 
-	ds *d = ds_module.slots[idx].memory;
+	ds *d = slot_at(idx)->memory;
 	d->stats.nmore_colspace++;
 
 	// for simplicity, let's not steal from the array heap, just from the string heap
@@ -650,6 +1779,7 @@ more_columndescr_space (uint64_t idx, uint64_t ncolumns_more) {
 		// if we can find the space just by shrinking the string heap, do that.
 		if (d->total_sz - d->strheap_start - d->strheap_sz   >   nbytes_more) {
 
+			const uint64_t t0 = resize_begin(idx);
 			char * move_src =(char *)  &d->columns[d->ccol];
 			char * move_dst = move_src + nbytes_more;
 			uint64_t arrheap_size = d->strheap_start - d->arrheap_start;
@@ -660,6 +1790,7 @@ more_columndescr_space (uint64_t idx, uint64_t ncolumns_more) {
 			d->strheap_start += nbytes_more;
 			d->arrheap_start += nbytes_more;
 			d->ccol += ncolumns_more;
+			resize_end(idx, arrheap_size + d->strheap_sz, t0);
 
 			return d;
 		}
@@ -672,250 +1803,548 @@ more_columndescr_space (uint64_t idx, uint64_t ncolumns_more) {
 }
 
 static uint64_t
-actual_arrheap_sz (ds *d) {
+actual_arrheap_sz_for (const ds *d, uint64_t crow) {
 	if (d->ncol > 0) {
-		ds_column last = d->columns[d->ncol-1];
-		return compute_col_reserved_space(d->crow, &last) + last.offset;
+		const ds_column *last = &d->columns[d->ncol-1];
+		return compute_col_reserved_space(crow, last) + last->offset;
 	}
 	return 0;
 }
 
-/**
- * Definitions for hash table where every key and value is 64 bits
- * Based on https://nullprogram.com/blog/2022/08/08/
- * Future work: Adapt for generic key/value types for the string buffer.
- */
-
-// Invalid or unset hashtable entry (64 bit all ones)
-#define DSHT64_INVALID 0xffffffffffffffffU
-
-typedef uint64_t ds_ht64_row[2];
-
-/**
- * Numeric hashtable where each key and value is a 64 bit integer
- */
-typedef struct ds_ht64 {
-	ds_ht64_row *ht; // array of key/value pairs
-	int32_t len;
-	int32_t exp; // exponent that denotes total hashtable capacity
-} ds_ht64;
-
-// https://nullprogram.com/blog/2018/07/31/
-static inline uint64_t hash64(uint64_t x) {
-    x ^= x >> 32;
-    x *= 0xd6e8feb86659fd93U;
-    x ^= x >> 32;
-    x *= 0xd6e8feb86659fd93U;
-    x ^= x >> 32;
-    return x;
+static uint64_t
+actual_arrheap_sz (const ds *d) {
+	return actual_arrheap_sz_for(d, d->crow);
 }
 
-// Allocate a hashtable with the given size
-static void ht64_new(ds_ht64 *t, uint32_t sz) {
-	// Allocate the given size for the hash table t
-	uint32_t exp = 0;
-	do { exp++; } while ((1 << exp) < sz);
-	exp += 1; // at least double the required size for fast lookups
-
-	size_t totalsz = sizeof(ds_ht64_row) * (1 << exp);
-	void *mem = DSREALLOC(0, totalsz);
-	// Initialize memory to -1 (all ones)
-	memset(mem, -1, totalsz);
-	t->ht = mem;
-	xassert(t->ht[0][0] == DSHT64_INVALID) // verify that memset worked
-	t->len =  0;
-	t->exp = exp;
+static inline uint64_t
+compute_arrheap_sz (const ds *d, uint64_t crow) {
+	uint64_t sz = 0;
+	for(uint32_t i = 0; i < d->ncol; i++)
+		sz += compute_col_reserved_space(crow, d->columns+i);
+	return sz;
 }
 
-// Free an allocated hash table
-static void ht64_del(ds_ht64 *t) {
-	if (t->ht) {
-	DSFREE(t->ht);
+/*
+	Strings are never freed individually because other rows may share them
+	(see stralloc). Instead, strings that lose their last use are left in the
+	heap and counted in strheap_freed (see strref_move). strheap_compact
+	reclaims them all at once: it marks every string still referenced by a
+	column key or a T_STR column, slides the live strings down to the start
+	of the heap, then rewrites the string handles.
+*/
+static int
+strheap_compact (ds *d, uint64_t idx)
+{
+	char * ptr = (char *) d;
+	char * strheap = ptr + d->strheap_start;
+	const uint64_t sz = d->strheap_sz;
+	ds_ht64 *strindex = &slot_at(idx)->strindex;
+	ds_counters *counters = &slot_at(idx)->counters;
+	const uint64_t t0 = now_ns();
+
+	// mark the first byte of each string that is still in use
+	uint8_t *live = DSREALLOC(0, sz / 8 + 1);
+	if (!live) {
+		nonfatal("dataset.strheap_compact: out of memory");
+		return 0;
 	}
-	t->ht = 0;
-	t->len = 0;
-	t->exp = 0;
-}
-
-// Compute the next candidate index. Initialize idx to the hash.
-static inline int32_t ht64_lookup(uint64_t hash, int exp, int32_t idx) {
-	uint32_t mask = ((uint32_t)1 << exp) - 1;
-	uint32_t step = (hash >> (64 - exp)) | 1;
-	return (idx + step) & mask;
-}
+	memset(live, 0, sz / 8 + 1);
+	#define MARK(h) do { if ((h) < sz) live[(h) >> 3] |= (uint8_t) (1 << ((h) & 7)); } while (0)
+	#define ISLIVE(h) (live[(h) >> 3] & (1 << ((h) & 7)))
 
-static inline int ht64_has(ds_ht64 *t, const uint64_t key) {
-	uint64_t h = hash64(key);
-	for (int32_t i = h;;) {
-		i = ht64_lookup(h, t->exp, i);
-		if (t->ht[i][0] == DSHT64_INVALID) return 0; // empty, does not exist
-		else if (t->ht[i][0] == key) return 1; // found
-		// otherwise keep looking
+	MARK(0); // empty string
+	uint64_t nlive = 1;
+	for (uint32_t i = 0; i < d->ncol; i++) {
+		const ds_column *c = &d->columns[i];
+		if (c->type < 0) MARK(c->longkey);
+		if (tcheck_s(c->type)) {
+			const uint64_t *handles = (uint64_t *) (ptr + d->arrheap_start + c->offset);
+			for (uint64_t j = 0; j < d->nrow; j++) MARK(handles[j]);
+		}
 	}
-	return 0;
-}
 
-// Find the value of key in the hash table. Put the result in val. Returns 1
-// (true) if located, 0 otherwise.
-static int ht64_find(ds_ht64 *t, const uint64_t key, uint64_t *val) {
-	uint64_t h = hash64(key);
-	for (int32_t i = h;;) {
-		i = ht64_lookup(h, t->exp, i);
-		if (t->ht[i][0] == DSHT64_INVALID) {
-			// empty
-			return 0;
-		} else if (t->ht[i][0] == key) {
-			// Found, populate result
-			*val = t->ht[i][1];
-			return 1;
+	// compact live strings, remembering where each one moved to. Rebuild the
+	// intern index with the new handles as we go.
+	ds_ht64 moved = {0};
+	for (uint64_t h = 0; h < sz; h += strlen(strheap + h) + 1) nlive += ISLIVE(h) ? 1 : 0;
+	if (!ht64_reserve(&moved, (uint32_t) nlive)) {
+		DSFREE(live);
+		nonfatal("dataset.strheap_compact: out of memory");
+		return 0;
+	}
+	ht64_del(strindex);
+	int have_index = ht64_reserve(strindex, (uint32_t) (nlive > 16 ? nlive : 16));
+
+	move_begin(idx);
+	uint64_t w = 0;
+	for (uint64_t r = 0; r < sz;) {
+		size_t len;
+		const uint64_t h = strhash(strheap + r, &len);
+		if (ISLIVE(r)) {
+			if (w != r) {
+				memmove(strheap + w, strheap + r, len + 1);
+				ht64_insert(&moved, r, w);
+				counters->bytes_moved += len + 1;
+			}
+			if (have_index) ht64_insert_dup(strindex, h, w);
+			w += len + 1;
 		}
-		// Otherwise keep looking
+		r += len + 1;
 	}
-	return 0;
+	#undef MARK
+	#undef ISLIVE
+	DSFREE(live);
+	if (!have_index) ht64_del(strindex); // rebuild when required
+
+	// update handles
+	if (moved.len > 0) {
+		uint64_t newh;
+		for (uint32_t i = 0; i < d->ncol; i++) {
+			ds_column *c = &d->columns[i];
+			if (c->type < 0 && ht64_find(&moved, c->longkey, &newh)) c->longkey = newh;
+			if (tcheck_s(c->type)) {
+				uint64_t *handles = (uint64_t *) (ptr + d->arrheap_start + c->offset);
+				for (uint64_t j = 0; j < d->nrow; j++) {
+					if (handles[j] && ht64_find(&moved, handles[j], &newh)) handles[j] = newh;
+				}
+			}
+		}
+	}
+	ht64_del(&moved);
+
+	memset(strheap + w, 0, sz - w);
+	d->strheap_sz = w;
+	d->strheap_freed = 0;
+	d->stats.nshift_strhandles++;
+	ht64_del(&slot_at(idx)->strrefs); // handles changed, rebuild when required
+	move_end(idx);
+	counters->string_ns += now_ns() - t0;
+	return 1;
 }
 
-// Insert a value into the hash table
-// Will overwrite val if the key already exists
-static int ht64_insert(ds_ht64 *t, const uint64_t key, const uint64_t val) {
-	if ((uint32_t) t->len == (uint32_t) (1 << t->exp)) {
-		// hash table is full
-		return 0;
+static uint64_t
+stralloc(ds **d, uint64_t idx, const char * str)
+{
+	ds_ht64 *strindex = &slot_at(idx)->strindex;
+	size_t len;
+	const uint64_t h  = strhash(str, &len);
+	const size_t   sz = 1 + len;
+
+	// make sure the intern index is available (e.g., first string allocation)
+	if (!strindex->ht) {
+		char * strheap = ((char *) *d) + (*d)->strheap_start;
+		if (!strindex_build(strindex, strheap, (*d)->strheap_sz)) {
+			nonfatal("dataset.stralloc: cannot build string index");
+			*d = 0;
+			return 0;
+		}
 	}
 
-	uint64_t h = hash64(key);
-	for (int32_t i = h;;) {
-		i = ht64_lookup(h, t->exp, i);
-		if (t->ht[i][0] == DSHT64_INVALID || t->ht[i][0] == key) {
-			// empty or existing key, insert here
-			t->len++;
-			t->ht[i][0] = key;
-			t->ht[i][1] = val;
-			return 1;
-		}
-		// Otherwise keep looking for a spot to insert
-	}
-	return 0;
-}
-
-
-static uint64_t
-stralloc(ds **d, uint64_t idx, const char * str)
-{
-	const size_t sz = 1 + strlen(str);
-	char * base = (char*)*d;
-
 	// do we already have this string?
 	{
-		char * strheap = base + (*d)->strheap_start;
-		char * strheap_end = strheap + (*d)->strheap_sz;
-
-		char * p = strheap;
-		while (p < strheap_end) {
-			if(!strcmp(str,p)) return p-strheap;
-			p += strlen(p) + 1;
+		char * strheap = ((char *) *d) + (*d)->strheap_start;
+		uint64_t existing = strindex_find(strindex, strheap, h, str);
+		slot_at(idx)->counters.nintern++;
+		if (existing != DSHT64_INVALID) {
+			slot_at(idx)->counters.nintern_hits++;
+			return existing;
 		}
 	} // guess not...
 
-	// do we need more space?
+	// do we need more space? If at least half the heap might be garbage,
+	// try reclaiming it first. Don't do this when the given string points
+	// into our own heap, because compaction would move it.
+	if ((*d)->total_sz - (*d)->strheap_start < (*d)->strheap_sz + sz) {
+		char * strheap = ((char *) *d) + (*d)->strheap_start;
+		const int str_in_heap = str >= strheap && str < strheap + (*d)->strheap_sz;
+		if (!str_in_heap && (*d)->strheap_freed >= (*d)->strheap_sz / 2) {
+			if (!strheap_compact(*d, idx)) {
+				*d = 0;
+				return 0;
+			}
+		}
+	}
 	if ((*d)->total_sz - (*d)->strheap_start < (*d)->strheap_sz + sz) {
 		*d = more_strheap(idx, sz);
 		if (!*d) return 0;
 	}
 
 	uint64_t newstr   = (*d)->strheap_sz;
-	(*d)->strheap_sz += sz;
+	if (!strindex_add(strindex, h, newstr)) {
+		nonfatal("dataset.stralloc: cannot add to string index");
+		*d = 0;
+		return 0;
+	}
 
-	memcpy(base + (*d)->strheap_start + newstr, str, sz);
-	return newstr; 
+	(*d)->strheap_sz += sz;
+	memcpy(((char *) *d) + (*d)->strheap_start + newstr, str, sz);
+	return newstr;
 }
 
-static void 
-shift_all_string_handles(ds *d, int64_t shift, uint64_t shift_greater_than)
-{
+static inline char *
+getstr(ds *d, ds_column *c, uint64_t index) {
 	char * ptr = (char *) d;
+	uint64_t *handles = ptr + d->arrheap_start + c->offset;
+	return ptr + d->strheap_start + handles[index];
+}
+
+// Get the data of column c of d in slot idx, from the given row. Columns of a
+// view are looked up by key in its parent, which must still have the same
+// column type, shape and rows. Sets owner to the dataset whose heaps hold the
+// data. Returns null if the view's parent no longer matches.
+static char *
+column_data(const ds *d, uint64_t idx, const ds_column *c, uint64_t row, const ds **owner, const char *fn) {
+	const ds_slot *s = slot_at(idx);
+	const size_t itemsize = type_size[abs_i8(c->type)] * stride(c);
+	*owner = d;
+	if (!s->parent) return (char *) d + d->arrheap_start + c->offset + row * itemsize;
+
+	ds *p = handle_lookup(s->parent, fn, 0, 0);
+	if (!p) return 0;
+	const char *key = getkey(d, c);
+	const ds_column *pc = column_lookup(p, key);
+	if (!pc || abs_i8(pc->type) != abs_i8(c->type) || memcmp(pc->shape, c->shape, sizeof(c->shape))) {
+		nonfatal("%s: column %s of view no longer matches its parent", fn, key);
+		return 0;
+	}
+	if (s->rowstart + d->nrow > p->nrow) {
+		nonfatal("%s: view rows no longer in its parent (%" PRIu64 " rows)", fn, p->nrow);
+		return 0;
+	}
+	*owner = p;
+	return (char *) p + p->arrheap_start + pc->offset + (s->rowstart + row) * itemsize;
+}
+
+/*
+	String reference counts, so that releasing a string that other rows still
+	share is not counted in strheap_freed; that would trigger compactions
+	that reclaim nothing. The table maps each string handle to its number of
+	uses by T_STR rows and long column keys. It is only built when a string
+	is first released, from the handles in the dataset at that time. From
+	then on, every change to a handle or long key goes through strref_move.
+	Strings that are no longer used keep an entry with count 0, so a string
+	that is interned again is taken back out of strheap_freed.
+*/
+// Use count of string h in refs, or null if it has none
+static uint64_t *
+strrefs_find(ds_ht64 *refs, uint64_t h) {
+	const uint64_t hh = hash64(h);
+	for (int32_t i = (int32_t) hh;;) {
+		i = ht64_lookup(hh, refs->exp, i);
+		if (refs->ht[i][0] == h) return &refs->ht[i][1];
+		if (refs->ht[i][0] == DSHT64_INVALID) return 0;
+	}
+}
+
+// Use count of string h in refs, added as 0 if it has none (then sets added).
+// Returns null if out of memory.
+static uint64_t *
+strrefs_get(ds_ht64 *refs, uint64_t h, int *added) {
+	uint64_t *count = strrefs_find(refs, h);
+	*added = !count;
+	if (count) return count;
+	if (!ht64_reserve(refs, (uint32_t) refs->len + 1)) return 0;
+	ht64_insert_dup(refs, h, 0);
+	return strrefs_find(refs, h);
+}
+
+static int
+strrefs_build(const ds *d, ds_ht64 *refs) {
+	const char *ptr = (const char *) d;
+	uint64_t *count;
+	int added;
+	ht64_del(refs);
+	if (!ht64_reserve(refs, 64)) return 0;
 	for (uint32_t i = 0; i < d->ncol; i++) {
-		if (d->columns[i].type < 0   &&   d->columns[i].longkey > shift_greater_than) {
-			d->columns[i].longkey += shift;
+		const ds_column *c = &d->columns[i];
+		if (c->type < 0 && c->longkey && c->longkey < d->strheap_sz) {
+			if (!(count = strrefs_get(refs, c->longkey, &added))) goto oom;
+			(*count)++;
 		}
-
-		if (tcheck_s(d->columns[i].type)) {
-			uint64_t *handles = ptr + d->arrheap_start + d->columns[i].offset;
-			for (uint64_t j = 0 ; j < d->nrow; j++) {
-			
-				if (handles[j] > shift_greater_than)
-					handles[j] += shift;
-			}
+		if (!tcheck_s(c->type)) continue;
+		const uint64_t *handles = (const uint64_t *) (ptr + d->arrheap_start + c->offset);
+		for (uint64_t j = 0; j < d->nrow; j++) {
+			if (!handles[j] || handles[j] >= d->strheap_sz) continue;
+			if (!(count = strrefs_get(refs, handles[j], &added))) goto oom;
+			(*count)++;
 		}
 	}
-	d->stats.nshift_strhandles++;
+	return 1;
+
+	oom:
+	ht64_del(refs);
+	return 0;
 }
 
+// Record that one use of string oldh of d in slot idx is replaced by a use
+// of newh, either of which may be 0 for none, and update strheap_freed. Call
+// before changing the handle or key. Without memory for the counts, a
+// released string is counted as freed, which at worst compacts too early.
 static void
-strfree (uint64_t oldstr, ds *d)
-{
-	// TODO: This should check that no one else is using this string before freeing it
-	if (!oldstr) return;
-	char * strheap = ((char *)d) + d->strheap_start;
-	char * s = strheap + oldstr;
-	int64_t sz = 1 + strlen(s);
-	memmove(s, s+sz, (strheap+d->strheap_sz) - (s+sz));
-	shift_all_string_handles(d, -sz, oldstr);
-	d->strheap_sz -= sz;
-}
+strref_move(ds *d, uint64_t idx, uint64_t oldh, uint64_t newh) {
+	ds_ht64 *refs = &slot_at(idx)->strrefs;
+	const char *strheap = (char *) d + d->strheap_start;
+	if (oldh == newh) return;
+	if (oldh >= d->strheap_sz) oldh = 0;
+	if (newh >= d->strheap_sz) newh = 0;
+	if (!refs->ht && !oldh) return; // nothing released, counts not required yet
+	if (!refs->ht && !strrefs_build(d, refs)) {
+		if (oldh) d->strheap_freed += 1 + strlen(strheap + oldh);
+		return;
+	}
 
-static inline char *
-getstr(ds *d, ds_column *c, uint64_t index) {
-	char * ptr = (char *) d;
-	uint64_t *handles = ptr + d->arrheap_start + c->offset;
-	return ptr + d->strheap_start + handles[index];
+	if (newh) {
+		int added;
+		uint64_t *count = strrefs_get(refs, newh, &added);
+		if (!count) {
+			ht64_del(refs); // rebuild when required
+			if (oldh) d->strheap_freed += 1 + strlen(strheap + oldh);
+			return;
+		}
+		if (*count == 0 && !added) {
+			// used again after it was released
+			const uint64_t sz = 1 + strlen(strheap + newh);
+			d->strheap_freed -= d->strheap_freed < sz ? d->strheap_freed : sz;
+		}
+		(*count)++;
+	}
+	if (oldh) {
+		uint64_t *count = strrefs_find(refs, oldh);
+		if (count && *count > 0 && --*count == 0) d->strheap_freed += 1 + strlen(strheap + oldh);
+	}
 }
 
 // Set string helper that returns dataset pointer with string assigned (may be
-// the same dataset pointer or different if required reallocation)
+// the same dataset pointer or different if required reallocation). idx is the
+// dataset's slot index. The previous string is not freed, since other rows
+// may be using it (see strref_move and strheap_compact)
 static ds *
-setstr (ds *d, ds_column *c, uint64_t index, const char *value) {
-	uint64_t idx;
-	char *ptr = (char *) d;
-	uint64_t *handles = ptr + d->arrheap_start + c->offset;
-	strfree(handles[index], d);
+setstr (ds *d, uint64_t idx, ds_column *c, uint64_t index, const char *value) {
+	const ptrdiff_t colidx = c - d->columns; // c is invalid if d gets reallocated
 	uint64_t newstr = stralloc(&d, idx, value);
 	if (!d) return 0; // Could not allocate string
 
+	uint64_t *handles = (uint64_t *) ((char *) d + d->arrheap_start + d->columns[colidx].offset);
+	strref_move(d, idx, handles[index], newstr);
 	handles[index] = newstr;
 	return d;
 }
 
+// Bulk version of setstr for rows [start, start + n). Two passes: the first
+// resolves each value against the intern index and collects the distinct new
+// strings, the second grows the heap once and copies those in. NULL values
+// are treated as empty strings.
+#define SETSTRS_PENDING 0x8000000000000000U
+static ds *
+setstrs (ds *d, uint64_t idx, ds_column *c, uint64_t start, uint64_t n, const char **values) {
+	const ptrdiff_t colidx = c - d->columns;
+	ds_ht64 *strindex = &slot_at(idx)->strindex;
+	ds_counters *counters = &slot_at(idx)->counters;
+	ds_ht64 pending = {0};
+	uint64_t *resolved = 0, *pending_rows = 0;
+	uint64_t npending = 0, need = 0;
+	int compacted = 0;
+	size_t len;
+
+	if (n == 0) return d;
+	const uint64_t t0 = now_ns();
+	const uint64_t string_ns = counters->string_ns; // includes any compaction below
+
+	resolved = DSREALLOC(0, n * sizeof(uint64_t));
+	if (!resolved) goto oom;
+
+	// pass 1: resolve interned strings, dedupe the rest. Repeated after a
+	// compaction in pass 2, which moves the strings that were resolved.
+	resolve:
+	if (!strindex->ht) {
+		if (!strindex_build(strindex, (char *) d + d->strheap_start, d->strheap_sz)) goto oom;
+	}
+	{
+		const char *strheap = (char *) d + d->strheap_start;
+		for (uint64_t i = 0; i < n; i++) {
+			const char *v = values[i] ? values[i] : "";
+			const uint64_t h = strhash(v, &len);
+			uint64_t found = strindex_find(strindex, strheap, h, v);
+			if (found != DSHT64_INVALID) {
+				resolved[i] = found;
+				continue;
+			}
+
+			// seen earlier in this batch?
+			if (!pending.ht && !ht64_reserve(&pending, 64)) goto oom;
+			uint64_t hh = hash64(h);
+			for (int32_t k = hh;;) {
+				k = ht64_lookup(hh, pending.exp, k);
+				if (pending.ht[k][0] == DSHT64_INVALID) break;
+				const uint64_t j = pending.ht[k][1];
+				if (pending.ht[k][0] == h && !strcmp(values[j] ? values[j] : "", v)) {
+					found = resolved[j];
+					break;
+				}
+			}
+			if (found != DSHT64_INVALID) {
+				resolved[i] = found;
+				continue;
+			}
+
+			if (!ht64_reserve(&pending, (uint32_t) (npending + 1))) goto oom;
+			if (npending % 1024 == 0) {
+				void *mem = DSREALLOC(pending_rows, (npending + 1024) * sizeof(uint64_t));
+				if (!mem) goto oom;
+				pending_rows = mem;
+			}
+			ht64_insert_dup(&pending, h, i);
+			resolved[i] = SETSTRS_PENDING | npending;
+			pending_rows[npending++] = i;
+			need += len + 1;
+		}
+	}
+
+	// pass 2: make space for all the new strings at once, then copy them in
+	if (need > 0) {
+		if (!compacted && strheap_capacity(d) < d->strheap_sz + need && d->strheap_freed >= d->strheap_sz / 2) {
+			const char *strheap = (char *) d + d->strheap_start;
+			int any_in_heap = 0;
+			for (uint64_t i = 0; i < n && !any_in_heap; i++) {
+				const char *v = values[i];
+				any_in_heap = v >= strheap && v < strheap + d->strheap_sz;
+			}
+			if (!any_in_heap) {
+				if (!strheap_compact(d, idx)) goto oom;
+				compacted = 1;
+				ht64_del(&pending);
+				npending = need = 0;
+				goto resolve;
+			}
+		}
+		if (strheap_capacity(d) < d->strheap_sz + need) {
+			d = more_strheap(idx, d->strheap_sz + need - strheap_capacity(d));
+			if (!d) goto oom;
+		}
+		if (!ht64_reserve(strindex, (uint32_t) (strindex->len + npending))) goto oom;
+
+		char *strheap = (char *) d + d->strheap_start;
+		for (uint64_t k = 0; k < npending; k++) {
+			const char *v = values[pending_rows[k]] ? values[pending_rows[k]] : "";
+			const uint64_t h = strhash(v, &len);
+			const uint64_t newstr = d->strheap_sz;
+			memcpy(strheap + newstr, v, len + 1);
+			d->strheap_sz += len + 1;
+			ht64_insert_dup(strindex, h, newstr);
+			pending_rows[k] = newstr; // reuse as the new handle
+		}
+	}
+
+	// pass 3: assign handles
+	{
+		uint64_t *handles = (uint64_t *) ((char *) d + d->arrheap_start + d->columns[colidx].offset) + start;
+		for (uint64_t i = 0; i < n; i++) {
+			const uint64_t newstr = resolved[i] & SETSTRS_PENDING ? pending_rows[resolved[i] & ~SETSTRS_PENDING] : resolved[i];
+			strref_move(d, idx, handles[i], newstr);
+			handles[i] = newstr;
+		}
+	}
+
+	DSFREE(resolved);
+	if (pending_rows) DSFREE(pending_rows);
+	ht64_del(&pending);
+	counters->nintern += n;
+	counters->nintern_hits += n - npending;
+	counters->string_ns = string_ns + (now_ns() - t0);
+	return d;
+
+	oom:
+	nonfatal("dataset.setstrs: out of memory");
+	if (resolved) DSFREE(resolved);
+	if (pending_rows) DSFREE(pending_rows);
+	ht64_del(&pending);
+	return 0;
+}
+#undef SETSTRS_PENDING
+
 static void
-reassign_arrayoffsets (ds *d,  uint32_t new_crow)
+reassign_arrayoffsets (ds *d, uint64_t idx, uint64_t new_crow)
 {
-	uint64_t cur_arrheap_used_sz = actual_arrheap_sz(d);
-
+	// Re-lay out the array heap so that each column has space for new_crow
+	// rows. Only the nrow rows in use are moved, and any reserved space past
+	// them is zeroed. Columns move towards the end of the heap when growing
+	// (so iterate backwards) and towards the start when shrinking.
 	char * arrheap = ((char *)d) + d->arrheap_start;
-	char * arrheap_end = arrheap + cur_arrheap_used_sz;
-
-	for(uint32_t i = 1; i < d->ncol; i++) {
+	const uint64_t old_end = actual_arrheap_sz(d);
+	uint64_t moved = 0;
 
-		ds_column * lastcol = d->columns+i-1;
+	if (d->ncol == 0) return;
+	const uint64_t t0 = resize_begin(idx);
 
-		const size_t lastcol_oldsz = compute_col_reserved_space(d->crow, lastcol);
-		const size_t lastcol_newsz = compute_col_reserved_space(new_crow, lastcol);
+	// start from the offset of the first column to be moved
+	uint64_t new_off = 0;
+	if (new_crow >= d->crow) {
+		for (uint32_t i = 0; i + 1 < d->ncol; i++)
+			new_off += compute_col_reserved_space(new_crow, &d->columns[i]);
+	}
 
-		const ptrdiff_t shift   = lastcol_newsz - lastcol_oldsz;
-		char * mov_src = arrheap + lastcol_oldsz + lastcol->offset;
-		char * mov_dst = mov_src + shift;
+	for (uint32_t k = 0; k < d->ncol; k++) {
+		const uint32_t i = new_crow >= d->crow ? d->ncol - 1 - k : k;
+		ds_column * c = d->columns + i;
 
-		// since we're forwards-iterating, if we forward shift, we need to move the entire array heap
-		const ptrdiff_t nbytes  = (shift > 0)  ?  (arrheap_end - mov_src)  :  lastcol_oldsz;
+		if (new_crow < d->crow && i > 0) {
+			// forwards iteration: offset follows the previous (already moved) column
+			new_off = d->columns[i-1].offset + compute_col_reserved_space(new_crow, d->columns + i - 1);
+		}
 
-		memmove (mov_dst, mov_src, nbytes);
-		arrheap_end += shift;
+		const uint64_t rowsz  = type_size[abs_i8(c->type)] * stride(c);
+		const uint64_t nused  = (d->nrow < new_crow ? d->nrow : new_crow) * rowsz;
+		const uint64_t newsz  = compute_col_reserved_space(new_crow, c);
 
-		if (shift > 0) memset (mov_src, 0, mov_dst-mov_src);
+		if (new_off != c->offset) {
+			memmove(arrheap + new_off, arrheap + c->offset, nused);
+			moved += nused;
+		}
+		memset(arrheap + new_off + nused, 0, newsz - nused);
+		c->offset = new_off;
 
-		d->columns[i].offset = mov_dst-arrheap;
+		if (new_crow >= d->crow && i > 0) {
+			// backwards iteration: offset precedes this one
+			new_off -= compute_col_reserved_space(new_crow, d->columns + i - 1);
+		}
 	}
 
+	// clear out any space that's no longer used at the end
+	const uint64_t new_end = actual_arrheap_sz_for(d, new_crow);
+	if (new_end < old_end) memset(arrheap + new_end, 0, old_end - new_end);
+
 	d->stats.nreassign_arroffsets++;
+	resize_end(idx, moved, t0);
+}
+
+// Change the space reserved for column i on the array heap to newsz bytes,
+// moving the columns after it in place. Bytes that are no longer used at the
+// end of the heap are zeroed, as is the gap if the column grows; the column's
+// own contents are left for the caller to fill in. Returns the (possibly
+// reallocated) dataset or null if out of memory.
+static ds *
+resize_colspace (ds *d, uint64_t idx, uint32_t i, uint64_t newsz)
+{
+	const uint64_t oldsz = compute_col_reserved_space(d->crow, d->columns + i);
+	const uint64_t end   = actual_arrheap_sz(d);
+
+	if (newsz > oldsz && end + newsz - oldsz > arrheap_capacity(d)) {
+		d = more_arrheap(idx, end + newsz - oldsz - arrheap_capacity(d));
+		if (!d) return 0;
+	}
+
+	const uint64_t t0 = resize_begin(idx);
+	char * arrheap = ((char *)d) + d->arrheap_start;
+	const uint64_t next = d->columns[i].offset + oldsz;
+	memmove(arrheap + d->columns[i].offset + newsz, arrheap + next, end - next);
+	if (newsz < oldsz) memset(arrheap + end - (oldsz - newsz), 0, oldsz - newsz);
+	else memset(arrheap + next, 0, newsz - oldsz);
+
+	for (uint32_t j = i + 1; j < d->ncol; j++)
+		d->columns[j].offset = d->columns[j].offset - oldsz + newsz;
+	resize_end(idx, end - next, t0);
+
+	return d;
 }
 
 static inline void
@@ -931,585 +2360,4854 @@ copyval(
 
 static inline ds *
 copystr(
-	ds *dst_ds, ds_column *dst_col, uint64_t dst_idx,
+	ds *dst_ds, uint64_t dst_slot, ds_column *dst_col, uint64_t dst_idx,
 	ds *src_ds, ds_column *src_col, uint64_t src_idx
 ) {
 	char *str = getstr(src_ds, src_col, src_idx);
-	return setstr(dst_ds, dst_col, dst_idx, str);
+	return setstr(dst_ds, dst_slot, dst_col, dst_idx, str);
 }
 
 /*
-===============================================================================
-                           ACTUAL API FUNCTIONS
-===============================================================================
+	Column compression in the snappy raw format, so that compressed column
+	data is readable by any snappy implementation (e.g., python-snappy's
+	uncompress). The input is split into DSCOMPRESS_CHUNK-byte chunks that
+	are compressed in parallel. Like the reference implementation, matches
+	never cross 64 kB block boundaries, so the compressed chunks may simply be
+	concatenated after the uncompressed length header.
 */
+#define DSSNAPPY_BLOCK_SZ (1 << 16)
+#define DSSNAPPY_TABLE_EXP 14
+#define DSCOMPRESS_CHUNK (UINT64_C(1) << 20)
+#define DSCOMPRESS_MIN_BYTES (UINT64_C(1) << 18) // per thread
+
+static inline uint32_t
+load32 (const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
 
-
-
-uint64_t dset_new(void) {
-	const size_t DS_INITIAL_SZ = 1<<15; // 32 kB as a good default?
-	ds * d = 0;
-
-	uint64_t handle = dset_new_(DS_INITIAL_SZ, &d);
-	if(handle == UINT64_MAX) 
-		return handle;
-
-	*d = (ds) {
-		.total_sz = DS_INITIAL_SZ,
-		.arrheap_start = sizeof(*d),
-		.strheap_start = sizeof(*d),
-		.strheap_sz    = 1, // the null string is the string with index zero.
-	};
-
-	// 0x94 CSDAT
-	d->magic[0] = 0x94;
-	d->magic[1] = 0x43;
-	d->magic[2] = 0x53;
-	d->magic[3] = 0x44;
-	d->magic[4] = 0x41;
-	d->magic[5] = 0x54;
-
-	return handle;
+static inline uint64_t
+snappy_bound (uint64_t n) {
+	return 32 + n + n / 6;
 }
 
-uint64_t dset_copy(uint64_t dset)
-{
-	uint64_t idx;
-	uint16_t generation;
+static inline uint8_t *
+snappy_literal (uint8_t *op, const uint8_t *lit, uint64_t len) {
+	uint64_t n = len - 1;
+	if (n < 60) {
+		*op++ = (uint8_t) (n << 2);
+	} else {
+		uint8_t *tag = op++;
+		uint8_t count = 0;
+		for (; n > 0; n >>= 8, count++) *op++ = (uint8_t) n;
+		*tag = (uint8_t) ((59 + count) << 2);
+	}
+	memcpy(op, lit, len);
+	return op + len;
+}
 
-	if(! handle_lookup(dset, "dset_del", &generation, &idx))
-		return UINT64_MAX;
+static inline uint8_t *
+snappy_copy (uint8_t *op, uint64_t offset, uint64_t len) {
+	// at most 64 bytes may be copied at a time, and each copy has at least 4
+	while (len > 0) {
+		const uint64_t l = len >= 68 ? 64 : len > 64 ? 60 : len;
+		if (l < 12 && offset < 2048) {
+			*op++ = (uint8_t) (1 | ((l - 4) << 2) | ((offset >> 8) << 5));
+			*op++ = (uint8_t) offset;
+		} else {
+			*op++ = (uint8_t) (2 | ((l - 1) << 2));
+			*op++ = (uint8_t) offset;
+			*op++ = (uint8_t) (offset >> 8);
+		}
+		len -= l;
+	}
+	return op;
+}
 
-	ds *oldds = ds_module.slots[idx].memory;
+// Compress a single block of at most DSSNAPPY_BLOCK_SZ bytes
+static uint8_t *
+snappy_block (const uint8_t *in, uint64_t n, uint8_t *op) {
+	uint16_t table[1 << DSSNAPPY_TABLE_EXP];
+	const uint8_t *ip = in, *next_emit = in, *end = in + n;
+	const uint8_t *candidate;
+
+	// size the table to the block, it must be cleared for every block
+	int exp = 8;
+	while (exp < DSSNAPPY_TABLE_EXP && ((uint64_t) 1 << exp) < n) exp++;
+	const int shift = 32 - exp;
+	memset(table, 0, sizeof(uint16_t) << exp);
+	#define SNAPPY_HASH(p) ((load32(p) * 0x1e35a7bdU) >> shift)
+
+	if (n >= 15) {
+		const uint8_t *limit = end - 15; // leave room for unchecked 4-byte loads
+		for (ip++;; ip++) {
+			// look for a match, skipping ahead faster the longer none is found
+			for (uint32_t skip = 32;;) {
+				const uint8_t *next = ip + (skip++ >> 5);
+				if (next > limit) goto emit_remainder;
+				const uint32_t h = SNAPPY_HASH(ip);
+				candidate = in + table[h];
+				table[h] = (uint16_t) (ip - in);
+				if (load32(ip) == load32(candidate)) break;
+				ip = next;
+			}
 
-	ds* newds = 0;
-	uint64_t newhandle = dset_new_(oldds->total_sz, &newds);
+			op = snappy_literal(op, next_emit, ip - next_emit);
+
+			// emit copies for as long as the next position also matches
+			do {
+				const uint8_t *base = ip;
+				const uint8_t *m = candidate + 4;
+				ip += 4;
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+				// compare 8 bytes at a time, the first differing bit gives the match end
+				for (uint64_t u, v; ip + 8 <= end; ip += 8, m += 8) {
+					memcpy(&u, ip, 8);
+					memcpy(&v, m, 8);
+					if (u != v) {
+						ip += __builtin_ctzll(u ^ v) >> 3;
+						goto matched;
+					}
+				}
+#endif
+				while (ip < end && *ip == *m) ip++, m++;
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+				matched:
+#endif
+				op = snappy_copy(op, base - candidate, ip - base);
+				next_emit = ip;
+				if (ip >= limit) goto emit_remainder;
+
+				table[SNAPPY_HASH(ip - 1)] = (uint16_t) (ip - 1 - in);
+				const uint32_t h = SNAPPY_HASH(ip);
+				candidate = in + table[h];
+				table[h] = (uint16_t) (ip - in);
+			} while (load32(ip) == load32(candidate));
+		}
+	}
+	#undef SNAPPY_HASH
 
-	if (newhandle != UINT64_MAX) 
-		memcpy(newds,oldds,oldds->total_sz); 
+	emit_remainder:
+	if (next_emit < end) op = snappy_literal(op, next_emit, end - next_emit);
+	return op;
+}
 
-	return newhandle;
+// Compress n bytes (a multiple of DSSNAPPY_BLOCK_SZ unless it's the end of the
+// input) without the length header. Output is at most snappy_bound(n) bytes
+static uint64_t
+snappy_chunk (const uint8_t *in, uint64_t n, uint8_t *out) {
+	uint8_t *op = out;
+	for (uint64_t i = 0; i < n; i += DSSNAPPY_BLOCK_SZ)
+		op = snappy_block(in + i, n - i < DSSNAPPY_BLOCK_SZ ? n - i : DSSNAPPY_BLOCK_SZ, op);
+	return op - out;
 }
 
-// Compute the inner join of two Datasets R and S by matching values in the
-// column with the given key. Currently only 64-bit columns (e.g., T_U64) with
-// zero shape may be specified as keys.
-//
-// Not recommended for key columns with duplicate values (does not deduplicate
-// and only matches one row in joined dataset).
-//
-// Implements Classic Hash Join algorithm
-// https://en.wikipedia.org/wiki/Hash_join#Classic_hash_join
-typedef struct ds_innerjoin_coldata {
-	ds_column *col;
-	int itemsize;
-	int is_str;
-} ds_innerjoin_coldata;
+static inline uint64_t
+varint_len (uint64_t v) {
+	uint64_t i = 1;
+	for (; v >= 0x80; v >>= 7) i++;
+	return i;
+}
 
-uint64_t dset_innerjoin(const char *key, uint64_t dset_r, uint64_t dset_s)
-{
-	uint64_t dset = 0;
-	uint64_t idx_r, idx_s;
-	uint16_t generation_r, generation_s;
-	ds *ds_r, *ds_s;
-	ds_column *keycol_r, *keycol_s;
-	ds_ht64 idx_lookup; idx_lookup.ht = 0;
-	uint64_t *keydata_r, *keydata_s;
-	uint32_t nrow = 0;
-
-	// Look up the two datasets and columns to join
-	if (!(ds_r = handle_lookup(dset_r, "dset_innerjoin", &generation_r, &idx_r))) return UINT64_MAX;
-	if (!(ds_s = handle_lookup(dset_s, "dset_innerjoin", &generation_s, &idx_s))) return UINT64_MAX;
-	keycol_r = column_lookup(ds_r, key);
-	keycol_s = column_lookup(ds_s, key);
-
-	if (!keycol_r || !keycol_s) {
-		nonfatal("dset_innerjoin: input dataset does not contain %s column", key);
-		return UINT64_MAX;
-	}
-	if (keycol_r->type != keycol_s->type) {
-		nonfatal("dset_innerjoin: input %s column types do match (%d, %d)", key, keycol_r->type, keycol_s->type);
-		return UINT64_MAX;
-	}
-	if (keycol_r->shape[0] != 0 || keycol_s->shape[0] != 0) {
-		nonfatal("dset_innerjoin: cannot innerjoin column %s with non-zero shape", key);
-		return UINT64_MAX;
-	}
+static inline uint64_t
+varint_write (uint8_t *out, uint64_t v) {
+	uint64_t i = 0;
+	for (; v >= 0x80; v >>= 7) out[i++] = (uint8_t) (v | 0x80);
+	out[i++] = (uint8_t) v;
+	return i;
+}
 
-	if (keycol_r->type != T_U64 && keycol_r->type != T_I64 && keycol_r->type != T_F64 && keycol_r->type != T_C32) {
-		// TODO: Allow innerjoining any type (or least numeric types)
-		nonfatal("dset_innerjoin: cannot innerjoin column %s with non-64bit type %d", key, keycol_r->type);
-		return UINT64_MAX;
+// Returns the number of header bytes read, or 0 if invalid
+static inline uint64_t
+varint_read (const uint8_t *in, uint64_t n, uint64_t *v) {
+	*v = 0;
+	for (uint64_t i = 0; i < n && i < 5; i++) {
+		*v |= (uint64_t) (in[i] & 0x7f) << (7 * i);
+		if (!(in[i] & 0x80)) return *v <= UINT32_MAX ? i + 1 : 0;
 	}
+	return 0;
+}
 
-	// Allocate new dataset with unioned fields
-	dset = dset_new();
-
-	// Populate fields from the first dataset R. Declare a stack-allocated
-	// dynamic array of structs which memoize the required column data
-	ds_column *col;
-	char *colkey;
-
-	// Cache source column details (try to use stack version if possible)
-	ds_innerjoin_coldata src_coldata_stack[1024];
-	ds_innerjoin_coldata *src_coldata = src_coldata_stack;
-	if (ds_r->ncol + ds_s->ncol > 1024) {
-		src_coldata = DSREALLOC(0, sizeof(ds_innerjoin_coldata) * (ds_r->ncol + ds_s->ncol));
-	}
-
-	uint32_t nrcol = 0, nscol = 0; // number of columns used from R and S
-	for (uint32_t c = 0; c < ds_r->ncol; c++) {
-		colkey = dset_key(dset_r, c);
-		if (strcmp(key, colkey) == 0 || !column_lookup(ds_s, colkey)) {
-			// key is either target join key or not in other dataset, add now
-			// with correct type details
-			col = column_lookup(ds_r, colkey);
-			if (!dset_addcol_array(
-				dset, colkey, col->type,
-				col->shape[0], col->shape[1], col->shape[2]
-			)) {
-				nonfatal("dset_innerjoin: cannot add column %s to result dataset", colkey);
-				goto fail;
+// Decompress exactly outsz bytes. Returns 0 if the input is invalid
+static int
+snappy_decompress (const uint8_t *in, uint64_t n, uint8_t *out, uint64_t outsz) {
+	uint64_t len;
+	const uint64_t hdr = varint_read(in, n, &len);
+	if (!hdr || len != outsz) return 0;
+
+	const uint8_t *ip = in + hdr, *end = in + n;
+	uint8_t *op = out, *oend = out + outsz;
+
+	while (ip < end) {
+		const uint8_t tag = *ip++;
+		uint64_t l, offset;
+
+		switch (tag & 3) {
+		case 0: // literal
+			l = tag >> 2;
+			if (l >= 60) {
+				const uint64_t nb = l - 59;
+				if ((uint64_t) (end - ip) < nb) return 0;
+				l = 0;
+				for (uint64_t i = 0; i < nb; i++) l |= (uint64_t) ip[i] << (8 * i);
+				ip += nb;
 			}
-			src_coldata[nrcol].col = col;
-			src_coldata[nrcol].itemsize = type_size[abs_i8(col->type)] * stride(col);
-			src_coldata[nrcol].is_str = col->type == T_STR;
-			nrcol++;
-		} // otherwise defer to dataset S for this column
-	}
-
-	// Populate fields from the second dataset S
-	for (uint32_t c = 0; c < ds_s->ncol; c++) {
-		colkey = dset_key(dset_s, c);
-		if (strcmp(key, colkey) == 0) {
-			continue; // already added in previous loop
+			l++;
+			if ((uint64_t) (end - ip) < l || (uint64_t) (oend - op) < l) return 0;
+			memcpy(op, ip, l);
+			ip += l;
+			op += l;
+			continue;
+		case 1:
+			if (ip >= end) return 0;
+			l = 4 + ((tag >> 2) & 7);
+			offset = ((uint64_t) (tag >> 5) << 8) | *ip++;
+			break;
+		case 2:
+			if (end - ip < 2) return 0;
+			l = 1 + (tag >> 2);
+			offset = ip[0] | (uint64_t) ip[1] << 8;
+			ip += 2;
+			break;
+		default:
+			if (end - ip < 4) return 0;
+			l = 1 + (tag >> 2);
+			offset = load32(ip);
+			ip += 4;
+			break;
 		}
-		col = column_lookup(ds_s, colkey);
-		if (!dset_addcol_array(
-			dset, colkey, col->type,
-			col->shape[0], col->shape[1], col->shape[2]
-		)) {
-			nonfatal("dset_innerjoin: cannot add column %s to result dataset", colkey);
-			goto fail;
+
+		if (offset == 0 || offset > (uint64_t) (op - out) || (uint64_t) (oend - op) < l) return 0;
+		const uint8_t *src = op - offset;
+		if (offset >= l) {
+			memcpy(op, src, l);
+			op += l;
+		} else {
+			// overlapping copy repeats the last offset bytes
+			for (uint64_t i = 0; i < l; i++) *op++ = *src++;
 		}
-		src_coldata[nrcol + nscol].col = col;
-		src_coldata[nrcol + nscol].itemsize = type_size[abs_i8(col->type)] * stride(col);
-		src_coldata[nrcol + nscol].is_str = col->type == T_STR;
-		nscol++;
 	}
+	return op == oend;
+}
 
-	// Get the data for each column to join
-	keydata_r = dset_get(dset_r, key);
-	keydata_s = dset_get(dset_s, key);
+typedef struct {
+	uint32_t n;
+	const uint8_t **src;
+	const uint64_t *srcsz;
+	uint8_t **dst;
+	uint64_t *dstsz;      // decompress: size of each output. compress: size of each task's output
+	const uint64_t *task; // first task index for each buffer, with n + 1 entries
+	uint64_t next;        // next task to take
+	uint64_t failed;
+} ds_codec_ctx;
+
+// Output location of a compressed chunk before it is moved into place
+static inline uint64_t
+chunk_scratch (uint64_t hdr, uint64_t chunk) {
+	return hdr + chunk * snappy_bound(DSCOMPRESS_CHUNK);
+}
 
-	// Create a hash table of values which store the index of each column value
-	// in dataset S
-	ht64_new(&idx_lookup, ds_s->nrow);
-	for (uint64_t j = 0; j < ds_s->nrow; j++) {
-		if (!ht64_insert(&idx_lookup, keydata_s[j], j)) {
-			nonfatal("dset_innerjoin: hash table full?? cannot proceed");
-			goto fail;
-		}
+static void
+compress_task (void *ctx, uint32_t tid, uint32_t nthreads) {
+	(void) tid; (void) nthreads;
+	ds_codec_ctx *x = ctx;
+	for (uint64_t t; (t = DSATOMIC_FETCH_ADD(x->next, 1)) < x->task[x->n];) {
+		uint32_t i = 0;
+		while (x->task[i + 1] <= t) i++;
+		const uint64_t k = t - x->task[i];
+		const uint64_t start = k * DSCOMPRESS_CHUNK;
+		const uint64_t len = x->srcsz[i] - start < DSCOMPRESS_CHUNK ? x->srcsz[i] - start : DSCOMPRESS_CHUNK;
+		uint8_t *out = x->dst[i] + chunk_scratch(varint_len(x->srcsz[i]), k);
+		x->dstsz[t] = snappy_chunk(x->src[i] + start, len, out);
 	}
+}
 
-	// Determine resulting number of rows in joined dataset. Note that entries
-	// in dataset R that share the same value will not be de-duplicated and only
-	// the highest index matching row in dataset S will be used.
-	for (uint64_t i = 0; i < ds_r->nrow; i++) {
-		if (ht64_has(&idx_lookup, keydata_r[i])) nrow++;
+static void
+decompress_task (void *ctx, uint32_t tid, uint32_t nthreads) {
+	(void) tid; (void) nthreads;
+	ds_codec_ctx *x = ctx;
+	for (uint64_t i; (i = DSATOMIC_FETCH_ADD(x->next, 1)) < x->n;) {
+		if (!snappy_decompress(x->src[i], x->srcsz[i], x->dst[i], x->dstsz[i])) DSATOMIC_STORE(x->failed, 1);
 	}
-	dset_addrows(dset, nrow);
-
-	// Populate columns of new dataset
-	uint64_t idx;
-	uint16_t generation;
-	ds *d;
-	uint32_t c;
-
-	if (!(d = handle_lookup(dset, "dset_innerjoin", &generation, &idx))) return UINT64_MAX;
+}
 
-	// Indeces i corresponds to R indices, j to S indices, k to the result dataset
-	for (uint64_t i = 0, k = 0, j = 0; i < ds_r->nrow; i++) {
-		if (!ht64_find(&idx_lookup, keydata_r[i], &j)) {
-			continue; // not in dataset, don't populate it
-		}
+/*
+	Byte-shuffle filter: the first byte of every element, then the second byte
+	of every element, and so on. Groups the slowly-varying sign and exponent
+	bytes of numeric columns together so that they compress much better.
+	Elements are processed in tiles so that both sides stay in cache.
+*/
+#define DSSHUFFLE_TILE 1024
 
-		// Copy row values from Dataset R
-		for (c = 0; c < nrcol; c++) {
-			if (src_coldata[c].is_str) {
-				d = copystr(d, &d->columns[c], k, ds_r, src_coldata[c].col, i);
-			} else {
-				copyval(d, &d->columns[c], k, ds_r, src_coldata[c].col, i, (size_t) src_coldata[c].itemsize);
-			}
-		}
+typedef struct {
+	const uint8_t *src;
+	uint8_t *dst;
+	uint64_t nel;
+	uint32_t elsize;
+	int reverse;
+} ds_shuffle_ctx;
 
-		// Copy row values from Dataset S
-		for (c = nrcol; c < nrcol + nscol; c++) {
-			if (src_coldata[c].is_str) {
-				d = copystr(d, &d->columns[c], k, ds_s, src_coldata[c].col, j);
+static void
+shuffle_task (void *ctx, uint32_t tid, uint32_t nthreads) {
+	ds_shuffle_ctx *x = ctx;
+	const uint64_t start = share_start(x->nel, tid, nthreads);
+	const uint64_t end = share_start(x->nel, tid + 1, nthreads);
+	const uint32_t k = x->elsize;
+	for (uint64_t i0 = start; i0 < end; i0 += DSSHUFFLE_TILE) {
+		const uint64_t i1 = end - i0 < DSSHUFFLE_TILE ? end : i0 + DSSHUFFLE_TILE;
+		for (uint32_t b = 0; b < k; b++) {
+			if (x->reverse) {
+				const uint8_t *in = x->src + b * x->nel;
+				for (uint64_t i = i0; i < i1; i++) x->dst[i * k + b] = in[i];
 			} else {
-				copyval(d, &d->columns[c], k, ds_s, src_coldata[c].col, j, (size_t) src_coldata[c].itemsize);
+				uint8_t *out = x->dst + b * x->nel;
+				for (uint64_t i = i0; i < i1; i++) out[i] = x->src[i * k + b];
 			}
 		}
-
-		k++; // increment row
 	}
+}
 
-	// Success! Skip over the fail case, cleanup and return the handle
-	goto done;
-
-	fail:
-	// Delete and invalidate dataset
-	if (dset) dset_del(dset);
-	dset = UINT64_MAX;
+static int
+byteshuffle (const void *src, void *dst, uint64_t size, uint32_t elsize, int reverse, const char *fn)
+{
+	if (!elsize || src == dst) {
+		nonfatal("%s: invalid element size %" PRIu32 " or overlapping buffers", fn, elsize);
+		return 0;
+	}
+	ds_shuffle_ctx x = { src, dst, size / elsize, elsize, reverse };
+	parallel_run(nthreads_for(x.nel), shuffle_task, &x);
+	// trailing partial element is copied as-is
+	const uint64_t tail = x.nel * elsize;
+	memcpy((uint8_t *) dst + tail, (const uint8_t *) src + tail, size - tail);
+	return 1;
+}
 
-	done:
-	// Clean up hash table
-	// Free up memoized column data, if necessary
-	ht64_del(&idx_lookup);
-	if (src_coldata != src_coldata_stack) DSFREE(src_coldata);
+/*
+	STAR files (e.g., from RELION) store each table as "loop_" followed by
+	column labels and then one row of whitespace-separated values per line,
+	until a blank line, the next block or the end of the file. dset_read_star
+	parses the rows in three passes:
+	1. find where each row starts (serial, about as fast as memchr)
+	2. infer the type of each column without a known type (parallel)
+	3. parse values straight into numeric columns and find the tokens of
+	   string columns (parallel), then intern each string column at once
+*/
+#define DSSTAR_INT   1
+#define DSSTAR_FLOAT 2
 
-	return dset;
+typedef struct {
+	const char *text;
+	const uint64_t *rows;  // offset of each row in text
+	uint64_t nrow;
+	uint64_t size;
+	uint32_t ncol;
+	const int *types;      // type of each column, 0 to infer
+	uint8_t *kinds;        // DSSTAR_* of all values in each column, per thread
+	void **cols;           // numeric column data
+	uint64_t **stroff;     // offset of each string in text
+	uint32_t **strsz;      // size of each string
+	uint64_t badrow[DSPARALLEL_MAX_THREADS]; // first row with an error
+	uint32_t badcol[DSPARALLEL_MAX_THREADS]; // its column, or ncol if wrong count
+} ds_star_ctx;
+
+static inline int
+star_ws (char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
 }
 
-void dset_del(uint64_t dset)
+// Find the next value between p and the end of the line. Quoted values end at
+// a matching quote followed by whitespace. Returns where to continue from or
+// 0 at the end of the line (or a comment)
+static const char *
+star_token (const char *p, const char *eol, const char **tok, uint32_t *toksz)
+{
+	while (p < eol && star_ws(*p)) p++;
+	if (p >= eol || *p == '#') return 0;
+	if (*p == '\'' || *p == '"') {
+		const char *e = p + 1;
+		while (e < eol && !(*e == *p && (e + 1 == eol || star_ws(e[1])))) e++;
+		if (e < eol) {
+			*tok = p + 1;
+			*toksz = (uint32_t) (e - p - 1);
+			return e + 1;
+		}
+	}
+	*tok = p;
+	while (p < eol && !star_ws(*p)) p++;
+	*toksz = (uint32_t) (p - *tok);
+	return p;
+}
+
+static int
+star_i64 (const char *s, uint32_t n, int64_t *out)
+{
+	uint32_t i = n > 0 && (s[0] == '-' || s[0] == '+');
+	if (i == n || n - i > 18) return 0; // longer values may overflow
+	int64_t v = 0;
+	for (; i < n; i++) {
+		if (s[i] < '0' || s[i] > '9') return 0;
+		v = v * 10 + (s[i] - '0');
+	}
+	*out = s[0] == '-' ? -v : v;
+	return 1;
+}
+
+static int
+star_f64 (const char *s, uint32_t n, double *out)
+{
+	// exact fast path for up to 15 significant digits and small exponents,
+	// which covers almost every value written by RELION
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	uint32_t i = n > 0 && (s[0] == '-' || s[0] == '+');
+	uint64_t mant = 0;
+	int ndigits = 0, exp10 = 0, any = 0;
+	for (; i < n && s[i] >= '0' && s[i] <= '9'; i++, any = 1) {
+		if (mant || s[i] != '0') ndigits++;
+		mant = mant * 10 + (uint64_t) (s[i] - '0');
+	}
+	if (i < n && s[i] == '.') {
+		for (i++; i < n && s[i] >= '0' && s[i] <= '9'; i++, any = 1) {
+			if (mant || s[i] != '0') ndigits++;
+			mant = mant * 10 + (uint64_t) (s[i] - '0');
+			exp10--;
+		}
+	}
+	if (any && i < n && (s[i] == 'e' || s[i] == 'E')) {
+		int64_t e;
+		if (n - i <= 5 && star_i64(s + i + 1, n - i - 1, &e)) {
+			exp10 += (int) e;
+			i = n;
+		}
+	}
+	if (any && i == n && ndigits <= 15 && exp10 >= -22 && exp10 <= 22) {
+		const double v = exp10 < 0 ? (double) mant / pow10[-exp10] : (double) mant * pow10[exp10];
+		*out = s[0] == '-' ? -v : v;
+		return 1;
+	}
+
+	// slow path for everything else: decimal values with more digits or
+	// larger exponents, and nan, inf or infinity (any case, optionally
+	// signed). Other strtod syntax such as hex floats or nan(...) is rejected
+	char buf[64];
+	char *end;
+	if (n == 0 || n >= sizeof(buf)) return 0;
+	for (i = 0; i < n; i++) buf[i] = s[i] >= 'A' && s[i] <= 'Z' ? (char) (s[i] - 'A' + 'a') : s[i];
+	buf[n] = '\0';
+	const char *word = buf + (buf[0] == '-' || buf[0] == '+');
+	if (strcmp(word, "nan") && strcmp(word, "inf") && strcmp(word, "infinity")) {
+		for (i = 0; i < n; i++)
+			if (!((buf[i] >= '0' && buf[i] <= '9') || buf[i] == '.' || buf[i] == 'e' || buf[i] == '-' || buf[i] == '+'))
+				return 0;
+	}
+	*out = strtod(buf, &end);
+	return end == buf + n;
+}
+
+// Values of row r with at most ncol + 1 tokens. Returns the number found
+static uint32_t
+star_row (const ds_star_ctx *x, uint64_t r, const char **tok, uint32_t *toksz)
+{
+	const char *p = x->text + x->rows[r];
+	const char *end = x->text + x->size;
+	const char *eol = memchr(p, '\n', (size_t) (end - p));
+	if (!eol) eol = end;
+	uint32_t n = 0;
+	while (n <= x->ncol && (p = star_token(p, eol, &tok[n], &toksz[n]))) n++;
+	return n;
+}
+
+static void
+star_infer (void *ctx, uint32_t tid, uint32_t nthreads) {
+	ds_star_ctx *x = ctx;
+	const uint64_t end = share_start(x->nrow, tid + 1, nthreads);
+	const char **tok = DSREALLOC(0, ((uint64_t) x->ncol + 1) * (sizeof(char *) + sizeof(uint32_t)));
+	uint32_t *toksz = (uint32_t *) (tok + x->ncol + 1);
+	uint8_t *kinds = x->kinds + (uint64_t) tid * x->ncol;
+	if (!tok) {
+		x->badrow[tid] = 0;
+		x->badcol[tid] = x->ncol;
+		return;
+	}
+	for (uint64_t r = share_start(x->nrow, tid, nthreads); r < end; r++) {
+		if (star_row(x, r, tok, toksz) != x->ncol) {
+			x->badrow[tid] = r;
+			x->badcol[tid] = x->ncol;
+			break;
+		}
+		for (uint32_t c = 0; c < x->ncol; c++) {
+			int64_t i;
+			double f;
+			if (x->types[c] || !kinds[c]) continue;
+			if ((kinds[c] & DSSTAR_INT) && !star_i64(tok[c], toksz[c], &i)) kinds[c] &= ~DSSTAR_INT;
+			if ((kinds[c] & DSSTAR_FLOAT) && !star_f64(tok[c], toksz[c], &f)) kinds[c] &= ~DSSTAR_FLOAT;
+		}
+	}
+	DSFREE(tok);
+}
+
+static void
+star_parse (void *ctx, uint32_t tid, uint32_t nthreads) {
+	ds_star_ctx *x = ctx;
+	const uint64_t end = share_start(x->nrow, tid + 1, nthreads);
+	const char **tok = DSREALLOC(0, ((uint64_t) x->ncol + 1) * (sizeof(char *) + sizeof(uint32_t)));
+	uint32_t *toksz = (uint32_t *) (tok + x->ncol + 1);
+	if (!tok) {
+		x->badrow[tid] = 0;
+		x->badcol[tid] = x->ncol;
+		return;
+	}
+	for (uint64_t r = share_start(x->nrow, tid, nthreads); r < end; r++) {
+		if (star_row(x, r, tok, toksz) != x->ncol) {
+			x->badrow[tid] = r;
+			x->badcol[tid] = x->ncol;
+			break;
+		}
+		uint32_t c = 0;
+		for (; c < x->ncol; c++) {
+			int64_t i;
+			double f;
+			if (x->types[c] == T_STR) {
+				x->stroff[c][r] = (uint64_t) (tok[c] - x->text);
+				x->strsz[c][r] = toksz[c];
+			} else if (x->types[c] == T_F64) {
+				if (!star_f64(tok[c], toksz[c], &((double *) x->cols[c])[r])) break;
+			} else if (star_i64(tok[c], toksz[c], &i)) {
+				((int64_t *) x->cols[c])[r] = i;
+			} else if (star_f64(tok[c], toksz[c], &f) && f >= -9.2e18 && f <= 9.2e18 && f == (double) (int64_t) f) {
+				((int64_t *) x->cols[c])[r] = (int64_t) f; // e.g., 1.000000 in an integer column, but not 1.5
+			} else {
+				break;
+			}
+		}
+		if (c < x->ncol) {
+			x->badrow[tid] = r;
+			x->badcol[tid] = c;
+			break;
+		}
+	}
+	DSFREE(tok);
+}
+
+// First error from each thread of a star_infer or star_parse run, or 0
+static int
+star_failed (const ds_star_ctx *x, uint32_t nthreads, const char *fn)
+{
+	uint32_t t = 0;
+	for (uint32_t i = 1; i < nthreads; i++) if (x->badrow[i] < x->badrow[t]) t = i;
+	if (x->badrow[t] == UINT64_MAX) return 0;
+	if (x->badcol[t] == x->ncol) {
+		nonfatal("%s: row %" PRIu64 " does not have %" PRIu32 " values (or out of memory)", fn, x->badrow[t] + 1, x->ncol);
+	} else {
+		nonfatal("%s: cannot parse value %" PRIu32 " of row %" PRIu64, fn, x->badcol[t] + 1, x->badrow[t] + 1);
+	}
+	return 1;
+}
+
+// Format a value of the given dataset column for a STAR file into buf with
+// room for 64 bytes. Returns the formatted size
+static int
+star_format (char *buf, const ds *d, const ds_column *c, uint64_t r)
+{
+	const char *data = (const char *) d + d->arrheap_start + c->offset;
+	int n;
+	char *end;
+	switch (abs_i8(c->type)) {
+	case T_F32: {
+		const float v = ((const float *) data)[r];
+		n = snprintf(buf, 64, "%.7g", v);
+		if (strtof(buf, &end) != v) n = snprintf(buf, 64, "%.9g", v);
+		break;
+	}
+	case T_F64: {
+		const double v = ((const double *) data)[r];
+		n = snprintf(buf, 64, "%.15g", v);
+		if (strtod(buf, &end) != v) n = snprintf(buf, 64, "%.17g", v);
+		break;
+	}
+	case T_I8:  return snprintf(buf, 64, "%" PRId8, ((const int8_t *) data)[r]);
+	case T_I16: return snprintf(buf, 64, "%" PRId16, ((const int16_t *) data)[r]);
+	case T_I32: return snprintf(buf, 64, "%" PRId32, ((const int32_t *) data)[r]);
+	case T_I64: return snprintf(buf, 64, "%" PRId64, ((const int64_t *) data)[r]);
+	case T_U8:  return snprintf(buf, 64, "%" PRIu8, ((const uint8_t *) data)[r]);
+	case T_U16: return snprintf(buf, 64, "%" PRIu16, ((const uint16_t *) data)[r]);
+	case T_U32: return snprintf(buf, 64, "%" PRIu32, ((const uint32_t *) data)[r]);
+	case T_U64: return snprintf(buf, 64, "%" PRIu64, ((const uint64_t *) data)[r]);
+	default: return -1;
+	}
+	// keep floats distinguishable from integers, e.g., 3410.0
+	if (!strpbrk(buf, ".eEnN")) {
+		buf[n++] = '.';
+		buf[n++] = '0';
+		buf[n] = '\0';
+	}
+	return n;
+}
+
+/*
+	Arrow export. A dataset is exported as a struct array with a child for
+	each column. Numeric columns are primitive arrays pointing straight at
+	the column data. Array and complex columns are fixed-size lists of their
+	elements, also without copying. String columns are large_utf8 arrays
+	with offsets and data generated from the string heap.
+
+	Each of the exported schema and array owns a single allocation for all
+	of its child structures, freed by the release callback of the root.
+*/
+#define DSARROW_FORMATSZ 24
+
+typedef struct {
+	void (*done)(void *);  // called when the exported array is released
+	void *ctx;
+	uint32_t nfree;        // number of generated string buffers
+	void **tofree;
+} ds_arrow_private;
+
+typedef struct {
+	const ds *d;
+	const uint64_t *handles;
+	int64_t *offsets;
+	char *data;
+	uint64_t nrow;
+	int copy;              // 0 to find lengths, 1 to copy strings
+} ds_arrowstr_ctx;
+
+static void
+arrowstr_task (void *ctx, uint32_t tid, uint32_t nthreads) {
+	ds_arrowstr_ctx *x = ctx;
+	const char *strheap = (const char *) x->d + x->d->strheap_start;
+	const uint64_t end = share_start(x->nrow, tid + 1, nthreads);
+	for (uint64_t r = share_start(x->nrow, tid, nthreads); r < end; r++) {
+		const char *s = strheap + x->handles[r];
+		if (x->copy) {
+			memcpy(x->data + x->offsets[r], s, (size_t) (x->offsets[r + 1] - x->offsets[r]));
+		} else {
+			x->offsets[r + 1] = (int64_t) strlen(s);
+		}
+	}
+}
+
+// Number of nested Arrow nodes needed for a column
+static uint32_t
+arrow_depth (const ds_column *c) {
+	const int t = abs_i8(c->type);
+	return 1 + (c->shape[0] != 0) + (t == T_C32 || t == T_C64);
+}
+
+static void arrow_release_child_schema (struct ArrowSchema *s) { s->release = 0; }
+static void arrow_release_child_array (struct ArrowArray *a) { a->release = 0; }
+
+static void
+arrow_release_schema (struct ArrowSchema *s) {
+	DSFREE(s->private_data);
+	s->release = 0;
+}
+
+static void
+arrow_release_array (struct ArrowArray *a) {
+	ds_arrow_private *p = a->private_data;
+	for (uint32_t i = 0; i < p->nfree; i++) DSFREE(p->tofree[i]);
+	if (p->done) p->done(p->ctx);
+	DSFREE(p);
+	a->release = 0;
+}
+
+static const char *
+arrow_format (int type) {
+	switch (type) {
+	case T_F32: case T_C32: return "f";
+	case T_F64: case T_C64: return "g";
+	case T_I8:  return "c";
+	case T_I16: return "s";
+	case T_I32: return "i";
+	case T_I64: return "l";
+	case T_U8:  return "C";
+	case T_U16: return "S";
+	case T_U32: return "I";
+	case T_U64: return "L";
+	case T_STR: return "U";
+	default: return 0;
+	}
+}
+
+static int
+arrow_export_schema (const ds *d, struct ArrowSchema *schema, uint32_t nnode, uint64_t keysz)
+{
+	// layout: nodes, child pointers (root's, then one per nested node),
+	// fixed-size list formats, names
+	char *mem = DSREALLOC(0, nnode * (sizeof(struct ArrowSchema) + DSARROW_FORMATSZ)
+		+ ((uint64_t) d->ncol + nnode) * sizeof(void *) + keysz);
+	if (!mem) {
+		nonfatal("dset_export_arrow: out of memory for schema with %" PRIu32 " nodes", nnode);
+		return 0;
+	}
+	struct ArrowSchema *nodes = (struct ArrowSchema *) mem;
+	struct ArrowSchema **children = (struct ArrowSchema **) (nodes + nnode);
+	char *formats = (char *) (children + d->ncol + nnode);
+	char *names = formats + (uint64_t) nnode * DSARROW_FORMATSZ;
+
+	*schema = (struct ArrowSchema) {
+		.format = "+s", .name = "", .n_children = d->ncol, .children = children,
+		.release = arrow_release_schema, .private_data = mem
+	};
+	uint32_t n = 0;
+	for (uint32_t i = 0; i < d->ncol; i++) {
+		const ds_column *c = d->columns + i;
+		const int t = abs_i8(c->type);
+		const uint32_t depth = arrow_depth(c);
+		const char *key = getkey(d, c);
+		const size_t len = strlen(key) + 1;
+		memcpy(names, key, len);
+		children[i] = nodes + n;
+		for (uint32_t k = 0; k < depth; k++, n++) {
+			char *format = formats + (uint64_t) n * DSARROW_FORMATSZ;
+			if (k + 1 < depth) {
+				// fixed-size list of array elements, then of complex parts
+				const uint64_t size = (k == 0 && c->shape[0]) ? stride(c) : 2;
+				snprintf(format, DSARROW_FORMATSZ, "+w:%" PRIu64, size);
+			}
+			nodes[n] = (struct ArrowSchema) {
+				.format = k + 1 < depth ? format : arrow_format(t),
+				.name = k == 0 ? names : "item",
+				.n_children = k + 1 < depth,
+				.children = k + 1 < depth ? &children[d->ncol + n] : 0,
+				.release = arrow_release_child_schema
+			};
+			if (k + 1 < depth) children[d->ncol + n] = nodes + n + 1;
+		}
+		names += len;
+	}
+	return 1;
+}
+
+static int
+arrow_export_array (const ds *d, struct ArrowArray *array, uint32_t nnode, uint32_t nstr, void (*done)(void *), void *ctx)
+{
+	// layout: private data, string buffers to free, nodes, child pointers,
+	// buffer pointers (up to 3 per node and 1 for the root)
+	const uint64_t memsz = sizeof(ds_arrow_private) + 2 * (uint64_t) nstr * sizeof(void *)
+		+ nnode * sizeof(struct ArrowArray) + ((uint64_t) d->ncol + nnode) * sizeof(void *)
+		+ (3 * (uint64_t) nnode + 1) * sizeof(void *);
+	char *mem = DSREALLOC(0, memsz);
+	if (!mem) {
+		nonfatal("dset_export_arrow: out of memory for array with %" PRIu32 " nodes", nnode);
+		return 0;
+	}
+	memset(mem, 0, memsz);
+	ds_arrow_private *p = (ds_arrow_private *) mem;
+	p->tofree = (void **) (p + 1);
+	struct ArrowArray *nodes = (struct ArrowArray *) (p->tofree + 2 * nstr);
+	struct ArrowArray **children = (struct ArrowArray **) (nodes + nnode);
+	const void **buffers = (const void **) (children + d->ncol + nnode);
+
+	uint32_t n = 0;
+	for (uint32_t i = 0; i < d->ncol; i++) {
+		const ds_column *c = d->columns + i;
+		const int t = abs_i8(c->type);
+		const uint32_t depth = arrow_depth(c);
+		const void *data = (const char *) d + d->arrheap_start + c->offset;
+		uint64_t length = d->nrow;
+		children[i] = nodes + n;
+		for (uint32_t k = 0; k < depth; k++, n++) {
+			const void **b = buffers + 3 * (uint64_t) n;
+			nodes[n] = (struct ArrowArray) {
+				.length = (int64_t) length, .n_buffers = 1, .buffers = b,
+				.release = arrow_release_child_array
+			};
+			if (k + 1 < depth) {
+				nodes[n].n_children = 1;
+				nodes[n].children = &children[d->ncol + n];
+				children[d->ncol + n] = nodes + n + 1;
+				length *= (k == 0 && c->shape[0]) ? stride(c) : 2;
+			} else if (t != T_STR) {
+				nodes[n].n_buffers = 2;
+				b[1] = data;
+			} else {
+				ds_arrowstr_ctx x = { d, data, DSREALLOC(0, sizeof(int64_t) * (length + 1)), 0, length, 0 };
+				if (x.offsets) {
+					parallel_run(nthreads_for(length), arrowstr_task, &x);
+					x.offsets[0] = 0;
+					for (uint64_t r = 0; r < length; r++) x.offsets[r + 1] += x.offsets[r];
+					x.data = DSREALLOC(0, (uint64_t) x.offsets[length] + 1);
+				}
+				p->tofree[p->nfree++] = x.offsets;
+				p->tofree[p->nfree++] = x.data;
+				if (!x.data) {
+					nonfatal("dset_export_arrow: out of memory for strings of '%s'", getkey(d, c));
+					arrow_release_array(&(struct ArrowArray) { .private_data = p });
+					return 0;
+				}
+				x.copy = 1;
+				parallel_run(nthreads_for(length), arrowstr_task, &x);
+				nodes[n].n_buffers = 3;
+				b[1] = x.offsets;
+				b[2] = x.data;
+			}
+		}
+	}
+
+	p->done = done;
+	p->ctx = ctx;
+	*array = (struct ArrowArray) {
+		.length = (int64_t) d->nrow, .n_buffers = 1, .buffers = buffers + 3 * (uint64_t) n,
+		.n_children = d->ncol, .children = children,
+		.release = arrow_release_array, .private_data = p
+	};
+	return 1;
+}
+
+/*
+===============================================================================
+                           ACTUAL API FUNCTIONS
+===============================================================================
+*/
+
+
+
+// Create an empty dataset with space for ccol column descriptors, crow rows
+// and arrheap_sz and strheap_sz bytes in the array and string heaps
+static uint64_t
+new_with_capacity(uint32_t ccol, uint64_t crow, uint64_t arrheap_sz, uint64_t strheap_sz) {
+	const uint64_t arrheap_start = sizeof(ds) + sizeof(ds_column) * (uint64_t) ccol;
+	const uint64_t total_sz = arrheap_start + arrheap_sz + (strheap_sz ? strheap_sz : 1);
+	ds * d = 0;
+
+	uint64_t handle = dset_new_(total_sz, &d);
+	if(handle == UINT64_MAX) 
+		return handle;
+
+	*d = (ds) {
+		.total_sz = total_sz,
+		.ccol = ccol,
+		.crow = crow,
+		.arrheap_start = arrheap_start,
+		.strheap_start = arrheap_start + arrheap_sz,
+		.strheap_sz    = 1, // the null string is the string with index zero.
+	};
+
+	// 0x94 CSDAT
+	d->magic[0] = 0x94;
+	d->magic[1] = 0x43;
+	d->magic[2] = 0x53;
+	d->magic[3] = 0x44;
+	d->magic[4] = 0x41;
+	d->magic[5] = 0x54;
+
+	return handle;
+}
+
+// Add the space that a new dataset needs for nrow rows of the given column of
+// d to the array heap size and (for long keys) string heap size
+static inline void
+count_column_space(const ds *d, const ds_column *c, uint64_t nrow, uint64_t *arrheap_sz, uint64_t *strheap_sz) {
+	*arrheap_sz += compute_col_reserved_space(nrow, c);
+	if (c->type < 0) *strheap_sz += 1 + strlen(getkey(d, c));
+}
+
+uint64_t dset_new(void) {
+	const size_t DS_INITIAL_SZ = 1<<15; // 32 kB as a good default?
+	return new_with_capacity(0, 0, 0, DS_INITIAL_SZ - sizeof(ds));
+}
+
+// Create an empty dataset sized for ncol_hint columns of nrow_hint rows of
+// 8-byte scalars and strheap_hint bytes of strings (including long column
+// keys). Adding up to that many rows and columns does not move memory, which
+// makes this much cheaper than dset_new for many small datasets. Hints may
+// be exceeded; the dataset grows as usual.
+uint64_t dset_new_sized(uint32_t ncol_hint, uint64_t nrow_hint, uint64_t strheap_hint) {
+	const ds_column scalar = { .type = T_U64 };
+	return new_with_capacity(
+		ncol_hint, nrow_hint, ncol_hint * compute_col_reserved_space(nrow_hint, &scalar), 1 + strheap_hint
+	);
+}
+
+// Look up the arena with the given handle. Lock must be held.
+static ds_arena *
+arena_lookup(uint64_t arena, const char *fn) {
+	const uint64_t i = arena & 0xffffffff;
+	if (i == 0 || i > DSARENA_MAX || !arena_at((uint32_t) i)->inuse || arena_at((uint32_t) i)->generation != arena >> 32) {
+		nonfatal("%s: invalid arena handle %" PRIu64, fn, arena);
+		return 0;
+	}
+	return arena_at((uint32_t) i);
+}
+
+// Create an arena that allocates slabs of slabsz bytes, or of a default size
+// if 0. Returns its handle or UINT64_MAX
+uint64_t dset_arena_new(uint64_t slabsz) {
+	module_init();
+	lock();
+	for (uint32_t i = 0; i < DSARENA_MAX; i++) {
+		ds_arena *a = &ds_module.arenas[i];
+		if (a->inuse) continue;
+		const uint16_t gen = (uint16_t) (a->generation + 1) ? (uint16_t) (a->generation + 1) : 1;
+		*a = (ds_arena) { .slabsz = slabsz ? slabsz : DSARENA_DEFAULT_SLABSZ, .generation = gen, .inuse = 1 };
+		unlock();
+		return (i + 1) | (uint64_t) gen << 32;
+	}
+	unlock();
+	nonfatal("dset_arena_new: no more than %d arenas may exist at once", DSARENA_MAX);
+	return UINT64_MAX;
+}
+
+// Allocate datasets created from now on (by any thread) from the given arena,
+// or with DSREALLOC again if arena is 0. Datasets keep the memory source they
+// were created with.
+int dset_arena_use(uint64_t arena) {
+	module_init();
+	lock();
+	const int ok = !arena || arena_lookup(arena, "dset_arena_use");
+	if (ok) ds_module.arena = (uint32_t) (arena & 0xffffffff);
+	unlock();
+	return ok;
+}
+
+// Delete every dataset still allocated from the arena, which invalidates
+// their handles, and free all of the arena's memory at once
+void dset_arena_del(uint64_t arena) {
+	module_init();
+	lock();
+	ds_arena *a = arena_lookup(arena, "dset_arena_del");
+	if (a) {
+		const uint32_t index = (uint32_t) (arena & 0xffffffff);
+		for (uint64_t i = 0; i < ds_module.nslots && a->nblocks; i++) {
+			if (slot_at(i)->memory && slot_at(i)->arena == index) delslot(i);
+		}
+		for (ds_slab *slab = a->slabs, *next; slab; slab = next) {
+			next = slab->next;
+			DSFREE(slab);
+		}
+		if (ds_module.arena == index) ds_module.arena = 0;
+		*a = (ds_arena) { .generation = a->generation };
+	}
+	unlock();
+}
+
+// Copy the rows of a view into a new dataset with the same columns
+static uint64_t
+copy_view(uint64_t view)
+{
+	const uint32_t ncol = dset_ncol(view);
+	const uint64_t nrow = dset_nrow(view);
+	const char **strs = 0;
+	if (nrow > UINT32_MAX) {
+		nonfatal("dset_copy: too many rows in view (%" PRIu64 ")", nrow);
+		return UINT64_MAX;
+	}
+
+	uint64_t result = dset_new_sized(ncol, nrow, 0);
+	if (result == UINT64_MAX) return result;
+	for (uint32_t c = 0; c < ncol; c++) {
+		const uint32_t shape = dset_getshp_at(view, c);
+		if (!dset_addcol_array(result, dset_key(view, c), dset_type_at(view, c), shape & 0xff, (shape >> 8) & 0xff, shape >> 16))
+			goto fail;
+	}
+	if (!dset_addrows(result, (uint32_t) nrow)) goto fail;
+
+	for (uint32_t c = 0; c < ncol; c++) {
+		const char *key = dset_key(view, c);
+		if (dset_type_at(view, c) == T_STR) {
+			if (!strs) strs = DSREALLOC(0, sizeof(*strs) * (nrow ? nrow : 1));
+			if (!strs) {
+				nonfatal("dset_copy: out of memory");
+				goto fail;
+			}
+			if (!dset_getstrs(view, key, 0, nrow, strs) || !dset_setstrs(result, key, 0, nrow, strs)) goto fail;
+		} else {
+			const void *src = dset_get_at(view, c);
+			if (!src) goto fail;
+			memcpy(dset_get_at(result, c), src, dset_getsz_at(view, c));
+		}
+	}
+	goto done;
+
+	fail:
+	dset_del(result);
+	result = UINT64_MAX;
+
+	done:
+	if (strs) DSFREE(strs);
+	return result;
+}
+
+uint64_t dset_copy(uint64_t dset)
+{
+	uint64_t idx;
+	uint16_t generation;
+
+	if(! handle_lookup_any(dset, "dset_copy", &generation, &idx))
+		return UINT64_MAX;
+	if (slot_at(idx)->parent)
+		return copy_view(dset);
+
+	ds *oldds = slot_at(idx)->memory;
+
+	ds* newds = 0;
+	uint64_t newhandle = dset_new_(oldds->total_sz, &newds);
+
+	if (newhandle != UINT64_MAX) {
+		memcpy(newds,oldds,oldds->total_sz);
+
+		// string handles are unchanged, so the intern index is still valid.
+		// If it cannot be copied, it will be rebuilt when required.
+		ht64_copy(&slot_at(MASK_IDX & newhandle)->strindex, &slot_at(idx)->strindex);
+		ht64_copy(&slot_at(MASK_IDX & newhandle)->strrefs, &slot_at(idx)->strrefs);
+	}
+
+	return newhandle;
+}
+
+// Create a view of nrow rows of the given dataset from row start, with the
+// ncol columns with the given keys, or all columns if keys is null. A view
+// has no data of its own: dset_get returns a pointer into the parent's rows
+// and dset_getstr(s) read the parent's strings, so no rows are ever copied.
+// Views support the dataset and column info functions, dset_get(_at),
+// dset_getstr(s) and dset_copy, which copies the rows into a new regular
+// dataset. Other operations fail, including any that modify the view, which
+// would be seen by the parent. A view of a view is a view of the same parent.
+// If the parent is deleted, or its viewed columns change type, reading the
+// view fails. Returns the view's handle or UINT64_MAX.
+uint64_t dset_view(uint64_t dset, uint64_t start, uint64_t nrow, uint32_t ncol, const char **keys)
+{
+	uint64_t idx;
+	const ds *d = handle_lookup_any(dset, "dset_view", 0, &idx);
+	if (!d) return UINT64_MAX;
+
+	if (start > d->nrow || nrow > d->nrow - start) {
+		nonfatal("dset_view: invalid range %" PRIu64 " + %" PRIu64 " (%" PRIu64 " rows)", start, nrow, d->nrow);
+		return UINT64_MAX;
+	}
+	if (!keys) ncol = d->ncol;
+
+	// The layout only needs the column descriptions and their long keys
+	uint64_t strheap_sz = 1;
+	for (uint32_t i = 0; i < ncol; i++) {
+		const ds_column *c = keys ? column_lookup((ds *) d, keys[i]) : d->columns + i;
+		if (!c) {
+			nonfatal("dset_view: no column %s", keys[i]);
+			return UINT64_MAX;
+		}
+		if (c->type < 0) strheap_sz += strlen(getkey(d, c)) + 1;
+	}
+
+	const uint64_t arrheap_start = sizeof(ds) + sizeof(ds_column) * (uint64_t) ncol;
+	ds *v = DSREALLOC(0, arrheap_start + strheap_sz);
+	if (!v) {
+		nonfatal("dset_view: out of memory");
+		return UINT64_MAX;
+	}
+	memset(v, 0, arrheap_start + strheap_sz);
+	*v = (ds) {
+		.total_sz      = arrheap_start + strheap_sz,
+		.ccol          = ncol,
+		.crow          = nrow,
+		.nrow          = nrow,
+		.arrheap_start = arrheap_start,
+		.strheap_start = arrheap_start,
+		.strheap_sz    = 1,
+	};
+	memcpy(v->magic, d->magic, sizeof(v->magic));
+
+	for (uint32_t i = 0; i < ncol; i++) {
+		const ds_column *c = keys ? column_lookup((ds *) d, keys[i]) : d->columns + i;
+		const char *key = getkey(d, c);
+		if (colindex_find(v, key) != UINT64_MAX) {
+			nonfatal("dset_view: repeated column %s", key);
+			DSFREE(v);
+			return UINT64_MAX;
+		}
+		v->columns[i] = *c;
+		v->columns[i].offset = 0;
+		if (c->type < 0) {
+			const size_t len = strlen(key) + 1;
+			memcpy((char *) v + v->strheap_start + v->strheap_sz, key, len);
+			v->columns[i].longkey = v->strheap_sz;
+			v->strheap_sz += len;
+		}
+		v->ncol = i + 1;
+		colindex_add(v);
+	}
+
+	const ds_slot *s = slot_at(idx);
+	const uint64_t parent = s->parent ? s->parent : dset;
+	const uint64_t rowstart = s->rowstart + start;
+	const uint64_t h = newslot(v, 0, 0, 0);
+	if (h == UINT64_MAX) {
+		nonfatal("dset_view: out of memory");
+		DSFREE(v);
+		return UINT64_MAX;
+	}
+	slot_at(MASK_IDX & h)->parent = parent;
+	slot_at(MASK_IDX & h)->rowstart = rowstart;
+	return h;
+}
+
+static int
+write_zeros (FILE *f, uint64_t n) {
+	static const char zeros[4096];
+	for (; n > sizeof(zeros); n -= sizeof(zeros))
+		if (fwrite(zeros, 1, sizeof(zeros), f) != sizeof(zeros)) return 0;
+	return fwrite(zeros, 1, n, f) == n;
+}
+
+// Save the dataset as an uncompressed image that may be mapped back into
+// memory with dset_mmap. The image is the ds block with all unused column
+// and row capacity removed, preceded by a DSIMAGE_OFFSET-byte file header.
+// The dataset itself is not modified. Columns of Python objects (T_OBJ)
+// cannot be saved. Data is in native byte order.
+int dset_save_image (uint64_t dset, const char *path)
+{
+	const ds *d = handle_lookup(dset, "dset_save_image", 0, 0);
+	if (!d) return 0;
+
+	for (uint32_t i = 0; i < d->ncol; i++) {
+		if (abs_i8(d->columns[i].type) == T_OBJ) {
+			nonfatal("dset_save_image: cannot save object column %s", getkey(d, d->columns + i));
+			return 0;
+		}
+	}
+
+	// compact header, same as the result of dset_defrag(dset, 1)
+	ds hdr = *d;
+	hdr.ccol = d->ncol;
+	hdr.crow = d->nrow;
+	hdr.arrheap_start = sizeof(ds) + d->ncol * sizeof(ds_column);
+	hdr.strheap_start = hdr.arrheap_start + compute_arrheap_sz(d, d->nrow);
+	hdr.total_sz = hdr.strheap_start + d->strheap_sz;
+	memset(&hdr.stats, 0, sizeof(hdr.stats));
+
+	FILE *f = fopen(path, "wb");
+	if (!f) {
+		nonfatal("dset_save_image: could not open %s", path);
+		return 0;
+	}
+
+	// magic followed by a zero stream header size and the image header
+	const ds_image_header imhdr = image_header(hdr.total_sz);
+	int ok = fwrite(d->magic, 1, sizeof(d->magic), f) == sizeof(d->magic);
+	ok = ok && write_zeros(f, DSIMAGE_HEADER_AT - sizeof(d->magic));
+	ok = ok && fwrite(&imhdr, sizeof(imhdr), 1, f) == 1;
+	ok = ok && write_zeros(f, DSIMAGE_OFFSET - DSIMAGE_HEADER_AT - sizeof(imhdr));
+	ok = ok && fwrite(&hdr, sizeof(ds), 1, f) == 1;
+
+	uint64_t offset = 0;
+	for (uint32_t i = 0; ok && i < d->ncol; i++) {
+		ds_column c = d->columns[i];
+		c.offset = offset;
+		offset += compute_col_reserved_space(d->nrow, &c);
+		ok = fwrite(&c, sizeof(c), 1, f) == 1;
+	}
+
+	for (uint32_t i = 0; ok && i < d->ncol; i++) {
+		const ds_column *c = d->columns + i;
+		const uint64_t sz = d->nrow * type_size[abs_i8(c->type)] * stride(c);
+		ok = fwrite((char *) d + d->arrheap_start + c->offset, 1, sz, f) == sz;
+		ok = ok && write_zeros(f, compute_col_reserved_space(d->nrow, c) - sz);
+	}
+
+	ok = ok && fwrite((char *) d + d->strheap_start, 1, d->strheap_sz, f) == d->strheap_sz;
+	ok = fclose(f) == 0 && ok;
+	if (!ok) nonfatal("dset_save_image: could not write %s", path);
+	return ok;
+}
+
+// Check that the mapped image at the given memory location with sz bytes
+// available is self-consistent, so that accesses stay within the mapping:
+// every column's data, key and string handle, and the column index. Reads
+// every string column, but no other data
+static int
+image_valid (const ds *d, uint64_t sz)
+{
+	const uint8_t magic[6] = {0x94, 0x43, 0x53, 0x44, 0x41, 0x54};
+	if (sz < sizeof(ds) || memcmp(d->magic, magic, sizeof(magic))) return 0;
+	if (d->total_sz > sz || d->ncol > d->ccol || d->nrow > d->crow) return 0;
+	if (d->ncolindexed > d->ncol || d->ncolindexed > DSCOLINDEX_MAX) return 0;
+	if (d->ccol > (d->total_sz - sizeof(ds)) / sizeof(ds_column)) return 0;
+	if (d->arrheap_start < sizeof(ds) + (uint64_t) d->ccol * sizeof(ds_column)) return 0;
+	if (d->strheap_start < d->arrheap_start || d->strheap_start > d->total_sz) return 0;
+	if (d->strheap_sz == 0 || d->strheap_sz > d->total_sz - d->strheap_start) return 0;
+
+	// strings must end within the heap
+	const char *strheap = (const char *) d + d->strheap_start;
+	if (strheap[d->strheap_sz - 1] != 0) return 0;
+
+	const uint64_t capacity = arrheap_capacity(d);
+	uint64_t end = 0;
+	for (uint32_t i = 0; i < d->ncol; i++) {
+		const ds_column *c = d->columns + i;
+		if (!tcheck(c->type) || abs_i8(c->type) == T_OBJ) return 0;
+		if (c->type < 0 ? c->longkey >= d->strheap_sz : !memchr(c->shortkey, 0, SHORTKEYSZ)) return 0;
+
+		// columns follow each other within the array heap
+		const uint64_t colsz = type_size[abs_i8(c->type)] * stride(c);
+		if (c->offset < end || c->offset > capacity || d->crow > (capacity - c->offset) / colsz) return 0;
+		end = c->offset + compute_col_reserved_space(d->crow, c);
+		if (end > capacity) return 0;
+
+		if (abs_i8(c->type) == T_STR) {
+			const uint64_t *handles = (const uint64_t *) ((const char *) d + d->arrheap_start + c->offset);
+			for (uint64_t r = 0; r < d->nrow * stride(c); r++)
+				if (handles[r] >= d->strheap_sz) return 0;
+		}
+	}
+
+	// index entries refer to indexed columns, and lookups end at an empty entry
+	uint32_t nindexed = 0;
+	for (uint32_t i = 0; i < DSCOLINDEX_SZ; i++) {
+		const uint32_t e = d->colindex[i];
+		if (e && ((e & 0xffff) == 0 || (e & 0xffff) > d->ncolindexed)) return 0;
+		nindexed += e != 0;
+	}
+	return nindexed == d->ncolindexed;
+}
+
+// Map a dataset image saved with dset_save_image into memory without reading
+// or copying it. If readonly is set, the dataset cannot be modified.
+// Otherwise changes are private to this process and the file is never
+// written. A mapped dataset is moved to regular memory the first time it
+// needs to grow.
+uint64_t dset_mmap (const char *path, int readonly)
+{
+	uint64_t sz = 0;
+	char *base = map_file(path, readonly, &sz);
+	if (!base) {
+		nonfatal("dset_mmap: could not map %s", path);
+		return UINT64_MAX;
+	}
+
+	ds *d = (ds *) (base + DSIMAGE_OFFSET);
+	const uint8_t noheader[4] = {0};
+	const ds_image_header expected = image_header(sz > DSIMAGE_OFFSET ? sz - DSIMAGE_OFFSET : 0);
+	ds_image_header imhdr;
+	memset(&imhdr, 0, sizeof(imhdr));
+	if (sz >= DSIMAGE_OFFSET) memcpy(&imhdr, base + DSIMAGE_HEADER_AT, sizeof(imhdr));
+	if (sz < DSIMAGE_OFFSET || memcmp(base + sizeof(d->magic), noheader, sizeof(noheader)) ||
+		memcmp(&imhdr, &expected, sizeof(imhdr)) || // version, layout or size mismatch
+		!image_valid(d, sz - DSIMAGE_OFFSET) || d->total_sz != imhdr.blocksz) {
+		unmap_file(base, sz);
+		nonfatal("dset_mmap: %s is not a dataset image", path);
+		return UINT64_MAX;
+	}
+
+	const uint64_t h = newslot(d, base, sz, readonly);
+	if (h == UINT64_MAX) {
+		unmap_file(base, sz);
+		nonfatal("dset_mmap: out of memory");
+	}
+	return h;
+}
+
+// Move the given dataset into a new shared memory object with the given name
+// (at most 200 characters), so that other processes may attach to it with
+// dset_attach without copying or serializing it. Changes made by this process
+// remain visible to attached processes until the dataset needs to grow, at
+// which point it moves back to private memory. Release the name with
+// dset_unshare when other processes no longer need to attach. Columns of
+// Python objects (T_OBJ) cannot be shared.
+int dset_share (uint64_t dset, const char *name)
+{
+	uint64_t idx, sz = 0;
+	ds *d = handle_lookup_mut(dset, "dset_share", &idx);
+	if (!d) return 0;
+	for (uint32_t i = 0; i < d->ncol; i++) {
+		if (abs_i8(d->columns[i].type) == T_OBJ) {
+			nonfatal("dset_share: column '%s' contains Python objects", getkey(d, d->columns + i));
+			return 0;
+		}
+	}
+	if (strlen(name) > 200) {
+		nonfatal("dset_share: name %s is too long", name);
+		return 0;
+	}
+
+	char *base = map_shared(name, d->total_sz, 0, &sz);
+	if (!base) {
+		nonfatal("dset_share: could not create shared memory %s", name);
+		return 0;
+	}
+	memcpy(base, d, d->total_sz);
+
+	ds_slot *s = slot_at(idx);
+	move_begin(idx);
+	lock();
+	release_memory(s);
+	unlock();
+	s->memory = (ds *) base;
+	s->mapbase = base;
+	s->mapsz = sz;
+	move_end(idx);
+	return 1;
+}
+
+// Attach to a dataset shared by another process with dset_share. If readonly
+// is set, the dataset cannot be modified but sees later in-place changes made
+// by the sharing process. Otherwise, changes are private to this process
+// (copy-on-write). Either way, the dataset moves to private memory the first
+// time it needs to grow.
+uint64_t dset_attach (const char *name, int readonly)
+{
+	uint64_t sz = 0;
+	char *base = strlen(name) > 200 ? 0 : map_shared(name, 0, readonly, &sz);
+	if (!base) {
+		nonfatal("dset_attach: could not open shared memory %s", name);
+		return UINT64_MAX;
+	}
+	if (!image_valid((ds *) base, sz)) {
+		unmap_file(base, sz);
+		nonfatal("dset_attach: shared memory %s is not a dataset", name);
+		return UINT64_MAX;
+	}
+
+	const uint64_t h = newslot((ds *) base, base, sz, readonly);
+	if (h == UINT64_MAX) {
+		unmap_file(base, sz);
+		nonfatal("dset_attach: out of memory");
+	}
+	return h;
+}
+
+// Remove the name of a shared memory object created with dset_share. Memory
+// is freed once every process using it deletes its dataset. On Windows, this
+// happens automatically and removing the name has no effect.
+int dset_unshare (const char *name)
+{
+#ifdef _WIN32
+	(void) name;
+	return 1;
+#else
+	char path[256];
+	snprintf(path, sizeof(path), "/%s", name[0] == '/' ? name + 1 : name);
+	if (shm_unlink(path) != 0) {
+		nonfatal("dset_unshare: could not remove shared memory %s", name);
+		return 0;
+	}
+	return 1;
+#endif
+}
+
+// Compute the inner join of two Datasets R and S by matching values in the
+// column with the given key. Currently only 64-bit columns (e.g., T_U64) with
+// zero shape may be specified as keys.
+//
+// Not recommended for key columns with duplicate values (does not deduplicate
+// and only matches one row in joined dataset).
+//
+// Implements Classic Hash Join algorithm
+// https://en.wikipedia.org/wiki/Hash_join#Classic_hash_join
+typedef struct ds_innerjoin_coldata {
+	ds_column *col;
+	uint32_t src; // index of the source dataset
+	int itemsize;
+	int is_str;
+} ds_innerjoin_coldata;
+
+/*
+	Index of the rows of one innerjoin input by key. Keys are split by hash
+	into one partition per thread so that the tables may be built in parallel
+	without synchronization. Each partition's table maps a key to the first
+	row with that key and next chains the remaining rows with the same key in
+	ascending order. Keys with all bits set cannot be stored in a ds_ht64, so
+	those rows are chained from allones instead.
+*/
+typedef struct ds_joinindex {
+	ds_ht64 parts[DSPARALLEL_MAX_THREADS];
+	uint32_t nparts;
+	uint64_t *next;
+	uint64_t allones;
+	int hasdups; // whether any key appears more than once
+	int oom;
+} ds_joinindex;
+
+#define JOIN_NONE UINT64_MAX
+
+// Read the join key of the given row, zero-extended to 64 bits
+static inline uint64_t
+joinkey(const void *data, size_t keysize, uint64_t row) {
+	switch (keysize) {
+	case 1: return ((const uint8_t *) data)[row];
+	case 2: return ((const uint16_t *) data)[row];
+	case 4: return ((const uint32_t *) data)[row];
+	default: return ((const uint64_t *) data)[row];
+	}
+}
+
+// Partition of the given key hash. Uses bits that don't pick table slots
+static inline uint32_t
+joinpart(uint64_t h, uint32_t nparts) {
+	return (uint32_t) (((h >> 32) * nparts) >> 32);
+}
+
+// First row with the given key in a join index, or JOIN_NONE
+static inline uint64_t
+joinindex_first(const ds_joinindex *x, uint64_t key) {
+	if (key == DSHT64_INVALID) return x->allones;
+	const uint64_t h = hash64(key);
+	const ds_ht64 *t = &x->parts[joinpart(h, x->nparts)];
+	for (int32_t i = h;;) {
+		i = ht64_lookup(h, t->exp, i);
+		if (t->ht[i][0] == DSHT64_INVALID) return JOIN_NONE;
+		if (t->ht[i][0] == key) return t->ht[i][1];
+	}
+	return JOIN_NONE;
+}
+
+/*
+	Building the index takes one pass over the keys to count the rows of each
+	partition in each thread's share, one to scatter the row numbers into
+	order grouped by partition, and then each thread inserts the rows of its
+	own partition. Within a partition, rows stay in ascending order.
+*/
+typedef struct {
+	ds_joinindex *x;
+	const void *keydata;
+	size_t keysize;
+	uint64_t nrow;
+	uint64_t *order;   // rows grouped by partition, null with one partition
+	uint64_t *offsets; // nparts * nparts: start in order of each thread's rows of each partition
+	uint64_t partstart[DSPARALLEL_MAX_THREADS + 1];
+	int hasdups[DSPARALLEL_MAX_THREADS];
+} ds_joinindex_build;
+
+// Count the rows of each partition in this thread's share of rows
+static void
+joinindex_count(void *ctx, uint32_t tid, uint32_t nthreads) {
+	ds_joinindex_build *b = ctx;
+	uint64_t *counts = b->offsets + (uint64_t) tid * nthreads;
+	const uint64_t end = share_start(b->nrow, tid + 1, nthreads);
+	for (uint32_t p = 0; p < nthreads; p++) counts[p] = 0;
+	for (uint64_t r = share_start(b->nrow, tid, nthreads); r < end; r++)
+		counts[joinpart(hash64(joinkey(b->keydata, b->keysize, r)), nthreads)]++;
+}
+
+// Scatter this thread's share of rows into order by partition
+static void
+joinindex_scatter(void *ctx, uint32_t tid, uint32_t nthreads) {
+	ds_joinindex_build *b = ctx;
+	uint64_t *cursors = b->offsets + (uint64_t) tid * nthreads;
+	const uint64_t end = share_start(b->nrow, tid + 1, nthreads);
+	for (uint64_t r = share_start(b->nrow, tid, nthreads); r < end; r++)
+		b->order[cursors[joinpart(hash64(joinkey(b->keydata, b->keysize, r)), nthreads)]++] = r;
+}
+
+// Build the partition with the same index as the thread
+static void
+joinindex_build_part(void *ctx, uint32_t tid, uint32_t nthreads) {
+	ds_joinindex_build *b = ctx;
+	ds_joinindex *x = b->x;
+	ds_ht64 *t = &x->parts[tid];
+	const uint64_t *order = b->order ? b->order + b->partstart[tid] : 0;
+	const uint64_t count = b->order ? b->partstart[tid + 1] - b->partstart[tid] : b->nrow;
+	int hasdups = 0;
+	(void) nthreads;
+
+	ht64_new(t, (uint32_t) count);
+	if (!t->ht) {
+		x->oom = 1;
+		return;
+	}
+
+	// iterate backwards so that each chain ends up in ascending row order
+	for (uint64_t k = count; k-- > 0;) {
+		const uint64_t r = order ? order[k] : k;
+		const uint64_t key = joinkey(b->keydata, b->keysize, r);
+		const uint64_t h = hash64(key);
+		if (key == DSHT64_INVALID) {
+			hasdups |= x->allones != JOIN_NONE;
+			x->next[r] = x->allones;
+			x->allones = r;
+			continue;
+		}
+		for (int32_t i = h;;) {
+			i = ht64_lookup(h, t->exp, i);
+			if (t->ht[i][0] == DSHT64_INVALID) {
+				t->ht[i][0] = key;
+				t->ht[i][1] = r;
+				t->len++;
+				x->next[r] = JOIN_NONE;
+				break;
+			} else if (t->ht[i][0] == key) {
+				hasdups = 1;
+				x->next[r] = t->ht[i][1];
+				t->ht[i][1] = r;
+				break;
+			}
+		}
+	}
+	b->hasdups[tid] = hasdups;
+}
+
+static int
+joinindex_build(ds_joinindex *x, const void *keydata, size_t keysize, uint64_t nrow) {
+	ds_joinindex_build b = { .x = x, .keydata = keydata, .keysize = keysize, .nrow = nrow };
+	const uint32_t nparts = x->nparts = nthreads_for(nrow);
+	x->allones = JOIN_NONE;
+	x->hasdups = 0;
+	x->oom = 0;
+	for (uint32_t p = 0; p < nparts; p++) x->parts[p] = (ds_ht64) {0};
+	x->next = DSREALLOC(0, sizeof(uint64_t) * (nrow ? nrow : 1));
+	if (!x->next) return 0;
+
+	if (nparts > 1) {
+		b.order = DSREALLOC(0, sizeof(uint64_t) * (nrow + (uint64_t) nparts * nparts));
+		if (!b.order) return 0;
+		b.offsets = b.order + nrow;
+		parallel_run(nparts, joinindex_count, &b);
+
+		// each partition's rows from each thread in turn, so rows stay in order
+		uint64_t pos = 0;
+		for (uint32_t p = 0; p < nparts; p++) {
+			b.partstart[p] = pos;
+			for (uint32_t t = 0; t < nparts; t++) {
+				const uint64_t count = b.offsets[(uint64_t) t * nparts + p];
+				b.offsets[(uint64_t) t * nparts + p] = pos;
+				pos += count;
+			}
+		}
+		b.partstart[nparts] = pos;
+		parallel_run(nparts, joinindex_scatter, &b);
+	}
+
+	parallel_run(nparts, joinindex_build_part, &b);
+	if (b.order) DSFREE(b.order);
+	for (uint32_t p = 0; p < nparts; p++) x->hasdups |= b.hasdups[p];
+	return !x->oom;
+}
+
+static void
+joinindex_del(ds_joinindex *x) {
+	for (uint32_t p = 0; p < x->nparts; p++) ht64_del(&x->parts[p]);
+	if (x->next) DSFREE(x->next);
+	x->next = 0;
+}
+
+// Copy the given rows of a source column into a destination column
+static inline void
+gathercol(char *dst, const char *src, const uint64_t *rows, uint64_t n, size_t itemsize) {
+	switch (itemsize) {
+	case 4: for (uint64_t k = 0; k < n; k++) ((uint32_t *) dst)[k] = ((const uint32_t *) src)[rows[k]]; break;
+	case 8: for (uint64_t k = 0; k < n; k++) ((uint64_t *) dst)[k] = ((const uint64_t *) src)[rows[k]]; break;
+	default: for (uint64_t k = 0; k < n; k++) memcpy(dst + k * itemsize, src + rows[k] * itemsize, itemsize);
+	}
+}
+
+/*
+	Shared state for the parallel phases of dset_innerjoin_many. The largest
+	input is probed against indexes of the others, which are numbered after it
+	in their original order. Each thread probes a contiguous share of the rows
+	of the probe input, so the output can be written in its row order once the
+	number of result rows from each share is known.
+*/
+typedef struct {
+	uint32_t n;
+	ds **srcs;
+	const void **keydata;
+	size_t keysize;
+	ds_joinindex *indexes;  // n - 1, one for each input after the probe input
+	const uint32_t *order;  // input at each position, with the probe input first
+	const uint32_t *slot;   // position of each input in order
+	int hasdups;
+	uint64_t *firsts;  // n arrays of nprobe: result count, then first match in each other input
+	uint64_t *rows;    // n arrays of rowstride: source row at each position for each result row
+	uint64_t rowstride;
+	uint64_t *cursors; // n per thread
+	uint64_t counts[DSPARALLEL_MAX_THREADS];
+	ds *dst;
+	ds_innerjoin_coldata *coldata;
+	uint32_t ncol;
+	uint64_t nrow;
+} ds_innerjoin_ctx;
+
+// Find the first match of each row of the probe input in every other input,
+// and count the result rows. Each row of the probe input appears once for
+// every combination of matching rows in the others.
+static void
+innerjoin_probe(void *ctx, uint32_t tid, uint32_t nthreads) {
+	ds_innerjoin_ctx *j = ctx;
+	const uint64_t nrow0 = j->srcs[j->order[0]]->nrow;
+	const uint64_t end = share_start(nrow0, tid + 1, nthreads);
+	uint64_t total = 0;
+
+	for (uint64_t r = share_start(nrow0, tid, nthreads); r < end; r++) {
+		const uint64_t k = joinkey(j->keydata[j->order[0]], j->keysize, r);
+		uint64_t combinations = 1;
+		for (uint32_t i = 1; i < j->n; i++) {
+			const uint64_t first = joinindex_first(&j->indexes[i - 1], k);
+			j->firsts[i * nrow0 + r] = first;
+			if (first == JOIN_NONE) { combinations = 0; break; }
+			if (!j->hasdups) continue;
+
+			uint64_t matches = 0;
+			for (uint64_t m = first; m != JOIN_NONE; m = j->indexes[i - 1].next[m]) matches++;
+			combinations *= matches;
+		}
+		j->firsts[r] = combinations;
+		total += combinations;
+	}
+	j->counts[tid] = total;
+}
+
+// Compute the source row in each input for each result row. As with nested
+// pairwise joins, the last input's matches vary fastest.
+static void
+innerjoin_fill(void *ctx, uint32_t tid, uint32_t nthreads) {
+	ds_innerjoin_ctx *j = ctx;
+	const uint32_t n = j->n;
+	const uint64_t nrow0 = j->srcs[j->order[0]]->nrow;
+	const uint64_t end = share_start(nrow0, tid + 1, nthreads);
+	const uint64_t *firsts = j->firsts;
+	uint64_t *rows = j->rows;
+	uint64_t *cursors = j->cursors + (uint64_t) n * tid;
+	uint64_t out = 0;
+	for (uint32_t t = 0; t < tid; t++) out += j->counts[t];
+
+	for (uint64_t r = share_start(nrow0, tid, nthreads); r < end; r++) {
+		if (firsts[r] == 0) continue;
+		uint32_t i;
+		for (i = 1; i < n; i++) cursors[i] = firsts[i * nrow0 + r];
+
+		for (;;) {
+			rows[out] = r;
+			for (i = 1; i < n; i++) rows[i * j->rowstride + out] = cursors[i];
+			out++;
+			if (!j->hasdups) break;
+
+			// advance to the next combination of matches
+			for (i = n - 1; i > 0; i--) {
+				cursors[i] = j->indexes[i - 1].next[cursors[i]];
+				if (cursors[i] != JOIN_NONE) break;
+				cursors[i] = firsts[i * nrow0 + r];
+			}
+			if (i == 0) break;
+		}
+	}
+}
+
+// Copy a share of the rows of every non-string result column
+static void
+innerjoin_gather(void *ctx, uint32_t tid, uint32_t nthreads) {
+	ds_innerjoin_ctx *j = ctx;
+	ds *d = j->dst;
+	const uint64_t start = share_start(j->nrow, tid, nthreads);
+	const uint64_t end = share_start(j->nrow, tid + 1, nthreads);
+
+	for (uint32_t c = 0; c < j->ncol; c++) {
+		const ds_innerjoin_coldata *cd = &j->coldata[c];
+		if (cd->is_str) continue;
+		const ds *src = j->srcs[cd->src];
+		const size_t itemsize = (size_t) cd->itemsize;
+		char *dst_ptr = (char *) d + d->arrheap_start + d->columns[c].offset + start * itemsize;
+		const char *src_ptr = (const char *) src + src->arrheap_start + cd->col->offset;
+		gathercol(dst_ptr, src_ptr, j->rows + j->slot[cd->src] * j->rowstride + start, end - start, itemsize);
+	}
+}
+
+/*
+	Put the result rows of a join that was probed with an input other than the
+	first back in the order of nested pairwise joins, which is ascending by the
+	source row in the first input, then the second, and so on. This is a
+	stable counting sort by each input from the last to the first. Without
+	duplicate keys, every result row has a different first-input row, so
+	sorting by that alone is enough. Returns the new rows or null if out of
+	memory.
+*/
+static uint64_t *
+innerjoin_reorder(const ds_innerjoin_ctx *j, uint64_t nrow) {
+	const uint32_t n = j->n;
+	uint64_t maxsrc = 0;
+	for (uint32_t i = 0; i < n; i++) if (j->srcs[i]->nrow > maxsrc) maxsrc = j->srcs[i]->nrow;
+	uint64_t *perm = DSREALLOC(0, sizeof(uint64_t) * 2 * (nrow ? nrow : 1));
+	uint64_t *counts = DSREALLOC(0, sizeof(uint64_t) * (maxsrc + 1));
+	uint64_t *rows = DSREALLOC(0, sizeof(uint64_t) * n * (nrow ? nrow : 1));
+	if (!perm || !counts || !rows) {
+		if (perm) DSFREE(perm);
+		if (counts) DSFREE(counts);
+		if (rows) DSFREE(rows);
+		return 0;
+	}
+
+	uint64_t *cur = perm, *next = perm + nrow;
+	for (uint64_t k = 0; k < nrow; k++) cur[k] = k;
+	for (uint32_t i = j->hasdups ? n : 1; i-- > 0;) {
+		const uint64_t *src = j->rows + j->slot[i] * j->rowstride;
+		const uint64_t nsrc = j->srcs[i]->nrow;
+		memset(counts, 0, sizeof(uint64_t) * (nsrc + 1));
+		for (uint64_t k = 0; k < nrow; k++) counts[src[k] + 1]++;
+		for (uint64_t r = 0; r < nsrc; r++) counts[r + 1] += counts[r];
+		for (uint64_t k = 0; k < nrow; k++) next[counts[src[cur[k]]]++] = cur[k];
+		uint64_t *t = cur; cur = next; next = t;
+	}
+
+	for (uint32_t s = 0; s < n; s++) {
+		const uint64_t *src = j->rows + s * j->rowstride;
+		uint64_t *dst = rows + s * nrow;
+		for (uint64_t k = 0; k < nrow; k++) dst[k] = src[cur[k]];
+	}
+	DSFREE(counts);
+	DSFREE(perm);
+	return rows;
+}
+
+// Record a join-like operation that started at time t0 and gave the result
+// dataset handle, which is returned
+static inline uint64_t
+count_join (uint64_t t0, uint64_t result) {
+	DSATOMIC_FETCH_ADD(ds_module.join_ns, now_ns() - t0);
+	DSATOMIC_FETCH_ADD(ds_module.njoin, 1);
+	return result;
+}
+
+static uint64_t
+innerjoin_many(const char *key, uint32_t n, const uint64_t *dsets)
+{
+	uint64_t dset = UINT64_MAX;
+	uint64_t nrow = 0;
+	ds **srcs = 0;
+	const void **keydata = 0;
+	ds_joinindex *indexes = 0;
+	uint32_t *order = 0;
+	uint64_t *cursors = 0, *firsts = 0, *rows = 0;
+	ds_innerjoin_coldata *coldata = 0;
+	uint32_t ncol = 0, nindexed = 0;
+	int keytype = 0;
+
+	if (n == 0) {
+		nonfatal("dset_innerjoin_many: no datasets given");
+		return UINT64_MAX;
+	}
+
+	srcs = DSREALLOC(0, sizeof(ds *) * n);
+	keydata = DSREALLOC(0, sizeof(void *) * n);
+	indexes = DSREALLOC(0, sizeof(ds_joinindex) * n);
+	order = DSREALLOC(0, sizeof(uint32_t) * 2 * n);
+	cursors = DSREALLOC(0, sizeof(uint64_t) * n * DSPARALLEL_MAX_THREADS);
+	if (!srcs || !keydata || !indexes || !order || !cursors) {
+		nonfatal("dset_innerjoin_many: out of memory");
+		goto fail;
+	}
+
+	// Look up the datasets and the columns to join
+	uint64_t ncol_total = 0;
+	for (uint32_t i = 0; i < n; i++) {
+		if (!(srcs[i] = handle_lookup(dsets[i], "dset_innerjoin_many", 0, 0))) goto fail;
+		const ds_column *keycol = column_lookup(srcs[i], key);
+		if (!keycol) {
+			nonfatal("dset_innerjoin: input dataset does not contain %s column", key);
+			goto fail;
+		}
+		const int t = abs_i8(keycol->type);
+		if (i > 0 && t != keytype) {
+			nonfatal("dset_innerjoin: input %s column types do not match (%d, %d)", key, keytype, t);
+			goto fail;
+		}
+		if (keycol->shape[0] != 0) {
+			nonfatal("dset_innerjoin: cannot innerjoin column %s with non-zero shape", key);
+			goto fail;
+		}
+		if (t == T_STR || t == T_OBJ || type_size[t] > sizeof(uint64_t)) {
+			nonfatal("dset_innerjoin: cannot innerjoin column %s with type %d", key, t);
+			goto fail;
+		}
+		keytype = t;
+		keydata[i] = (char *) srcs[i] + srcs[i]->arrheap_start + keycol->offset;
+		ncol_total += srcs[i]->ncol;
+	}
+
+	// Probe with the largest input (the first of equal ones) and index the
+	// smaller others, so the hash tables cover as few rows as possible
+	uint32_t probe = 0;
+	for (uint32_t i = 1; i < n; i++) if (srcs[i]->nrow > srcs[probe]->nrow) probe = i;
+	uint32_t *slot = order + n;
+	order[0] = probe;
+	for (uint32_t i = 0, s = 1; i < n; i++) if (i != probe) order[s++] = i;
+	for (uint32_t s = 0; s < n; s++) slot[order[s]] = s;
+
+	ds_innerjoin_ctx j = {
+		.n = n,
+		.srcs = srcs,
+		.keydata = keydata,
+		.keysize = type_size[keytype],
+		.indexes = indexes,
+		.order = order,
+		.slot = slot,
+		.cursors = cursors,
+	};
+
+	for (; nindexed + 1 < n; nindexed++) {
+		const uint32_t i = order[nindexed + 1];
+		if (!joinindex_build(&indexes[nindexed], keydata[i], j.keysize, srcs[i]->nrow)) {
+			nindexed++;
+			nonfatal("dset_innerjoin_many: out of memory");
+			goto fail;
+		}
+		j.hasdups |= indexes[nindexed].hasdups;
+	}
+
+	const uint64_t nrow0 = srcs[probe]->nrow;
+	const uint32_t nthreads = nthreads_for(nrow0);
+	firsts = DSREALLOC(0, sizeof(uint64_t) * n * (nrow0 ? nrow0 : 1));
+	if (!firsts) {
+		nonfatal("dset_innerjoin_many: out of memory");
+		goto fail;
+	}
+	j.firsts = firsts;
+	parallel_run(nthreads, innerjoin_probe, &j);
+	for (uint32_t t = 0; t < nthreads; t++) nrow += j.counts[t];
+	if (nrow > UINT32_MAX) {
+		nonfatal("dset_innerjoin_many: too many result rows (%" PRIu64 ")", nrow);
+		goto fail;
+	}
+
+	// Result rows are stored as n consecutive arrays of rowstride entries.
+	// Without duplicates a single thread can compact them in place, since
+	// there is at most one result row per row of the probe input.
+	if (nthreads == 1 && !j.hasdups) {
+		j.rows = firsts;
+		j.rowstride = nrow0;
+	} else {
+		rows = DSREALLOC(0, sizeof(uint64_t) * n * (nrow ? nrow : 1));
+		if (!rows) {
+			nonfatal("dset_innerjoin_many: out of memory");
+			goto fail;
+		}
+		j.rows = rows;
+		j.rowstride = nrow;
+	}
+	parallel_run(nthreads, innerjoin_fill, &j);
+	if (probe != 0) {
+		uint64_t *sorted = innerjoin_reorder(&j, nrow);
+		if (!sorted) {
+			nonfatal("dset_innerjoin_many: out of memory");
+			goto fail;
+		}
+		if (rows) DSFREE(rows);
+		j.rows = rows = sorted;
+		j.rowstride = nrow;
+	}
+
+	// Each column is taken from the last input that has it, except for the
+	// key which comes from the first.
+	coldata = DSREALLOC(0, sizeof(ds_innerjoin_coldata) * (ncol_total ? ncol_total : 1));
+	if (!coldata) {
+		nonfatal("dset_innerjoin_many: out of memory");
+		goto fail;
+	}
+	for (uint32_t i = 0; i < n; i++) {
+		for (uint32_t c = 0; c < srcs[i]->ncol; c++) {
+			ds_column *col = &srcs[i]->columns[c];
+			const char *colkey = getkey(srcs[i], col);
+			const int is_key = strcmp(key, colkey) == 0;
+			if (is_key && i > 0) continue;
+
+			uint32_t later = i + 1;
+			while (!is_key && later < n && !column_lookup(srcs[later], colkey)) later++;
+			if (!is_key && later < n) continue; // defer to later dataset
+
+			coldata[ncol].col = col;
+			coldata[ncol].src = i;
+			coldata[ncol].itemsize = type_size[abs_i8(col->type)] * stride(col);
+			coldata[ncol].is_str = abs_i8(col->type) == T_STR;
+			ncol++;
+		}
+	}
+
+	// Allocate new dataset with unioned fields and space for all rows
+	uint64_t arrheap_sz = 0, keys_sz = 1;
+	for (uint32_t c = 0; c < ncol; c++)
+		count_column_space(srcs[coldata[c].src], coldata[c].col, nrow, &arrheap_sz, &keys_sz);
+	dset = new_with_capacity(ncol, nrow, arrheap_sz, keys_sz);
+	if (dset == UINT64_MAX) goto fail;
+	for (uint32_t c = 0; c < ncol; c++) {
+		const ds_column *col = coldata[c].col;
+		const char *colkey = getkey(srcs[coldata[c].src], col);
+		if (!dset_addcol_array(
+			dset, colkey, abs_i8(col->type),
+			col->shape[0], col->shape[1], col->shape[2]
+		)) {
+			nonfatal("dset_innerjoin: cannot add column %s to result dataset", colkey);
+			goto fail;
+		}
+	}
+	if (!dset_addrows(dset, (uint32_t) nrow)) goto fail;
+
+	// Populate columns of new dataset, column at a time. Strings are copied
+	// last on this thread because the result may need to grow for them.
+	uint64_t idx;
+	ds *d;
+	if (!(d = handle_lookup(dset, "dset_innerjoin_many", 0, &idx))) goto fail;
+
+	j.dst = d;
+	j.coldata = coldata;
+	j.ncol = ncol;
+	j.nrow = nrow;
+	parallel_run(nthreads_for(nrow), innerjoin_gather, &j);
+
+	for (uint32_t c = 0; c < ncol; c++) {
+		if (!coldata[c].is_str) continue;
+		ds *src = srcs[coldata[c].src];
+		const uint64_t *srcrows = j.rows + slot[coldata[c].src] * j.rowstride;
+		for (uint64_t k = 0; k < nrow; k++) {
+			d = copystr(d, idx, &d->columns[c], k, src, coldata[c].col, srcrows[k]);
+			if (!d) goto fail;
+		}
+	}
+
+	// Success! Skip over the fail case, cleanup and return the handle
+	goto done;
+
+	fail:
+	// Delete and invalidate dataset
+	if (dset != UINT64_MAX) dset_del(dset);
+	dset = UINT64_MAX;
+
+	done:
+	// Clean up hash tables and scratch arrays
+	for (uint32_t i = 0; i < nindexed; i++) joinindex_del(&indexes[i]);
+	if (srcs) DSFREE(srcs);
+	if (keydata) DSFREE((void *) keydata);
+	if (indexes) DSFREE(indexes);
+	if (order) DSFREE(order);
+	if (cursors) DSFREE(cursors);
+	if (firsts) DSFREE(firsts);
+	if (rows) DSFREE(rows);
+	if (coldata) DSFREE(coldata);
+
+	return dset;
+}
+
+/*
+	Copy count strings from the given rows of a source string column (or the
+	first count rows if rows is null) to rows start, start + step, ... of
+	column c of d. Each distinct source handle is copied to d's string heap
+	only once, and remembered in remap for subsequent calls with the same
+	source. Returns the (possibly moved) destination or null on failure.
+
+	d's string heap must not be compacted while remap is in use, which holds
+	as long as nothing in it has been freed (e.g., a new dataset).
+*/
+static ds *
+remapstrs(
+	ds *d, uint64_t idx, uint32_t c, uint64_t start, uint64_t step,
+	const ds *src, const ds_column *src_col, const uint64_t *rows, uint64_t count,
+	ds_ht64 *remap
+) {
+	if (!ht64_reserve(remap, 1024)) {
+		nonfatal("dataset.remapstrs: out of memory");
+		return 0;
+	}
+	const uint64_t *src_handles = (const uint64_t *) ((char *) src + src->arrheap_start + src_col->offset);
+	const char *src_strheap = (char *) src + src->strheap_start;
+	for (uint64_t r = 0; r < count; r++) {
+		const uint64_t h = src_handles[rows ? rows[r] : r];
+		uint64_t newh;
+		if (!ht64_find(remap, h, &newh)) {
+			newh = stralloc(&d, idx, src_strheap + h);
+			if (!d) return 0;
+			if (!ht64_reserve(remap, (uint32_t) remap->len + 1)) {
+				nonfatal("dataset.remapstrs: out of memory");
+				return 0;
+			}
+			ht64_insert_dup(remap, h, newh);
+		}
+		uint64_t *dst_handles = (uint64_t *) ((char *) d + d->arrheap_start + d->columns[c].offset);
+		dst_handles[start + r * step] = newh;
+	}
+	return d;
+}
+
+uint64_t dset_innerjoin(const char *key, uint64_t dset_r, uint64_t dset_s)
+{
+	const uint64_t dsets[2] = { dset_r, dset_s };
+	return dset_innerjoin_many(key, 2, dsets);
+}
+
+uint64_t dset_innerjoin_many(const char *key, uint32_t n, const uint64_t *dsets)
+{
+	const uint64_t t0 = now_ns();
+	return count_join(t0, innerjoin_many(key, n, dsets));
+}
+
+/*
+	Shared implementation of dset_append_many, dset_union_many and
+	dset_interlace. The result has the columns of the first dataset that all
+	the others also have with the same type and shape. Rows of dataset i go to
+	result rows start_i, start_i + step, start_i + 2*step, ...
+
+	A column that holds C strings (T_STR) in one dataset and Python strings
+	(T_OBJ) in another fails the whole operation rather than being left out;
+	convert it to one representation first.
+*/
+typedef enum { COMBINE_APPEND, COMBINE_UNION, COMBINE_INTERLACE } ds_combine_mode;
+
+static uint64_t
+combine_many(const char *key, uint32_t n, const uint64_t *dsets, ds_combine_mode mode, const char *fn)
+{
+	uint64_t dset = UINT64_MAX;
+	ds **srcs = 0;
+	uint64_t **keep = 0;  // for union, rows to keep from each source, null if all
+	uint64_t *nkeep = 0;
+	ds_innerjoin_coldata *coldata = 0;
+	ds_ht64 seen = {0}, remap = {0};
+	uint32_t ncol = 0;
+	uint64_t nrow = 0, strheap_sz = 0;
+
+	if (n == 0) {
+		nonfatal("%s: no datasets given", fn);
+		return UINT64_MAX;
+	}
+
+	srcs = DSREALLOC(0, sizeof(ds *) * n);
+	keep = DSREALLOC(0, sizeof(uint64_t *) * n);
+	nkeep = DSREALLOC(0, sizeof(uint64_t) * n);
+	if (!srcs || !keep || !nkeep) {
+		nonfatal("%s: out of memory", fn);
+		goto fail;
+	}
+	memset(keep, 0, sizeof(uint64_t *) * n);
+
+	for (uint32_t i = 0; i < n; i++) {
+		if (!(srcs[i] = handle_lookup(dsets[i], fn, 0, 0))) goto fail;
+		nkeep[i] = srcs[i]->nrow;
+		nrow += srcs[i]->nrow;
+		strheap_sz += srcs[i]->strheap_sz;
+		if (mode == COMBINE_INTERLACE && srcs[i]->nrow != srcs[0]->nrow) {
+			nonfatal("%s: all datasets must be the same length to interlace", fn);
+			goto fail;
+		}
+	}
+
+	// Find repeated keys. Union drops them, the others fail
+	if (key) {
+		int type = 0;
+		int seen_allones = 0;
+		if (!ht64_reserve(&seen, (uint32_t) nrow)) {
+			nonfatal("%s: out of memory", fn);
+			goto fail;
+		}
+		for (uint32_t i = 0; i < n; i++) {
+			const ds_column *keycol = column_lookup(srcs[i], key);
+			if (!keycol) {
+				nonfatal("%s: input dataset does not contain %s column", fn, key);
+				goto fail;
+			}
+			const int t = abs_i8(keycol->type);
+			if ((i > 0 && t != type) || t == T_STR || t == T_OBJ || type_size[t] > sizeof(uint64_t) || keycol->shape[0]) {
+				nonfatal("%s: unsupported or mismatched %s column type %d", fn, key, t);
+				goto fail;
+			}
+			type = t;
+
+			const void *keydata = (char *) srcs[i] + srcs[i]->arrheap_start + keycol->offset;
+			for (uint64_t r = 0; r < srcs[i]->nrow; r++) {
+				const uint64_t k = joinkey(keydata, type_size[t], r);
+				int repeated;
+				if (k == DSHT64_INVALID) {
+					repeated = seen_allones;
+					seen_allones = 1;
+				} else if (!(repeated = ht64_has(&seen, k))) {
+					ht64_insert_dup(&seen, k, 0);
+				}
+				if (!repeated) {
+					if (keep[i]) keep[i][nkeep[i]++] = r;
+					continue;
+				}
+				if (mode != COMBINE_UNION) {
+					nonfatal("%s: cannot combine datasets that contain the same %s", fn, key);
+					goto fail;
+				}
+				if (!keep[i]) {
+					// first dropped row from this dataset, switch to a row list
+					keep[i] = DSREALLOC(0, sizeof(uint64_t) * srcs[i]->nrow);
+					if (!keep[i]) {
+						nonfatal("%s: out of memory", fn);
+						goto fail;
+					}
+					for (uint64_t q = 0; q < r; q++) keep[i][q] = q;
+					nkeep[i] = r;
+				}
+				nrow--;
+			}
+		}
+		ht64_del(&seen);
+	}
+	if (nrow > UINT32_MAX) {
+		nonfatal("%s: too many result rows (%" PRIu64 ")", fn, nrow);
+		goto fail;
+	}
+
+	// Columns of the first dataset that are in all the others
+	coldata = DSREALLOC(0, sizeof(ds_innerjoin_coldata) * (srcs[0]->ncol ? srcs[0]->ncol : 1));
+	if (!coldata) {
+		nonfatal("%s: out of memory", fn);
+		goto fail;
+	}
+	for (uint32_t c = 0; c < srcs[0]->ncol; c++) {
+		ds_column *col = &srcs[0]->columns[c];
+		const char *colkey = getkey(srcs[0], col);
+		uint32_t i = 1;
+		for (; i < n; i++) {
+			const ds_column *other = column_lookup(srcs[i], colkey);
+			const int t = abs_i8(col->type), ot = other ? abs_i8(other->type) : 0;
+			if ((t == T_STR && ot == T_OBJ) || (t == T_OBJ && ot == T_STR)) {
+				// Python objects cannot be read here, so don't quietly drop the field
+				nonfatal("%s: column %s has C strings in one dataset and Python objects in another", fn, colkey);
+				goto fail;
+			}
+			if (!other || ot != t || memcmp(other->shape, col->shape, sizeof(col->shape))) break;
+		}
+		if (i < n) continue;
+		coldata[ncol].col = col;
+		coldata[ncol].src = 0;
+		coldata[ncol].itemsize = type_size[abs_i8(col->type)] * stride(col);
+		coldata[ncol].is_str = abs_i8(col->type) == T_STR;
+		ncol++;
+	}
+
+	// Pre-size the result for all rows and (at most) all strings in one go
+	uint64_t arrheap_sz = 0, keys_sz = 1;
+	for (uint32_t c = 0; c < ncol; c++) count_column_space(srcs[0], coldata[c].col, nrow, &arrheap_sz, &keys_sz);
+	dset = new_with_capacity(ncol, nrow, arrheap_sz, keys_sz + strheap_sz);
+	if (dset == UINT64_MAX) goto fail;
+	for (uint32_t c = 0; c < ncol; c++) {
+		const ds_column *col = coldata[c].col;
+		if (!dset_addcol_array(dset, getkey(srcs[0], col), abs_i8(col->type), col->shape[0], col->shape[1], col->shape[2])) {
+			nonfatal("%s: cannot add column %s to result dataset", fn, getkey(srcs[0], col));
+			goto fail;
+		}
+	}
+	if (!dset_reserve(dset, nrow, strheap_sz)) goto fail;
+	if (!dset_addrows(dset, (uint32_t) nrow)) goto fail;
+
+	uint64_t idx;
+	ds *d;
+	if (!(d = handle_lookup(dset, fn, 0, &idx))) goto fail;
+
+	const uint64_t step = mode == COMBINE_INTERLACE ? n : 1;
+	uint64_t start = 0;
+	for (uint32_t i = 0; i < n; i++) {
+		ds *src = srcs[i];
+		const uint64_t *rows = keep[i];
+		const uint64_t count = nkeep[i];
+		int have_remap = 0;
+
+		for (uint32_t c = 0; c < ncol; c++) {
+			ds_column *src_col = column_lookup(src, getkey(srcs[0], coldata[c].col));
+			const size_t itemsize = (size_t) coldata[c].itemsize;
+			const char *src_ptr = (char *) src + src->arrheap_start + src_col->offset;
+
+			if (!coldata[c].is_str) {
+				char *dst_ptr = (char *) d + d->arrheap_start + d->columns[c].offset + start * itemsize;
+				if (step == 1 && !rows) {
+					memcpy(dst_ptr, src_ptr, count * itemsize);
+				} else if (step == 1) {
+					gathercol(dst_ptr, src_ptr, rows, count, itemsize);
+				} else {
+					for (uint64_t r = 0; r < count; r++)
+						memcpy(dst_ptr + r * step * itemsize, src_ptr + r * itemsize, itemsize);
+				}
+				continue;
+			}
+
+			// string handle mapping is shared by all string columns of the source
+			if (!have_remap) ht64_del(&remap);
+			have_remap = 1;
+			d = remapstrs(d, idx, c, start, step, src, src_col, rows, count, &remap);
+			if (!d) goto fail;
+		}
+		start += mode == COMBINE_INTERLACE ? 1 : count;
+	}
+
+	// Success! Skip over the fail case, cleanup and return the handle
+	goto done;
+
+	fail:
+	// Delete and invalidate dataset
+	if (dset != UINT64_MAX) dset_del(dset);
+	dset = UINT64_MAX;
+
+	done:
+	ht64_del(&seen);
+	ht64_del(&remap);
+	for (uint32_t i = 0; keep && i < n; i++) if (keep[i]) DSFREE(keep[i]);
+	if (keep) DSFREE(keep);
+	if (srcs) DSFREE(srcs);
+	if (nkeep) DSFREE(nkeep);
+	if (coldata) DSFREE(coldata);
+
+	return dset;
+}
+
+uint64_t dset_append_many(const char *key, uint32_t n, const uint64_t *dsets)
+{
+	const uint64_t t0 = now_ns();
+	return count_join(t0, combine_many(key, n, dsets, COMBINE_APPEND, "dset_append_many"));
+}
+
+uint64_t dset_union_many(const char *key, uint32_t n, const uint64_t *dsets)
+{
+	if (!key) {
+		nonfatal("dset_union_many: key is required");
+		return UINT64_MAX;
+	}
+	const uint64_t t0 = now_ns();
+	return count_join(t0, combine_many(key, n, dsets, COMBINE_UNION, "dset_union_many"));
+}
+
+uint64_t dset_interlace(const char *key, uint32_t n, const uint64_t *dsets)
+{
+	const uint64_t t0 = now_ns();
+	return count_join(t0, combine_many(key, n, dsets, COMBINE_INTERLACE, "dset_interlace"));
+}
+
+/*
+	Row subsets for dset_take and dset_mask. Both allocate the result once
+	and copy one column at a time. Large inputs are split into one share of
+	rows per thread; for masks, each share's output offset is the number of
+	selected rows in the preceding shares.
+*/
+typedef struct { uint32_t v[3]; } ds_item12;
+typedef struct { uint64_t v[2]; } ds_item16;
+
+// Copy the masked items of src to the start of dst, which has space for
+// exactly cnt (the number of non-zero mask entries). The loop is branchless
+// and stops after the last selected item, so it never writes past cnt.
+#define MASKCOL_LOOP(T) { \
+	T *d_ = (T *) dst; const T *s_ = (const T *) src; \
+	for (uint64_t r = 0, k = 0; k < cnt; r++) { d_[k] = s_[r]; k += mask[r] != 0; } \
+	break; }
+
+static inline void
+maskcol(char *dst, const char *src, const uint8_t *mask, uint64_t cnt, size_t itemsize) {
+	switch (itemsize) {
+	case 1: MASKCOL_LOOP(uint8_t)
+	case 2: MASKCOL_LOOP(uint16_t)
+	case 4: MASKCOL_LOOP(uint32_t)
+	case 8: MASKCOL_LOOP(uint64_t)
+	case 12: MASKCOL_LOOP(ds_item12)
+	case 16: MASKCOL_LOOP(ds_item16)
+	default:
+		for (uint64_t r = 0, k = 0; k < cnt; r++) {
+			if (!mask[r]) continue;
+			memcpy(dst + k * itemsize, src + r * itemsize, itemsize);
+			k++;
+		}
+	}
+}
+#undef MASKCOL_LOOP
+
+typedef struct {
+	const ds *src;
+	ds *dst;
+	const uint64_t *rows;  // for take
+	const uint8_t *mask;   // for mask
+	uint64_t n;            // number of indices, or number of source rows for mask
+	uint64_t counts[DSPARALLEL_MAX_THREADS];
+} ds_subset_ctx;
+
+static void
+subset_count(void *ctx, uint32_t tid, uint32_t nthreads) {
+	ds_subset_ctx *x = ctx;
+	const uint64_t end = share_start(x->n, tid + 1, nthreads);
+	uint64_t cnt = 0;
+	for (uint64_t r = share_start(x->n, tid, nthreads); r < end; r++) cnt += x->mask[r] != 0;
+	x->counts[tid] = cnt;
+}
+
+static void
+subset_gather(void *ctx, uint32_t tid, uint32_t nthreads) {
+	ds_subset_ctx *x = ctx;
+	const ds *src = x->src;
+	ds *d = x->dst;
+	const uint64_t start = share_start(x->n, tid, nthreads);
+	const uint64_t end = share_start(x->n, tid + 1, nthreads);
+	uint64_t out = start;
+	if (x->mask) {
+		out = 0;
+		for (uint32_t t = 0; t < tid; t++) out += x->counts[t];
+	}
+
+	for (uint32_t c = 0; c < src->ncol; c++) {
+		const ds_column *col = &src->columns[c];
+		if (abs_i8(col->type) == T_STR) continue;
+		const size_t itemsize = type_size[abs_i8(col->type)] * stride(col);
+		char *dst_ptr = (char *) d + d->arrheap_start + d->columns[c].offset + out * itemsize;
+		const char *src_ptr = (const char *) src + src->arrheap_start + col->offset;
+		if (x->mask) {
+			maskcol(dst_ptr, src_ptr + start * itemsize, x->mask + start, x->counts[tid], itemsize);
+		} else {
+			gathercol(dst_ptr, src_ptr, x->rows + start, end - start, itemsize);
+		}
+	}
+}
+
+static uint64_t
+subset(uint64_t dset, const uint64_t *rows, const uint8_t *mask, uint64_t n, const char *fn)
+{
+	uint64_t result = UINT64_MAX;
+	uint64_t *maskrows = 0;
+	ds_ht64 remap = {0};
+	const ds *src = handle_lookup(dset, fn, 0, 0);
+	if (!src) return UINT64_MAX;
+
+	ds_subset_ctx x = { .src = src, .rows = rows, .mask = mask, .n = mask ? src->nrow : n };
+	const uint32_t nthreads = nthreads_for(x.n);
+	uint64_t nrow = n;
+	if (mask) {
+		parallel_run(nthreads, subset_count, &x);
+		nrow = 0;
+		for (uint32_t t = 0; t < nthreads; t++) nrow += x.counts[t];
+	} else {
+		for (uint64_t k = 0; k < n; k++) {
+			if (rows[k] >= src->nrow) {
+				nonfatal("%s: index %" PRIu64 " out of range (%" PRIu64 " rows)", fn, rows[k], src->nrow);
+				return UINT64_MAX;
+			}
+		}
+	}
+	if (nrow > UINT32_MAX) {
+		nonfatal("%s: too many result rows (%" PRIu64 ")", fn, nrow);
+		return UINT64_MAX;
+	}
+
+	// Copy the column layout into a result sized for exactly nrow rows, so
+	// that many small subsets each take one small allocation
+	int has_str = 0;
+	uint64_t arrheap_sz = 0, keys_sz = 1;
+	for (uint32_t c = 0; c < src->ncol; c++) {
+		has_str |= abs_i8(src->columns[c].type) == T_STR;
+		count_column_space(src, &src->columns[c], nrow, &arrheap_sz, &keys_sz);
+	}
+
+	// Room for the strings of the selected rows, but never more than the
+	// whole source heap (e.g., when rows share strings)
+	uint64_t strs_sz = 0;
+	if (has_str && mask) {
+		maskrows = DSREALLOC(0, sizeof(uint64_t) * (nrow ? nrow : 1));
+		if (!maskrows) {
+			nonfatal("%s: out of memory", fn);
+			goto fail;
+		}
+		for (uint64_t r = 0, k = 0; k < nrow; r++) {
+			maskrows[k] = r;
+			k += mask[r] != 0;
+		}
+		rows = maskrows;
+	}
+	for (uint32_t c = 0; has_str && c < src->ncol; c++) {
+		const ds_column *col = &src->columns[c];
+		if (abs_i8(col->type) != T_STR) continue;
+		const uint64_t *handles = (const uint64_t *) ((const char *) src + src->arrheap_start + col->offset);
+		const char *strheap = (const char *) src + src->strheap_start;
+		for (uint64_t k = 0; k < nrow && strs_sz < src->strheap_sz; k++) {
+			const uint64_t h = handles[rows[k]];
+			if (h) strs_sz += 1 + strlen(strheap + h);
+		}
+	}
+	if (strs_sz > src->strheap_sz) strs_sz = src->strheap_sz;
+
+	result = new_with_capacity(src->ncol, nrow, arrheap_sz, keys_sz + strs_sz);
+	if (result == UINT64_MAX) goto fail;
+	for (uint32_t c = 0; c < src->ncol; c++) {
+		const ds_column *col = &src->columns[c];
+		if (!dset_addcol_array(result, getkey(src, col), abs_i8(col->type), col->shape[0], col->shape[1], col->shape[2])) {
+			nonfatal("%s: cannot add column %s to result dataset", fn, getkey(src, col));
+			goto fail;
+		}
+	}
+	if (!dset_reserve(result, nrow, strs_sz)) goto fail;
+	if (!dset_addrows(result, (uint32_t) nrow)) goto fail;
+
+	uint64_t idx;
+	ds *d = handle_lookup(result, fn, 0, &idx);
+	if (!d) goto fail;
+	x.dst = d;
+	parallel_run(nthreads, subset_gather, &x);
+
+	if (!has_str) goto done;
+
+	// Strings are copied on this thread, only those still referenced
+	for (uint32_t c = 0; c < src->ncol; c++) {
+		const ds_column *col = &src->columns[c];
+		if (abs_i8(col->type) != T_STR) continue;
+		d = remapstrs(d, idx, c, 0, 1, src, col, rows, nrow, &remap);
+		if (!d) goto fail;
+	}
+	goto done;
+
+	fail:
+	if (result != UINT64_MAX) dset_del(result);
+	result = UINT64_MAX;
+
+	done:
+	ht64_del(&remap);
+	if (maskrows) DSFREE(maskrows);
+	return result;
+}
+
+uint64_t dset_take(uint64_t dset, const uint64_t *indices, uint64_t n)
+{
+	return subset(dset, indices, 0, n, "dset_take");
+}
+
+uint64_t dset_mask(uint64_t dset, const uint8_t *mask)
+{
+	return subset(dset, 0, mask, 0, "dset_mask");
+}
+
+/*
+	Query masks. Each queried column gets a set of the wanted values keyed by
+	their bits, so every row is checked with one hash probe per column. Floats
+	are keyed so that 0.0 and -0.0 match and NaN never does, the same as ==.
+	String columns are keyed by handle: the string heap is scanned once for the
+	wanted strings, so rows are never compared by text.
+*/
+
+typedef struct {
+	const char *data;
+	int type;
+	int has_invalid; // DSHT64_INVALID is wanted, but cannot be a key
+	ds_ht64 set;
+} ds_query_col;
+
+typedef struct {
+	ds_query_col *cols;
+	uint32_t ncol;
+	uint64_t nrow;
+	uint8_t *mask;
+} ds_query_ctx;
+
+static inline uint64_t
+query_f32_key(float v) {
+	uint32_t bits;
+	if (v == 0) v = 0; // -0.0
+	memcpy(&bits, &v, sizeof(bits));
+	return bits;
+}
+
+static inline uint64_t
+query_f64_key(double v) {
+	uint64_t bits;
+	if (v == 0) v = 0;
+	memcpy(&bits, &v, sizeof(bits));
+	return bits;
+}
+
+static inline int
+query_has(ds_query_col *q, uint64_t key) {
+	return key == DSHT64_INVALID ? q->has_invalid : ht64_has(&q->set, key);
+}
+
+static int
+query_add(ds_query_col *q, uint64_t key) {
+	if (key == DSHT64_INVALID) {
+		q->has_invalid = 1;
+		return 1;
+	}
+	if (q->set.ht && ht64_has(&q->set, key)) return 1;
+	if (!ht64_reserve(&q->set, (uint32_t) q->set.len + 1)) return 0;
+	ht64_insert_dup(&q->set, key, 0);
+	return 1;
+}
+
+// Key of item i in the given values of the given column type. Returns 0 if it
+// can never match (NaN)
+static inline int
+query_key(const void *values, int type, uint64_t i, uint64_t *key) {
+	switch (type) {
+	case T_F32: { float v = ((const float *) values)[i]; *key = query_f32_key(v); return v == v; }
+	case T_F64: { double v = ((const double *) values)[i]; *key = query_f64_key(v); return v == v; }
+	case T_I8:  *key = (uint64_t) ((const int8_t *) values)[i]; return 1;
+	case T_I16: *key = (uint64_t) ((const int16_t *) values)[i]; return 1;
+	case T_I32: *key = (uint64_t) ((const int32_t *) values)[i]; return 1;
+	case T_U8:  *key = ((const uint8_t *) values)[i]; return 1;
+	case T_U16: *key = ((const uint16_t *) values)[i]; return 1;
+	case T_U32: *key = ((const uint32_t *) values)[i]; return 1;
+	default:    *key = ((const uint64_t *) values)[i]; return 1;
+	}
+}
+
+// Add the handle of every string in the heap that is one of the given strings
+static int
+query_add_strs(ds_query_col *q, const ds *d, const char **strs, uint64_t n) {
+	ds_ht64 wanted = {0}; // string hash -> index in strs
+	size_t len;
+	int ok = ht64_reserve(&wanted, n > 16 ? (uint32_t) n : 16);
+	for (uint64_t i = 0; ok && i < n; i++) ht64_insert_dup(&wanted, strhash(strs[i], &len), i);
+
+	const char *strheap = (const char *) d + d->strheap_start;
+	for (const char *p = strheap; ok && p < strheap + d->strheap_sz; p += len + 1) {
+		const uint64_t h = strhash(p, &len), hh = hash64(h);
+		for (int32_t i = hh;;) {
+			i = ht64_lookup(hh, wanted.exp, i);
+			if (wanted.ht[i][0] == DSHT64_INVALID) break;
+			if (wanted.ht[i][0] == h && !strcmp(strs[wanted.ht[i][1]], p)) {
+				ok = query_add(q, (uint64_t) (p - strheap));
+				break;
+			}
+		}
+	}
+	ht64_del(&wanted);
+	return ok;
+}
+
+#define QUERY_LOOP(T, KEY) { \
+	const T *col_ = (const T *) q->data; \
+	for (uint64_t r = start; r < end; r++) { \
+		const T v = col_[r]; \
+		mask[r] = mask[r] && (KEY) && query_has(q, (uint64_t) key_); \
+	} \
+	break; }
+
+static void
+query_task(void *ctx, uint32_t tid, uint32_t nthreads) {
+	ds_query_ctx *x = ctx;
+	const uint64_t start = share_start(x->nrow, tid, nthreads);
+	const uint64_t end = share_start(x->nrow, tid + 1, nthreads);
+	uint8_t *mask = x->mask;
+	memset(mask + start, 1, end - start);
+	for (uint32_t c = 0; c < x->ncol; c++) {
+		ds_query_col *q = &x->cols[c];
+		uint64_t key_;
+		switch (q->type) {
+		case T_F32: QUERY_LOOP(float,    (key_ = query_f32_key(v), v == v))
+		case T_F64: QUERY_LOOP(double,   (key_ = query_f64_key(v), v == v))
+		case T_I8:  QUERY_LOOP(int8_t,   (key_ = (uint64_t) v, 1))
+		case T_I16: QUERY_LOOP(int16_t,  (key_ = (uint64_t) v, 1))
+		case T_I32: QUERY_LOOP(int32_t,  (key_ = (uint64_t) v, 1))
+		case T_U8:  QUERY_LOOP(uint8_t,  (key_ = v, 1))
+		case T_U16: QUERY_LOOP(uint16_t, (key_ = v, 1))
+		case T_U32: QUERY_LOOP(uint32_t, (key_ = v, 1))
+		default:    QUERY_LOOP(uint64_t, (key_ = v, 1))
+		}
+	}
+}
+#undef QUERY_LOOP
+
+// Set mask[r] to 1 for each row r of the given dataset where every one of the
+// given columns has one of the values at the same index, 0 otherwise. values[i]
+// points to nvalues[i] items of the column's type, or strings for columns of C
+// strings (T_STR). Columns of complex numbers, Python objects or arrays cannot
+// be queried.
+int dset_query_mask(uint64_t dset, uint32_t nfields, const char **keys, const uint64_t *nvalues, const void **values, uint8_t *mask)
+{
+	const ds *d = handle_lookup(dset, "dset_query_mask", 0, 0);
+	if (!d) return 0;
+
+	int ok = 1;
+	ds_query_ctx x = { .ncol = nfields, .nrow = d->nrow, .mask = mask };
+	x.cols = DSREALLOC(0, sizeof(ds_query_col) * (nfields ? nfields : 1));
+	if (!x.cols) {
+		nonfatal("dset_query_mask: out of memory");
+		return 0;
+	}
+	memset(x.cols, 0, sizeof(ds_query_col) * (nfields ? nfields : 1));
+
+	for (uint32_t i = 0; ok && i < nfields; i++) {
+		const ds_column *c = column_lookup((ds *) d, keys[i]);
+		ds_query_col *q = &x.cols[i];
+		if (!c) {
+			nonfatal("dset_query_mask: column %s does not exist", keys[i]);
+			ok = 0;
+			break;
+		}
+		q->type = abs_i8(c->type);
+		q->data = (const char *) d + d->arrheap_start + c->offset;
+		if (q->type == T_C32 || q->type == T_C64 || q->type == T_OBJ || stride(c) != 1) {
+			nonfatal("dset_query_mask: cannot query column %s with type %d and shape %u", keys[i], q->type, (unsigned) stride(c));
+			ok = 0;
+			break;
+		}
+		if (nvalues[i] > UINT32_MAX / 2) {
+			nonfatal("dset_query_mask: too many values for column %s (%" PRIu64 ")", keys[i], nvalues[i]);
+			ok = 0;
+			break;
+		}
+		ok = ht64_reserve(&q->set, nvalues[i] > 16 ? (uint32_t) nvalues[i] : 16);
+		if (ok && q->type == T_STR) {
+			ok = query_add_strs(q, d, (const char **) values[i], nvalues[i]);
+		} else {
+			uint64_t key;
+			for (uint64_t k = 0; ok && k < nvalues[i]; k++) {
+				if (query_key(values[i], q->type, k, &key)) ok = query_add(q, key);
+			}
+		}
+		if (!ok) nonfatal("dset_query_mask: out of memory");
+	}
+
+	if (ok && x.nrow) parallel_run(nthreads_for(x.nrow), query_task, &x);
+
+	for (uint32_t i = 0; i < nfields; i++) ht64_del(&x.cols[i].set);
+	DSFREE(x.cols);
+	return ok;
+}
+
+/*
+	Sorting and grouping. Each key column is converted to unsigned integers
+	that sort in the same order as its values, then the rows are sorted with
+	a stable LSD radix sort by the last key first. Byte positions that are
+	the same in every row are skipped, so narrow or small-range columns need
+	only a few passes. Strings sort by text: each string in the heap is keyed
+	by the rank of its text among all strings in the heap.
+*/
+
+// Order-preserving unsigned keys for signed and floating point values. NaN
+// sorts after everything else and -0.0 is equal to 0.0, like numpy
+static inline uint64_t
+sortkey_i64(int64_t v) {
+	return (uint64_t) v ^ ((uint64_t) 1 << 63);
+}
+
+static inline uint64_t
+sortkey_f32(float v) {
+	uint32_t bits;
+	if (v != v) return UINT32_MAX;
+	if (v == 0) v = 0;
+	memcpy(&bits, &v, sizeof(bits));
+	return bits >> 31 ? ~bits : bits | ((uint32_t) 1 << 31);
+}
+
+static inline uint64_t
+sortkey_f64(double v) {
+	uint64_t bits;
+	if (v != v) return UINT64_MAX;
+	if (v == 0) v = 0;
+	memcpy(&bits, &v, sizeof(bits));
+	return bits >> 63 ? ~bits : bits | ((uint64_t) 1 << 63);
+}
+
+static int
+strptr_cmp(const void *a, const void *b) {
+	return strcmp(*(const char * const *) a, *(const char * const *) b);
+}
+
+// Map the handle of each string in the heap to the rank of its text. Equal
+// strings get the same rank. Returns 0 if out of memory
+static int
+strrank_build(ds_ht64 *ranks, const ds *d) {
+	const char *strheap = (const char *) d + d->strheap_start;
+	uint64_t count = 0;
+	for (const char *p = strheap; p < strheap + d->strheap_sz; p += strlen(p) + 1) count++;
+
+	const char **strs = DSREALLOC(0, sizeof(const char *) * (count ? count : 1));
+	if (!strs || !ht64_reserve(ranks, count > 16 ? (uint32_t) count : 16)) {
+		if (strs) DSFREE(strs);
+		return 0;
+	}
+	uint64_t i = 0;
+	for (const char *p = strheap; p < strheap + d->strheap_sz; p += strlen(p) + 1) strs[i++] = p;
+	qsort(strs, count, sizeof(const char *), strptr_cmp);
+	for (uint64_t k = 0, rank = 0; k < count; k++) {
+		if (k > 0 && strcmp(strs[k - 1], strs[k])) rank++;
+		ht64_insert_dup(ranks, (uint64_t) (strs[k] - strheap), rank);
+	}
+	DSFREE(strs);
+	return 1;
+}
+
+#define SORTKEY_LOOP(T, KEY) { \
+	const T *col_ = (const T *) data; \
+	for (uint64_t r = 0; r < n; r++) { const T v = col_[r]; keys[r] = (KEY); } \
+	break; }
+
+// Compute the sort key of each row of the given column. Returns 0 if out of
+// memory
+static int
+sortkeys(const ds *d, const ds_column *c, uint64_t *keys) {
+	const char *data = (const char *) d + d->arrheap_start + c->offset;
+	const uint64_t n = d->nrow;
+	ds_ht64 ranks = {0};
+	switch (abs_i8(c->type)) {
+	case T_F32: SORTKEY_LOOP(float,    sortkey_f32(v))
+	case T_F64: SORTKEY_LOOP(double,   sortkey_f64(v))
+	case T_I8:  SORTKEY_LOOP(int8_t,   sortkey_i64(v))
+	case T_I16: SORTKEY_LOOP(int16_t,  sortkey_i64(v))
+	case T_I32: SORTKEY_LOOP(int32_t,  sortkey_i64(v))
+	case T_I64: SORTKEY_LOOP(int64_t,  sortkey_i64(v))
+	case T_U8:  SORTKEY_LOOP(uint8_t,  v)
+	case T_U16: SORTKEY_LOOP(uint16_t, v)
+	case T_U32: SORTKEY_LOOP(uint32_t, v)
+	case T_U64: SORTKEY_LOOP(uint64_t, v)
+	case T_STR:
+		if (!strrank_build(&ranks, d)) return 0;
+		for (uint64_t r = 0; r < n; r++) {
+			keys[r] = 0;
+			ht64_find(&ranks, ((const uint64_t *) data)[r], &keys[r]);
+		}
+		ht64_del(&ranks);
+		break;
+	}
+	return 1;
+}
+#undef SORTKEY_LOOP
+
+// Stably sort the n keys and the row indexes in order together. tmpkeys and
+// tmporder are scratch space for n entries each
+static void
+radixsort(uint64_t *keys, uint64_t *order, uint64_t *tmpkeys, uint64_t *tmporder, uint64_t n) {
+	uint64_t counts[8][256] = {{0}};
+	for (uint64_t i = 0; i < n; i++) {
+		for (int b = 0; b < 8; b++) counts[b][(keys[i] >> (8 * b)) & 0xff]++;
+	}
+
+	uint64_t *k = keys, *o = order;
+	for (int b = 0; b < 8; b++) {
+		if (n == 0 || counts[b][(k[0] >> (8 * b)) & 0xff] == n) continue; // same byte in every row
+		uint64_t pos[256];
+		for (uint64_t v = 0, total = 0; v < 256; v++) {
+			pos[v] = total;
+			total += counts[b][v];
+		}
+		for (uint64_t i = 0; i < n; i++) {
+			const uint64_t dst = pos[(k[i] >> (8 * b)) & 0xff]++;
+			tmpkeys[dst] = k[i];
+			tmporder[dst] = o[i];
+		}
+		uint64_t *swap = k; k = tmpkeys; tmpkeys = swap;
+		swap = o; o = tmporder; tmporder = swap;
+	}
+	if (k != keys) {
+		memcpy(keys, k, sizeof(uint64_t) * n);
+		memcpy(order, o, sizeof(uint64_t) * n);
+	}
+}
+
+// Same as radixsort for keys that fit in 32 bits, packed into the upper half
+// of each item with the row index in the lower half. Moving one array instead
+// of two is about twice as fast
+static void
+radixsort_packed(uint64_t *items, uint64_t *tmp, uint64_t n) {
+	uint64_t counts[4][256] = {{0}};
+	for (uint64_t i = 0; i < n; i++) {
+		for (int b = 0; b < 4; b++) counts[b][(items[i] >> (32 + 8 * b)) & 0xff]++;
+	}
+
+	uint64_t *it = items;
+	for (int b = 0; b < 4; b++) {
+		if (n == 0 || counts[b][(it[0] >> (32 + 8 * b)) & 0xff] == n) continue;
+		uint64_t pos[256];
+		for (uint64_t v = 0, total = 0; v < 256; v++) {
+			pos[v] = total;
+			total += counts[b][v];
+		}
+		for (uint64_t i = 0; i < n; i++) tmp[pos[(it[i] >> (32 + 8 * b)) & 0xff]++] = it[i];
+		uint64_t *swap = it; it = tmp; tmp = swap;
+	}
+	if (it != items) memcpy(items, it, sizeof(uint64_t) * n);
+}
+
+// If there are few distinct keys, replace each key with its rank among them
+// so that the radix sort needs fewer passes, e.g., for 64-bit uids that are
+// shared by many rows. Gives up and leaves the keys as they were once more
+// than 1/16 of the rows are distinct.
+static void
+rankkeys(uint64_t *keys, uint64_t n) {
+	const uint64_t maxdistinct = n / 16 < (1 << 20) ? n / 16 : (1 << 20);
+	if (maxdistinct < 256) return;
+
+	ds_ht64 distinct = {0}; // key -> index in vals
+	uint64_t *vals = DSREALLOC(0, sizeof(uint64_t) * 4 * maxdistinct);
+	if (!vals || !ht64_reserve(&distinct, (uint32_t) maxdistinct)) goto done;
+	uint64_t *idx = vals + maxdistinct, *tmpvals = vals + 2 * maxdistinct, *tmpidx = vals + 3 * maxdistinct;
+
+	uint64_t ndistinct = 0, invalid = UINT64_MAX; // index of DSHT64_INVALID, which cannot be a key
+	for (uint64_t r = 0; r < n; r++) {
+		uint64_t j = DSHT64_INVALID;
+		if (keys[r] == DSHT64_INVALID ? invalid != UINT64_MAX : ht64_find(&distinct, keys[r], &j)) {
+			keys[r] = keys[r] == DSHT64_INVALID ? invalid : j;
+			continue;
+		}
+		if (ndistinct == maxdistinct) {
+			for (uint64_t k = 0; k < r; k++) keys[k] = vals[keys[k]];
+			goto done;
+		}
+		if (keys[r] == DSHT64_INVALID) invalid = ndistinct;
+		else ht64_insert_dup(&distinct, keys[r], ndistinct);
+		vals[ndistinct] = keys[r];
+		keys[r] = ndistinct++;
+	}
+
+	// rank of each distinct key, reusing tmpvals
+	for (uint64_t j = 0; j < ndistinct; j++) idx[j] = j;
+	radixsort(vals, idx, tmpvals, tmpidx, ndistinct);
+	for (uint64_t rank = 0; rank < ndistinct; rank++) tmpvals[idx[rank]] = rank;
+	for (uint64_t r = 0; r < n; r++) keys[r] = tmpvals[keys[r]];
+
+	done:
+	ht64_del(&distinct);
+	if (vals) DSFREE(vals);
+}
+
+// Stably sort the row indexes of d by the values of the given columns, the
+// first column first. If sorted is given, it receives an allocated array of
+// the keys of the first column in sorted order, to be freed by the caller
+static int
+sortrows(const ds *d, uint32_t nkeys, const char **colkeys, uint64_t *order, uint64_t **sorted, const char *fn) {
+	const uint64_t n = d->nrow;
+	for (uint32_t i = 0; i < nkeys; i++) {
+		const ds_column *c = column_lookup((ds *) d, colkeys[i]);
+		if (!c) {
+			nonfatal("%s: column %s does not exist", fn, colkeys[i]);
+			return 0;
+		}
+		const int type = abs_i8(c->type);
+		if (type == T_C32 || type == T_C64 || type == T_OBJ || stride(c) != 1) {
+			nonfatal("%s: cannot sort column %s with type %d and shape %u", fn, colkeys[i], type, (unsigned) stride(c));
+			return 0;
+		}
+	}
+
+	uint64_t *buf = DSREALLOC(0, sizeof(uint64_t) * 3 * (n ? n : 1));
+	uint64_t *keys = DSREALLOC(0, sizeof(uint64_t) * (n ? n : 1));
+	int ok = buf && keys;
+	for (uint64_t r = 0; r < n; r++) order[r] = r;
+	for (uint32_t i = nkeys; ok && i > 0; i--) {
+		const ds_column *c = column_lookup((ds *) d, colkeys[i - 1]);
+		uint64_t *colsortkeys = buf, *tmpkeys = buf + n, *tmporder = buf + 2 * n;
+		ok = sortkeys(d, c, colsortkeys);
+		if (ok && type_size[abs_i8(c->type)] >= 4 && abs_i8(c->type) != T_STR) rankkeys(colsortkeys, n);
+		uint64_t bits = 0;
+		for (uint64_t r = 0; ok && r < n; r++) bits |= keys[r] = colsortkeys[order[r]];
+		if (!ok) break;
+		if (bits >> 32 || n > UINT32_MAX) {
+			radixsort(keys, order, tmpkeys, tmporder, n);
+			continue;
+		}
+		for (uint64_t r = 0; r < n; r++) keys[r] = keys[r] << 32 | order[r];
+		radixsort_packed(keys, tmpkeys, n);
+		for (uint64_t r = 0; r < n; r++) {
+			order[r] = keys[r] & UINT32_MAX;
+			keys[r] >>= 32;
+		}
+	}
+	if (!ok) nonfatal("%s: out of memory", fn);
+	if (buf) DSFREE(buf);
+	if (ok && sorted) *sorted = keys;
+	else if (keys) DSFREE(keys);
+	return ok;
+}
+
+typedef struct {
+	char *data;
+	char *tmp;
+	const uint64_t *order;
+	uint64_t nrow;
+	size_t itemsize;
+} ds_reorder_ctx;
+
+static void
+reorder_task(void *ctx, uint32_t tid, uint32_t nthreads) {
+	ds_reorder_ctx *x = ctx;
+	const uint64_t start = share_start(x->nrow, tid, nthreads);
+	const uint64_t end = share_start(x->nrow, tid + 1, nthreads);
+	gathercol(x->tmp + start * x->itemsize, x->data, x->order + start, end - start, x->itemsize);
+}
+
+// Indexes of the rows of the given dataset in order of the values of the
+// given columns, compared by the first column, then the next, etc. Rows with
+// equal values stay in the same order. Strings are compared by text. Writes
+// nrow indexes to order. Columns of complex numbers, Python objects or arrays
+// cannot be sorted.
+int dset_argsort(uint64_t dset, uint32_t nkeys, const char **keys, uint64_t *order)
+{
+	const ds *d = handle_lookup(dset, "dset_argsort", 0, 0);
+	if (!d) return 0;
+	return sortrows(d, nkeys, keys, order, 0, "dset_argsort");
+}
+
+// Group the rows of the given dataset by the value of the given column. Rows
+// order[offsets[g]] to order[offsets[g + 1] - 1] have the g-th smallest
+// value, in their original order. Writes nrow indexes to order and up to nrow
+// + 1 group offsets. If reorder is non-zero, also moves the rows of every
+// column so that group g is rows offsets[g] to offsets[g + 1] - 1, after which
+// order[r] is the previous index of row r. Returns the number of groups, or
+// UINT64_MAX on error.
+uint64_t dset_groupby(uint64_t dset, const char *key, uint64_t *order, uint64_t *offsets, int reorder)
+{
+	ds *d = reorder ? handle_lookup_mut(dset, "dset_groupby", 0) : handle_lookup(dset, "dset_groupby", 0, 0);
+	if (!d) return UINT64_MAX;
+
+	uint64_t *sorted = 0, ngroup = 0;
+	if (!sortrows(d, 1, &key, order, &sorted, "dset_groupby")) return UINT64_MAX;
+	for (uint64_t r = 0; r < d->nrow; r++) {
+		if (r == 0 || sorted[r] != sorted[r - 1]) offsets[ngroup++] = r;
+	}
+	offsets[ngroup] = d->nrow;
+	DSFREE(sorted);
+	if (!reorder || d->nrow == 0) return ngroup;
+
+	size_t maxitemsize = 0;
+	for (uint32_t c = 0; c < d->ncol; c++) {
+		const size_t itemsize = type_size[abs_i8(d->columns[c].type)] * stride(d->columns + c);
+		if (itemsize > maxitemsize) maxitemsize = itemsize;
+	}
+	ds_reorder_ctx x = { .order = order, .nrow = d->nrow };
+	x.tmp = DSREALLOC(0, maxitemsize * d->nrow);
+	if (!x.tmp) {
+		nonfatal("dset_groupby: out of memory");
+		return UINT64_MAX;
+	}
+	for (uint32_t c = 0; c < d->ncol; c++) {
+		x.itemsize = type_size[abs_i8(d->columns[c].type)] * stride(d->columns + c);
+		x.data = (char *) d + d->arrheap_start + d->columns[c].offset;
+		parallel_run(nthreads_for(d->nrow), reorder_task, &x);
+		memcpy(x.data, x.tmp, x.itemsize * d->nrow);
+	}
+	DSFREE(x.tmp);
+	return ngroup;
+}
+
+/*
+	Column kernels. Each makes one pass over a numeric column with its rows
+	split between threads. Every loop reads or writes contiguous elements of a
+	single known type, so that the compiler can vectorize it for the target
+	instruction set. Complex, string and object columns are not supported.
+*/
+
+#define DSKERNEL_TYPELIST(X) \
+	X(T_F32, float,    0,         0)          \
+	X(T_F64, double,   0,         0)          \
+	DSKERNEL_INTLIST(X)
+
+#define DSKERNEL_INTLIST(X) \
+	X(T_I8,  int8_t,   INT8_MIN,  INT8_MAX)   \
+	X(T_I16, int16_t,  INT16_MIN, INT16_MAX)  \
+	X(T_I32, int32_t,  INT32_MIN, INT32_MAX)  \
+	X(T_I64, int64_t,  INT64_MIN, INT64_MAX)  \
+	X(T_U8,  uint8_t,  0,         UINT8_MAX)  \
+	X(T_U16, uint16_t, 0,         UINT16_MAX) \
+	X(T_U32, uint32_t, 0,         UINT32_MAX) \
+	X(T_U64, uint64_t, 0,         UINT64_MAX)
+
+static inline int
+kernel_type(int type) {
+	return type != T_C32 && type != T_C64 && type != T_STR && type != T_OBJ;
+}
+
+// Find a numeric column for a kernel. Sets data to its first element and
+// returns it, or null if there is no such numeric column
+static const ds_column *
+kernel_column(uint64_t dset, const char *key, int mut, char **data, const char *fn) {
+	uint64_t idx;
+	const ds *d = mut ? handle_lookup_mut(dset, fn, &idx) : handle_lookup_any(dset, fn, 0, &idx);
+	const ds_column *c = column_lookup((ds *) d, key);
+	const ds *owner;
+	if (!d) return 0;
+	if (!c) {
+		nonfatal("%s: no column %s", fn, key);
+		return 0;
+	}
+	if (!kernel_type(abs_i8(c->type))) {
+		nonfatal("%s: column %s with type %d is not numeric", fn, key, abs_i8(c->type));
+		return 0;
+	}
+	*data = column_data(d, idx, c, 0, &owner, fn);
+	return *data ? c : 0;
+}
+
+// Element conversion. Floats converted to integers saturate, with NaN as 0,
+// so that no input is undefined behaviour. Integers wrap as with a C cast.
+#define EMIT_SATURATE(typeenum, ctype, lo, hi) \
+static inline ctype CONCAT(saturate_,typeenum)(double v) { \
+	return v != v ? 0 : v <= (double) (lo) ? (lo) : v >= (double) (hi) ? (hi) : (ctype) v; \
+}
+DSKERNEL_INTLIST(EMIT_SATURATE)
+#undef EMIT_SATURATE
+static inline float saturate_T_F32(double v) { return (float) v; }
+static inline double saturate_T_F64(double v) { return v; }
+
+typedef struct {
+	const char *src;
+	char *dst;
+	int srctype;
+	int dsttype;
+	uint64_t n; // number of elements
+} ds_convert_ctx;
+
+#define CONVERT_LOOP(stype, dtype, expr) { \
+	const stype *s = (const stype *) x->src; \
+	dtype *o = (dtype *) x->dst; \
+	for (uint64_t i = start; i < end; i++) o[i] = expr; \
+}
+// Same types as DSKERNEL_TYPELIST, since a list cannot be expanded inside itself
+#define DSKERNEL_SRCLIST(X) \
+	X(T_F32, float) X(T_F64, double) \
+	X(T_I8, int8_t) X(T_I16, int16_t) X(T_I32, int32_t) X(T_I64, int64_t) \
+	X(T_U8, uint8_t) X(T_U16, uint16_t) X(T_U32, uint32_t) X(T_U64, uint64_t)
+
+#define EMIT_CONVERT_FROM(typeenum, ctype) \
+	case typeenum: \
+		if (typeenum == T_F32 || typeenum == T_F64) CONVERT_LOOP(ctype, dtype, saturate(s[i])) \
+		else CONVERT_LOOP(ctype, dtype, (dtype) s[i]) \
+		break;
+
+#define EMIT_CONVERT_TO(typeenum, ctype, lo, hi) \
+static void CONCAT(convert_to_,typeenum)(const ds_convert_ctx *x, uint64_t start, uint64_t end) { \
+	typedef ctype dtype; \
+	ctype (*const saturate)(double) = CONCAT(saturate_,typeenum); \
+	switch (x->srctype) { DSKERNEL_SRCLIST(EMIT_CONVERT_FROM) } \
+}
+DSKERNEL_TYPELIST(EMIT_CONVERT_TO)
+#undef EMIT_CONVERT_TO
+#undef EMIT_CONVERT_FROM
+#undef CONVERT_LOOP
+
+static void
+convert_task(void *ctx, uint32_t tid, uint32_t nthreads) {
+	const ds_convert_ctx *x = ctx;
+	const uint64_t start = share_start(x->n, tid, nthreads);
+	const uint64_t end = share_start(x->n, tid + 1, nthreads);
+	switch (x->dsttype) {
+	#define EMIT_CONVERT_CASE(typeenum, ctype, lo, hi) case typeenum: CONCAT(convert_to_,typeenum)(x, start, end); break;
+	DSKERNEL_TYPELIST(EMIT_CONVERT_CASE)
+	#undef EMIT_CONVERT_CASE
+	}
+}
+
+typedef struct {
+	char *data;
+	int type;
+	uint32_t stride;
+	uint64_t nrow;
+	const double *scale;  // one per element of a row, or null for 1
+	const double *offset; // one per element of a row, or null for 0
+} ds_fma_ctx;
+
+#define FMA_LOOP(ctype) { \
+	ctype *v = (ctype *) x->data; \
+	if (s == 1) { \
+		const double a = x->scale ? x->scale[0] : 1, b = x->offset ? x->offset[0] : 0; \
+		for (uint64_t r = start; r < end; r++) v[r] = (ctype) (v[r] * a + b); \
+	} else { \
+		for (uint64_t r = start; r < end; r++) \
+			for (uint32_t j = 0; j < s; j++) \
+				v[r * s + j] = (ctype) (v[r * s + j] * (x->scale ? x->scale[j] : 1) + (x->offset ? x->offset[j] : 0)); \
+	} \
+} break;
+
+static void
+fma_task(void *ctx, uint32_t tid, uint32_t nthreads) {
+	const ds_fma_ctx *x = ctx;
+	const uint64_t start = share_start(x->nrow, tid, nthreads);
+	const uint64_t end = share_start(x->nrow, tid + 1, nthreads);
+	const uint32_t s = x->stride;
+	switch (x->type) {
+	case T_F32: FMA_LOOP(float)
+	case T_F64: FMA_LOOP(double)
+	}
+}
+#undef FMA_LOOP
+
+typedef struct {
+	const char *data;
+	int type;
+	uint32_t stride;
+	uint64_t ngroup;
+	const uint64_t *order;   // rows of the groups, or null if contiguous
+	const uint64_t *offsets; // ngroup + 1 group starts in order
+	double *min, *max, *sum; // ngroup * stride results
+	double *part;            // per-thread results if there is one group
+} ds_reduce_ctx;
+
+/*
+	Each reduction keeps DSREDUCE_LANES independent minimums, maximums and
+	sums, so that consecutive elements don't wait on each other's result.
+	Compilers don't vectorize the min/max selects without fast-math flags,
+	but breaking up the dependency chain still roughly halves the time.
+	The selects skip NaN; a NaN element always makes the sum NaN, so only
+	then is the range scanned again to decide whether min and max are NaN.
+*/
+#define DSREDUCE_LANES 4
+
+// Minimum or maximum of a and b that is NaN if either is
+static inline double reduce_min(double a, double b) { return b < a || b != b ? b : a; }
+static inline double reduce_max(double a, double b) { return b > a || b != b ? b : a; }
+
+#define REDUCE_LANES(idx) \
+	for (; k + DSREDUCE_LANES <= end; k += DSREDUCE_LANES) { \
+		for (uint32_t l = 0; l < DSREDUCE_LANES; l++) { \
+			const double e = (double) v[(idx) * s + j]; \
+			mn[l] = e < mn[l] ? e : mn[l]; \
+			mx[l] = e > mx[l] ? e : mx[l]; \
+			sm[l] += e; \
+		} \
+	} \
+	for (uint32_t l = 0; k < end; k++) { \
+		const double e = (double) v[(idx) * s + j]; \
+		mn[l] = e < mn[l] ? e : mn[l]; \
+		mx[l] = e > mx[l] ? e : mx[l]; \
+		sm[l] += e; \
+	}
+
+#define REDUCE_LOOP(ctype) { \
+	const ctype *v = (const ctype *) x->data; \
+	for (uint32_t j = 0; j < s; j++) { \
+		double mn[DSREDUCE_LANES], mx[DSREDUCE_LANES], sm[DSREDUCE_LANES]; \
+		for (uint32_t l = 0; l < DSREDUCE_LANES; l++) { mn[l] = INFINITY; mx[l] = -INFINITY; sm[l] = 0; } \
+		uint64_t k = start; \
+		if (rows) { REDUCE_LANES(rows[k + l]) } \
+		else { REDUCE_LANES(k + l) } \
+		for (uint32_t l = 1; l < DSREDUCE_LANES; l++) { \
+			mn[0] = mn[l] < mn[0] ? mn[l] : mn[0]; \
+			mx[0] = mx[l] > mx[0] ? mx[l] : mx[0]; \
+			sm[0] += sm[l]; \
+		} \
+		for (k = start; sm[0] != sm[0] && k < end; k++) { \
+			const double e = (double) v[(rows ? rows[k] : k) * s + j]; \
+			if (e != e) { mn[0] = mx[0] = e; break; } \
+		} \
+		min[j] = mn[0]; max[j] = mx[0]; sum[j] = sm[0]; \
+	} \
+} break;
+
+// Reduce rows start to end of the order (or the column, if there is none)
+static void
+reduce_range(const ds_reduce_ctx *x, uint64_t start, uint64_t end, double *min, double *max, double *sum) {
+	const uint64_t *rows = x->order;
+	const uint32_t s = x->stride;
+	switch (x->type) {
+	#define EMIT_REDUCE_CASE(typeenum, ctype, lo, hi) case typeenum: REDUCE_LOOP(ctype)
+	DSKERNEL_TYPELIST(EMIT_REDUCE_CASE)
+	#undef EMIT_REDUCE_CASE
+	}
+}
+#undef REDUCE_LOOP
+#undef REDUCE_LANES
+
+static void
+reduce_task(void *ctx, uint32_t tid, uint32_t nthreads) {
+	const ds_reduce_ctx *x = ctx;
+	const uint32_t s = x->stride;
+	if (x->part) {
+		const uint64_t n = x->offsets[1] - x->offsets[0];
+		double *p = x->part + (uint64_t) tid * 3 * s;
+		reduce_range(x, x->offsets[0] + share_start(n, tid, nthreads), x->offsets[0] + share_start(n, tid + 1, nthreads), p, p + s, p + 2 * s);
+		return;
+	}
+	const uint64_t end = share_start(x->ngroup, tid + 1, nthreads);
+	for (uint64_t g = share_start(x->ngroup, tid, nthreads); g < end; g++)
+		reduce_range(x, x->offsets[g], x->offsets[g + 1], x->min + g * s, x->max + g * s, x->sum + g * s);
+}
+
+typedef struct {
+	const char *data;
+	int type;
+	uint64_t n; // number of elements
+	double lo, hi;
+	uint32_t nbins;
+	uint64_t *counts; // nbins per thread
+} ds_histogram_ctx;
+
+// Bin edges and the choice of bin at an edge are the same as numpy.histogram
+static inline double
+histogram_edge(const ds_histogram_ctx *x, uint32_t i) {
+	return i == x->nbins ? x->hi : x->lo + i * ((x->hi - x->lo) / x->nbins);
+}
+
+#define HISTOGRAM_LOOP(ctype) { \
+	const ctype *v = (const ctype *) x->data; \
+	for (uint64_t k = start; k < end; k++) { \
+		const double e = (double) v[k]; \
+		if (!(e >= x->lo && e <= x->hi)) continue; \
+		const double f = (e - x->lo) * norm; \
+		uint32_t i = f >= x->nbins ? x->nbins - 1 : f > 0 ? (uint32_t) f : 0; \
+		if (i > 0 && e < histogram_edge(x, i)) i--; \
+		else if (i + 1 < x->nbins && e >= histogram_edge(x, i + 1)) i++; \
+		counts[i]++; \
+	} \
+} break;
+
+static void
+histogram_task(void *ctx, uint32_t tid, uint32_t nthreads) {
+	const ds_histogram_ctx *x = ctx;
+	const uint64_t start = share_start(x->n, tid, nthreads);
+	const uint64_t end = share_start(x->n, tid + 1, nthreads);
+	const double norm = x->nbins / (x->hi - x->lo);
+	uint64_t *counts = x->counts + (uint64_t) tid * x->nbins;
+	switch (x->type) {
+	#define EMIT_HISTOGRAM_CASE(typeenum, ctype, lo, hi) case typeenum: HISTOGRAM_LOOP(ctype)
+	DSKERNEL_TYPELIST(EMIT_HISTOGRAM_CASE)
+	#undef EMIT_HISTOGRAM_CASE
+	}
+}
+#undef HISTOGRAM_LOOP
+
+// Write the values of the given numeric column, converted to the given
+// numeric type, to out, which must have room for dset_getsz bytes of the new
+// type. Floats converted to integers are truncated and saturate at the
+// integer type's limits, with NaN converted to 0. Integers are converted as
+// with a C cast.
+int dset_convert(uint64_t dset, const char *key, int type, void *out)
+{
+	char *data;
+	const ds_column *c = kernel_column(dset, key, 0, &data, "dset_convert");
+	if (!c) return 0;
+	if (!tcheck(type) || !kernel_type(type)) {
+		nonfatal("dset_convert: cannot convert to type %d", type);
+		return 0;
+	}
+
+	ds_convert_ctx x = {
+		.src = data, .dst = out, .srctype = abs_i8(c->type), .dsttype = type,
+		.n = dset_nrow(dset) * stride(c),
+	};
+	parallel_run(nthreads_for(x.n), convert_task, &x);
+	return 1;
+}
+
+// Replace each value of the given floating-point column with value * scale +
+// offset, computed in double precision. scale and offset each have one entry
+// per element of a row (e.g., 2 for shifts), or are null to leave values
+// unscaled or unshifted.
+int dset_fma(uint64_t dset, const char *key, const double *scale, const double *offset)
+{
+	char *data;
+	const ds_column *c = kernel_column(dset, key, 1, &data, "dset_fma");
+	if (!c) return 0;
+	if (abs_i8(c->type) != T_F32 && abs_i8(c->type) != T_F64) {
+		nonfatal("dset_fma: column %s is not floating-point", key);
+		return 0;
+	}
+
+	ds_fma_ctx x = {
+		.data = data, .type = abs_i8(c->type), .stride = (uint32_t) stride(c),
+		.nrow = dset_nrow(dset), .scale = scale, .offset = offset,
+	};
+	parallel_run(nthreads_for(x.nrow), fma_task, &x);
+	return 1;
+}
+
+// Minimum, maximum and sum of each element of the rows of the given numeric
+// column in each of ngroup groups, written to min[g * n + j], max[g * n + j]
+// and sum[g * n + j] for element j of n in group g. Group g is rows
+// order[offsets[g]] to order[offsets[g + 1] - 1], as from dset_groupby, or
+// rows offsets[g] to offsets[g + 1] - 1 if order is null. If offsets is null,
+// there is one group of every row. Results are doubles, NaN if any value is
+// NaN. Empty groups have minimum inf, maximum -inf and sum 0.
+int dset_reduce(uint64_t dset, const char *key, uint64_t ngroup, const uint64_t *order, const uint64_t *offsets, double *min, double *max, double *sum)
+{
+	char *data;
+	const uint64_t nrow = dset_nrow(dset);
+	const uint64_t all[] = {0, nrow};
+	const ds_column *c = kernel_column(dset, key, 0, &data, "dset_reduce");
+	if (!c) return 0;
+	if (!offsets) {
+		ngroup = 1;
+		offsets = all;
+	}
+	for (uint64_t g = 0; g < ngroup; g++) {
+		if (offsets[g] > offsets[g + 1] || offsets[g + 1] > nrow) {
+			nonfatal("dset_reduce: invalid group offsets %" PRIu64 " to %" PRIu64 " (%" PRIu64 " rows)", offsets[g], offsets[g + 1], nrow);
+			return 0;
+		}
+	}
+	for (uint64_t k = offsets[0]; order && k < offsets[ngroup]; k++) {
+		if (order[k] >= nrow) {
+			nonfatal("dset_reduce: index %" PRIu64 " out of range (%" PRIu64 " rows)", order[k], nrow);
+			return 0;
+		}
+	}
+
+	ds_reduce_ctx x = {
+		.data = data, .type = abs_i8(c->type), .stride = (uint32_t) stride(c),
+		.ngroup = ngroup, .order = order, .offsets = offsets, .min = min, .max = max, .sum = sum,
+	};
+	if (ngroup != 1) {
+		parallel_run(nthreads_for(offsets[ngroup] - offsets[0]), reduce_task, &x);
+		return 1;
+	}
+
+	// A single group is split between threads, then their results combined
+	const uint32_t nthreads = nthreads_for(offsets[1] - offsets[0]), s = x.stride;
+	x.part = DSREALLOC(0, sizeof(double) * 3 * s * nthreads);
+	if (!x.part) {
+		nonfatal("dset_reduce: out of memory");
+		return 0;
+	}
+	parallel_run(nthreads, reduce_task, &x);
+	for (uint32_t j = 0; j < s; j++) {
+		min[j] = INFINITY;
+		max[j] = -INFINITY;
+		sum[j] = 0;
+		for (uint32_t t = 0; t < nthreads; t++) {
+			const double *p = x.part + (uint64_t) t * 3 * s;
+			min[j] = reduce_min(min[j], p[j]);
+			max[j] = reduce_max(max[j], p[s + j]);
+			sum[j] += p[2 * s + j];
+		}
+	}
+	DSFREE(x.part);
+	return 1;
+}
+
+// Count the elements of the given numeric column in each of nbins equal
+// bins from lo to hi, the same as numpy.histogram. The last bin includes hi.
+// Elements outside the range and NaN are not counted.
+int dset_histogram(uint64_t dset, const char *key, double lo, double hi, uint32_t nbins, uint64_t *counts)
+{
+	char *data;
+	const ds_column *c = kernel_column(dset, key, 0, &data, "dset_histogram");
+	if (!c) return 0;
+	if (nbins == 0 || !(lo < hi)) {
+		nonfatal("dset_histogram: invalid range %g to %g with %" PRIu32 " bins", lo, hi, nbins);
+		return 0;
+	}
+
+	ds_histogram_ctx x = {
+		.data = data, .type = abs_i8(c->type), .n = dset_nrow(dset) * stride(c),
+		.lo = lo, .hi = hi, .nbins = nbins,
+	};
+	const uint32_t nthreads = nthreads_for(x.n);
+	x.counts = DSREALLOC(0, sizeof(uint64_t) * nbins * nthreads);
+	if (!x.counts) {
+		nonfatal("dset_histogram: out of memory");
+		return 0;
+	}
+	memset(x.counts, 0, sizeof(uint64_t) * nbins * nthreads);
+	parallel_run(nthreads, histogram_task, &x);
+	for (uint32_t i = 0; i < nbins; i++) {
+		counts[i] = 0;
+		for (uint32_t t = 0; t < nthreads; t++) counts[i] += x.counts[(uint64_t) t * nbins + i];
+	}
+	DSFREE(x.counts);
+	return 1;
+}
+
+void dset_del(uint64_t dset)
 {
 	module_init();
 	lock();
 
 	uint64_t idx;
-	uint16_t generation;
-	if (handle_lookup(dset, "dset_del", &generation, &idx)) {
+	uint16_t generation;
+	if (handle_lookup_any(dset, "dset_del", &generation, &idx)) {
+
+		delslot(idx);
+	}
+	unlock();
+}
+
+uint64_t dset_totalsz(uint64_t dset)
+{
+	ds *d = handle_lookup_any(dset, "dset_ncol", 0, 0);
+	if(d) return d->total_sz;
+	else  return 0;
+}
+
+uint32_t dset_ncol(uint64_t dset)
+{
+	ds *d = handle_lookup_any(dset, "dset_ncol", 0, 0);
+	if(d) return d->ncol;
+	else  return 0;
+}
+
+uint64_t dset_nrow(uint64_t dset)
+{
+	ds *d = handle_lookup_any(dset, "dset_nrow", 0, 0);
+	if(d) return d->nrow;
+	else  return 0;
+}
+
+const char *dset_key(uint64_t dset, uint64_t index)
+{
+	const ds *d  = handle_lookup_any(dset, "dset_colkey", 0, 0);
+	if (!d) return "";
+	if (index >= d->ncol) {
+		nonfatal("dset_key: column index %d out of range (%d ncol)", index, d->ncol);
+		return "";
+	}
+	const ds_column *c  = &d->columns[index];
+	return getkey(d, c);
+}
+
+
+int dset_type (uint64_t dset, const char * colkey)
+{
+	const ds        *d  = handle_lookup_any(dset, colkey, 0, 0);
+	const ds_column *c  = column_lookup(d, colkey);
+
+	if(!(d && c)) return 0;
+	return abs_i8(c->type);
+}
+
+void *dset_get (uint64_t dset, const char * colkey)
+{
+	// Caution: T_STR columns cannot be used directly, actual strings must be
+	// retrieved through dset_getstr
+	uint64_t idx;
+	const ds        *d  = handle_lookup_any(dset, colkey, 0, &idx);
+	const ds_column *c  = column_lookup(d, colkey);
+	const ds        *owner;
+
+	if(!(d && c)) return 0;
+
+	return column_data(d, idx, c, 0, &owner, "dset_get");
+}
+
+uint64_t dset_getsz(uint64_t dset, const char * colkey)
+{
+	const ds        *d  = handle_lookup_any(dset, colkey, 0, 0);
+	const ds_column *c  = column_lookup(d, colkey);
+
+	if(!(d && c)) return 0;
+
+	return d->nrow * abs_i8(type_size[abs_i8(c->type)]) * stride(c);
+}
+
+uint32_t dset_getshp (uint64_t dset, const char * colkey)
+{
+	const ds        *d  = handle_lookup_any(dset, colkey, 0, 0);
+	const ds_column *c  = column_lookup(d, colkey);
+
+	if(!(d && c)) return 0;
+
+	// Each byte in the result is a member of the shape tuple (ordered by
+	// significance)
+	return c->shape[0] | c->shape[1] << 8 | c->shape[2] << 16;
+}
+
+uint64_t dset_colindex (uint64_t dset, const char * colkey)
+{
+	const ds *d = handle_lookup_any(dset, colkey, 0, 0);
+	if (!d) return UINT64_MAX;
+	return colindex_find(d, colkey);
+}
+
+static const ds_column *
+column_at (const ds *d, uint64_t colindex)
+{
+	if (!d || colindex >= d->ncol) return 0;
+	return d->columns + colindex;
+}
+
+int dset_type_at (uint64_t dset, uint64_t colindex)
+{
+	const ds        *d  = handle_lookup_any(dset, "dset_type_at", 0, 0);
+	const ds_column *c  = column_at(d, colindex);
+
+	if(!(d && c)) return 0;
+	return abs_i8(c->type);
+}
+
+void *dset_get_at (uint64_t dset, uint64_t colindex)
+{
+	uint64_t idx;
+	const ds        *d  = handle_lookup_any(dset, "dset_get_at", 0, &idx);
+	const ds_column *c  = column_at(d, colindex);
+	const ds        *owner;
+
+	if(!(d && c)) return 0;
+	return column_data(d, idx, c, 0, &owner, "dset_get_at");
+}
+
+uint64_t dset_getsz_at (uint64_t dset, uint64_t colindex)
+{
+	const ds        *d  = handle_lookup_any(dset, "dset_getsz_at", 0, 0);
+	const ds_column *c  = column_at(d, colindex);
+
+	if(!(d && c)) return 0;
+	return d->nrow * abs_i8(type_size[abs_i8(c->type)]) * stride(c);
+}
+
+uint32_t dset_getshp_at (uint64_t dset, uint64_t colindex)
+{
+	const ds        *d  = handle_lookup_any(dset, "dset_getshp_at", 0, 0);
+	const ds_column *c  = column_at(d, colindex);
+
+	if(!(d && c)) return 0;
+	return c->shape[0] | c->shape[1] << 8 | c->shape[2] << 16;
+}
+
+int dset_addcol_scalar (uint64_t dset, const char * key, int type) {
+	return dset_addcol_array(dset, key, type, 0, 0, 0);
+}
+
+
+int dset_addcol_array (uint64_t dset, const char * key, int type, int shape0, int shape1, int shape2) {
+
+	if(!tcheck(type)) {
+		nonfatal("invalid column data type: %i", type);
+		return 0;
+	}
+
+	uint64_t idx; 
+	ds *d = handle_lookup_mut(dset, "add column", &idx);
+	if(!d) return 0;
+
+	const size_t ksz = 1 + strlen(key);
+	const int8_t t   = abs_i8(type);
+
+	// hypothetical new column descriptor.
+	ds_column col;
+	col.type =  ksz > SHORTKEYSZ ? -t : t;
+	col.shape[0] = (uint8_t) shape0;
+	col.shape[1] = (uint8_t) shape1;
+	col.shape[2] = (uint8_t) shape2;
+
+	if (d->ncol == d->ccol) {
+
+		// need more space for column descriptors
+		d = more_columndescr_space(idx, 30);
+		if (!d) return 0;
+	}
+
+	// compute the offset for the new column
+	col.offset = actual_arrheap_sz(d);
+	
+	// compute the required space on the array heap for the  new column
+	const uint64_t reqd_arrheap_space = compute_col_reserved_space(d->crow, &col);
+
+	const uint64_t arrheap_sz = d->strheap_start - d->arrheap_start;
+
+	if (col.offset + reqd_arrheap_space > arrheap_sz) {
+
+		// need more space on the array heap
+		const size_t howmuch_need = col.offset + reqd_arrheap_space - arrheap_sz;
+		d = more_arrheap(idx, howmuch_need);
+		if (!d) return 0;
+	}
+
+	if (col.type < 0) {
+		// key is long, so allocate a string for it	
+
+		uint64_t newstr = stralloc(&d, idx, key);
+		if (!d) return 0;
+		strref_move(d, idx, 0, newstr);
+		col.longkey    = newstr;
+
+	} else {
+		snprintf(col.shortkey, sizeof(col.shortkey), "%s", key);
+	}
+
+	// commit the new column
+	d->columns[d->ncol++] = col;
+	colindex_add(d);
+	return 1;
+}
+
+// Change the type of the given column. Type must be compatible in size
+// NOTE: This is unsafe! Does not cast existing values to expected values. Use
+// dset_castcol to convert them.
+int dset_changecol (uint64_t dset, const char *key, int type) {
+	if (!tcheck(type)) {
+		nonfatal("invalid column data type: %i", type);
+		return 0;
+	}
+
+	uint64_t idx;
+	ds        *d  = handle_lookup_mut(dset, key, &idx);
+	ds_column *c  = column_lookup(d, key);
+
+	if (!(d && c)) return 0;
 
-		DSFREE(ds_module.slots[idx].memory);
-		ds_module.slots[idx].memory = 0;
+	int8_t current_size = abs_i8(type_size[abs_i8(c->type)]);
+	int8_t proposed_size = abs_i8(type_size[type]);
+
+	if (current_size != proposed_size) {
+		nonfatal("cannot change column with type %i to incompatible type %i", c->type, type);
+		return 0;
 	}
-	unlock();
+
+	// values become or stop being string handles
+	const int from_str = abs_i8(c->type) == T_STR, to_str = type == T_STR;
+	if (from_str != to_str) {
+		const uint64_t *handles = (const uint64_t *) ((char *) d + d->arrheap_start + c->offset);
+		for (uint64_t j = 0; j < d->nrow; j++) strref_move(d, idx, from_str ? handles[j] : 0, to_str ? handles[j] : 0);
+	}
+
+	c->type = c->type < 0 ? -type : type; // keep long key flag
+	return 1;
 }
 
-uint64_t dset_totalsz(uint64_t dset)
-{
-	ds *d = handle_lookup(dset, "dset_ncol", 0, 0);
-	if(d) return d->total_sz;
-	else  return 0;
+// Convert the values of the given numeric column to the given numeric type in
+// place, as with dset_convert. Columns after it move to fit the new width,
+// so existing pointers to column data are invalidated.
+int dset_castcol (uint64_t dset, const char *key, int type) {
+	uint64_t idx;
+	ds *d = handle_lookup_mut(dset, "dset_castcol", &idx);
+	if (!d) return 0;
+
+	const uint64_t i = colindex_find(d, key);
+	if (i == UINT64_MAX) {
+		nonfatal("dset_castcol: no column %s", key);
+		return 0;
+	}
+
+	ds_column *c = d->columns + i;
+	const int srctype = abs_i8(c->type);
+	if (!tcheck(type) || !kernel_type(type) || !kernel_type(srctype)) {
+		nonfatal("dset_castcol: cannot cast column %s with type %d to type %d", key, srctype, type);
+		return 0;
+	}
+	if (srctype == type) return 1;
+
+	const uint64_t n = d->nrow * stride(c);
+	char *tmp = DSREALLOC(0, n * type_size[type] + 1);
+	if (!tmp) {
+		nonfatal("dset_castcol: out of memory");
+		return 0;
+	}
+	ds_convert_ctx x = {
+		.src = (char *) d + d->arrheap_start + c->offset, .dst = tmp, .srctype = srctype, .dsttype = type, .n = n,
+	};
+	parallel_run(nthreads_for(n), convert_task, &x);
+
+	ds_column newcol = *c;
+	newcol.type = c->type < 0 ? -type : type; // keep long key flag
+	const uint64_t reserved = compute_col_reserved_space(d->crow, &newcol);
+	d = resize_colspace(d, idx, (uint32_t) i, reserved);
+	if (d) {
+		c = d->columns + i;
+		c->type = newcol.type;
+		char *data = (char *) d + d->arrheap_start + c->offset;
+		memcpy(data, tmp, n * type_size[type]);
+		// reserved rows must be zero, see dset_addrows
+		memset(data + n * type_size[type], 0, reserved - n * type_size[type]);
+	}
+	DSFREE(tmp);
+	return d != 0;
 }
 
-uint32_t dset_ncol(uint64_t dset)
-{
-	ds *d = handle_lookup(dset, "dset_ncol", 0, 0);
-	if(d) return d->ncol;
-	else  return 0;
+// Remove the given column. Columns after it move down to fill its space,
+// which is then free for new rows or columns; call dset_defrag to give the
+// memory back. Invalidates column indexes after it.
+int dset_dropcol (uint64_t dset, const char *key) {
+	uint64_t idx;
+	ds *d = handle_lookup_mut(dset, "dset_dropcol", &idx);
+	if (!d) return 0;
+
+	const uint64_t i = colindex_find(d, key);
+	if (i == UINT64_MAX) {
+		nonfatal("dset_dropcol: no column %s", key);
+		return 0;
+	}
+
+	// Pinned readers must not see the columns or their index half changed
+	move_begin(idx);
+	const ds_column *c = &d->columns[i];
+	if (tcheck_s(c->type)) {
+		const uint64_t *handles = (const uint64_t *) ((char *) d + d->arrheap_start + c->offset);
+		for (uint64_t j = 0; j < d->nrow; j++) strref_move(d, idx, handles[j], 0);
+	}
+	if (c->type < 0) strref_move(d, idx, c->longkey, 0);
+	d = resize_colspace(d, idx, (uint32_t) i, 0); // never grows, so never fails
+
+	memmove(d->columns + i, d->columns + i + 1, (d->ncol - i - 1) * sizeof(ds_column));
+	d->ncol--;
+	memset(d->columns + d->ncol, 0, sizeof(ds_column));
+	colindex_rebuild(d);
+	move_end(idx);
+	return 1;
 }
 
-uint64_t dset_nrow(uint64_t dset)
-{
-	ds *d = handle_lookup(dset, "dset_nrow", 0, 0);
-	if(d) return d->nrow;
-	else  return 0;
+// Change the key of the given column without moving its data
+int dset_renamecol (uint64_t dset, const char *key, const char *newkey) {
+	uint64_t idx;
+	ds *d = handle_lookup_mut(dset, "dset_renamecol", &idx);
+	if (!d) return 0;
+
+	const uint64_t i = colindex_find(d, key);
+	if (i == UINT64_MAX) {
+		nonfatal("dset_renamecol: no column %s", key);
+		return 0;
+	}
+	if (!strcmp(key, newkey)) return 1;
+	if (colindex_find(d, newkey) != UINT64_MAX) {
+		nonfatal("dset_renamecol: column %s already exists", newkey);
+		return 0;
+	}
+
+	const int8_t t = abs_i8(d->columns[i].type);
+
+	move_begin(idx); // as in dset_dropcol
+	if (1 + strlen(newkey) > SHORTKEYSZ) {
+		const uint64_t newstr = stralloc(&d, idx, newkey);
+		if (!d) {
+			move_end(idx);
+			return 0;
+		}
+		// stralloc may have compacted the heap and renumbered the old key
+		const uint64_t oldkey = d->columns[i].type < 0 ? d->columns[i].longkey : 0;
+		strref_move(d, idx, oldkey, newstr);
+		d->columns[i].longkey = newstr;
+		d->columns[i].type = -t;
+	} else {
+		strref_move(d, idx, d->columns[i].type < 0 ? d->columns[i].longkey : 0, 0);
+		memset(d->columns[i].shortkey, 0, sizeof(d->columns[i].shortkey));
+		snprintf(d->columns[i].shortkey, sizeof(d->columns[i].shortkey), "%s", newkey);
+		d->columns[i].type = t;
+	}
+
+	colindex_rebuild(d);
+	move_end(idx);
+	return 1;
 }
 
-const char *dset_key(uint64_t dset, uint64_t index)
+int dset_addrows (uint64_t dset, uint32_t num) {
+	uint64_t idx; 
+
+	ds *d = handle_lookup_mut(dset, "dset_addrows", &idx);
+	if (!d) return 0;
+
+	if (d->nrow + num <= d->crow) {
+		// we already have enough space reserved, so no big deal.
+		d->nrow += num;
+		return 1;
+	}
+
+	// reserve a geometrically-increasing number of rows so that appending
+	// rows in a loop does not re-layout the array heap every time
+	uint64_t rowsz = 0;
+	for(uint32_t i = 0; i < d->ncol; i++)
+		rowsz += type_size[abs_i8(d->columns[i].type)] * stride(d->columns+i);
+
+	const uint64_t new_crow = grow_capacity(d->crow, d->nrow + num, rowsz);
+	const uint64_t req_arrheap_sz = compute_arrheap_sz(d, new_crow);
+	const uint64_t cur_arrheap_sz = d->strheap_start - d->arrheap_start;
+
+	// do we have enough space in the heap already?
+	if (req_arrheap_sz > cur_arrheap_sz) {
+		d = more_arrheap(idx, req_arrheap_sz-cur_arrheap_sz);
+		if(!d) return 0;
+	}
+
+	// now we have enough space, we just need to reassign the offsets and do some memmoves
+	reassign_arrayoffsets(d, idx, new_crow);
+
+	d->crow  = new_crow;
+	d->nrow += num;
+	return 1;
+}
+
+// Pre-size the dataset so that it has space for at least nrow rows in total
+// and strheap_bytes more bytes of strings, with at most one reallocation.
+// Subsequent dset_addrows/dset_setstr calls within these limits will not
+// move memory.
+int dset_reserve (uint64_t dset, uint64_t nrow, uint64_t strheap_bytes) {
+	uint64_t idx;
+
+	ds *d = handle_lookup_mut(dset, "dset_reserve", &idx);
+	if (!d) return 0;
+
+	const uint64_t cur_arrcap = arrheap_capacity(d);
+	const uint64_t cur_strcap = strheap_capacity(d);
+	const uint64_t req_arrcap = nrow > d->crow ? compute_arrheap_sz(d, nrow) : 0;
+	const uint64_t new_arrcap = req_arrcap > cur_arrcap ? req_arrcap : cur_arrcap;
+	const uint64_t new_strcap = d->strheap_sz + strheap_bytes > cur_strcap ? d->strheap_sz + strheap_bytes : cur_strcap;
+	const uint64_t new_total  = d->arrheap_start + new_arrcap + new_strcap;
+
+	if (new_total > d->total_sz) {
+		ds *newptr = resize_memory(idx, new_total);
+		if (!newptr) {
+			nonfatal("dset_reserve: out of memory");
+			return 0;
+		}
+		d = newptr;
+		memset((char *) d + d->total_sz, 0, new_total - d->total_sz);
+		d->total_sz = new_total;
+	}
+
+	if (new_arrcap > cur_arrcap) {
+		// shift the string heap forward to make room for the array heap
+		const uint64_t t0 = resize_begin(idx);
+		char * strheap = (char *) d + d->strheap_start;
+		const uint64_t shift = new_arrcap - cur_arrcap;
+		memmove(strheap + shift, strheap, d->strheap_sz);
+		memset(strheap, 0, shift < d->strheap_sz ? shift : d->strheap_sz);
+		d->strheap_start += shift;
+		resize_end(idx, d->strheap_sz, t0);
+	}
+
+	if (nrow > d->crow) {
+		reassign_arrayoffsets(d, idx, nrow);
+		d->crow = nrow;
+	}
+
+	return 1;
+}
+
+
+
+int dset_defrag (uint64_t dset, int realloc_smaller)
 {
-	const ds *d  = handle_lookup(dset, "dset_colkey", 0, 0);
-	if (!d) return "";
-	if (index >= d->ncol) {
-		nonfatal("dset_key: column index %d out of range (%d ncol)", index, d->ncol);
-		return "";
+	uint64_t idx;
+	ds *d = handle_lookup_mut(dset, "dset_defrag", &idx);
+	if(!d) return 0;
+	char * pd = (char *) d;
+
+	// reclaim strings that are no longer in use
+	if (!strheap_compact(d, idx)) return 0;
+
+	if (d->ccol > d->ncol) {
+
+		const uint64_t t0 = resize_begin(idx);
+		char * end = pd + d->strheap_start + d->strheap_sz;
+		char * arrheap = pd + d->arrheap_start;
+		const uint64_t gap = (d->ccol - d->ncol) * sizeof(ds_column);
+
+		memmove(d->columns + d->ncol,  arrheap,  end-arrheap);
+		d->arrheap_start -= gap;
+		d->strheap_start -= gap;
+		d->ccol = d->ncol;
+		memset(pd + d->strheap_start + d->strheap_sz, 0, gap);
+		resize_end(idx, end - arrheap, t0);
 	}
-	const ds_column *c  = &d->columns[index];
-	return getkey(d, c);
+
+	if (d->crow > d->nrow) {
+		reassign_arrayoffsets(d, idx, d->nrow);
+		d->crow = d->nrow;
+	}
+
+	uint64_t actual_heapsz = actual_arrheap_sz(d);
+	uint64_t gap = (d->strheap_start - d->arrheap_start) - actual_heapsz;
+	if (gap) {
+		const uint64_t t0 = resize_begin(idx);
+		memmove(pd + d->strheap_start - gap, pd + d->strheap_start, d->strheap_sz);
+		d->strheap_start -= gap;
+		memset(pd + d->strheap_start + d->strheap_sz, 0, gap);
+		resize_end(idx, d->strheap_sz, t0);
+	}
+
+	if (realloc_smaller) {
+		const uint64_t newsz = d->strheap_start + d->strheap_sz;
+		ds *newptr = resize_memory(idx, newsz);
+		if (!newptr) return 0;
+		d = newptr;
+		d->total_sz = newsz;
+	}
+
+	return 1;
 }
 
 
-int dset_type (uint64_t dset, const char * colkey)
+
+const char *dset_getstr (uint64_t dset, const char * colkey, uint64_t index) 
 {
-	const ds        *d  = handle_lookup(dset, colkey, 0, 0);
-	const ds_column *c  = column_lookup(d, colkey);
+	uint64_t   idx;
+	ds        *d = handle_lookup_any(dset, colkey, 0, &idx);
+	ds_column *c = column_lookup(d, colkey);
+	const ds  *owner;
 
 	if(!(d && c)) return 0;
-	return abs_i8(c->type);
+
+	if (abs_i8(c->type) != T_STR) {
+		nonfatal("dset_getstr: column '%s' is not a string", colkey);
+		return 0;
+	}
+
+	const uint64_t *handle = (uint64_t *) column_data(d, idx, c, index, &owner, "dset_getstr");
+	return handle ? (char *) owner + owner->strheap_start + *handle : 0;
 }
 
-void *dset_get (uint64_t dset, const char * colkey)
+
+int dset_setstr (uint64_t dset, const char * colkey, uint64_t index, const char * value)
 {
-	// Caution: T_STR columns cannot be used directly, actual strings must be
-	// retrieved through dset_getstr
-	const ds        *d  = handle_lookup(dset, colkey, 0, 0);
-	const ds_column *c  = column_lookup(d, colkey);
-	char * ptr = (char *) d;
+	uint64_t idx;
+
+	ds        *d = handle_lookup_mut(dset, colkey, &idx);
+	ds_column *c = column_lookup(d, colkey);
 
 	if(!(d && c)) return 0;
 
-	return ptr + d->arrheap_start + c->offset;
+	if (index >= d->nrow) {
+		nonfatal("dset_setstr: invalid index %"PRIu64, index);
+		return 0;
+	}
+
+	if (abs_i8(c->type) != T_STR) {
+		nonfatal("dset_setstr: column '%s' is not a string", colkey);
+		return 0;
+	}
+
+	return setstr(d, idx, c, index, value) ? 1 : 0;
 }
 
-uint64_t dset_getsz(uint64_t dset, const char * colkey)
+// Set n strings in the given T_STR column starting at row index start.
+// Preferred over repeated dset_setstr calls for large datasets.
+int dset_setstrs (uint64_t dset, const char * colkey, uint64_t start, uint64_t n, const char ** values)
 {
-	const ds        *d  = handle_lookup(dset, colkey, 0, 0);
-	const ds_column *c  = column_lookup(d, colkey);
+	uint64_t idx;
+
+	ds        *d = handle_lookup_mut(dset, colkey, &idx);
+	ds_column *c = column_lookup(d, colkey);
 
 	if(!(d && c)) return 0;
 
-	return d->nrow * abs_i8(type_size[c->type]) * stride(c);
+	if (start > d->nrow || n > d->nrow - start) {
+		nonfatal("dset_setstrs: invalid range %"PRIu64" + %"PRIu64" (%"PRIu64" rows)", start, n, d->nrow);
+		return 0;
+	}
+
+	if (abs_i8(c->type) != T_STR) {
+		nonfatal("dset_setstrs: column '%s' is not a string", colkey);
+		return 0;
+	}
+
+	return setstrs(d, idx, c, start, n, values) ? 1 : 0;
 }
 
-uint32_t dset_getshp (uint64_t dset, const char * colkey)
+// Get pointers to n strings in the given T_STR column starting at row index
+// start. Pointers are only valid until the next dataset modification.
+int dset_getstrs (uint64_t dset, const char * colkey, uint64_t start, uint64_t n, const char ** out)
 {
-	const ds        *d  = handle_lookup(dset, colkey, 0, 0);
-	const ds_column *c  = column_lookup(d, colkey);
+	uint64_t   idx;
+	ds        *d = handle_lookup_any(dset, colkey, 0, &idx);
+	ds_column *c = column_lookup(d, colkey);
+	const ds  *owner;
 
 	if(!(d && c)) return 0;
 
-	// Each byte in the result is a member of the shape tuple (ordered by
-	// significance)
-	return c->shape[0] | c->shape[1] << 8 | c->shape[2] << 16;
+	if (start > d->nrow || n > d->nrow - start) {
+		nonfatal("dset_getstrs: invalid range %"PRIu64" + %"PRIu64" (%"PRIu64" rows)", start, n, d->nrow);
+		return 0;
+	}
+
+	if (abs_i8(c->type) != T_STR) {
+		nonfatal("dset_getstrs: column '%s' is not a string", colkey);
+		return 0;
+	}
+
+	const uint64_t *handles = (uint64_t *) column_data(d, idx, c, start, &owner, "dset_getstrs");
+	if (!handles) return 0;
+
+	const char *strheap = (char *) owner + owner->strheap_start;
+	for (uint64_t i = 0; i < n; i++) out[i] = strheap + handles[i];
+	return 1;
 }
 
-int dset_addcol_scalar (uint64_t dset, const char * key, int type) {
-	return dset_addcol_array(dset, key, type, 0, 0, 0);
+static char* 
+repr_cfloat (uint64_t ds, int sz, char * buf, ds_float_complex_t fc)
+{
+	snprintf(buf,sz,"(%f,%f)", crealf(fc), cimagf(fc));
+	return buf;
 }
 
+static char*
+repr_cdouble (uint64_t ds, int sz, char * buf, ds_double_complex_t dc)
+{
+	snprintf(buf,sz,"(%f,%f)", creal(dc), cimag(dc));
+	return buf;
+}
 
-int dset_addcol_array (uint64_t dset, const char * key, int type, int shape0, int shape1, int shape2) {
+static char*
+repr_str (uint64_t dset, int sz, char * buf, uint64_t handle)
+{
+	ds     *d = handle_lookup(dset, "repr_str", 0, 0);
+	char *ptr = (char *) d;
+	snprintf(buf,sz,"%s",ptr + d->strheap_start + handle );
+	return buf;
+}
 
-	if(!tcheck(type)) {
-		nonfatal("invalid column data type: %i", type);
-		return 0;
+
+// Upper bound of the compressed size of n bytes, see dset_compress
+uint64_t dset_compress_bound (uint64_t n) {
+	const uint64_t nchunks = n ? (n - 1) / DSCOMPRESS_CHUNK + 1 : 1;
+	return varint_len(n) + (nchunks - 1) * snappy_bound(DSCOMPRESS_CHUNK) + snappy_bound(n - (nchunks - 1) * DSCOMPRESS_CHUNK);
+}
+
+// Compress n buffers in parallel, e.g., column data. Each dst buffer must have
+// space for dset_compress_bound(srcsz) bytes. Writes the compressed sizes to
+// dstsz. Output is in the snappy raw format. Buffers may not exceed 4 GB.
+int dset_compress (uint32_t n, const void **src, const uint64_t *srcsz, void **dst, uint64_t *dstsz)
+{
+	uint64_t *task = DSREALLOC(0, sizeof(uint64_t) * (n + 1));
+	uint64_t *tasksz = 0;
+	uint64_t total = 0;
+	if (!task) goto oom;
+
+	task[0] = 0;
+	for (uint32_t i = 0; i < n; i++) {
+		if (srcsz[i] > UINT32_MAX) {
+			nonfatal("dset_compress: buffer %" PRIu32 " is too large (%" PRIu64 " bytes)", i, srcsz[i]);
+			DSFREE(task);
+			return 0;
+		}
+		task[i + 1] = task[i] + (srcsz[i] + DSCOMPRESS_CHUNK - 1) / DSCOMPRESS_CHUNK;
+		total += srcsz[i];
+		varint_write(dst[i], srcsz[i]);
 	}
 
-	uint64_t idx; 
-	ds *d = handle_lookup(dset, "add column", 0, &idx);
-	if(!d) return 0;
+	tasksz = DSREALLOC(0, sizeof(uint64_t) * (task[n] ? task[n] : 1));
+	if (!tasksz) goto oom;
+
+	ds_codec_ctx x = { n, (const uint8_t **) src, srcsz, (uint8_t **) dst, tasksz, task, 0, 0 };
+	const uint64_t maxthreads = total / DSCOMPRESS_MIN_BYTES;
+	parallel_run(nthreads_for_tasks(task[n] < maxthreads ? task[n] : maxthreads), compress_task, &x);
+
+	// move chunks down to follow each other
+	for (uint32_t i = 0; i < n; i++) {
+		uint8_t *out = dst[i];
+		const uint64_t hdr = varint_len(srcsz[i]);
+		uint64_t sz = hdr;
+		for (uint64_t t = task[i]; t < task[i + 1]; t++) {
+			memmove(out + sz, out + chunk_scratch(hdr, t - task[i]), tasksz[t]);
+			sz += tasksz[t];
+		}
+		dstsz[i] = sz;
+	}
 
-	const size_t ksz = 1 + strlen(key);
-	const int8_t t   = abs_i8(type);
+	DSFREE(task);
+	DSFREE(tasksz);
+	return 1;
+
+	oom:
+	if (task) DSFREE(task);
+	nonfatal("dset_compress: out of memory");
+	return 0;
+}
+
+// Size of the given compressed data once decompressed, or UINT64_MAX if invalid
+uint64_t dset_decompressed_size (const void *src, uint64_t srcsz)
+{
+	uint64_t len;
+	return varint_read(src, srcsz, &len) ? len : UINT64_MAX;
+}
+
+// Decompress n buffers compressed with dset_compress (or any snappy raw
+// format compressor) in parallel. Each dst buffer must be exactly the
+// decompressed size, see dset_decompressed_size.
+int dset_decompress (uint32_t n, const void **src, const uint64_t *srcsz, void **dst, const uint64_t *dstsz)
+{
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < n; i++) total += dstsz[i];
 
-	// hypothetical new column descriptor.
-	ds_column col;
-	col.type =  ksz > SHORTKEYSZ ? -t : t;
-	col.shape[0] = (uint8_t) shape0;
-	col.shape[1] = (uint8_t) shape1;
-	col.shape[2] = (uint8_t) shape2;
+	ds_codec_ctx x = { n, (const uint8_t **) src, srcsz, (uint8_t **) dst, (uint64_t *) dstsz, 0, 0, 0 };
+	const uint64_t maxthreads = total / DSCOMPRESS_MIN_BYTES;
+	parallel_run(nthreads_for_tasks(n < maxthreads ? n : maxthreads), decompress_task, &x);
 
-	if (d->ncol == d->ccol) {
+	if (x.failed) nonfatal("dset_decompress: invalid or corrupt data");
+	return !x.failed;
+}
 
-		// need more space for column descriptors
-		d = more_columndescr_space(idx, 30);
-		if (!d) return 0;
-	}
+// Byte-shuffle size bytes of elsize-byte elements from src into dst, in
+// parallel for large buffers. Buffers must not overlap.
+int dset_shuffle (const void *src, void *dst, uint64_t size, uint32_t elsize)
+{
+	return byteshuffle(src, dst, size, elsize, 0, "dset_shuffle");
+}
 
-	// compute the offset for the new column
-	col.offset = actual_arrheap_sz(d);
-	
-	// compute the required space on the array heap for the  new column
-	const uint64_t reqd_arrheap_space = compute_col_reserved_space(d->crow, &col);
+// Reverse dset_shuffle
+int dset_unshuffle (const void *src, void *dst, uint64_t size, uint32_t elsize)
+{
+	return byteshuffle(src, dst, size, elsize, 1, "dset_unshuffle");
+}
 
-	const uint64_t arrheap_sz = d->strheap_start - d->arrheap_start;
+/*
+	Incremental decoder for the field data of a CSDAT stream, i.e.,
+	everything after the header: for each field, a 32-bit little-endian size
+	followed by that many bytes of encoded data. The caller decodes the
+	header and describes each field in stream order, then feeds in the data
+	in chunks of any size as they arrive, e.g., from a network response.
+
+	The result dataset is allocated as soon as the number of rows is known
+	(from the size of the first decoded field). Snappy data is decompressed
+	straight into the result's columns as it arrives and uncompressed data is
+	copied there, so the whole stream is never held in memory. Only
+	byte-shuffled and string fields need a temporary copy of one field, which
+	is converted when the field is complete.
+
+	dset_stream_need gives the number of bytes needed to finish the current
+	size or field, so that callers reading from a file-like stream never read
+	past the end of the dataset. dset_stream_dataset gives the result so far
+	and the number of fields completed. dset_stream_finish frees the decoder
+	and returns the result once all fields have been fed in.
+*/
+enum { DSSTREAM_SIZE, DSSTREAM_DATA, DSSTREAM_DONE, DSSTREAM_FAILED };
 
-	if (col.offset + reqd_arrheap_space > arrheap_sz) {
+// Snappy raw format decompression of data that arrives in pieces. Op headers
+// that are split between pieces are collected in hdr
+typedef struct {
+	uint8_t   hdr[5];
+	uint32_t  nhdr;
+	uint64_t  lit;   // literal bytes left to copy
+	uint8_t   *out, *op, *oend;
+} ds_snappy_stream;
+
+struct ds_stream {
+	uint32_t         nfield;
+	ds_stream_field  *fields;  // keys are copied
+	uint32_t         field;    // current field
+	int              state;
+	uint8_t          sizebuf[4];
+	uint32_t         nsizebuf;
+	uint64_t         size;     // of the current field's data
+	uint64_t         got;
+	uint64_t         dset;     // result, UINT64_MAX until allocated
+	uint64_t         nrow;
+	uint8_t          *tmp;     // current field's data if shuffled or strings
+	int              started;  // output of the current field is set up
+	uint8_t          lenbuf[5]; // snappy length header
+	uint32_t         nlenbuf;
+	ds_snappy_stream z;
+};
 
-		// need more space on the array heap
-		const size_t howmuch_need = col.offset + reqd_arrheap_space - arrheap_sz;
-		d = more_arrheap(idx, howmuch_need);
-		if (!d) return 0;
-	}
+static int
+snappy_stream (ds_snappy_stream *z, const uint8_t *ip, const uint8_t *end) {
+	while (ip < end) {
+		if (z->lit) {
+			const uint64_t l = (uint64_t) (end - ip) < z->lit ? (uint64_t) (end - ip) : z->lit;
+			if ((uint64_t) (z->oend - z->op) < l) return 0;
+			memcpy(z->op, ip, l);
+			z->op += l;
+			ip += l;
+			z->lit -= l;
+			continue;
+		}
 
-	if (col.type < 0) {
-		// key is long, so allocate a string for it	
+		// header of the next op, from the input directly if it's all there
+		const uint8_t tag = z->nhdr ? z->hdr[0] : *ip;
+		const uint32_t need = (tag & 3) == 0 ? 1 + ((tag >> 2) >= 60 ? (tag >> 2) - 59 : 0) : (tag & 3) == 1 ? 2 : (tag & 3) == 2 ? 3 : 5;
+		const uint8_t *h;
+		if (!z->nhdr && (uint64_t) (end - ip) >= need) {
+			h = ip;
+			ip += need;
+		} else {
+			while (z->nhdr < need && ip < end) z->hdr[z->nhdr++] = *ip++;
+			if (z->nhdr < need) return 1;
+			h = z->hdr;
+			z->nhdr = 0;
+		}
 
-		uint64_t newstr = stralloc(&d, idx, key);
-		if (!d) return 0;
-		col.longkey    = newstr;
+		uint64_t l, offset;
+		switch (tag & 3) {
+		case 0: // literal
+			l = tag >> 2;
+			if (l >= 60) {
+				l = 0;
+				for (uint32_t i = 1; i < need; i++) l |= (uint64_t) h[i] << (8 * (i - 1));
+			}
+			z->lit = l + 1;
+			continue;
+		case 1:
+			l = 4 + ((tag >> 2) & 7);
+			offset = ((uint64_t) (tag >> 5) << 8) | h[1];
+			break;
+		case 2:
+			l = 1 + (tag >> 2);
+			offset = h[1] | (uint64_t) h[2] << 8;
+			break;
+		default:
+			l = 1 + (tag >> 2);
+			offset = load32(h + 1);
+			break;
+		}
 
-	} else {
-		snprintf(col.shortkey, sizeof(col.shortkey), "%s", key);
+		if (offset == 0 || offset > (uint64_t) (z->op - z->out) || (uint64_t) (z->oend - z->op) < l) return 0;
+		const uint8_t *src = z->op - offset;
+		if (offset >= l) {
+			memcpy(z->op, src, l);
+			z->op += l;
+		} else {
+			for (uint64_t i = 0; i < l; i++) *z->op++ = *src++;
+		}
 	}
-
-	// commit the new column
-	d->columns[d->ncol++] = col;
 	return 1;
 }
 
-// Change the type of the given column. Type must be compatible in size
-// NOTE: This is unsafe! Does not cast existing values to expected values
-int dset_changecol (uint64_t dset, const char *key, int type) {
-	if (!tcheck(type)) {
-		nonfatal("invalid column data type: %i", type);
+// Allocate the result with the columns of the wanted fields for nrow rows
+static int
+stream_allocate (ds_stream *s, uint64_t nrow) {
+	uint32_t nwanted = 0;
+	for (uint32_t i = 0; i < s->nfield; i++) nwanted += s->fields[i].wanted ? 1 : 0;
+	if (nrow > UINT32_MAX) {
+		nonfatal("dset_stream_feed: too many rows (%" PRIu64 ")", nrow);
 		return 0;
 	}
 
-	const ds  *d  = handle_lookup(dset, key, 0, 0);
-	ds_column *c  = column_lookup(d, key);
-
-	if (!(d && c)) return 0;
-
-	int8_t current_size = abs_i8(type_size[c->type]);
-	int8_t proposed_size = abs_i8(type_size[type]);
-
-	if (current_size != proposed_size) {
-		nonfatal("cannot change column with type %i to incompatible type %i", c->type, type);
+	const uint64_t d = dset_new_sized(nwanted, nrow, 0);
+	if (d == UINT64_MAX) return 0;
+	for (uint32_t i = 0; i < s->nfield; i++) {
+		const ds_stream_field *f = s->fields + i;
+		if (!f->wanted) continue;
+		const int ok = f->shape[0]
+			? dset_addcol_array(d, f->key, f->type, f->shape[0], f->shape[1], f->shape[2])
+			: dset_addcol_scalar(d, f->key, f->type);
+		if (!ok) {
+			dset_del(d);
+			return 0;
+		}
+	}
+	if (!dset_addrows(d, (uint32_t) nrow)) {
+		dset_del(d);
 		return 0;
 	}
-
-	c->type = type;
+	s->dset = d;
+	s->nrow = nrow;
 	return 1;
 }
 
-int dset_addrows (uint64_t dset, uint32_t num) {
-	uint64_t idx; 
-
-	ds *d = handle_lookup(dset, "dset_addrows", 0, &idx);
-	if (!d) return 0;
-
-	if (d->nrow + num < d->crow) {
-		// we already have enough space reserved, so no big deal.
-		d->nrow += num;
-		return 1;
+// Set up the output of the current field once its decoded size is known.
+// Data goes into a temporary buffer if it needs converting afterwards,
+// otherwise straight into the result
+static uint8_t *
+stream_output (ds_stream *s, uint64_t decodedsz) {
+	const ds_stream_field *f = s->fields + s->field;
+	const uint64_t nrow = f->itemsize ? decodedsz / f->itemsize : 0;
+	if (f->itemsize == 0 || nrow * f->itemsize != decodedsz) {
+		nonfatal("dset_stream_feed: size of field %s (%" PRIu64 ") is not a multiple of its row size %" PRIu32,
+			f->key, decodedsz, f->itemsize);
+		return 0;
+	}
+	if (s->dset == UINT64_MAX && !stream_allocate(s, nrow)) return 0;
+	if (nrow != s->nrow) {
+		nonfatal("dset_stream_feed: field %s has %" PRIu64 " rows, expected %" PRIu64, f->key, nrow, s->nrow);
+		return 0;
 	}
 
-	// compute the minimum required array heap size for the new row count
-	uint64_t req_arrheap_sz = 0;
-	for(uint32_t i = 0; i < d->ncol; i++) {
+	s->started = 1;
+	if (f->shuffle || f->type == T_STR) {
+		s->tmp = DSREALLOC(0, decodedsz ? decodedsz : 1);
+		if (!s->tmp) nonfatal("dset_stream_feed: out of memory");
+		return s->tmp;
+	}
+	return dset_get(s->dset, f->key);
+}
 
-		ds_column *c = d->columns+i;
-		req_arrheap_sz += compute_col_reserved_space(d->nrow+num,c);
+// Convert the temporary data of a complete field into the result
+static int
+stream_convert (ds_stream *s) {
+	const ds_stream_field *f = s->fields + s->field;
+	const uint64_t sz = s->nrow * f->itemsize;
+	uint8_t *data = s->tmp;
+	int ok = 1;
+
+	if (f->shuffle) {
+		uint8_t *dst = f->type == T_STR ? DSREALLOC(0, sz ? sz : 1) : dset_get(s->dset, f->key);
+		if (!dst) goto oom;
+		ok = byteshuffle(data, dst, sz, f->shuffle, 1, "dset_stream_feed");
+		if (f->type != T_STR) goto done;
+		DSFREE(data);
+		s->tmp = data = dst;
 	}
 
-	// do we have enough space in the heap already?
+	if (ok && f->type == T_STR) {
+		// null-terminate each fixed-width value, a batch of rows at a time
+		enum { BATCH = 4096 };
+		const uint64_t w = f->itemsize;
+		char *buf = DSREALLOC(0, BATCH * (w + 1));
+		const char **values = DSREALLOC(0, BATCH * sizeof(char *));
+		if (!buf || !values) {
+			if (buf) DSFREE(buf);
+			if (values) DSFREE(values);
+			goto oom;
+		}
+		for (uint64_t start = 0; ok && start < s->nrow; start += BATCH) {
+			const uint64_t n = s->nrow - start < BATCH ? s->nrow - start : BATCH;
+			for (uint64_t i = 0; i < n; i++) {
+				char *v = buf + i * (w + 1);
+				memcpy(v, data + (start + i) * w, w);
+				v[w] = 0;
+				values[i] = v;
+			}
+			ok = dset_setstrs(s->dset, f->key, start, n, values);
+		}
+		DSFREE(buf);
+		DSFREE(values);
+	}
 
-	uint64_t cur_arrheap_sz = d->strheap_start - d->arrheap_start;
-	uint32_t new_crow = d->nrow + num;
+	done:
+	DSFREE(s->tmp);
+	s->tmp = 0;
+	return ok;
 
-	if (req_arrheap_sz > cur_arrheap_sz) {
+	oom:
+	nonfatal("dset_stream_feed: out of memory");
+	return 0;
+}
 
-		// we don't have enough, so we need to make space.
-		// but, let's make space for some round number of rows, more than we need.
-		uint32_t num_reserve = roundup(num, 100);
-		new_crow = d->nrow + num_reserve;
+// Decode n bytes of the current field's data
+static int
+stream_data (ds_stream *s, const uint8_t *ip, uint64_t n) {
+	const ds_stream_field *f = s->fields + s->field;
+	if (!f->wanted) return 1;
+
+	if (f->codec == DSCODEC_NONE) {
+		if (!s->started && !(s->z.out = s->z.op = stream_output(s, s->size))) return 0;
+		memcpy(s->z.op, ip, n);
+		s->z.op += n;
+		return 1;
+	}
 
-		// we of course need to recompute the required space...
-		req_arrheap_sz = 0;
-		for(uint32_t i = 0; i < d->ncol; i++) {
+	// snappy: read the decompressed size first
+	const uint8_t *end = ip + n;
+	while (!s->started && ip < end) {
+		uint64_t len;
+		s->lenbuf[s->nlenbuf++] = *ip++;
+		if (varint_read(s->lenbuf, s->nlenbuf, &len)) {
+			if (!(s->z.out = s->z.op = stream_output(s, len))) return 0;
+			s->z.oend = s->z.out + len;
+		} else if (s->nlenbuf == sizeof(s->lenbuf)) {
+			nonfatal("dset_stream_feed: invalid or corrupt data in field %s", f->key);
+			return 0;
+		}
+	}
+	if (!snappy_stream(&s->z, ip, end)) {
+		nonfatal("dset_stream_feed: invalid or corrupt data in field %s", f->key);
+		return 0;
+	}
+	return 1;
+}
 
-			ds_column *c = d->columns+i;
-			req_arrheap_sz += compute_col_reserved_space(d->nrow+num_reserve,c);
+// Finish the current field once all its data has been fed in
+static int
+stream_field_end (ds_stream *s) {
+	const ds_stream_field *f = s->fields + s->field;
+	if (f->wanted) {
+		if (f->codec == DSCODEC_NONE && !s->started && !stream_output(s, 0)) return 0; // empty field
+		if (f->codec == DSCODEC_SNAP && (!s->started || s->z.op != s->z.oend || s->z.lit || s->z.nhdr)) {
+			nonfatal("dset_stream_feed: invalid or corrupt data in field %s", f->key);
+			return 0;
 		}
+		if (s->tmp && !stream_convert(s)) return 0;
+	}
+	s->z = (ds_snappy_stream) {0};
+	s->started = 0;
+	s->nlenbuf = 0;
+	s->state = ++s->field == s->nfield ? DSSTREAM_DONE : DSSTREAM_SIZE;
+	return 1;
+}
 
-		d = more_arrheap(idx, req_arrheap_sz-cur_arrheap_sz);
-		if(!d) return 0;
+// Create a decoder for a CSDAT stream with the given fields, in the order
+// they appear in the stream. Returns null on error
+ds_stream *dset_stream_new (uint32_t nfield, const ds_stream_field *fields)
+{
+	ds_stream *s = DSREALLOC(0, sizeof(ds_stream));
+	if (!s) goto oom;
+	*s = (ds_stream) { .nfield = nfield, .dset = UINT64_MAX };
+	s->state = nfield ? DSSTREAM_SIZE : DSSTREAM_DONE;
+	s->fields = DSREALLOC(0, (nfield ? nfield : 1) * sizeof(ds_stream_field));
+	if (!s->fields) goto oom;
+	memset(s->fields, 0, nfield * sizeof(ds_stream_field)); // keys are freed on error
+
+	for (uint32_t i = 0; i < nfield; i++) {
+		const ds_stream_field *f = fields + i;
+		s->fields[i] = *f;
+		s->fields[i].key = 0;
+		if (f->codec != DSCODEC_NONE && f->codec != DSCODEC_SNAP) {
+			nonfatal("dset_stream_new: field %s has unknown codec %d", f->key, f->codec);
+			dset_stream_del(s);
+			return 0;
+		}
+		if (f->wanted && (f->type < T_F32 || f->type >= T_OBJ || (f->type == T_STR && f->shape[0]))) {
+			nonfatal("dset_stream_new: field %s has unsupported type %d", f->key, f->type);
+			dset_stream_del(s);
+			return 0;
+		}
+		char *key = DSREALLOC(0, strlen(f->key) + 1);
+		if (!key) goto oom;
+		strcpy(key, f->key);
+		s->fields[i].key = key;
 	}
+	return s;
+
+	oom:
+	nonfatal("dset_stream_new: out of memory");
+	dset_stream_del(s);
+	return 0;
+}
 
+// Decode the next size bytes of the stream. Returns 0 if the data is
+// invalid, after which the decoder cannot be used except to delete it
+int dset_stream_feed (ds_stream *s, const void *data, uint64_t size)
+{
+	const uint8_t *ip = data, *end = ip + size;
+	if (s->state == DSSTREAM_FAILED) {
+		nonfatal("dset_stream_feed: decoder has failed");
+		return 0;
+	}
 
-	// now we have enough space, we just need to reassign the offsets and do some memmoves
-	reassign_arrayoffsets(d, new_crow);
+	while (ip < end || (s->state == DSSTREAM_DATA && s->got == s->size)) {
+		if (s->state == DSSTREAM_DONE) {
+			nonfatal("dset_stream_feed: unexpected data after the last field");
+			goto fail;
+		}
+		if (s->state == DSSTREAM_SIZE) {
+			while (s->nsizebuf < 4 && ip < end) s->sizebuf[s->nsizebuf++] = *ip++;
+			if (s->nsizebuf < 4) break;
+			s->size = load32(s->sizebuf);
+			s->got = 0;
+			s->nsizebuf = 0;
+			s->state = DSSTREAM_DATA;
+			continue;
+		}
 
-	d->crow  = new_crow;
-	d->nrow += num;
+		const uint64_t n = (uint64_t) (end - ip) < s->size - s->got ? (uint64_t) (end - ip) : s->size - s->got;
+		if (n && !stream_data(s, ip, n)) goto fail;
+		ip += n;
+		s->got += n;
+		if (s->got == s->size && !stream_field_end(s)) goto fail;
+	}
 	return 1;
+
+	fail:
+	s->state = DSSTREAM_FAILED;
+	return 0;
 }
 
+// Number of bytes needed to complete the current field (or its size), 0 if
+// all fields have been decoded
+uint64_t dset_stream_need (const ds_stream *s)
+{
+	switch (s->state) {
+	case DSSTREAM_SIZE: return 4 - s->nsizebuf;
+	case DSSTREAM_DATA: return s->size - s->got;
+	default: return 0;
+	}
+}
 
+// The dataset being decoded, UINT64_MAX if it has not been allocated yet.
+// Sets ndone (if given) to the number of fields that have been completely
+// fed in; the columns of wanted fields among them have their final values.
+// The dataset may move while more data is fed in, see dset_setconcurrent.
+uint64_t dset_stream_dataset (const ds_stream *s, uint32_t *ndone)
+{
+	if (ndone) *ndone = s->field;
+	return s->dset;
+}
 
-int dset_defrag (uint64_t dset, int realloc_smaller)
+// Delete the decoder and return the decoded dataset, or UINT64_MAX if the
+// stream was incomplete or invalid
+uint64_t dset_stream_finish (ds_stream *s)
 {
-	ds *d = handle_lookup(dset, "dset_compress", 0, 0);
-	if(!d) return 0;
-	char * pd = (char *) d;
+	uint64_t d = UINT64_MAX;
+	if (s->state == DSSTREAM_DONE) {
+		d = s->dset == UINT64_MAX ? dset_new() : s->dset;
+		s->dset = UINT64_MAX;
+	} else if (s->state != DSSTREAM_FAILED) {
+		nonfatal("dset_stream_finish: stream ended in field %" PRIu32 " of %" PRIu32, s->field + 1, s->nfield);
+	}
+	dset_stream_del(s);
+	return d;
+}
 
-	if (d->ccol > d->ncol) {
+// Delete the decoder and the dataset it was decoding, if any
+void dset_stream_del (ds_stream *s)
+{
+	if (!s) return;
+	if (s->dset != UINT64_MAX) dset_del(s->dset);
+	if (s->tmp) DSFREE(s->tmp);
+	if (s->fields) {
+		for (uint32_t i = 0; i < s->nfield; i++) {
+			if (s->fields[i].key) DSFREE((char *) s->fields[i].key);
+		}
+		DSFREE(s->fields);
+	}
+	DSFREE(s);
+}
 
-		char * end = pd + d->strheap_start + d->strheap_sz;
+// Parse the rows of a STAR file "loop_" table that starts at the beginning of
+// the given text, i.e., right after its labels, into a new dataset with a
+// scalar column for each label. Each type is T_F64, T_I64, T_STR or 0 to
+// infer the narrowest of these that fits every value. Floating-point values
+// may also be nan, inf or infinity; integer values may be written as floats
+// only if they have no fractional part. The table ends at the first blank
+// line, the next block or label, or the end of the text; end is set to its
+// offset. Returns UINT64_MAX on error
+uint64_t dset_read_star (const char *text, uint64_t size, uint32_t ncol, const char **labels, const int *types, uint64_t *end)
+{
+	uint64_t dset = UINT64_MAX;
+	uint64_t nrow = 0, crow = 0, pos = 0;
+	uint64_t *rows = 0;
+	int *coltypes = 0;
+	uint8_t *kinds = 0;
+	void **cols = 0;
+	uint64_t **stroff = 0;
+	uint32_t **strsz = 0;
+	char *arena = 0;
+	const char **values = 0;
+
+	if (!ncol) {
+		nonfatal("dset_read_star: invalid number of labels %" PRIu32, ncol);
+		return UINT64_MAX;
+	}
 
-		char * arrheap = pd + d->arrheap_start;
-		memmove(d->columns + d->ncol,  arrheap,  end-arrheap);
-		d->arrheap_start -= (end-arrheap);
-		d->ccol = d->ncol;
+	// 1. find the start of each row
+	while (pos < size) {
+		const char *p = text + pos;
+		const char *eol = memchr(p, '\n', (size_t) (size - pos));
+		const uint64_t next = eol ? (uint64_t) (eol - text) + 1 : size;
+		while (p < text + next && star_ws(*p) && *p != '\n') p++;
+		if (p == text + next || *p == '\n') break;
+		if (*p == '_' || (size - (uint64_t) (p - text) >= 5 && (!memcmp(p, "data_", 5) || !memcmp(p, "loop_", 5)))) break;
+		if (*p != '#') {
+			if (nrow == crow) {
+				crow = crow ? crow * 2 : 1024;
+				uint64_t *mem = DSREALLOC(rows, sizeof(uint64_t) * crow);
+				if (!mem) {
+					nonfatal("dset_read_star: out of memory for %" PRIu64 " rows", crow);
+					goto cleanup;
+				}
+				rows = mem;
+			}
+			rows[nrow++] = pos;
+		}
+		pos = next;
+	}
+	*end = pos;
+	if (nrow > UINT32_MAX) {
+		nonfatal("dset_read_star: too many rows (%" PRIu64 ")", nrow);
+		goto cleanup;
 	}
 
-	if (d->crow > d->nrow) {
-		reassign_arrayoffsets(d, d->nrow);
-		d->crow = d->nrow;
+	// 2. infer types for columns without one
+	const uint32_t nthreads = nthreads_for(nrow);
+	coltypes = DSREALLOC(0, sizeof(int) * ncol);
+	kinds = DSREALLOC(0, (uint64_t) ncol * nthreads);
+	cols = DSREALLOC(0, sizeof(void *) * ncol);
+	stroff = DSREALLOC(0, sizeof(uint64_t *) * ncol);
+	strsz = DSREALLOC(0, sizeof(uint32_t *) * ncol);
+	if (!(coltypes && kinds && cols && stroff && strsz)) {
+		nonfatal("dset_read_star: out of memory for %" PRIu32 " columns", ncol);
+		goto cleanup;
 	}
+	memset(kinds, DSSTAR_INT | DSSTAR_FLOAT, (uint64_t) ncol * nthreads);
+	memset(stroff, 0, sizeof(uint64_t *) * ncol);
+	memset(strsz, 0, sizeof(uint32_t *) * ncol);
 
-	uint64_t actual_heapsz = actual_arrheap_sz(d);
-	uint64_t gap = (d->strheap_start - d->arrheap_start) - actual_heapsz;
-	if (gap) {
-		memmove(pd + d->strheap_start, pd + d->strheap_start - gap, d->strheap_sz);
-		d->strheap_start -= gap;
+	ds_star_ctx x = {
+		.text = text, .rows = rows, .nrow = nrow, .size = size, .ncol = ncol,
+		.types = coltypes, .kinds = kinds, .cols = cols, .stroff = stroff, .strsz = strsz,
+	};
+	for (uint32_t t = 0; t < DSPARALLEL_MAX_THREADS; t++) x.badrow[t] = UINT64_MAX;
+	int infer = 0;
+	for (uint32_t c = 0; c < ncol; c++) {
+		if (types[c] != 0 && types[c] != T_F64 && types[c] != T_I64 && types[c] != T_STR) {
+			nonfatal("dset_read_star: invalid type %d for '%s'", types[c], labels[c]);
+			goto cleanup;
+		}
+		coltypes[c] = types[c];
+		infer |= !types[c];
+	}
+	if (infer) {
+		parallel_run(nthreads, star_infer, &x);
+		if (star_failed(&x, nthreads, "dset_read_star")) goto cleanup;
+		for (uint32_t c = 0; c < ncol; c++) {
+			if (coltypes[c]) continue;
+			uint8_t kind = nrow ? DSSTAR_INT | DSSTAR_FLOAT : 0;
+			for (uint32_t t = 0; t < nthreads; t++) kind &= kinds[(uint64_t) t * ncol + c];
+			coltypes[c] = (kind & DSSTAR_INT) ? T_I64 : (kind & DSSTAR_FLOAT) ? T_F64 : T_STR;
+		}
 	}
 
-	if (realloc_smaller) {
-		d->stats.nrealloc++;
-		d = DSREALLOC(d, d->strheap_start + d->strheap_sz);
-		if (!d) return 0;
+	// 3. parse values into a new dataset
+	dset = dset_new();
+	if (dset == UINT64_MAX) goto cleanup;
+	for (uint32_t c = 0; c < ncol; c++) {
+		if (!dset_addcol_scalar(dset, labels[c], coltypes[c])) goto fail;
+	}
+	if (nrow && !dset_addrows(dset, (uint32_t) nrow)) goto fail;
+
+	uint64_t maxsz = 0;
+	for (uint32_t c = 0; c < ncol; c++) {
+		cols[c] = dset_get_at(dset, c);
+		if (coltypes[c] != T_STR) continue;
+		stroff[c] = DSREALLOC(0, sizeof(uint64_t) * (nrow ? nrow : 1));
+		strsz[c] = DSREALLOC(0, sizeof(uint32_t) * (nrow ? nrow : 1));
+		if (!(stroff[c] && strsz[c])) {
+			nonfatal("dset_read_star: out of memory for '%s'", labels[c]);
+			goto fail;
+		}
+	}
+	for (uint32_t t = 0; t < DSPARALLEL_MAX_THREADS; t++) x.badrow[t] = UINT64_MAX;
+	parallel_run(nthreads, star_parse, &x);
+	if (star_failed(&x, nthreads, "dset_read_star")) goto fail;
+
+	// strings must be NUL-terminated to intern, so copy each column's
+	// strings into one arena first
+	values = DSREALLOC(0, sizeof(char *) * (nrow ? nrow : 1));
+	if (!values) {
+		nonfatal("dset_read_star: out of memory for %" PRIu64 " strings", nrow);
+		goto fail;
+	}
+	for (uint32_t c = 0; c < ncol; c++) {
+		if (coltypes[c] != T_STR) continue;
+		uint64_t sz = 0;
+		for (uint64_t r = 0; r < nrow; r++) sz += strsz[c][r] + 1;
+		if (sz > maxsz) {
+			char *mem = DSREALLOC(arena, sz);
+			if (!mem) {
+				nonfatal("dset_read_star: out of memory for '%s' strings", labels[c]);
+				goto fail;
+			}
+			arena = mem;
+			maxsz = sz;
+		}
+		char *p = arena;
+		for (uint64_t r = 0; r < nrow; r++) {
+			memcpy(p, text + stroff[c][r], strsz[c][r]);
+			p[strsz[c][r]] = '\0';
+			values[r] = p;
+			p += strsz[c][r] + 1;
+		}
+		if (!dset_setstrs(dset, labels[c], 0, nrow, values)) goto fail;
 	}
+	goto cleanup;
 
-	return 1;
+fail:
+	dset_del(dset);
+	dset = UINT64_MAX;
+cleanup:
+	if (stroff) for (uint32_t c = 0; c < ncol; c++) DSFREE(stroff[c]);
+	if (strsz) for (uint32_t c = 0; c < ncol; c++) DSFREE(strsz[c]);
+	DSFREE(rows);
+	DSFREE(coltypes);
+	DSFREE(kinds);
+	DSFREE(cols);
+	DSFREE(stroff);
+	DSFREE(strsz);
+	DSFREE(arena);
+	DSFREE(values);
+	return dset;
 }
 
+// Format whole rows of the given columns (by index) starting at row start as
+// STAR file lines into buf, with values separated by spaces. Floating-point
+// values are written with enough digits to read back exactly and strings are
+// quoted if empty or if they contain whitespace. Sets used to the number of
+// bytes written. Returns the number of rows formatted (which is less than the
+// remaining rows if buf is full) or UINT64_MAX on error
+uint64_t dset_format_star (uint64_t dset, uint32_t ncol, const uint64_t *cols, uint64_t start, char *buf, uint64_t bufsz, uint64_t *used)
+{
+	const ds *d = handle_lookup(dset, "dset_format_star", 0, 0);
+	if (!d) return UINT64_MAX;
+	if (!ncol || start > d->nrow) {
+		nonfatal("dset_format_star: invalid %" PRIu32 " columns or start row %" PRIu64, ncol, start);
+		return UINT64_MAX;
+	}
+	for (uint32_t i = 0; i < ncol; i++) {
+		const ds_column *c = cols[i] < d->ncol ? d->columns + cols[i] : 0;
+		const int t = c ? abs_i8(c->type) : 0;
+		if (!c || c->shape[0] || t == T_C32 || t == T_C64 || t == T_OBJ) {
+			nonfatal("dset_format_star: column %" PRIu64 " is missing or cannot be written to a STAR file", cols[i]);
+			return UINT64_MAX;
+		}
+	}
 
+	const char *strheap = (const char *) d + d->strheap_start;
+	uint64_t pos = 0, r = start;
+	for (; r < d->nrow; r++) {
+		uint64_t p = pos;
+		for (uint32_t i = 0; i < ncol; i++) {
+			const ds_column *c = d->columns + cols[i];
+			char tmp[64];
+			const char *s = tmp;
+			uint64_t len;
+			char quote = 0;
+			if (abs_i8(c->type) == T_STR) {
+				s = strheap + ((const uint64_t *) ((const char *) d + d->arrheap_start + c->offset))[r];
+				len = strlen(s);
+				if (!len || strpbrk(s, " \t\r\n")) quote = strchr(s, '"') ? '\'' : '"';
+			} else {
+				len = (uint64_t) star_format(tmp, d, c, r);
+			}
+			if (bufsz - p < len + (quote ? 3 : 1)) goto full;
+			if (quote) buf[p++] = quote;
+			memcpy(buf + p, s, len);
+			p += len;
+			if (quote) buf[p++] = quote;
+			buf[p++] = i + 1 < ncol ? ' ' : '\n';
+		}
+		pos = p;
+	}
+full:
+	*used = pos;
+	return r - start;
+}
 
-const char *dset_getstr (uint64_t dset, const char * colkey, uint64_t index) 
+// Export the given dataset as an Arrow struct array with a field for each
+// column, either of schema or array may be null to skip exporting it. The
+// array refers to the dataset's memory, which must not be freed or modified
+// until the array is released. done(ctx) is called (from the releasing
+// thread) once that happens, e.g., to release a reference to the dataset.
+// Columns of Python objects (T_OBJ) cannot be exported.
+int dset_export_arrow (uint64_t dset, struct ArrowSchema *schema, struct ArrowArray *array, void (*done)(void *), void *ctx)
 {
-	ds        *d = handle_lookup(dset, colkey, 0, 0);
-	ds_column *c = column_lookup(d, colkey);
+	const ds *d = handle_lookup(dset, "dset_export_arrow", 0, 0);
+	if (!d) return 0;
 
-	if(!(d && c)) return 0;
+	uint32_t nnode = 0, nstr = 0;
+	uint64_t keysz = 0;
+	for (uint32_t i = 0; i < d->ncol; i++) {
+		const ds_column *c = d->columns + i;
+		if (!arrow_format(abs_i8(c->type)) || (abs_i8(c->type) == T_STR && c->shape[0])) {
+			nonfatal("dset_export_arrow: column '%s' cannot be exported to Arrow", getkey(d, c));
+			return 0;
+		}
+		nnode += arrow_depth(c);
+		nstr += abs_i8(c->type) == T_STR;
+		keysz += strlen(getkey(d, c)) + 1;
+	}
+	nnode = nnode ? nnode : 1;
 
-	if (abs_i8(c->type) != T_STR) {
-		nonfatal("dset_getstr: column '%s' is not a string", colkey);
+	if (schema && !arrow_export_schema(d, schema, nnode, keysz)) return 0;
+	if (array && !arrow_export_array(d, array, nnode, nstr, done, ctx)) {
+		if (schema) schema->release(schema);
 		return 0;
-	} else {
-		return getstr(d, c, index);
 	}
+	return 1;
 }
 
+void dset_setnthreads (uint32_t nthreads) {
+	// 0 means one thread per CPU
+	DSATOMIC_STORE(ds_module.nthreads, (uint64_t) nthreads);
+}
 
-int dset_setstr (uint64_t dset, const char * colkey, uint64_t index, const char * value)
+// Set the growth policy of all datasets (see DSGROWTH_PERCENT). Capacity
+// grows by percent of its current value, and by at most max_bytes more than
+// required. Applies to later growth; existing reservations are kept.
+void dset_setgrowth (uint32_t percent, uint64_t max_bytes) {
+	DSATOMIC_STORE(ds_module.growth_percent, (uint64_t) percent);
+	DSATOMIC_STORE(ds_module.growth_max_bytes, max_bytes);
+}
+
+/*
+	Concurrent readers. Datasets are not safe to access from several threads
+	at once by default: adding rows, columns or strings may move the dataset's
+	memory, or its columns within it, which invalidates pointers returned by
+	dset_get and dset_getstr in other threads.
+
+	Enabling concurrent mode with dset_setconcurrent lets reader threads pin
+	the dataset with dset_pin. Column and string pointers stay valid until the
+	reader calls dset_unpin. Any change that would move them waits until no
+	readers have the dataset pinned, and new pins wait until that change is
+	done. So a single writer thread may append rows and set values (in rows
+	that readers are not reading) while readers use the rows that were already
+	there.
+
+	Notes:
+	- Only one thread may modify the dataset at a time, and the writer must
+	  not have the dataset pinned itself
+	- Readers should only look up columns while they have the dataset pinned,
+	  and should not look up columns that the writer is adding or removing
+	- Enable or disable concurrent mode and delete the dataset only while no
+	  other threads are using it
+	- Views cannot be pinned. Pin the viewed dataset instead
+*/
+int dset_setconcurrent (uint64_t dset, int enable)
 {
 	uint64_t idx;
+	if (!handle_lookup(dset, "dset_setconcurrent", 0, &idx)) return 0;
+	ds_slot *s = slot_at(idx);
+
+	if (enable && !s->pins) {
+		ds_rwlock_t *pins = DSREALLOC(0, sizeof(ds_rwlock_t));
+		if (!pins || !DSRWLOCK_INIT(pins)) {
+			if (pins) DSFREE(pins);
+			nonfatal("dset_setconcurrent: cannot create lock");
+			return 0;
+		}
+		s->pins = pins;
+		s->nmoving = 0;
+	} else if (!enable && s->pins) {
+		// wait for any remaining readers
+		DSRWLOCK_WRLOCK(s->pins);
+		DSRWLOCK_WRUNLOCK(s->pins);
+		DSRWLOCK_DESTROY(s->pins);
+		DSFREE(s->pins);
+		s->pins = 0;
+	}
+	return 1;
+}
 
-	ds        *d = handle_lookup(dset, colkey, 0, &idx);
-	ds_column *c = column_lookup(d, colkey);
-
-	if(!(d && c)) return 0;
-
-	if (index > d->nrow) {
-		nonfatal("dset_setstr: invalid index %"PRIu64, index);
+// Keep the memory of the dataset in place until dset_unpin is called. May
+// be called by several threads at once. Waits if the dataset is moving.
+int dset_pin (uint64_t dset)
+{
+	// the dataset may be moving, so only look at its memory once pinned
+	uint64_t idx = MASK_IDX & dset;
+	if (DSATOMIC_LOAD(ds_module.nslots) <= idx || !slot_at(idx)->pins) {
+		if (handle_lookup(dset, "dset_pin", 0, 0)) {
+			nonfatal("dset_pin: concurrent mode is not enabled, see dset_setconcurrent");
+		}
 		return 0;
 	}
-
-	if (abs_i8(c->type) != T_STR) {
-		nonfatal("dset_setstr: column '%s' is not a string", colkey);
+	ds_slot *s = slot_at(idx);
+	DSRWLOCK_RDLOCK(s->pins);
+	if (!handle_lookup(dset, "dset_pin", 0, 0)) {
+		DSRWLOCK_RDUNLOCK(s->pins);
 		return 0;
 	}
-
-	return setstr(d, c, index, value) ? 1 : 0;
+	return 1;
 }
 
-static char* 
-repr_cfloat (uint64_t ds, int sz, char * buf, ds_float_complex_t fc)
+int dset_unpin (uint64_t dset)
 {
-	snprintf(buf,sz,"(%f,%f)", crealf(fc), cimagf(fc));
-	return buf;
+	uint64_t idx;
+	if (!handle_lookup(dset, "dset_unpin", 0, &idx)) return 0;
+	ds_slot *s = slot_at(idx);
+	if (!s->pins) {
+		nonfatal("dset_unpin: concurrent mode is not enabled, see dset_setconcurrent");
+		return 0;
+	}
+	DSRWLOCK_RDUNLOCK(s->pins);
+	return 1;
 }
 
-static char*
-repr_cdouble (uint64_t ds, int sz, char * buf, ds_double_complex_t dc)
-{
-	snprintf(buf,sz,"(%f,%f)", creal(dc), cimag(dc));
-	return buf;
-}
+int dset_stats (uint64_t dset, ds_stats *out) {
+	if (!out) {
+		nonfatal("dset_stats: no output given");
+		return 0;
+	}
+	*out = (ds_stats) {0};
 
-static char*
-repr_str (uint64_t dset, int sz, char * buf, uint64_t handle)
-{
-	ds     *d = handle_lookup(dset, "repr_str", 0, 0);
-	char *ptr = (char *) d;
-	snprintf(buf,sz,"%s",ptr + d->strheap_start + handle );
-	return buf;
-}
+	if (dset) {
+		uint64_t idx;
+		const ds *d = handle_lookup_any(dset, "dset_stats", 0, &idx);
+		if (!d) return 0;
+		const ds_counters *c = &slot_at(idx)->counters;
+
+		out->total_sz             = d->total_sz;
+		out->nrow                 = d->nrow;
+		out->crow                 = d->crow;
+		out->ncol                 = d->ncol;
+		out->ccol                 = d->ccol;
+		out->arrheap_sz           = actual_arrheap_sz(d);
+		out->arrheap_capacity     = arrheap_capacity(d);
+		out->strheap_sz           = d->strheap_sz;
+		out->strheap_capacity     = strheap_capacity(d);
+		out->strheap_freed        = d->strheap_freed;
+		out->nrealloc             = d->stats.nrealloc;
+		out->nreassign_arroffsets = d->stats.nreassign_arroffsets;
+		out->nshift_strhandles    = d->stats.nshift_strhandles;
+		out->nmore_arrheap        = d->stats.nmore_arrheap;
+		out->nmore_strheap        = d->stats.nmore_strheap;
+		out->nmore_colspace       = d->stats.nmore_colspace;
+		out->bytes_moved          = c->bytes_moved;
+		out->resize_ns            = c->resize_ns;
+		out->string_ns            = c->string_ns;
+		out->nintern              = c->nintern;
+		out->nintern_hits         = c->nintern_hits;
+	}
+
+	// module totals: deleted datasets plus the ones still in use
+	module_init();
+	lock();
+	ds_counters total = ds_module.retired;
+	const uint64_t nslots = ds_module.nslots;
+	for (uint64_t i = 0; i < nslots; i++) {
+		const ds_slot *s = slot_at(i);
+		if (!s->memory) continue;
+		total.bytes_moved  += s->counters.bytes_moved;
+		total.resize_ns    += s->counters.resize_ns;
+		total.string_ns    += s->counters.string_ns;
+		total.nintern      += s->counters.nintern;
+		total.nintern_hits += s->counters.nintern_hits;
+		out->module_nslots_used++;
+	}
+	for (uint32_t i = 0; i < DSARENA_MAX; i++) out->module_narenas += ds_module.arenas[i].inuse ? 1 : 0;
+	unlock();
 
+	out->module_bytes_moved  = total.bytes_moved;
+	out->module_resize_ns    = total.resize_ns;
+	out->module_string_ns    = total.string_ns;
+	out->module_nintern      = total.nintern;
+	out->module_nintern_hits = total.nintern_hits;
+	out->module_join_ns      = DSATOMIC_LOAD(ds_module.join_ns);
+	out->module_njoin        = DSATOMIC_LOAD(ds_module.njoin);
+	out->module_nslots       = nslots;
+	return 1;
+}
 
 void dset_dumptxt (uint64_t dset) {
 
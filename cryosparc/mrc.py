@@ -1,12 +1,15 @@
+import os
 from enum import Enum
 from pathlib import PurePath
-from typing import IO, TYPE_CHECKING, NamedTuple, Tuple, Union
+from typing import IO, TYPE_CHECKING, NamedTuple, Optional, Sequence, Tuple, Union
 
 import numpy as n
 
 if TYPE_CHECKING:
     from numpy.typing import NDArray  # type: ignore
 
+    from .dataset import Dataset
+
 from .util import bopen
 
 
@@ -113,6 +116,131 @@ def read(file: Union[str, PurePath, IO[bytes]]) -> Tuple[Header, "NDArray"]:
         return header, data
 
 
+def mmap(file: Union[str, PurePath]) -> Tuple[Header, "n.memmap"]:
+    """
+    Map the data of the .mrc file at the given path into memory without
+    reading it. Slicing the resulting array (e.g., ``data[10:20]`` for
+    sections 10 to 19 of a particle stack) gives a view that only reads the
+    required sections from disk when accessed. The array is read-only and
+    has the file's data type, including ``float16``.
+
+    Args:
+        file (str | Path): MRC file path.
+
+    Returns:
+        tuple[Header, memmap]: The MRC header and MRC data as a read-only
+            memory-mapped numpy array with shape ``(nz, ny, nx)``.
+    """
+    with bopen(file, "rb") as f:
+        header = _read_header(f)
+    dtype = DT_TO_DATATYPE[header.datatype]
+    shape = (header.nz, header.ny, header.nx)
+    if header.nz * header.ny * header.nx == 0:
+        return header, n.empty(shape, dtype=dtype)  # type: ignore
+    return header, n.memmap(file, dtype=dtype, mode="r", offset=_data_offset(header), shape=shape)
+
+
+def read_sections(
+    file: Union[str, PurePath, IO[bytes]], start: int, stop: Optional[int] = None
+) -> Tuple[Header, "NDArray"]:
+    """
+    Read only the sections in the given range of an .mrc file, e.g., a few
+    particles from a large stack. Unlike ``mmap``, also works with file
+    handles that cannot be mapped, as long as they are seekable.
+
+    Args:
+        file (str | Path | IO): MRC file path or handle.
+        start (int): Index of the first section to read.
+        stop (int, optional): Index after the last section to read. Defaults
+            to the end of the file.
+
+    Returns:
+        tuple[Header, NDArray]: The MRC header and the sections as a numpy
+            array with shape ``(stop - start, ny, nx)``. ``float16`` data is
+            converted to ``float32``, same as ``read``.
+    """
+    with bopen(file, "rb") as f:
+        header = _read_header(f)
+        start, stop, _ = slice(start, stop).indices(header.nz)
+        data = n.empty((max(stop - start, 0), header.ny, header.nx), dtype=DT_TO_DATATYPE[header.datatype])
+        f.seek(_data_offset(header) + start * _section_size(header))
+        _readinto(f, data)
+    return header, _to_float32(data)
+
+
+def gather(file: Union[str, PurePath, IO[bytes]], indices: Sequence[int]) -> Tuple[Header, "NDArray"]:
+    """
+    Read the sections at the given indices of an .mrc file, in the given
+    order. Runs of adjacent indices are read together, so nearby particles
+    need few reads even if the indices are not sorted.
+
+    Reads release the GIL, so gathers from different files may run in
+    parallel in background threads.
+
+    Args:
+        file (str | Path | IO): MRC file path or seekable handle.
+        indices (Sequence[int]): Section indices to read. May repeat.
+
+    Raises:
+        IndexError: If an index is out of range.
+
+    Returns:
+        tuple[Header, NDArray]: The MRC header and the sections as a numpy
+            array with shape ``(len(indices), ny, nx)``. ``float16`` data is
+            converted to ``float32``, same as ``read``.
+    """
+    indices = n.asarray(indices, dtype=n.int64).reshape(-1)
+    with bopen(file, "rb") as f:
+        header = _read_header(f)
+        data = n.empty((len(indices), header.ny, header.nx), dtype=DT_TO_DATATYPE[header.datatype])
+        _gather_into(f, header, indices, data, n.arange(len(indices)))
+    return header, _to_float32(data)
+
+
+def gather_blobs(dset: "Dataset", field: str = "blob", root: Union[str, PurePath] = "") -> "NDArray":
+    """
+    Read the particle (or other) image of each row of the given dataset from
+    the .mrc stacks referenced by its ``<field>/path`` and ``<field>/idx``
+    fields. Each stack is opened once and its sections are read with
+    ``gather``.
+
+    Args:
+        dset (Dataset): Dataset with ``<field>/path`` and ``<field>/idx`` fields.
+        field (str, optional): Prefix of the path and index fields. Defaults
+            to ``"blob"``.
+        root (str | Path, optional): Directory that paths are relative to,
+            e.g., the project directory. Defaults to the current directory.
+
+    Raises:
+        ValueError: If the stacks have different image shapes or data types.
+
+    Returns:
+        NDArray: Image for each row with shape ``(len(dset), ny, nx)``.
+    """
+    paths = n.asarray(dset[f"{field}/path"])
+    indices = n.asarray(dset[f"{field}/idx"], dtype=n.int64)
+    data: Optional["NDArray"] = None
+    first: Optional[Header] = None
+    if len(paths) == 0:
+        return n.empty((0, 0, 0), dtype=n.float32)
+
+    stacks, inverse = n.unique(paths, return_inverse=True)
+    for k, path in enumerate(stacks):
+        rows = n.flatnonzero(inverse == k)
+        with bopen(os.path.join(root, path), "rb") as f:
+            header = _read_header(f)
+            if first is None:
+                first = header
+                data = n.empty((len(paths), header.ny, header.nx), dtype=DT_TO_DATATYPE[header.datatype])
+            elif (header.ny, header.nx, header.datatype) != (first.ny, first.nx, first.datatype):
+                raise ValueError(f"Image shape or data type of {path} does not match {stacks[0]}")
+            assert data is not None
+            _gather_into(f, header, indices[rows], data, rows)
+
+    assert data is not None
+    return _to_float32(data)
+
+
 def write(file: Union[str, PurePath, IO[bytes]], data: "NDArray", psize: float):
     """
     Write the given ndarray data to a file. Specify a pixel size for the mrc
@@ -157,6 +285,54 @@ def _read_header(file: IO) -> Header:
     )
 
 
+def _data_offset(header: Header) -> int:
+    return 1024 + header.nsymbt
+
+
+def _section_size(header: Header) -> int:
+    return header.nx * header.ny * n.dtype(DT_TO_DATATYPE[header.datatype]).itemsize
+
+
+def _to_float32(data: "NDArray") -> "NDArray":
+    # Same as read, which converts float16 data to float32
+    return data.astype(n.float32) if data.dtype == n.float16 else data
+
+
+def _readinto(file: IO[bytes], data: "NDArray"):
+    # Fill the given contiguous array from the file's current position
+    view = memoryview(data).cast("B")  # type: ignore
+    pos = 0
+    while pos < len(view):
+        count = file.readinto(view[pos:])  # type: ignore
+        if not count:
+            raise EOFError(f"MRC file {file} ended {len(view) - pos} bytes early")
+        pos += count
+
+
+def _gather_into(file: IO[bytes], header: Header, indices: "NDArray", data: "NDArray", rows: "NDArray"):
+    # Read section indices[i] into data[rows[i]] for each i, coalescing runs
+    # of adjacent sections into a single read
+    if len(indices) == 0:
+        return
+    if indices.min() < 0 or indices.max() >= header.nz:
+        raise IndexError(f"Section indices must be in range [0, {header.nz}) for MRC file {file}")
+
+    order = n.argsort(indices, kind="stable")
+    ordered = indices[order]
+    targets = rows[order]
+    breaks = n.flatnonzero(n.diff(ordered) != 1) + 1
+    section_size = _section_size(header)
+    for start, stop in zip(n.concatenate(([0], breaks)), n.concatenate((breaks, [len(ordered)]))):
+        file.seek(_data_offset(header) + int(ordered[start]) * section_size)
+        first, last = targets[start], targets[stop - 1]
+        if last - first == stop - start - 1 and n.all(n.diff(targets[start:stop]) == 1):
+            _readinto(file, data[first : last + 1])  # already in output order
+        else:
+            run = n.empty((stop - start,) + data.shape[1:], dtype=data.dtype)
+            _readinto(file, run)
+            data[targets[start:stop]] = run
+
+
 def _write_header(file: IO, data: "NDArray", psize: float):
     assert data.dtype.type in DATATYPE_TO_DT, "Unsupported MRC dtype: {0}".format(data.dtype)
 
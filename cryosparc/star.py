@@ -1,15 +1,18 @@
 """
 Helper module for reading and writing relion star files.
 """
+import mmap
+import re
 from pathlib import PurePath
-from typing import IO, TYPE_CHECKING, Any, Callable, Dict, List, Mapping, Optional, Tuple, Type, Union, overload
-from typing_extensions import Literal
+from typing import IO, TYPE_CHECKING, Any, Dict, List, Mapping, Optional, Tuple, Type, Union
 import numpy as n
 from numpy.core.records import fromrecords
 
 if TYPE_CHECKING:
     from numpy.typing import NDArray  # type: ignore
 
+from .core import Data, DsetType
+from .dataset import Dataset
 from .util import topen
 
 # Available star file fields and their types. Fields marked as type ``object``
@@ -471,6 +474,17 @@ RLN_DTYPES: Dict[str, Type[object]] = dict(
     rlnUnknownLabel=object,
 )
 
+# Types to parse values of each known label as. bool values are written as 0
+# or 1 so they are parsed as integers.
+STAR_TYPES = {float: DsetType.T_F64, int: DsetType.T_I64, bool: DsetType.T_I64, object: DsetType.T_STR}
+
+WRITE_BUFFER_SIZE = 1 << 20
+"""
+Size of each chunk of formatted rows when writing STAR files.
+"""
+
+_DATA_BLOCK = re.compile(rb"^[ \t]*data_(\S*)", re.MULTILINE)
+
 
 def read(file: Union[str, PurePath, IO[str]]) -> Dict[str, "NDArray"]:
     """
@@ -502,89 +516,92 @@ def read(file: Union[str, PurePath, IO[str]]) -> Dict[str, "NDArray"]:
         >>> blocks['optics']
         array([...])
     """
+    data = {}
+    for name, dset in read_datasets(file).items():
+        dset.to_pystrs()
+        fields = list(dset)
+        dtype = [(f, bool if RLN_DTYPES.get(f) is bool else dset[f].dtype) for f in fields]
+        arr = n.empty(len(dset), dtype=dtype)
+        for f in fields:
+            arr[f] = dset[f]
+        data[name] = arr
+    return data
+
+
+def read_datasets(file: Union[str, PurePath, IO[str]]) -> Dict[str, Dataset]:
+    """
+    Read each ``loop_`` block of the given STAR file into a dataset with a
+    field for each label, without creating a Python object for each value.
+    Labels in ``RLN_DTYPES`` are read as that type (with ``bool`` labels read
+    as integers). The type of other labels is inferred from their values.
+    Path inputs are memory-mapped rather than read into memory at once.
+
+    Args:
+        file (str | Path | IO): Path or file handle to ``.star`` file.
+
+    Returns:
+        dict[str, Dataset]: Dataset for each block name found in the star file.
+        Datasets have a ``uid`` field only if the block has a ``uid`` label.
 
-    # If numpy.loadtxt has a max_rows argument, can read more efficiently.
-    from inspect import signature
-    import tempfile
-
-    use_max_rows = "max_rows" in signature(n.loadtxt).parameters
-
-    with topen(file, "r") as f:
-        data_blocks: List[tuple] = []
-        line = 0
-        skiprows = 0
-
-        # Stage 1: Determine available fields the STAR file and what line the
-        # data starts and ends at
-        while True:
-            skiprows = 0
-            num, val = _read_until(f, lambda x: x.strip().startswith("data_"))
-            if num is None:
-                assert data_blocks, f"Cannot find any 'data_' blocks in the STAR file {file}."
-                break
-
-            line += num
-            skiprows += num
-            dblk_name = val.strip().replace("data_", "", 1)
-            dblk_start = line - 1  # which line is 'data_'
-
-            num, val = _read_until(f, lambda x: x.strip().startswith("loop_"))
-            assert (
-                num is not None
-            ), f"Cannot find any 'loop_' in the data block starting at line {dblk_start} in the STAR file."
-            line += num
-            skiprows += num
-
-            num, val = _read_until(f, lambda x: x.strip().startswith("_"))
-            assert (
-                num is not None
-            ), f"Cannot find start of label names in the data block starting at line {dblk_start} in the STAR file."
-            line += num
-            skiprows += num
-            dtype: List[Tuple[str, Type[object]]] = []
-            while val:
-                val = val.strip()
-                if val.startswith("_"):
-                    label = val.lstrip("_").split(" ")[0]
-                    dtype.append((label, RLN_DTYPES.get(label, object)))
-                elif val.startswith("#") or val.startswith(";"):
-                    pass  # comment
-                else:
-                    break  # done reading fields
-                line += 1
-                skiprows += 1
-                val = f.readline()
-
-            skiprows -= 1
-            num, val = _read_until(f, lambda x: x.strip() == "", allow_eof=True)  # look for empty line or EOF
-            line += num
-            maxrows = num
-
-            data_blocks.append((dblk_name, dtype, skiprows, maxrows))
-
-        # STAGE 2: Seek back to the beginning of the file and read in rows
-        f.seek(0)
-        data = {}
-        for dblk_name, dtype, skiprows, maxrows in data_blocks:
-            if use_max_rows:
-                # Can read directly
-                data[dblk_name] = n.loadtxt(f, dtype=dtype, skiprows=skiprows, max_rows=maxrows, ndmin=1)
-                f.readline()
-                continue
-
-            # Cannot read directly because loadtxt attempts to read every row.
-            # Save required rows to tempfile first and read from there
-            with tempfile.TemporaryFile("w+") as temp:
-                for _ in range(skiprows):
-                    f.readline()
-                for _ in range(maxrows):
-                    temp.write(f.readline())
-                temp.seek(0)
-                data[dblk_name] = n.loadtxt(temp, dtype=dtype, ndmin=1)
-
-            f.readline()  # skip one more line
-
-        return data
+    Examples:
+
+        >>> from cryosparc import star
+        >>> particles = star.read_datasets('particles.star')['particles']
+        >>> particles['rlnImageName']
+        array([...])
+    """
+    if isinstance(file, (str, PurePath)):
+        with open(file, "rb") as f:
+            try:
+                text = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+            except ValueError:  # empty files cannot be mapped
+                text = b""
+            try:
+                return _read_blocks(text, file)
+            finally:
+                if isinstance(text, mmap.mmap):
+                    text.close()
+
+    text = file.read()
+    return _read_blocks(text.encode() if isinstance(text, str) else text, file)
+
+
+def _read_blocks(text, file) -> Dict[str, Dataset]:
+    # Find each data block and its labels here and parse its rows natively
+    data = {}
+    pos = 0
+    while True:
+        match = _DATA_BLOCK.search(text, pos)
+        if not match:
+            assert data, f"Cannot find any 'data_' blocks in the STAR file {file}."
+            break
+        name = match.group(1).decode()
+        line, pos = _next_line(text, match.end())
+        while pos < len(text) and not line.startswith(b"loop_"):
+            line, pos = _next_line(text, pos)
+        assert line.startswith(b"loop_"), f"Cannot find any 'loop_' in the data block '{name}' in the STAR file."
+
+        labels: List[str] = []
+        while pos < len(text):
+            line, nextpos = _next_line(text, pos)
+            if line.startswith(b"_"):
+                labels.append(line[1:].split()[0].decode())
+            elif line and not line.startswith(b"#") and not line.startswith(b";"):
+                break  # done reading labels
+            pos = nextpos
+        assert labels, f"Cannot find start of label names in the data block '{name}' in the STAR file."
+
+        types = [STAR_TYPES.get(RLN_DTYPES.get(label), 0) for label in labels]
+        block, pos = Data.read_star(text, labels, types, pos)
+        data[name] = Dataset(block)
+    return data
+
+
+def _next_line(text, pos: int) -> Tuple[bytes, int]:
+    # Stripped line at the given position and the position of the next one
+    end = text.find(b"\n", pos)
+    end = len(text) if end < 0 else end + 1
+    return bytes(text[pos:end]).strip(), end
 
 
 def write(
@@ -663,35 +680,32 @@ def write_blocks(file: Union[str, PurePath, IO[str]], blocks: Mapping[str, "NDAr
         # Infer labels from numpy record array
         labels = [f[0] for f in d.dtype.descr]
         assert all(labels), f"Cannot write STAR file data with missing labels: {d}"
-        entries.append((k, d, labels))
+        entries.append((k, _star_dataset(d, labels), labels))
 
+    buf = bytearray(WRITE_BUFFER_SIZE)
     with topen(file, "w") as f:
-        for name, block, labels in entries:
+        for name, dset, labels in entries:
             f.writelines(["\n", f"data_{name}\n", "\n", "loop_\n"])
             f.writelines(f"_{field} #{i + 1}\n" for i, field in enumerate(labels))
-            for row in block:
-                f.writelines([" ".join(map(str, row)), "\n"])
+            start = 0
+            while start < len(dset):
+                rows, used = dset._data.format_star(labels, start, buf)
+                if rows == 0:
+                    buf = bytearray(len(buf) * 2)  # a single row does not fit
+                    continue
+                f.write(buf[:used].decode())
+                start += rows
             f.write("\n")
 
 
-@overload
-def _read_until(f: IO[str], line_test: Callable[[str], bool]) -> Tuple[Optional[int], str]:
-    ...
-
-
-@overload
-def _read_until(f: IO[str], line_test: Callable[[str], bool], allow_eof: Literal[True]) -> Tuple[int, str]:
-    ...
-
-
-def _read_until(f: IO[str], line_test: Callable[[str], bool], allow_eof=False) -> Tuple[Optional[int], str]:
-    # Read from the given file handle line-by-line until the line m
-    num_lines = 0
-    inp = ""
-    while True:
-        num_lines += 1
-        inp = f.readline()
-        if inp == "":  # end of file
-            return (num_lines if allow_eof else None), inp
-        elif line_test(inp):  # found the test condition
-            return num_lines, inp
+def _star_dataset(data: "NDArray", labels: List[str]) -> Dataset:
+    # Dataset with a C-string or numeric field for each label to format
+    fields = []
+    for label in labels:
+        arr = data[label]
+        if arr.dtype.kind in "SU":
+            arr = arr.astype(str).astype(object)
+        elif arr.dtype.kind == "b":
+            arr = arr.astype(n.uint8)
+        fields.append((label, arr))
+    return Dataset(fields).to_cstrs()
@@ -287,6 +287,32 @@ def u32intle(buffer: bytes) -> int:
     return int.from_bytes(buffer, "little", signed=False)
 
 
+def u64bytesle(x: int) -> bytes:
+    """
+    Get the uint64 bytes of for integer x in little endian.
+
+    Args:
+        x (int): Integer to encode.
+
+    Returns:
+        bytes: Encoded integer bytes
+    """
+    return x.to_bytes(8, "little", signed=False)
+
+
+def u64intle(buffer: bytes) -> int:
+    """
+    Get int from buffer representing a uint64 integer in little endian.
+
+    Args:
+        buffer (bytes): 8 bytes representing little-endian integer.
+
+    Returns:
+        int: decoded integer
+    """
+    return int.from_bytes(buffer, "little", signed=False)
+
+
 def strbytelen(s: str) -> int:
     """
     Get the number of bytes in a string's UTF-8 representation.
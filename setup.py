@@ -13,6 +13,8 @@ if sys.platform == "win32":
     extra_compile_args += ["/std:c11"]
 else:
     libraries.append("pthread")
+if sys.platform.startswith("linux"):
+    libraries.append("rt")  # shm_open on glibc < 2.34
 
 if sys.platform == "win32" and DEBUG:
     define_macros += [("_DEBUG",)]
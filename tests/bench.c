@@ -0,0 +1,305 @@
+/*
+	Benchmarks for the hot paths of dataset.h. Build and run with bench.sh.
+
+	Usage: bench [scale [filter [reps]]]
+
+	scale multiplies the base size of 1M rows (e.g., 0.01 for a quick run),
+	filter runs only benchmarks whose names start with it and reps is the
+	number of times to run each one (the fastest is reported). Prints one JSON
+	object per benchmark per line, e.g.
+
+	{"bench": "setstr_unique", "rows": 1000000, "ops": 1000000, "ns": 91230144, "ns_per_op": 91.2, ...}
+
+	Counters from dset_stats for the dataset being measured are included
+	where relevant, so that changes in reallocation and copying show up even
+	when times are noisy.
+*/
+#include <stdio.h>
+#include <string.h>
+
+#define DATASET_IMPLEMENTATION
+#include <cryosparc-tools/dataset.h>
+
+static const char *filter = "";
+static uint32_t reps = 3;
+
+static uint64_t rng = 0x9e3779b97f4a7c15U;
+
+static uint64_t
+xorshift (void) {
+	rng ^= rng << 13;
+	rng ^= rng >> 7;
+	rng ^= rng << 17;
+	return rng;
+}
+
+static int
+enabled (const char *name) {
+	return !strncmp(name, filter, strlen(filter));
+}
+
+// Print a result line. extra is either empty or starts with ", "
+static void
+report (const char *name, uint64_t rows, uint64_t ops, uint64_t ns, const char *extra) {
+	printf("{\"bench\": \"%s\", \"rows\": %" PRIu64 ", \"ops\": %" PRIu64 ", \"ns\": %" PRIu64
+		", \"ns_per_op\": %.2f%s}\n", name, rows, ops, ns, ops ? (double) ns / (double) ops : 0.0, extra);
+	fflush(stdout);
+}
+
+static void
+stats_json (uint64_t dset, char *buf, size_t bufsz) {
+	ds_stats st;
+	xassert(dset_stats(dset, &st));
+	snprintf(buf, bufsz,
+		", \"total_sz\": %" PRIu64 ", \"nrealloc\": %" PRIu32 ", \"nreassign_arroffsets\": %" PRIu32
+		", \"bytes_moved\": %" PRIu64 ", \"resize_ns\": %" PRIu64 ", \"string_ns\": %" PRIu64
+		", \"nintern\": %" PRIu64 ", \"nintern_hits\": %" PRIu64,
+		st.total_sz, st.nrealloc, st.nreassign_arroffsets, st.bytes_moved, st.resize_ns, st.string_ns,
+		st.nintern, st.nintern_hits);
+}
+
+// Particle-like dataset with a few numeric columns of n rows
+static uint64_t
+particles (uint64_t n) {
+	uint64_t d = dset_new_sized(4, n, 0);
+	xassert(dset_addcol_scalar(d, "uid", T_U64));
+	xassert(dset_addcol_array(d, "alignments3D/pose", T_F32, 3, 0, 0));
+	xassert(dset_addcol_scalar(d, "alignments3D/class", T_U32));
+	xassert(dset_addcol_scalar(d, "blob/path", T_STR));
+	xassert(dset_addrows(d, (uint32_t) n));
+	uint64_t *uid = dset_get(d, "uid");
+	float *pose = dset_get(d, "alignments3D/pose");
+	uint32_t *cls = dset_get(d, "alignments3D/class");
+	for (uint64_t i = 0; i < n; i++) {
+		uid[i] = i;
+		pose[3*i] = pose[3*i+1] = pose[3*i+2] = (float) i;
+		cls[i] = (uint32_t) (i % 50);
+	}
+	return d;
+}
+
+/*
+	Growth by appending rows in batches, with and without reserving the final
+	size first
+*/
+static void
+bench_addrows (const char *name, uint64_t n, int reserve) {
+	if (!enabled(name)) return;
+	uint64_t best = UINT64_MAX;
+	char extra[512] = "";
+	for (uint32_t r = 0; r < reps; r++) {
+		uint64_t t0 = now_ns();
+		uint64_t d = dset_new();
+		xassert(dset_addcol_scalar(d, "uid", T_U64));
+		xassert(dset_addcol_array(d, "alignments3D/pose", T_F32, 3, 0, 0));
+		xassert(dset_addcol_scalar(d, "blob/path", T_STR));
+		if (reserve) xassert(dset_reserve(d, n, 0));
+		for (uint64_t i = 0; i < n; i += 1000) xassert(dset_addrows(d, (uint32_t) (n - i < 1000 ? n - i : 1000)));
+		uint64_t t = now_ns() - t0;
+		if (t < best) {
+			best = t;
+			stats_json(d, extra, sizeof(extra));
+		}
+		dset_del(d);
+	}
+	report(name, n, n / 1000, best, extra);
+}
+
+/*
+	String assignment one row at a time and in bulk, with all-distinct values
+	or a few values repeated (so that most lookups hit the intern index)
+*/
+static void
+bench_setstr (const char *name, uint64_t n, uint64_t ndistinct, int bulk) {
+	if (!enabled(name)) return;
+	char *strs = malloc(ndistinct * 48);
+	const char **values = malloc(n * sizeof(char *));
+	xassert(strs && values);
+	for (uint64_t i = 0; i < ndistinct; i++) snprintf(strs + 48 * i, 48, "J12/imported/mic_%08" PRIu64 ".mrc", i);
+	for (uint64_t i = 0; i < n; i++) values[i] = strs + 48 * ((i * 7919) % ndistinct);
+
+	uint64_t best = UINT64_MAX;
+	char extra[512] = "";
+	for (uint32_t r = 0; r < reps; r++) {
+		uint64_t d = particles(n);
+		uint64_t t0 = now_ns();
+		if (bulk) {
+			for (uint64_t i = 0; i < n; i += 4096) xassert(dset_setstrs(d, "blob/path", i, n - i < 4096 ? n - i : 4096, values + i));
+		} else {
+			for (uint64_t i = 0; i < n; i++) xassert(dset_setstr(d, "blob/path", i, values[i]));
+		}
+		uint64_t t = now_ns() - t0;
+		if (t < best) {
+			best = t;
+			stats_json(d, extra, sizeof(extra));
+		}
+		dset_del(d);
+	}
+	report(name, n, n, best, extra);
+	free(values);
+	free(strs);
+}
+
+/*
+	Inner join of n rows on uid with another dataset whose keys are:
+	- "same":     the same keys in the same order
+	- "shuffled": the same keys in a random order
+	- "half":     every other key, so half the rows match
+	- "random":   random 64-bit values, so almost nothing matches
+*/
+typedef enum { KEYS_SAME, KEYS_SHUFFLED, KEYS_HALF, KEYS_RANDOM } bench_keys;
+
+static void
+bench_innerjoin (const char *name, uint64_t n, bench_keys keys) {
+	if (!enabled(name)) return;
+	uint64_t r_ds = particles(n);
+	uint64_t s_ds = dset_new_sized(2, n, 0);
+	xassert(dset_addcol_scalar(s_ds, "uid", T_U64) && dset_addcol_scalar(s_ds, "ctf/df1_A", T_F32));
+	xassert(dset_addrows(s_ds, (uint32_t) n));
+	uint64_t *uid = dset_get(s_ds, "uid");
+	float *df = dset_get(s_ds, "ctf/df1_A");
+	for (uint64_t i = 0; i < n; i++) {
+		uid[i] = keys == KEYS_HALF ? 2 * i : keys == KEYS_RANDOM ? xorshift() : i;
+		df[i] = (float) i;
+	}
+	if (keys == KEYS_SHUFFLED) {
+		for (uint64_t i = n - 1; i > 0; i--) {
+			const uint64_t j = xorshift() % (i + 1), tmp = uid[i];
+			uid[i] = uid[j];
+			uid[j] = tmp;
+		}
+	}
+
+	uint64_t best = UINT64_MAX, nrow = 0;
+	for (uint32_t r = 0; r < reps; r++) {
+		uint64_t t0 = now_ns();
+		uint64_t j = dset_innerjoin("uid", r_ds, s_ds);
+		uint64_t t = now_ns() - t0;
+		xassert(j != UINT64_MAX);
+		nrow = dset_nrow(j);
+		dset_del(j);
+		if (t < best) best = t;
+	}
+	char extra[64];
+	snprintf(extra, sizeof(extra), ", \"result_rows\": %" PRIu64, nrow);
+	report(name, n, 1, best, extra);
+	dset_del(r_ds);
+	dset_del(s_ds);
+}
+
+/*
+	Looking up columns by key in a dataset with as many columns as a large
+	particle stack, including keys too long to store inline
+*/
+static void
+bench_column_lookup (const char *name, uint64_t nlookups) {
+	if (!enabled(name)) return;
+	enum { NCOL = 150 };
+	char keys[NCOL][64];
+	uint64_t d = dset_new();
+	xassert(dset_addrows(d, 10));
+	for (uint32_t i = 0; i < NCOL; i++) {
+		if (i % 10 == 9) snprintf(keys[i], sizeof(keys[i]), "alignments_class_%u/a_long_column_name_%u", i, i);
+		else snprintf(keys[i], sizeof(keys[i]), "ctf%u/df1_A", i);
+		xassert(dset_addcol_scalar(d, keys[i], T_F32));
+	}
+
+	uint64_t best = UINT64_MAX;
+	uintptr_t check = 0;
+	for (uint32_t r = 0; r < reps; r++) {
+		uint64_t t0 = now_ns();
+		for (uint64_t i = 0; i < nlookups; i++) check += (uintptr_t) dset_get(d, keys[(i * 37) % NCOL]);
+		uint64_t t = now_ns() - t0;
+		if (t < best) best = t;
+	}
+	xassert(check);
+	char extra[32];
+	snprintf(extra, sizeof(extra), ", \"ncol\": %d", NCOL);
+	report(name, 10, nlookups, best, extra);
+	dset_del(d);
+}
+
+/*
+	Copying a dataset with strings, and defragmenting it after half of its
+	strings have been replaced
+*/
+static void
+bench_copy_defrag (uint64_t n) {
+	if (!enabled("copy") && !enabled("defrag")) return;
+	uint64_t d = particles(n);
+	char buf[32];
+	for (uint64_t i = 0; i < n; i++) {
+		snprintf(buf, sizeof(buf), "J1/mic_%" PRIu64 ".mrc", i % 1000);
+		xassert(dset_setstr(d, "blob/path", i, buf));
+	}
+
+	if (enabled("copy")) {
+		uint64_t best = UINT64_MAX;
+		for (uint32_t r = 0; r < reps; r++) {
+			uint64_t t0 = now_ns();
+			uint64_t c = dset_copy(d);
+			uint64_t t = now_ns() - t0;
+			xassert(c != UINT64_MAX);
+			dset_del(c);
+			if (t < best) best = t;
+		}
+		char extra[64];
+		snprintf(extra, sizeof(extra), ", \"total_sz\": %" PRIu64, dset_totalsz(d));
+		report("copy", n, 1, best, extra);
+	}
+
+	if (enabled("defrag")) {
+		uint64_t best = UINT64_MAX;
+		char extra[512] = "";
+		for (uint32_t r = 0; r < reps; r++) {
+			uint64_t c = dset_copy(d);
+			xassert(c != UINT64_MAX);
+			for (uint64_t i = 0; i < n; i += 2) {
+				snprintf(buf, sizeof(buf), "J2/mic_%" PRIu64 ".mrc", i % 1000);
+				xassert(dset_setstr(c, "blob/path", i, buf));
+			}
+			uint64_t t0 = now_ns();
+			xassert(dset_defrag(c, 1));
+			uint64_t t = now_ns() - t0;
+			if (t < best) {
+				best = t;
+				stats_json(c, extra, sizeof(extra));
+			}
+			dset_del(c);
+		}
+		report("defrag", n, 1, best, extra);
+	}
+	dset_del(d);
+}
+
+int main (int argc, char ** argv)
+{
+	const double scale = argc > 1 ? atof(argv[1]) : 1.0;
+	filter = argc > 2 ? argv[2] : "";
+	reps = argc > 3 ? (uint32_t) atoi(argv[3]) : 3;
+	if (scale <= 0 || reps == 0) {
+		fprintf(stderr, "usage: %s [scale [filter [reps]]]\n", argv[0]);
+		return 1;
+	}
+
+	const uint64_t n = (uint64_t) (1000000 * scale) > 1 ? (uint64_t) (1000000 * scale) : 1;
+	bench_addrows("addrows_grow", n, 0);
+	bench_addrows("addrows_reserved", n, 1);
+	bench_setstr("setstr_unique", n, n, 0);
+	bench_setstr("setstr_repeated", n, 100, 0);
+	bench_setstr("setstrs_unique", n, n, 1);
+	bench_setstr("setstrs_repeated", n, 100, 1);
+
+	static const char *keynames[] = { "same", "shuffled", "half", "random" };
+	for (uint64_t m = n; m <= 10 * n; m *= 10) {
+		for (int k = KEYS_SAME; k <= KEYS_RANDOM; k++) {
+			char name[64];
+			snprintf(name, sizeof(name), "innerjoin_%s_%s", keynames[k], m == n ? "1x" : "10x");
+			bench_innerjoin(name, m, (bench_keys) k);
+		}
+	}
+
+	bench_column_lookup("column_lookup", n);
+	bench_copy_defrag(n);
+	return 0;
+}
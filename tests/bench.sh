@@ -0,0 +1,6 @@
+#!/usr/bin/env sh
+# Benchmarks for the native module, one JSON result per line. Arguments are
+# passed on to bench, e.g. ./bench.sh 0.1 innerjoin
+set -e
+cc -O2 bench.c -I ../cryosparc/include -lpthread -lm -o bench
+./bench "$@"
@@ -12,6 +12,19 @@ char * randstr(void) {
 	return str;
 }
 
+// Reader for the concurrent mode test: checks that the first 1000 rows stay
+// readable while another thread appends rows
+static DSTHREAD_RETURN pinned_reader(void *arg) {
+	uint64_t dset = *(uint64_t *) arg;
+	for (int i = 0; i < 2000; i++) {
+		xassert(dset_pin(dset));
+		const uint64_t *uid = dset_get(dset, "uid");
+		xassert(uid && uid[i % 1000] == (uint64_t) (i % 1000) && !strcmp(dset_getstr(dset, "s", 999), "last"));
+		xassert(dset_unpin(dset));
+	}
+	return 0;
+}
+
 #include <time.h>
 int main (int argc, char ** argv) 
 {
@@ -45,6 +58,18 @@ int main (int argc, char ** argv)
 	}
 
 
+	// identical strings share the same handle
+	xassert(dset_setstr(d, LONGSTR, 0, "interned"));
+	xassert(dset_setstr(d, LONGSTR, 1, "interned"));
+	xassert(((uint64_t *) dset_get(d, LONGSTR))[0] == ((uint64_t *) dset_get(d, LONGSTR))[1]);
+
+	// columns can be accessed by index after a single key lookup
+	xassert(dset_colindex(d, "col2") == 2);
+	xassert(dset_colindex(d, LONGSTR) == 4);
+	xassert(dset_colindex(d, "missing") == UINT64_MAX);
+	xassert(dset_get_at(d, 2) == (void *) col2);
+	xassert(dset_type_at(d, 4) == T_STR);
+
 	printf("ncol %u \n", dset_ncol(d));
 	printf("nrow %u \n", dset_nrow(d));
 	printf("\n");
@@ -54,6 +79,9 @@ int main (int argc, char ** argv)
 	for (int i = 0; i < 10; i++) {
 		xassert(dset_setstr(d, LONGSTR, i, randstr()));
 	}
+	xassert(dset_setstr(d, LONGSTR, 9, "last"));
+	xassert(dset_defrag(d, 1)); // reclaims overwritten strings
+	xassert(!strcmp(dset_getstr(d, LONGSTR, 9), "last"));
 	dset_dumptxt(d);
 	printf("\n");
 
@@ -78,9 +106,413 @@ int main (int argc, char ** argv)
 	dset_dumptxt(f);
 	printf("\n");
 
+	uint64_t joined[] = {d, e, e};
+	uint64_t f3 = dset_innerjoin_many("uid", 3, joined);
+	xassert(dset_nrow(f3) == dset_nrow(f));
+	xassert(dset_ncol(f3) == dset_ncol(f));
+	dset_del(f3);
+
+	uint64_t parts[] = {e, e};
+	xassert(dset_append_many("uid", 2, parts) == UINT64_MAX); // repeated uids
+	uint64_t app = dset_append_many(0, 2, parts);
+	uint64_t uni = dset_union_many("uid", 2, parts);
+	xassert(dset_nrow(app) == 14 && dset_nrow(uni) == 7);
+	xassert(!strcmp(dset_getstr(app, "morestrs", 8), dset_getstr(e, "morestrs", 1)));
+	// a field that is T_STR in one input and T_OBJ in another is an error, not dropped
+	uint64_t eo = dset_new();
+	xassert(dset_addcol_scalar(eo, "uid", T_U64) && dset_addcol_scalar(eo, "morestrs", T_OBJ) && dset_addrows(eo, 1));
+	((uint64_t *) dset_get(eo, "uid"))[0] = 1;
+	const uint64_t mixed[] = {e, eo};
+	xassert(dset_append_many(0, 2, mixed) == UINT64_MAX);
+	dset_del(eo);
+	const uint64_t rows[] = {6, 0};
+	const uint8_t keep[] = {0, 1, 0, 0, 0, 0, 1};
+	uint64_t tk = dset_take(e, rows, 2);
+	uint64_t mk = dset_mask(e, keep);
+	xassert(dset_nrow(tk) == 2 && dset_nrow(mk) == 2);
+	xassert(((uint64_t *) dset_get(tk, "uid"))[0] == ((uint64_t *) dset_get(e, "uid"))[6]);
+	xassert(!strcmp(dset_getstr(mk, "morestrs", 1), dset_getstr(e, "morestrs", 6)));
+	// a subset only reserves room for the strings it selects
+	uint64_t bs = dset_new();
+	char *bsbig = calloc(1, 1 << 16);
+	memset(bsbig, 'b', (1 << 16) - 1);
+	xassert(dset_addcol_scalar(bs, "s", T_STR) && dset_addrows(bs, 2));
+	xassert(dset_setstr(bs, "s", 0, bsbig) && dset_setstr(bs, "s", 1, "small"));
+	uint64_t bstk = dset_take(bs, (uint64_t[]) {1}, 1);
+	uint64_t bsmk = dset_mask(bs, (uint8_t[]) {0, 1});
+	xassert(dset_totalsz(bstk) < 4096 && dset_totalsz(bsmk) < 4096);
+	xassert(!strcmp(dset_getstr(bstk, "s", 0), "small") && !strcmp(dset_getstr(bsmk, "s", 0), "small"));
+	dset_del(bstk);
+	dset_del(bsmk);
+	bstk = dset_take(bs, (uint64_t[]) {0, 0, 1}, 3);
+	xassert(!strcmp(dset_getstr(bstk, "s", 1), bsbig) && !strcmp(dset_getstr(bstk, "s", 2), "small"));
+	dset_del(bstk);
+	dset_del(bs);
+	free(bsbig);
+	// query masks match numbers by value and strings by text
+	const char * qkeys[] = {"uid", "morestrs"}, * qfkeys[] = {"col4"};
+	const uint64_t quids[] = {((uint64_t *) dset_get(e, "uid"))[1], ((uint64_t *) dset_get(e, "uid"))[6], 12345};
+	const char * qstrs[] = {"missing", dset_getstr(e, "morestrs", 1)};
+	const float qfloats[] = {-0.0f, NAN};
+	const uint64_t qn[] = {3, 2}, qfn[] = {2};
+	const void * qvals[] = {quids, qstrs}, * qfvals[] = {qfloats};
+	uint8_t qmask[7];
+	xassert(dset_query_mask(e, 2, qkeys, qn, qvals, qmask));
+	xassert(!memcmp(qmask, (uint8_t[]) {0, 1, 0, 0, 0, 0, 0}, 7));
+	xassert(dset_query_mask(e, 1, qfkeys, qfn, qfvals, qmask));
+	xassert(!memcmp(qmask, (uint8_t[]) {1, 0, 0, 0, 0, 0, 0}, 7));
+	xassert(dset_query_mask(e, 0, 0, 0, 0, qmask) && qmask[6]);
+	// rows sort stably by several columns and group by value
+	uint64_t gb = dset_new();
+	const int32_t gbk[] = {3, -1, 3, 2, -1};
+	const char * gbs[] = {"b", "a", "b", "a", "c"};
+	xassert(dset_addrows(gb, 5) && dset_addcol_scalar(gb, "k", T_I32) && dset_addcol_scalar(gb, "s", T_STR));
+	memcpy(dset_get(gb, "k"), gbk, sizeof(gbk));
+	xassert(dset_setstrs(gb, "s", 0, 5, gbs));
+	const char * sortks[] = {"k", "s"}, * sortsk[] = {"s", "k"};
+	uint64_t gborder[5], gboffsets[6];
+	xassert(dset_argsort(gb, 2, sortks, gborder) && !memcmp(gborder, (uint64_t[]) {1, 4, 3, 0, 2}, 40));
+	xassert(dset_argsort(gb, 2, sortsk, gborder) && !memcmp(gborder, (uint64_t[]) {1, 3, 0, 2, 4}, 40));
+	xassert(dset_groupby(gb, "k", gborder, gboffsets, 1) == 3 && !memcmp(gboffsets, (uint64_t[]) {0, 2, 3, 5}, 32));
+	xassert(!memcmp(dset_get(gb, "k"), (int32_t[]) {-1, -1, 2, 3, 3}, 20) && !strcmp(dset_getstr(gb, "s", 1), "c"));
+	// views read rows of the parent without copying them
+	const char *viewks[] = {"s"};
+	uint64_t gv = dset_view(gb, 1, 3, 0, 0), gvv = dset_view(gv, 1, 2, 1, viewks);
+	xassert(dset_nrow(gv) == 3 && dset_get(gv, "k") == (int32_t *) dset_get(gb, "k") + 1 && !dset_addrows(gv, 1));
+	xassert(dset_ncol(gvv) == 1 && !strcmp(dset_getstr(gvv, "s", 1), "b"));
+	uint64_t gvc = dset_copy(gvv);
+	xassert(dset_nrow(gvc) == 2 && !strcmp(dset_getstr(gvc, "s", 0), "a") && dset_addrows(gvc, 1));
+	dset_del(gvc);
+	dset_del(gb);
+	xassert(dset_nrow(gv) == 3 && !dset_get(gv, "k"));
+	dset_del(gvv);
+	dset_del(gv);
+	// column kernels transform, reduce, bin and convert values in one pass
+	uint64_t kn = dset_new();
+	xassert(dset_addrows(kn, 4) && dset_addcol_array(kn, "sh", T_F32, 2, 0, 0) && dset_addcol_scalar(kn, "g", T_I64));
+	memcpy(dset_get(kn, "sh"), (float[]) {1, 2, 3, 4, 5, 6, -7, 8}, 32);
+	memcpy(dset_get(kn, "g"), (int64_t[]) {1, 0, 1, 0}, 32);
+	xassert(dset_fma(kn, "sh", (double[]) {2, 1}, (double[]) {0, -1}) && !dset_fma(kn, "g", 0, 0));
+	double kmin[4], kmax[4], ksum[4];
+	xassert(dset_reduce(kn, "sh", 0, 0, 0, kmin, kmax, ksum) && kmin[0] == -14 && kmax[1] == 7 && ksum[0] == 4 && ksum[1] == 16);
+	uint64_t korder[4], koffsets[5], kcounts[4];
+	xassert(dset_groupby(kn, "g", korder, koffsets, 0) == 2);
+	xassert(dset_reduce(kn, "sh", 2, korder, koffsets, kmin, kmax, ksum) && kmin[0] == -14 && kmax[2] == 10 && ksum[3] == 6);
+	xassert(dset_histogram(kn, "sh", -14, 10, 4, kcounts) && !memcmp(kcounts, (uint64_t[]) {1, 0, 3, 4}, 32));
+	// infinities of both signs make a NaN sum but leave min and max alone; a NaN makes all three NaN
+	uint64_t kr = dset_new();
+	xassert(dset_addrows(kr, 7) && dset_addcol_scalar(kr, "v", T_F64));
+	memcpy(dset_get(kr, "v"), (double[]) {3, -1, INFINITY, 2, -INFINITY, 5, 0}, 56);
+	xassert(dset_reduce(kr, "v", 0, 0, 0, kmin, kmax, ksum) && kmin[0] == -INFINITY && kmax[0] == INFINITY && isnan(ksum[0]));
+	((double *) dset_get(kr, "v"))[2] = NAN;
+	xassert(dset_reduce(kr, "v", 0, 0, 0, kmin, kmax, ksum) && isnan(kmin[0]) && isnan(kmax[0]) && isnan(ksum[0]));
+	dset_del(kr);
+	uint8_t kbytes[8];
+	xassert(dset_convert(kn, "sh", T_U8, kbytes) && !memcmp(kbytes, (uint8_t[]) {2, 1, 6, 3, 10, 5, 0, 7}, 8));
+	// columns cast, drop and rename in place without rebuilding the dataset
+	const char *klong = "ctf/a_column_name_that_is_much_too_long_for_a_short_key";
+	xassert(dset_addcol_scalar(kn, klong, T_U64) && dset_castcol(kn, "sh", T_F64) && dset_castcol(kn, "g", T_U8));
+	xassert(((double *) dset_get(kn, "sh"))[6] == -14 && ((uint8_t *) dset_get(kn, "g"))[2] == 1 && dset_getsz(kn, "g") == 4);
+	((uint64_t *) dset_get(kn, klong))[3] = 99;
+	xassert(dset_dropcol(kn, "sh") && !dset_dropcol(kn, "sh") && dset_ncol(kn) == 2 && !dset_castcol(kn, "g", T_STR));
+	xassert(!dset_renamecol(kn, "g", klong) && dset_renamecol(kn, klong, "k") && dset_renamecol(kn, "g", klong));
+	xassert(((uint64_t *) dset_get(kn, "k"))[3] == 99 && ((uint8_t *) dset_get(kn, klong))[2] == 1 && !dset_get(kn, "g"));
+	xassert(dset_defrag(kn, 1) && dset_addrows(kn, 100) && ((uint64_t *) dset_get(kn, "k"))[3] == 99);
+	dset_del(kn);
+	// renaming to a long key that compacts the heap releases the old key, not a stale handle
+	uint64_t rk = dset_new();
+	char rkjunk[200] = {0}, *rkbig = calloc(1, 1 << 16);
+	memset(rkjunk, 'j', sizeof(rkjunk) - 1);
+	memset(rkbig, 'k', (1 << 16) - 1);
+	xassert(dset_addcol_scalar(rk, "s", T_STR) && dset_addrows(rk, 2) && dset_setstr(rk, "s", 0, rkjunk));
+	xassert(dset_addcol_scalar(rk, klong, T_U8) && dset_setstr(rk, "s", 0, ""));
+	ds_stats rkst;
+	const uint64_t rkshifts = dset_stats(rk, &rkst) ? rkst.nshift_strhandles : 0;
+	xassert(dset_renamecol(rk, klong, rkbig) && dset_get(rk, rkbig) && !dset_get(rk, klong));
+	xassert(dset_stats(rk, &rkst) && rkst.nshift_strhandles == rkshifts + 1 && rkst.strheap_freed == 1 + strlen(klong));
+	dset_del(rk);
+	free(rkbig);
+	// narrowing casts leave reserved rows zeroed for new rows
+	uint64_t kc = dset_new();
+	xassert(dset_addcol_scalar(kc, "v", T_F64) && dset_addrows(kc, 4) && dset_reserve(kc, 8, 0));
+	memcpy(dset_get(kc, "v"), (double[]) {1.5, 2.5, 3.5, 4.5}, 32);
+	xassert(dset_castcol(kc, "v", T_F32) && dset_addrows(kc, 4));
+	const float *kv = dset_get(kc, "v");
+	xassert(kv[3] == 4.5f && kv[4] == 0 && kv[5] == 0 && kv[6] == 0 && kv[7] == 0);
+	dset_del(kc);
+	// sized datasets fill without moving and arenas release many datasets at once
+	uint64_t sz = dset_new_sized(2, 100, 64);
+	const uint64_t szbytes = dset_totalsz(sz);
+	xassert(szbytes < 8192 && dset_addcol_scalar(sz, "uid", T_U64) && dset_addcol_scalar(sz, klong, T_F32));
+	xassert(dset_addrows(sz, 100) && dset_totalsz(sz) == szbytes);
+	dset_del(sz);
+	uint64_t ar = dset_arena_new(1 << 16), arparts[50];
+	xassert(ar != UINT64_MAX && dset_arena_use(ar));
+	for (uint64_t i = 0; i < 50; i++) arparts[i] = dset_take(e, (uint64_t[]) {i % 7, (i + 3) % 7}, 2);
+	xassert(dset_arena_use(0) && !dset_arena_use(ar + 1));
+	xassert(dset_addrows(arparts[49], 1000) && dset_addrows(arparts[20], 1000) && dset_nrow(arparts[20]) == 1002);
+	xassert(!strcmp(dset_getstr(arparts[20], "morestrs", 1), dset_getstr(e, "morestrs", 2)));
+	dset_del(arparts[0]);
+	dset_arena_del(ar);
+	xassert(dset_nrow(arparts[1]) == 0);
+	// pinned readers keep their pointers and find columns while a writer appends rows and renames columns
+	uint64_t cc = dset_new();
+	xassert(dset_addcol_scalar(cc, "uid", T_U64) && dset_addcol_scalar(cc, "s", T_STR) && dset_addrows(cc, 1000));
+	xassert(dset_addcol_scalar(cc, "tmp", T_U8));
+	for (uint64_t i = 0; i < 1000; i++) ((uint64_t *) dset_get(cc, "uid"))[i] = i;
+	xassert(dset_setstr(cc, "s", 999, "last") && !dset_pin(cc) && dset_setconcurrent(cc, 1));
+	ds_thread_t readers[4];
+	for (int i = 0; i < 4; i++) xassert(DSTHREAD_CREATE(readers[i], pinned_reader, &cc));
+	for (uint64_t i = 0; i < 200; i++) {
+		xassert(dset_addrows(cc, 500) && dset_setstr(cc, "s", dset_nrow(cc) - 1, randstr()));
+		xassert(dset_renamecol(cc, i % 2 ? klong : "tmp", i % 2 ? "tmp" : klong));
+	}
+	xassert(dset_dropcol(cc, "tmp"));
+	for (int i = 0; i < 4; i++) DSTHREAD_JOIN(readers[i]);
+	xassert(dset_nrow(cc) == 101000 && dset_setconcurrent(cc, 0) && dset_defrag(cc, 1));
+	dset_del(cc);
+	// parallel joins match a single-threaded join, including duplicate keys
+	uint64_t jr = dset_new(), js = dset_new(), jres[2];
+	xassert(dset_addcol_scalar(jr, "k", T_U64) && dset_addrows(jr, 300000));
+	xassert(dset_addcol_scalar(js, "k", T_U64) && dset_addcol_scalar(js, "v", T_U32) && dset_addrows(js, 300000));
+	for (uint64_t i = 0; i < 300000; i++) {
+		((uint64_t *) dset_get(jr, "k"))[i] = i * 7919 % 100003;
+		((uint64_t *) dset_get(js, "k"))[i] = i % 150000 * 3;
+		((uint32_t *) dset_get(js, "v"))[i] = (uint32_t) i;
+	}
+	for (int t = 0; t < 2; t++) {
+		dset_setnthreads(t ? 4 : 1);
+		jres[t] = dset_innerjoin("k", jr, js);
+	}
+	dset_setnthreads(0);
+	xassert(dset_nrow(jres[0]) > 0 && dset_nrow(jres[0]) == dset_nrow(jres[1]));
+	xassert(!memcmp(dset_get(jres[0], "v"), dset_get(jres[1], "v"), dset_nrow(jres[0]) * 4));
+	xassert(!memcmp(dset_get(jres[0], "k"), dset_get(jres[1], "k"), dset_nrow(jres[0]) * 8));
+	dset_del(jres[0]);
+	dset_del(jres[1]);
+	dset_del(jr);
+	dset_del(js);
+	// a small first input is indexed instead of the larger ones, in the same result order
+	uint64_t ja = dset_new(), jb = dset_new();
+	xassert(dset_addcol_scalar(ja, "k", T_U32) && dset_addcol_scalar(ja, "x", T_U8) && dset_addrows(ja, 3));
+	xassert(dset_addcol_scalar(jb, "k", T_U32) && dset_addcol_scalar(jb, "y", T_U8) && dset_addrows(jb, 10));
+	memcpy(dset_get(ja, "k"), (uint32_t[]) {5, 3, 9}, 12);
+	memcpy(dset_get(ja, "x"), (uint8_t[]) {0, 1, 2}, 3);
+	memcpy(dset_get(jb, "k"), (uint32_t[]) {3, 7, 5, 3, 1, 9, 2, 4, 6, 8}, 40);
+	memcpy(dset_get(jb, "y"), (uint8_t[]) {0, 1, 2, 3, 4, 5, 6, 7, 8, 9}, 10);
+	uint64_t jab = dset_innerjoin("k", ja, jb);
+	xassert(dset_nrow(jab) == 4 && !memcmp(dset_get(jab, "x"), (uint8_t[]) {0, 1, 1, 2}, 4));
+	xassert(!memcmp(dset_get(jab, "y"), (uint8_t[]) {2, 0, 3, 5}, 4));
+	const uint64_t jabbs[] = {ja, jb, jb};
+	uint64_t jabb = dset_innerjoin_many("k", 3, jabbs);
+	xassert(dset_nrow(jabb) == 6 && !memcmp(dset_get(jabb, "x"), (uint8_t[]) {0, 1, 1, 1, 1, 2}, 6));
+	xassert(!memcmp(dset_get(jabb, "y"), (uint8_t[]) {2, 0, 3, 0, 3, 5}, 6));
+	dset_del(jabb);
+	dset_del(jab);
+	dset_del(ja);
+	dset_del(jb);
+	// stats count interned strings and heap growth per dataset and in total
+	ds_stats dst, dst0;
+	uint64_t stn = dset_new();
+	xassert(dset_stats(0, &dst0) && dset_addcol_scalar(stn, "s", T_STR) && dset_addrows(stn, 4000));
+	xassert(dset_setstrs(stn, "s", 0, 4, (const char *[]) {"a", "b", "a", ""}) && dset_setstr(stn, "s", 5, "b"));
+	xassert(dset_stats(stn, &dst) && dst.nrow == 4000 && dst.nrealloc >= 1 && dst.bytes_moved > 0);
+	xassert(dst.nintern == 5 && dst.nintern_hits == 3 && dst.strheap_sz == 5 && !dst.module_narenas);
+	xassert(dst.module_nslots_used >= 1 && dst.module_nintern >= dst0.module_nintern + 5);
+	dset_del(stn);
+	xassert(dset_stats(0, &dst) && dst.nrow == 0 && dst.module_nintern >= dst0.module_nintern + 5 && !dset_stats(stn, &dst));
+	// images map back without copying and are detached from the file on growth
+	xassert(dset_save_image(e, "test.cs"));
+	uint64_t im = dset_mmap("test.cs", 0);
+	xassert(dset_nrow(im) == 7 && !strcmp(dset_getstr(im, "morestrs", 3), dset_getstr(e, "morestrs", 3)));
+	xassert(dset_addrows(im, 1) && dset_nrow(im) == 8);
+	dset_del(im);
+	// truncated images and images from another version are rejected
+	FILE *imf = fopen("test.cs", "rb");
+	static char imbuf[1 << 16];
+	const size_t imsz = fread(imbuf, 1, sizeof(imbuf), imf);
+	fclose(imf);
+	xassert(imsz > 4096 && imsz < sizeof(imbuf));
+	imf = fopen("test.cs", "wb");
+	xassert(fwrite(imbuf, 1, imsz - 1, imf) == imsz - 1 && fclose(imf) == 0);
+	xassert(dset_mmap("test.cs", 1) == UINT64_MAX);
+	for (int k = 0; k < 2; k++) {
+		if (k == 0) imbuf[24]++; // version
+		if (k == 1) imbuf[24]--, imbuf[imsz - 1] = 'x'; // unterminated string heap
+		imf = fopen("test.cs", "wb");
+		xassert(fwrite(imbuf, 1, imsz, imf) == imsz && fclose(imf) == 0);
+		xassert(dset_mmap("test.cs", 1) == UINT64_MAX);
+	}
+	remove("test.cs");
+	// shared datasets attach without copying, read-only or copy-on-write
+	char shname[64];
+	snprintf(shname, sizeof(shname), "/dset-test-%d", (int) getpid());
+	uint64_t sh = dset_copy(e);
+	xassert(dset_share(sh, shname) && !dset_share(sh, shname));
+	uint64_t ro = dset_attach(shname, 1), cow = dset_attach(shname, 0);
+	xassert(dset_nrow(ro) == 7 && !strcmp(dset_getstr(ro, "morestrs", 2), dset_getstr(e, "morestrs", 2)));
+	((float *) dset_get(sh, "col4"))[0] = 42;
+	xassert(((float *) dset_get(ro, "col4"))[0] == 42 && !dset_addrows(ro, 1));
+	((float *) dset_get(cow, "col4"))[1] = 43;
+	xassert(((float *) dset_get(sh, "col4"))[1] != 43 && dset_addrows(cow, 1));
+	xassert(dset_unshare(shname) && dset_attach(shname, 1) == UINT64_MAX);
+	dset_del(ro);
+	dset_del(cow);
+	dset_del(sh);
+	// compressed buffers round-trip and corrupt input is rejected
+	static uint8_t raw[200000], back[200000];
+	for (int i = 0; i < 200000; i++) raw[i] = (uint8_t) (i % 251 < 100 ? i % 7 : rand());
+	const void * csrc[] = {raw};
+	uint64_t csz[] = {sizeof(raw)}, zsz[] = {dset_compress_bound(sizeof(raw))};
+	void * zbuf[] = {malloc(zsz[0])}, * bbuf[] = {back};
+	xassert(dset_compress(1, csrc, csz, zbuf, zsz) && zsz[0] < sizeof(raw));
+	xassert(dset_decompressed_size(zbuf[0], zsz[0]) == sizeof(raw));
+	xassert(dset_decompress(1, (const void **) zbuf, zsz, bbuf, csz) && !memcmp(raw, back, sizeof(raw)));
+	zsz[0] /= 2;
+	xassert(!dset_decompress(1, (const void **) zbuf, zsz, bbuf, csz));
+	free(zbuf[0]);
+	// byte-shuffled data is restored exactly, including a partial last element
+	xassert(dset_shuffle(raw, back, 99999, 4) && back[1] == raw[4] && back[24999] == raw[1]);
+	xassert(dset_unshuffle(back, raw + 100000, 99999, 4) && !memcmp(raw, raw + 100000, 99999));
+	// CSDAT field data decodes incrementally from small chunks
+	static uint32_t sa[5000], sashuf[5000];
+	static uint8_t sbody[80000];
+	for (int i = 0; i < 5000; i++) sa[i] = (uint32_t) (i * 3 % 101);
+	xassert(dset_shuffle(sa, sashuf, sizeof(sa), 4));
+	const void * ssrc[] = {sashuf};
+	uint64_t ssz[] = {sizeof(sa)}, szsz[] = {dset_compress_bound(sizeof(sa))};
+	void * szbuf[] = {malloc(szsz[0])};
+	xassert(dset_compress(1, ssrc, ssz, szbuf, szsz));
+	uint64_t sn = 0;
+	const uint32_t sizes[] = {(uint32_t) szsz[0], 8, 5000 * 3};
+	for (int f = 0; f < 3; f++) {
+		for (int b = 0; b < 4; b++) sbody[sn++] = (uint8_t) (sizes[f] >> (8 * b));
+		if (f == 0) memcpy(sbody + sn, szbuf[0], sizes[f]);
+		if (f == 1) memcpy(sbody + sn, "skipped!", 8);
+		if (f == 2) for (int i = 0; i < 5000; i++) memcpy(sbody + sn + i * 3, i % 2 ? "ab\0" : "cde", 3);
+		sn += sizes[f];
+	}
+	free(szbuf[0]);
+	const ds_stream_field sfields[] = {
+		{"a", T_U32, {0}, 4, 4, DSCODEC_SNAP, 1},
+		{"skip", T_U8, {0}, 1, 0, DSCODEC_NONE, 0},
+		{"name", T_STR, {0}, 3, 0, DSCODEC_NONE, 1},
+	};
+	ds_stream_field sbad[3] = {sfields[0], sfields[1], sfields[2]};
+	sbad[0].codec = 7;
+	xassert(!dset_stream_new(3, sbad));
+	ds_stream * ss = dset_stream_new(3, sfields);
+	xassert(ss && dset_stream_need(ss) == 4 && dset_stream_dataset(ss, 0) == UINT64_MAX);
+	uint32_t sdone = 0;
+	for (uint64_t i = 0; i < sn; i += 7) {
+		xassert(dset_stream_feed(ss, sbody + i, sn - i < 7 ? sn - i : 7));
+		if (i == 70) xassert(dset_stream_dataset(ss, &sdone) != UINT64_MAX && sdone == 0);
+	}
+	xassert(dset_stream_need(ss) == 0 && !dset_stream_feed(ss, "x", 1));
+	dset_stream_del(ss);
+	ss = dset_stream_new(3, sfields);
+	xassert(dset_stream_feed(ss, sbody, sn) && dset_stream_need(ss) == 0);
+	uint64_t sd = dset_stream_finish(ss);
+	xassert(sd != UINT64_MAX && dset_nrow(sd) == 5000 && dset_ncol(sd) == 2);
+	xassert(!memcmp(dset_get(sd, "a"), sa, sizeof(sa)));
+	xassert(!strcmp(dset_getstr(sd, "name", 0), "cde") && !strcmp(dset_getstr(sd, "name", 4999), "ab"));
+	dset_del(sd);
+	// truncated and corrupt streams are rejected
+	ss = dset_stream_new(3, sfields);
+	xassert(dset_stream_feed(ss, sbody, sn - 1) && dset_stream_need(ss) == 1);
+	xassert(dset_stream_finish(ss) == UINT64_MAX);
+	sbody[4] ^= 1;
+	ss = dset_stream_new(3, sfields);
+	xassert(!dset_stream_feed(ss, sbody, sn) && !dset_stream_feed(ss, sbody, 1));
+	dset_stream_del(ss);
+	// STAR tables parse with inferred types and format back the same
+	const char star[] = "1 2.5 'a b' x\n# comment\n-3 1e-3 \"\" 7\n\ndata_next\n";
+	const char * const stlabels[] = {"i", "f", "s", "x"};
+	const int sttypes[] = {0, 0, 0, T_STR};
+	uint64_t stend, stused, stcols[] = {0, 1, 2, 3};
+	uint64_t st = dset_read_star(star, sizeof(star) - 1, 4, (const char **) stlabels, sttypes, &stend);
+	xassert(st != UINT64_MAX && dset_nrow(st) == 2 && stend == 37);
+	xassert(dset_type(st, "i") == T_I64 && dset_type(st, "f") == T_F64 && dset_type(st, "s") == T_STR);
+	xassert(((int64_t *) dset_get(st, "i"))[1] == -3 && ((double *) dset_get(st, "f"))[1] == 1e-3);
+	xassert(!strcmp(dset_getstr(st, "s", 0), "a b") && !strcmp(dset_getstr(st, "x", 1), "7"));
+	char stbuf[64];
+	xassert(dset_format_star(st, 4, stcols, 0, stbuf, 20, &stused) == 1 && stused == 14);
+	xassert(dset_format_star(st, 4, stcols, 0, stbuf, sizeof(stbuf), &stused) == 2);
+	xassert(!memcmp(stbuf, "1 2.5 \"a b\" x\n-3 0.001 \"\" 7\n", stused));
+	xassert(dset_read_star("1 2\n", 4, 1, (const char **) stlabels, sttypes, &stend) == UINT64_MAX);
+	// integers only parse from floats without a fraction; no hex floats
+	const int stints[] = {T_I64, T_F64};
+	uint64_t sti = dset_read_star("2.000 NaN\n-1e2 -inf\n", 20, 2, (const char **) stlabels, stints, &stend);
+	xassert(sti != UINT64_MAX && ((int64_t *) dset_get(sti, "i"))[1] == -100 && isnan(((double *) dset_get(sti, "f"))[0]));
+	dset_del(sti);
+	xassert(dset_read_star("1.5 1\n", 6, 2, (const char **) stlabels, stints, &stend) == UINT64_MAX);
+	xassert(dset_read_star("1 0x1p3\n", 8, 2, (const char **) stlabels, stints, &stend) == UINT64_MAX);
+	// Arrow export points at numeric columns and generates string buffers
+	struct ArrowSchema schema;
+	struct ArrowArray array;
+	xassert(dset_addcol_array(st, "arr", T_C32, 3, 0, 0));
+	xassert(dset_export_arrow(st, &schema, &array, 0, 0));
+	xassert(schema.n_children == 5 && array.n_children == 5 && array.length == 2);
+	xassert(!strcmp(schema.children[1]->format, "g") && !strcmp(schema.children[2]->name, "s"));
+	xassert(array.children[0]->buffers[1] == dset_get(st, "i"));
+	xassert(!memcmp((const int64_t *) array.children[2]->buffers[1], (int64_t[]) {0, 3, 3}, 24));
+	xassert(!memcmp(array.children[2]->buffers[2], "a b", 3));
+	xassert(!strcmp(schema.children[4]->format, "+w:3") && !strcmp(schema.children[4]->children[0]->format, "+w:2"));
+	xassert(array.children[4]->children[0]->children[0]->length == 12);
+	schema.release(&schema);
+	array.release(&array);
+	xassert(!schema.release && !array.release);
+	dset_del(st);
+	dset_del(tk);
+	dset_del(mk);
+	dset_del(app);
+	dset_del(uni);
+
+	// reserved capacity absorbs later growth without reallocating
+	uint64_t g = dset_new();
+	xassert(dset_addcol_scalar(g, "uid", T_U64));
+	xassert(dset_reserve(g, 1000, 4096));
+	uint32_t nrealloc = ((ds *) dset_dump(g))->stats.nrealloc;
+	for (int i = 0; i < 1000; i++) xassert(dset_addrows(g, 1));
+	xassert(((ds *) dset_dump(g))->stats.nrealloc == nrealloc);
+	// strings still used by other rows are not counted as freed
+	uint64_t sf = dset_new();
+	const char *sfshared[10] = {"shared", "shared", "shared", "shared", "shared", "shared", "shared", "shared", "shared", "shared"};
+	xassert(dset_addcol_scalar(sf, "s", T_STR) && dset_addrows(sf, 10) && dset_setstrs(sf, "s", 0, 10, sfshared));
+	xassert(dset_setstr(sf, "s", 0, "other") && ((ds *) dset_dump(sf))->strheap_freed == 0);
+	for (uint64_t i = 1; i < 10; i++) xassert(dset_setstr(sf, "s", i, "other"));
+	xassert(((ds *) dset_dump(sf))->strheap_freed == 7);
+	xassert(dset_setstr(sf, "s", 1, "shared") && ((ds *) dset_dump(sf))->strheap_freed == 0);
+	xassert(dset_changecol(sf, "s", T_U64) && ((ds *) dset_dump(sf))->strheap_freed == 13);
+	dset_del(sf);
+	// a compaction while setting many strings keeps both existing and new strings right
+	uint64_t sc = dset_new();
+	xassert(dset_addcol_scalar(sc, "s", T_STR) && dset_addrows(sc, 4) && dset_setstr(sc, "s", 0, "keep"));
+	xassert(dset_setstr(sc, "s", 1, "hhhhhhhhhhhhhhhhhhhh") && dset_setstr(sc, "s", 2, "iiiiiiiiiiiiiiiiiiii"));
+	xassert(dset_setstr(sc, "s", 1, "") && dset_setstr(sc, "s", 2, ""));
+	xassert(((ds *) dset_dump(sc))->strheap_freed * 2 >= ((ds *) dset_dump(sc))->strheap_sz);
+	char *scbig = calloc(1, 1 << 16); // more than the free heap space
+	memset(scbig, 'b', (1 << 16) - 1);
+	const char *scvals[] = {"iiiiiiiiiiiiiiiiiiii", scbig, "keep", "keep"};
+	const uint64_t scshifts = ((ds *) dset_dump(sc))->stats.nshift_strhandles;
+	xassert(dset_setstrs(sc, "s", 0, 4, scvals) && ((ds *) dset_dump(sc))->stats.nshift_strhandles == scshifts + 1);
+	for (uint64_t i = 0; i < 4; i++) xassert(!strcmp(dset_getstr(sc, "s", i), scvals[i]));
+	free(scbig);
+	dset_del(sc);
+	// the growth policy can be changed at run time
+	uint64_t gp = dset_new();
+	xassert(dset_addcol_scalar(gp, "uid", T_U64) && dset_addrows(gp, 100));
+	dset_setgrowth(0, 0);
+	xassert(dset_addrows(gp, 1) && ((ds *) dset_dump(gp))->crow == 101);
+	dset_setgrowth(100, DSGROWTH_MAX_BYTES);
+	xassert(dset_addrows(gp, 1) && ((ds *) dset_dump(gp))->crow == 202);
+	dset_setgrowth(DSGROWTH_PERCENT, DSGROWTH_MAX_BYTES);
+	dset_del(gp);
+
 	dset_del(d);
 	dset_del(e);
 	dset_del(f);
+	dset_del(g);
 
 	/*
 	// Hash table tests
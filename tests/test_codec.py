@@ -0,0 +1,102 @@
+from io import BytesIO
+
+import numpy as n
+import pytest
+
+from cryosparc import codec
+from cryosparc.dataset import CSDAT_FORMAT, ROWGROUP_FORMAT
+from cryosparc.dtype import decode_dataset_header
+from cryosparc.util import AsyncBinaryIteratorIO, BinaryIteratorIO, u32intle
+
+from .conftest import Dataset
+
+
+@pytest.fixture
+def dset():
+    rng = n.random.default_rng(42)
+    return Dataset(
+        [
+            ("uid", n.arange(1, 10001)),
+            ("pose", (100 + rng.random((10000, 3))).astype("f4")),
+            ("cls", rng.integers(0, 50, size=10000)),
+            ("path", n.array(["J1/imported/mic_%d.mrc" % (i % 20) for i in range(10000)])),
+        ]
+    )
+
+
+def header(data: bytes):
+    return decode_dataset_header(data[10 : 10 + u32intle(data[6:10])])
+
+
+def saved(dset, format=CSDAT_FORMAT, compression="snap"):
+    buf = BytesIO()
+    dset.save(buf, format=format, compression=compression)
+    return buf.getvalue()
+
+
+def test_shuffle_roundtrip():
+    data = n.arange(1001, dtype="u1")
+    shuffled = n.empty_like(data)
+    codec.shuffle(data, shuffled, 4)
+    assert shuffled[1] == data[4] and shuffled[250] == data[1] and shuffled[-1] == data[-1]
+    restored = n.empty_like(data)
+    codec.shuffle(shuffled, restored, 4, reverse=True)
+    assert n.array_equal(restored, data)
+
+
+def test_default_codec_compatible(dset):
+    data = saved(dset)
+    assert header(data)["compression"] == "snap"
+    assert header(data)["codecs"] == {}
+    assert Dataset.load(BytesIO(data)) == dset
+
+
+@pytest.mark.parametrize("format", [CSDAT_FORMAT, ROWGROUP_FORMAT])
+def test_field_codecs(dset, format):
+    compression = {"pose": "shuffle+snap", "cls": "shuffle+snap", "path": "snap"}
+    data = saved(dset, format, compression)
+    assert header(data)["compression"] == "field"
+    assert header(data)["codecs"] == {"pose": "shuffle+snap", "cls": "shuffle+snap", "path": "snap"}
+    assert Dataset.load(BytesIO(data)) == dset
+    assert Dataset.load(BytesIO(data), fields=["pose"]) == dset.filter_fields(["pose"], copy=True)
+    assert len(data) < len(saved(dset, format))
+
+
+def test_auto_codec(dset):
+    data = saved(dset, compression="auto")
+    codecs = header(data)["codecs"]
+    assert "uid" not in codecs
+    assert codecs["pose"].startswith(codec.SHUFFLE)
+    assert not codecs["path"].startswith(codec.SHUFFLE)
+    assert Dataset.load(BytesIO(data)) == dset
+
+
+@pytest.mark.parametrize("backend", ["zstd", "lz4"])
+def test_backend_codecs(dset, backend):
+    pytest.importorskip(codec.BACKENDS[backend])
+    data = saved(dset, compression="shuffle+" + backend)
+    assert Dataset.load(BytesIO(data)) == dset
+
+
+@pytest.mark.parametrize("compression", ["snap", {"pose": "shuffle+snap", "cls": "", "path": "snap"}])
+def test_stream_decode(dset, compression):
+    import asyncio
+
+    data = saved(dset, compression=compression)
+    chunks = [data[i : i + 1000] for i in range(0, len(data), 1000)]
+    assert Dataset.load(BinaryIteratorIO(iter(chunks))) == dset
+    assert Dataset.load(BinaryIteratorIO(iter(chunks)), fields=["path"]) == dset.filter_fields(["path"], copy=True)
+    with pytest.raises(ValueError):
+        Dataset.load(BinaryIteratorIO(iter(chunks[:-1])))
+
+    async def achunks():
+        for chunk in chunks:
+            yield chunk
+
+    loaded = asyncio.run(Dataset.from_async_stream(AsyncBinaryIteratorIO(achunks()), fields=["pose"]))
+    assert loaded == dset.filter_fields(["pose"], copy=True)
+
+
+def test_invalid_codec(dset):
+    with pytest.raises(TypeError):
+        saved(dset, compression="gzip")
@@ -1,4 +1,5 @@
 from io import BytesIO
+import sys
 from base64 import b64decode
 import pytest
 import numpy as n
@@ -26,6 +27,39 @@ def test_allocate():
     assert storage is not None
 
 
+def test_allocate_sized():
+    storage = Dataset.allocate(size=10, fields=[("field1", "u8"), ("field2", "f4", (2,))])
+    assert len(storage) == 10 and len(set(storage["uid"])) == 10
+    assert storage._data.totalsz() < 1 << 15  # smaller than a dataset that starts empty
+
+
+def test_allocate_object_fields():
+    storage = Dataset.allocate(size=3, fields=[("field1", "O"), ("field2", "f4")])
+    assert list(storage["field1"]) == ["", "", ""]
+    buf = BytesIO()
+    storage.save(buf)
+    buf.seek(0)
+    assert Dataset.load(buf) == storage
+
+
+def test_data_stats():
+    storage = Dataset.allocate(size=10, fields=[("field1", "u8")])
+    storage.add_fields([("field2", "f4")])
+    stats = storage._data.stats()
+    assert stats["nrow"] == 10 and stats["ncol"] == 3
+    assert stats["arrheap_sz"] <= stats["arrheap_capacity"]
+    assert stats["module_nslots_used"] >= 1
+
+
+def test_data_pin():
+    storage = Dataset.allocate(size=10, fields=[("field1", "u8")])
+    assert not storage._data.pin()
+    assert storage._data.setconcurrent(True)
+    assert storage._data.pin() and storage._data.unpin()
+    storage.add_fields([("field2", "f4")])  # moves while nothing is pinned
+    assert storage._data.setconcurrent(False) and storage._data.ncol() == 3
+
+
 def test_populate_new_0():
     storage = Dataset.allocate(size=0)
     assert len(storage) == 0
@@ -176,6 +210,21 @@ def test_subset_range_out_of_bounds():
     assert len(subset) == 1
 
 
+def test_take_and_mask():
+    data = Dataset([("uid", [1, 2, 3, 4]), ("cls", [0, 1, 0, 1]), ("path", ["a", "b", "c", "d"])])
+    expected = Dataset([("uid", [2, 4]), ("cls", [1, 1]), ("path", ["b", "d"])])
+    assert data.mask(data["cls"] == 1) == expected
+    assert data.take([1, -1]) == expected
+    assert data.slice(1, 4, 2) == expected
+    assert data.take(n.array([-3, 3], dtype="i1")) == expected
+    assert data.take(n.array([3, 1], dtype="u8")).take([1, 0]) == expected
+    assert len(data.take([])) == 0
+    with pytest.raises(IndexError):
+        data.take([4])
+    with pytest.raises(IndexError):
+        data.take([-5])
+
+
 def test_from_data_none():
     data = Dataset()  # FIXME: Not necessary, remove
     assert len(data) == 0
@@ -203,6 +252,275 @@ def test_streaming_bytes():
     assert dset == result
 
 
+def test_load_fields(tmp_path):
+    from cryosparc.dataset import CSDAT_FORMAT
+
+    dset = Dataset(
+        [
+            ("uid", n.array([1, 2, 3])),
+            ("pose", n.array([[0.1, 0.2, 0.3]] * 3, dtype="f4")),
+            ("dat", n.array(["Hello", "World", "!"])),
+            ("cls", n.array([4, 5, 6])),
+        ]
+    )
+    path = tmp_path / "fields.cs"
+    dset.save(path, format=CSDAT_FORMAT)
+    expected = dset.filter_fields(["dat", "cls"], copy=True)
+
+    assert Dataset.load(path, fields=["dat", "cls"]) == expected
+    stream = BytesIO()
+    for dat in dset.stream():
+        stream.write(dat)
+    stream.seek(0)
+    assert Dataset.load(stream, fields=["dat", "cls"]) == expected
+
+    lazy = Dataset.load(path, fields=["dat", "cls"], lazy=True)
+    assert lazy.fields() == ["uid", "dat", "cls"]
+    assert n.array_equal(lazy["cls"], [4, 5, 6])
+    assert lazy == expected
+    assert Dataset.load(path, lazy=True).take([2, 0]) == dset.take([2, 0])
+
+
+def test_compress_roundtrip():
+    from cryosparc.core import compress, decompress, decompressed_size
+
+    data = [n.arange(300000, dtype="f4"), n.zeros(0, dtype="u1"), n.random.bytes(5000)]
+    compressed = compress([memoryview(d).cast("B") for d in data])
+    assert len(compressed[0]) < data[0].nbytes
+    assert [decompressed_size(c) for c in compressed] == [data[0].nbytes, 0, 5000]
+
+    outputs = [n.empty(decompressed_size(c), dtype="u1") for c in compressed]
+    decompress(compressed, outputs)
+    assert outputs[0].view("f4").tolist() == data[0].tolist()
+    assert outputs[2].tobytes() == data[2]
+    with pytest.raises(ValueError):
+        decompress([compressed[0][:100]], [outputs[0]])
+
+
+def test_query_mask():
+    dset = Dataset(
+        [
+            ("uid", n.arange(1, 7)),
+            ("mic", n.array([3, 3, -1, 5, 5, 3], dtype="i4")),
+            ("defocus", n.array([0.0, -0.0, 1.5, n.nan, 2.5, 1.5], dtype="f4")),
+            ("path", ["a.mrc", "b.mrc", "a.mrc", "c.mrc", "a.mrc", "b.mrc"]),
+        ]
+    )
+    assert dset.query_mask({"mic": [3, -1, 3.5]}).tolist() == [True, True, True, False, False, True]
+    assert dset.query_mask({"defocus": [0.0, n.nan, 1.5]}).tolist() == [True, True, True, False, False, True]
+    assert dset.query_mask({"path": ["a.mrc", "d.mrc"], "mic": 3}).tolist() == [True, False, False, False, False, False]
+    assert dset.query_mask({"path": "b.mrc"}, invert=True).tolist() == [True, False, True, True, True, False]
+    assert dset.query_mask({"missing": [1]}).all()
+
+    cstrs = dset.copy().to_cstrs()
+    assert n.array_equal(cstrs.query_mask({"path": ["a.mrc", "c.mrc"]}), dset.query_mask({"path": ["a.mrc", "c.mrc"]}))
+
+
+def test_argsort_groupby():
+    dset = Dataset(
+        [
+            ("uid", n.arange(1, 7)),
+            ("mic", n.array([3, 3, -1, 5, 5, 3], dtype="i4")),
+            ("defocus", n.array([0.5, -0.0, 1.5, n.nan, -2.5, 0.0], dtype="f4")),
+            ("path", ["b.mrc", "a.mrc", "b.mrc", "c.mrc", "a.mrc", "b.mrc"]),
+        ]
+    )
+    assert dset.argsort("mic").tolist() == [2, 0, 1, 5, 3, 4]
+    assert dset.argsort("defocus").tolist() == [4, 1, 5, 0, 2, 3]
+    assert dset.argsort("path", "mic").tolist() == [1, 4, 2, 0, 5, 3]
+    assert dset.copy().to_cstrs().argsort("path", "mic").tolist() == [1, 4, 2, 0, 5, 3]
+
+    order, offsets = dset.groupby("path")
+    assert order.tolist() == [1, 4, 0, 2, 5, 3]
+    assert offsets.tolist() == [0, 2, 5, 6]
+
+    grouped = dset.copy()
+    order, offsets = grouped.groupby("mic", reorder=True)
+    assert offsets.tolist() == [0, 1, 4, 6]
+    assert grouped["uid"].tolist() == [3, 1, 2, 6, 4, 5]
+    assert grouped["path"].tolist() == dset["path"][order].tolist()
+    grouped = dset.copy()
+    grouped.groupby("path", reorder=True)
+    assert grouped["path"].tolist() == ["a.mrc", "a.mrc", "b.mrc", "b.mrc", "b.mrc", "c.mrc"]
+
+    split = dset.split_by("path")
+    assert list(split) == ["b.mrc", "a.mrc", "c.mrc"]
+    assert split["b.mrc"]["uid"].tolist() == [1, 3, 6]
+
+
+def test_view():
+    dset = Dataset(
+        [
+            ("uid", n.arange(1, 7)),
+            ("mic", n.array([3, 3, -1, 5, 5, 3], dtype="i4")),
+            ("path", ["b.mrc", "a.mrc", "b.mrc", "c.mrc", "a.mrc", "b.mrc"]),
+        ]
+    )
+    view = dset.view(1, 4)
+    assert len(view) == 3 and view.fields() == dset.fields()
+    assert view["mic"].tolist() == [3, -1, 5] and view["path"].tolist() == ["a.mrc", "b.mrc", "c.mrc"]
+    dset["mic"][2] = 7
+    assert view["mic"][1] == 7
+    assert Dataset(view) == dset.slice(1, 4)
+
+    projected = dset.view(4, fields=["path"])
+    assert projected.fields() == ["uid", "path"] and projected["uid"].tolist() == [5, 6]
+    with pytest.raises(AssertionError):
+        projected.add_fields(["foo"], ["f4"])
+
+
+def test_column_kernels():
+    rng = n.random.default_rng(0)
+    dset = Dataset(
+        [
+            ("uid", n.arange(1, 1001)),
+            ("shift", rng.normal(size=(1000, 2)).astype("f4")),
+            ("mic", rng.integers(0, 5, size=1000).astype("u4")),
+        ]
+    )
+    expected = dset["shift"] * n.array([2.0, 0.5]) + 1.0
+    dset.transform("shift", scale=[2.0, 0.5], offset=1.0)
+    assert n.allclose(dset["shift"], expected)
+
+    stats = dset.reduce("shift")
+    assert n.allclose(stats["min"], expected.min(axis=0)) and n.allclose(stats["max"], expected.max(axis=0))
+    assert n.allclose(stats["mean"], expected.mean(axis=0)) and stats["count"] == 1000
+
+    grouped = dset.reduce("shift", by="mic")
+    assert grouped["groups"].tolist() == [0, 1, 2, 3, 4]
+    for i, mic in enumerate(grouped["groups"]):
+        assert n.allclose(grouped["mean"][i], expected[dset["mic"] == mic].mean(axis=0))
+        assert grouped["count"][i] == n.sum(dset["mic"] == mic)
+
+    counts, edges = dset.histogram("shift", bins=7)
+    ref_counts, ref_edges = n.histogram(dset["shift"], bins=7)
+    assert counts.tolist() == ref_counts.tolist() and n.allclose(edges, ref_edges)
+    assert dset.histogram("mic", bins=5, range=(0, 4))[0].tolist() == n.histogram(dset["mic"], 5, (0, 4))[0].tolist()
+
+
+def test_fields_in_place():
+    rng = n.random.default_rng(0)
+    shift = rng.normal(size=(1000, 2))
+    dset = Dataset(
+        [
+            ("uid", n.arange(1, 1001)),
+            ("location/micrograph_path", n.array(["mic_%d.mrc" % (i % 7) for i in range(1000)])),
+            ("alignments2D/shift", shift),
+            ("blob/idx", n.arange(1000, dtype="u8")),
+            ("ctf/exp_group_id", n.full(1000, 3, dtype="u4")),
+        ]
+    )
+    copied = dset.cast_fields({"alignments2D/shift": n.float32}, copy=True)
+    assert dset["alignments2D/shift"].dtype == n.float64 and copied["alignments2D/shift"].dtype == n.float32
+
+    dset.cast_fields({"alignments2D/shift": n.float32, "blob/idx": n.uint8})
+    assert n.array_equal(dset["alignments2D/shift"], copied["alignments2D/shift"])
+    assert dset["blob/idx"].dtype == n.uint8 and dset["blob/idx"][300] == 300 % 256
+    assert dset["location/micrograph_path"][8] == "mic_1.mrc" and dset["ctf/exp_group_id"][999] == 3
+
+    del dset["blob/idx"]
+    dset.rename_fields({"ctf/exp_group_id": "location/micrograph_path", "location/micrograph_path": "ctf/exp_group_id"})
+    assert dset.fields() == ["uid", "ctf/exp_group_id", "alignments2D/shift", "location/micrograph_path"]
+    assert dset["ctf/exp_group_id"][8] == "mic_1.mrc" and dset["location/micrograph_path"][999] == 3
+
+    dset.filter_fields(["ctf/exp_group_id"])
+    assert dset.fields() == ["uid", "ctf/exp_group_id"] and dset["ctf/exp_group_id"][15] == "mic_1.mrc"
+
+
+def test_rowgroup_roundtrip(tmp_path):
+    import asyncio
+    from cryosparc.dataset import ROWGROUP_FORMAT
+    from cryosparc.util import AsyncBinaryIteratorIO, BinaryIteratorIO
+
+    dset = Dataset(
+        [
+            ("uid", n.arange(1, 11)),
+            ("pose", n.array([[0.1, 0.2, 0.3]] * 10, dtype="f4")),
+            ("dat", n.array(["Hello", "World"] * 5)),
+        ]
+    )
+    path = tmp_path / "rowgroups.cs"
+    with open(path, "wb") as f:
+        for chunk in Dataset.stream_rowgroups([dset.slice(0, 7), dset.slice(7)], rowgroup=3):
+            f.write(chunk)
+
+    assert Dataset.load(path) == dset
+    assert Dataset.load(path, rows=slice(4, 8)) == dset.slice(4, 8)
+    assert Dataset.load(path, rows=slice(None, None, -3)) == dset.take([9, 6, 3, 0])
+    assert Dataset.load(path, fields=["dat"], rows=slice(8, 20)) == dset.filter_fields(["dat"], copy=True).slice(8)
+    assert len(Dataset.load(path, rows=slice(5, 5))) == 0
+
+    data = path.read_bytes()
+    assert Dataset.load(BinaryIteratorIO(iter([data[:20], data[20:]])), rows=slice(2, 4)) == dset.slice(2, 4)
+
+    async def chunks():
+        for i in range(0, len(data), 16):
+            yield data[i : i + 16]
+
+    assert asyncio.run(Dataset.from_async_stream(AsyncBinaryIteratorIO(chunks()))) == dset
+
+    dset.save(path, format=ROWGROUP_FORMAT)
+    assert Dataset.load(path) == dset
+
+
+def test_rowgroup_append(tmp_path):
+    from cryosparc.dataset import ROWGROUP_FORMAT
+    from cryosparc.util import BinaryIteratorIO
+
+    dset = Dataset([("uid", n.arange(1, 11)), ("dat", n.array(["Hello", "World"] * 5))])
+    path = tmp_path / "append.cs"
+    dset.slice(0, 6).save(path, format=ROWGROUP_FORMAT)
+    dset.slice(6).append_to(path, rowgroup=3)
+    assert Dataset.load(path) == dset
+
+    dset.add_fields([("pose", "f4", (3,))])
+    dset["pose"] = n.arange(30, dtype="f4").reshape(10, 3)
+    dset.add_fields_to(path, compression="shuffle+snap")
+    assert Dataset.load(path) == dset
+    assert Dataset.load(path, fields=["pose"], rows=slice(5, 8)) == dset.filter_fields(["pose"], copy=True).slice(5, 8)
+
+    more = Dataset([("uid", [11, 12]), ("dat", ["!", "?"]), ("pose", n.ones((2, 3), dtype="f4"))])
+    more.append_to(path)
+    full = Dataset.append(dset, more)
+    assert Dataset.load(path) == full
+    assert Dataset.load(BinaryIteratorIO(iter([path.read_bytes()]))) == full
+
+    # without the footer, e.g., if an append was interrupted, rows are read in order
+    path.write_bytes(path.read_bytes()[:-6])
+    assert Dataset.load(path) == full
+    full.slice(0, 1).append_to(path)
+    assert len(Dataset.load(path)) == 13
+
+    with pytest.raises(AssertionError):
+        more.add_fields_to(path, ["pose"])
+    with pytest.raises(TypeError):
+        more.append_to(BytesIO(b"\x94CSDAT"))
+
+
+def test_image_roundtrip(tmp_path):
+    from cryosparc.dataset import IMAGE_FORMAT
+
+    dset = Dataset(
+        [
+            ("uid", n.array([1, 2, 3])),
+            ("pose", n.array([[0.1, 0.2, 0.3]] * 3, dtype="f4")),
+            ("dat", n.array(["Hello", "World", "!"])),
+        ]
+    )
+    path = tmp_path / "image.cs"
+    dset.save(path, format=IMAGE_FORMAT)
+    assert dset["dat"][1] == "World"  # strings restored after saving
+
+    result = Dataset.load(path)
+    assert result == dset
+    result.add_fields([("extra", "f4")])  # moves mapped data to memory
+    assert n.array_equal(result["uid"], [1, 2, 3])
+    assert Dataset.load(path) == dset  # file is unchanged
+
+    with pytest.raises(TypeError):
+        dset.save(BytesIO(), format=IMAGE_FORMAT)
+
+
 def test_pickle_unpickle():
     import pickle
 
@@ -220,6 +538,15 @@ def test_pickle_unpickle():
     assert n.array_equal(dset["dat"], ["Hello", "World", "!"])
 
 
+def test_cstrs_roundtrip():
+    dset = Dataset([("uid", [1, 2, 3, 4]), ("dat", ["Hello", "World", "Hello", ""])])
+    dset.to_cstrs()
+    assert dset._data.type("dat") == 13  # T_STR
+    assert [dset._data.getstr("dat", i) for i in range(4)] == [b"Hello", b"World", b"Hello", b""]
+    dset.to_pystrs()
+    assert n.array_equal(dset["dat"], ["Hello", "World", "Hello", ""])
+
+
 def test_column_aggregation(t20s_dset):
     assert type(t20s_dset["uid"]) == Column
     assert type(n.max(t20s_dset["uid"])) == n.uint64
@@ -259,6 +586,19 @@ def test_innerjoin_smaller():
     )
 
 
+def test_innerjoin_duplicate_keys():
+    d1 = Dataset([("uid", [1, 2]), ("dat1", ["a", "b"])])
+    d2 = Dataset([("uid", [2, 1, 2]), ("dat2", ["x", "y", "z"])])
+
+    assert d1.innerjoin(d2) == Dataset(
+        [
+            ("uid", [1, 2, 2]),
+            ("dat1", ["a", "b", "b"]),
+            ("dat2", ["y", "x", "z"]),
+        ]
+    )
+
+
 def test_append_many_empty():
     assert len(Dataset.append_many().rows()) == 0
 
@@ -267,6 +607,28 @@ def test_union_many_empty():
     assert len(Dataset.union_many().rows()) == 0
 
 
+def test_append_many_strings():
+    d1 = Dataset([("uid", [1, 2]), ("blob/path", ["a.mrc", "b.mrc"]), ("x", [1.0, 2.0])])
+    d2 = Dataset([("uid", [3]), ("blob/path", ["a.mrc"]), ("x", [3.0]), ("y", [0])])
+    assert Dataset.append_many(d1, d2) == Dataset(
+        [("uid", [1, 2, 3]), ("blob/path", ["a.mrc", "b.mrc", "a.mrc"]), ("x", [1.0, 2.0, 3.0])]
+    )
+    with pytest.raises(AssertionError):
+        Dataset.append_many(d1, d1)
+
+
+def test_union_many_overlap():
+    d1 = Dataset([("uid", [1, 2]), ("dat", ["a", "b"])])
+    d2 = Dataset([("uid", [2, 3, 3]), ("dat", ["x", "c", "y"])])
+    assert Dataset.union_many(d1, d2) == Dataset([("uid", [1, 2, 3]), ("dat", ["a", "b", "c"])])
+
+
+def test_interlace():
+    d1 = Dataset([("uid", [1, 2]), ("dat", ["a", "b"])])
+    d2 = Dataset([("uid", [3, 4]), ("dat", ["c", "d"])])
+    assert d1.interlace(d2) == Dataset([("uid", [1, 3, 2, 4]), ("dat", ["a", "c", "b", "d"])])
+
+
 def test_allocate_many_separate():
     for _ in range(66_000):
         allocated = []
@@ -284,3 +646,37 @@ def test_allocate_many_together():
             allocated.append(Dataset(1))
         assert len(allocated) == 66_000
         del allocated
+
+
+def test_to_arrow():
+    pa = pytest.importorskip("pyarrow")
+    dset = Dataset(
+        [
+            ("uid", n.arange(1, 4)),
+            ("pose", n.arange(9, dtype="f4").reshape(3, 3)),
+            ("phase", n.array([1 + 2j, 3, -1j], dtype="c8")),
+            ("path", n.array(["a.mrc", "", "b b.mrc"], dtype=object)),
+        ]
+    )
+    batch = dset.to_arrow()
+    assert batch.schema.names == ["uid", "pose", "phase", "path"]
+    assert batch.column("uid").type == pa.uint64()
+    assert batch.column("pose").to_pylist() == dset["pose"].tolist()
+    assert batch.column("phase").to_pylist()[0] == [1.0, 2.0]
+    assert batch.column("path").to_pylist() == ["a.mrc", "", "b b.mrc"]
+    assert dset["path"].dtype == object  # exported from a copy with C strings
+    dset.to_cstrs()
+    assert dset.to_arrow().column("uid").buffers()[1].address == dset["uid"].ctypes.data
+
+
+@pytest.mark.skipif(sys.platform == "win32", reason="Shared memory names are released differently on Windows")
+def test_shared():
+    dset = Dataset([("uid", n.arange(1, 4)), ("cls", [4, 5, 6]), ("path", ["a.mrc", "b.mrc", "a.mrc"])])
+    with dset.shared() as name:
+        copy = Dataset.attach(name)
+        assert copy == dset
+        copy["cls"][0] = 7
+        assert Dataset.attach(name, readonly=True)["cls"][0] == 4
+        assert dset["path"][0] == "a.mrc"
+    with pytest.raises(OSError):
+        Dataset.attach(name)
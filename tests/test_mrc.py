@@ -0,0 +1,55 @@
+import numpy as n
+import pytest
+
+from cryosparc import mrc
+
+from .conftest import Dataset
+
+
+@pytest.fixture
+def stack(tmp_path):
+    data = n.arange(10 * 4 * 3, dtype=n.float32).reshape(10, 4, 3)
+    path = tmp_path / "stack.mrc"
+    mrc.write(path, data, 1.5)
+    return path, data
+
+
+def test_mmap(stack):
+    path, data = stack
+    header, mapped = mrc.mmap(path)
+    assert (header.nz, header.ny, header.nx) == (10, 4, 3)
+    assert isinstance(mapped, n.memmap)
+    assert n.array_equal(mapped[2:5], data[2:5])
+
+
+def test_read_sections(stack):
+    path, data = stack
+    _, sections = mrc.read_sections(path, 7)
+    assert n.array_equal(sections, data[7:])
+    with open(path, "rb") as f:
+        _, sections = mrc.read_sections(f, 1, 3)
+    assert n.array_equal(sections, data[1:3])
+
+
+def test_gather(stack):
+    path, data = stack
+    indices = [4, 5, 6, 0, 9, 8, 5]
+    _, sections = mrc.gather(path, indices)
+    assert n.array_equal(sections, data[indices])
+    with pytest.raises(IndexError):
+        mrc.gather(path, [10])
+
+
+def test_gather_blobs(stack, tmp_path):
+    path, data = stack
+    other = data[::-1] + 100
+    mrc.write(tmp_path / "other.mrc", n.ascontiguousarray(other), 1.5)
+    dset = Dataset(
+        [
+            ("uid", n.arange(5)),
+            ("blob/path", n.array(["stack.mrc", "other.mrc", "stack.mrc", "stack.mrc", "other.mrc"], dtype=object)),
+            ("blob/idx", n.array([3, 0, 4, 1, 9], dtype=n.uint32)),
+        ]
+    )
+    images = mrc.gather_blobs(dset, root=tmp_path)
+    assert n.array_equal(images, n.stack([data[3], other[0], data[4], data[1], other[9]]))
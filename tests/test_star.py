@@ -1,6 +1,7 @@
 from io import StringIO
 import os
 from pathlib import Path
+import numpy as n
 import pytest
 
 from cryosparc import star
@@ -125,3 +126,55 @@ def test_write_simple(simple_star_file):
     result = StringIO()
     star.write_blocks(result, data)
     assert result.getvalue() == simple_star_file.getvalue()
+
+
+def test_read_infer_types():
+    data = star.read(
+        StringIO(
+            """
+data_particles
+
+loop_
+_rlnClassNumber #1
+_myScore #2
+_myCount #3
+_myName #4
+# comment rows are skipped
+1 0.5 3 'particle one'
+2 1e-3 -4 "two"
+"""
+        )
+    )
+    particles = data["particles"]
+    assert particles.dtype["myScore"] == n.float64
+    assert particles.dtype["myCount"] == n.int64
+    assert particles.dtype["myName"] == object
+    assert list(particles["rlnClassNumber"]) == [1, 2]
+    assert list(particles["myName"]) == ["particle one", "two"]
+
+
+def test_read_datasets():
+    data = star.read_datasets(StringIO("data_\nloop_\n_rlnImageName\n_rlnCoordinateX\n1@a.mrcs 2.5\n2@a.mrcs 3\n"))
+    assert "uid" not in data[""]
+    assert list(data[""]["rlnImageName"]) == ["1@a.mrcs", "2@a.mrcs"]
+    assert list(data[""]["rlnCoordinateX"]) == [2.5, 3.0]
+
+
+def test_write_roundtrip(tmp_path):
+    path = tmp_path / "roundtrip.star"
+    optics = n.array(
+        [("my optics", 1, True)],
+        dtype=[("rlnOpticsGroupName", object), ("rlnOpticsGroup", int), ("rlnIsFlip", bool)],
+    )
+    particles = n.array(
+        [(0.1, n.float32(1 / 3), "", 1), (1e300, n.float32(-2.5), "1@a b.mrcs", -7)],
+        dtype=[("rlnCoordinateX", "f8"), ("rlnAngleRot", "f4"), ("rlnImageName", "U10"), ("rlnClassNumber", int)],
+    )
+    star.write_blocks(path, {"optics": optics, "particles": particles})
+    data = star.read(path)
+    assert data["optics"]["rlnOpticsGroupName"][0] == "my optics"
+    assert data["optics"]["rlnIsFlip"][0] == True  # noqa: E712
+    assert list(data["particles"]["rlnCoordinateX"]) == [0.1, 1e300]
+    assert list(data["particles"]["rlnAngleRot"].astype(n.float32)) == [n.float32(1 / 3), -2.5]
+    assert list(data["particles"]["rlnImageName"]) == ["", "1@a b.mrcs"]
+    assert list(data["particles"]["rlnClassNumber"]) == [1, -7]